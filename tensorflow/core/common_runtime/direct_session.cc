@@ -63,14 +63,19 @@ limitations under the License.
 #include "tensorflow/core/lib/core/threadpool.h"
 #include "tensorflow/core/lib/core/threadpool_options.h"
 #include "tensorflow/core/lib/gtl/array_slice.h"
+#include "tensorflow/core/lib/io/path.h"
 #include "tensorflow/core/lib/monitoring/counter.h"
 #include "tensorflow/core/lib/random/random.h"
 #include "tensorflow/core/lib/strings/numbers.h"
+#include "tensorflow/core/lib/strings/proto_serialization.h"
 #include "tensorflow/core/lib/strings/str_util.h"
 #include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/nccl/collective_communicator.h"
 #include "tensorflow/core/platform/byte_order.h"
 #include "tensorflow/core/platform/cpu_info.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/fingerprint.h"
+#include "tensorflow/core/platform/hash.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/mutex.h"
 #include "tensorflow/core/platform/tracing.h"
@@ -79,6 +84,8 @@ limitations under the License.
 #include "tensorflow/core/profiler/lib/device_profiler_session.h"
 #include "tensorflow/core/profiler/lib/traceme_encode.h"
 #include "tensorflow/core/protobuf/config.pb.h"
+#include "tensorflow/core/protobuf/session_graph_cache.pb.h"
+#include "tensorflow/core/public/version.h"
 #include "tensorflow/core/util/device_name_utils.h"
 #include "tensorflow/core/util/env_var.h"
 
@@ -90,6 +97,37 @@ auto* direct_session_runs = monitoring::Counter<0>::New(
     "/tensorflow/core/direct_session_runs",
     "The number of times DirectSession::Run() has been called.");
 
+auto* direct_session_graph_cache = monitoring::Counter<1>::New(
+    "/tensorflow/core/direct_session_graph_cache",
+    "The number of graph cache lookups made by DirectSession, by result.",
+    "result");
+
+// Writes `entry` to `path`, going through a temporary file so that concurrent
+// readers never observe a partially written entry. Failures are logged but
+// otherwise ignored, as the cache is only an optimization.
+void WriteGraphCacheEntry(Env* env, const string& path,
+                          const SessionGraphCacheEntry& entry) {
+  const string dir(io::Dirname(path));
+  Status s = env->RecursivelyCreateDir(dir);
+  if (s.ok() || absl::IsAlreadyExists(s)) {
+    string tmp_path = strings::StrCat(path, ".");
+    if (!env->CreateUniqueFileName(&tmp_path, ".tmp")) {
+      s = errors::Internal("Could not create a temporary file name.");
+    } else {
+      s = WriteBinaryProto(env, tmp_path, entry);
+      if (s.ok()) {
+        s = env->RenameFile(tmp_path, path);
+      }
+      if (!s.ok()) {
+        env->DeleteFile(tmp_path).IgnoreError();
+      }
+    }
+  }
+  if (!s.ok()) {
+    LOG(WARNING) << "Failed to write graph cache entry " << path << ": " << s;
+  }
+}
+
 Status NewThreadPoolFromThreadPoolOptions(
     const SessionOptions& options,
     const ThreadPoolOptionProto& thread_pool_options, int pool_number,
@@ -148,6 +186,16 @@ thread::ThreadPool* GlobalThreadPool(const SessionOptions& options,
   return thread_pool;
 }
 
+// Returns the pool on which the kernels and graphs of large partitions are
+// created. It is separate from the inter-op pools, since sessions may be
+// created from their threads, which would then wait for work queued behind
+// them.
+thread::ThreadPool* GraphLoadThreadPool() {
+  static thread::ThreadPool* const thread_pool = new thread::ThreadPool(
+      Env::Default(), "direct_session_graph_load", port::MaxParallelism());
+  return thread_pool;
+}
+
 // TODO(vrv): Figure out how to unify the many different functions
 // that generate RendezvousKey, since many of them have to be
 // consistent with each other.
@@ -365,6 +413,7 @@ DirectSession::DirectSession(const SessionOptions& options,
   if (!status.ok()) {
     LOG(ERROR) << status.message();
   }
+  graph_cache_dir_ = options_.config.experimental().graph_cache_dir();
   session_handle_ =
       strings::StrCat("direct", strings::FpToString(random::New64()));
   if (options.config.log_device_placement()) {
@@ -1423,6 +1472,9 @@ Status DirectSession::CreateExecutors(
       if (kernel && !OpSegment::ShouldOwnKernel(lib, kernel->type_string()))
         delete kernel;
     };
+    // Both the function library runtime and the op segment are thread-safe,
+    // so kernels of large partitions can be created concurrently.
+    params.kernel_creation_thread_pool = GraphLoadThreadPool();
 
     optimizer.Optimize(lib, options_.env, device, &partition_graph,
                        GraphOptimizer::Options());
@@ -1602,17 +1654,117 @@ Status DirectSession::GetOrCreateExecutors(
   return absl::OkStatus();
 }
 
-Status DirectSession::CreateGraphs(
-    const BuildGraphOptions& subgraph_options,
-    std::unordered_map<string, std::unique_ptr<Graph>>* outputs,
-    std::unique_ptr<FunctionLibraryDefinition>* flib_def,
-    RunStateArgs* run_state_args, DataTypeVector* input_types,
-    DataTypeVector* output_types, int64_t* collective_graph_key) {
-  mutex_lock l(graph_state_lock_);
-  if (finalized_) {
-    return errors::FailedPrecondition("Session has been finalized.");
+string DirectSession::GraphCachePath(const BuildGraphOptions& options,
+                                     uint64* key_fingerprint) {
+  if (graph_cache_dir_.empty() || execution_state_ == nullptr) return "";
+  // The original graph is released when optimizing for a static graph, in
+  // which case there is nothing to fingerprint.
+  const GraphDef* graph_def = execution_state_->original_graph_def();
+  if (graph_def == nullptr) return "";
+  // The location of the cache doesn't change the graphs it holds.
+  ConfigProto config = options_.config;
+  config.mutable_experimental()->clear_graph_cache_dir();
+
+  // The entry is named after one fingerprint of the key and records another,
+  // independently seeded one, so that a collision of the file names is
+  // detected when reading the entry.
+  const auto fingerprint_key = [&](uint64 seed) {
+    uint64 fingerprint = DeterministicProtoHash64(*graph_def, seed);
+    fingerprint = FingerprintCat64(
+        fingerprint, DeterministicProtoHash64(options.callable_options, seed));
+    fingerprint = FingerprintCat64(
+        fingerprint, DeterministicProtoHash64(config, seed));
+    const string settings = strings::StrCat(
+        options.use_function_convention, "/",
+        static_cast<int>(options.collective_order), "/", tf_git_version());
+    fingerprint = FingerprintCat64(
+        fingerprint, Hash64(settings.data(), settings.size(), seed));
+    for (const Device* device : devices_) {
+      const string name =
+          strings::StrCat(device->name(), "/", device->device_type());
+      fingerprint = FingerprintCat64(fingerprint,
+                                     Hash64(name.data(), name.size(), seed));
+    }
+    return fingerprint;
+  };
+  const uint64 fingerprint = fingerprint_key(/*seed=*/0);
+  *key_fingerprint = fingerprint_key(/*seed=*/0x9ae16a3b2f90404fULL);
+  return io::JoinPath(graph_cache_dir_,
+                      strings::StrCat("graph_", strings::FpToString(fingerprint),
+                                      ".pb"));
+}
+
+Status DirectSession::LookupGraphCache(
+    const string& cache_path, uint64 key_fingerprint,
+    std::unordered_map<string, GraphDef>* partitions,
+    std::unique_ptr<FunctionLibraryDefinition>* client_flib_def,
+    DataTypeVector* input_types, DataTypeVector* output_types,
+    int64_t* collective_graph_key, bool* found) {
+  *found = false;
+  SessionGraphCacheEntry entry;
+  Status s = ReadBinaryProto(options_.env, cache_path, &entry);
+  if (!s.ok()) {
+    if (!absl::IsNotFound(s)) {
+      LOG(WARNING) << "Ignoring unreadable graph cache entry " << cache_path
+                   << ": " << s;
+    }
+    return absl::OkStatus();
+  }
+  if (entry.key_fingerprint() != key_fingerprint) {
+    LOG(WARNING) << "Ignoring graph cache entry " << cache_path
+                 << " written for a different key.";
+    return absl::OkStatus();
+  }
+
+  // A cached entry is only usable if its stateful placements agree with the
+  // placements already made by this session.
+  for (const auto& placement_pair : entry.stateful_placements()) {
+    auto iter = stateful_placements_.find(placement_pair.first);
+    if (iter != stateful_placements_.end() &&
+        iter->second != placement_pair.second) {
+      VLOG(1) << "Ignoring graph cache entry " << cache_path
+              << " because the placement of " << placement_pair.first
+              << " changed.";
+      return absl::OkStatus();
+    }
+  }
+  for (const auto& placement_pair : entry.stateful_placements()) {
+    stateful_placements_.insert(
+        std::make_pair(placement_pair.first, placement_pair.second));
+  }
+
+  client_flib_def->reset(
+      new FunctionLibraryDefinition(OpRegistry::Global(), entry.library()));
+  for (int type : entry.feed_types()) {
+    input_types->push_back(static_cast<DataType>(type));
   }
+  for (int type : entry.fetch_types()) {
+    output_types->push_back(static_cast<DataType>(type));
+  }
+  *collective_graph_key = entry.collective_graph_key();
+  // The names generated later must not collide with the names of the edges
+  // added by partitioning the cached graphs.
+  int64_t edge_name_counter = edge_name_counter_.load();
+  while (edge_name_counter < entry.edge_name_counter() &&
+         !edge_name_counter_.compare_exchange_weak(edge_name_counter,
+                                                   entry.edge_name_counter())) {
+  }
+  for (auto& partition : *entry.mutable_partition_graphs()) {
+    (*partitions)[partition.first] = std::move(partition.second);
+  }
+  *found = true;
+  return absl::OkStatus();
+}
 
+Status DirectSession::BuildAndPartitionGraph(
+    const BuildGraphOptions& subgraph_options,
+    std::unique_ptr<FunctionLibraryDefinition>* flib_def,
+    RunStateArgs* run_state_args, const string& cache_path,
+    uint64 cache_key_fingerprint,
+    std::unordered_map<string, GraphDef>* partitions,
+    std::unique_ptr<FunctionLibraryDefinition>* client_flib_def,
+    DataTypeVector* input_types, DataTypeVector* output_types,
+    int64_t* collective_graph_key) {
   std::unique_ptr<ClientGraph> client_graph;
 
   std::unique_ptr<GraphExecutionState> temp_exec_state_holder;
@@ -1696,8 +1848,78 @@ Status DirectSession::CreateGraphs(
   popts.flib_def = flib_def->get();
   popts.control_flow_added = false;
 
+  TF_RETURN_IF_ERROR(Partition(popts, &client_graph->graph, partitions));
+
+  if (!cache_path.empty()) {
+    SessionGraphCacheEntry entry;
+    entry.set_key_fingerprint(cache_key_fingerprint);
+    for (const auto& partition : *partitions) {
+      (*entry.mutable_partition_graphs())[partition.first] = partition.second;
+    }
+    *entry.mutable_library() = client_graph->flib_def->ToProto();
+    for (DataType type : client_graph->feed_types) {
+      entry.add_feed_types(type);
+    }
+    for (DataType type : client_graph->fetch_types) {
+      entry.add_fetch_types(type);
+    }
+    entry.set_collective_graph_key(client_graph->collective_graph_key);
+    entry.set_edge_name_counter(edge_name_counter_.load());
+    for (const auto& placement_pair : current_stateful_placements) {
+      (*entry.mutable_stateful_placements())[placement_pair.first] =
+          placement_pair.second;
+    }
+    WriteGraphCacheEntry(options_.env, cache_path, entry);
+  }
+
+  *client_flib_def = std::move(client_graph->flib_def);
+  std::swap(*input_types, client_graph->feed_types);
+  std::swap(*output_types, client_graph->fetch_types);
+  return absl::OkStatus();
+}
+
+Status DirectSession::CreateGraphs(
+    const BuildGraphOptions& subgraph_options,
+    std::unordered_map<string, std::unique_ptr<Graph>>* outputs,
+    std::unique_ptr<FunctionLibraryDefinition>* flib_def,
+    RunStateArgs* run_state_args, DataTypeVector* input_types,
+    DataTypeVector* output_types, int64_t* collective_graph_key) {
+  mutex_lock l(graph_state_lock_);
+  if (finalized_) {
+    return errors::FailedPrecondition("Session has been finalized.");
+  }
+
+  const uint64 start_time_usecs = options_.env->NowMicros();
+
+  // Partial runs need the full placed graph, which is not cached.
+  uint64 cache_key_fingerprint = 0;
+  const string cache_path =
+      run_state_args->is_partial_run
+          ? ""
+          : GraphCachePath(subgraph_options, &cache_key_fingerprint);
+
   std::unordered_map<string, GraphDef> partitions;
-  TF_RETURN_IF_ERROR(Partition(popts, &client_graph->graph, &partitions));
+  std::unique_ptr<FunctionLibraryDefinition> client_flib_def;
+  bool cache_hit = false;
+  if (!cache_path.empty()) {
+    TF_RETURN_IF_ERROR(LookupGraphCache(
+        cache_path, cache_key_fingerprint, &partitions, &client_flib_def,
+        input_types, output_types, collective_graph_key, &cache_hit));
+    direct_session_graph_cache->GetCell(cache_hit ? "hit" : "miss")
+        ->IncrementBy(1);
+  }
+
+  if (!cache_hit) {
+    TF_RETURN_IF_ERROR(BuildAndPartitionGraph(
+        subgraph_options, flib_def, run_state_args, cache_path,
+        cache_key_fingerprint, &partitions, &client_flib_def, input_types,
+        output_types, collective_graph_key));
+  }
+  VLOG(1) << "Built partitioned graphs in "
+          << options_.env->NowMicros() - start_time_usecs << " us"
+          << (cache_path.empty() ? ""
+                                 : (cache_hit ? " (graph cache hit)"
+                                              : " (graph cache miss)"));
 
   std::vector<string> device_names;
   device_names.reserve(devices_.size());
@@ -1721,13 +1943,13 @@ Status DirectSession::CreateGraphs(
   }
 
   for (auto& partition : partitions) {
-    std::unique_ptr<Graph> device_graph(
-        new Graph(client_graph->flib_def.get()));
+    std::unique_ptr<Graph> device_graph(new Graph(client_flib_def.get()));
     device_graph->SetConstructionContext(ConstructionContext::kDirectSession);
     GraphConstructorOptions device_opts;
     // There are internal operations (e.g., send/recv) that we now allow.
     device_opts.allow_internal_ops = true;
     device_opts.expect_device_spec = true;
+    device_opts.thread_pool = GraphLoadThreadPool();
     TF_RETURN_IF_ERROR(ConvertGraphDefToGraph(
         device_opts, std::move(partition.second), device_graph.get()));
     outputs->emplace(partition.first, std::move(device_graph));
@@ -1735,7 +1957,7 @@ Status DirectSession::CreateGraphs(
 
   GraphOptimizationPassOptions optimization_options;
   optimization_options.session_options = &options_;
-  optimization_options.flib_def = client_graph->flib_def.get();
+  optimization_options.flib_def = client_flib_def.get();
   optimization_options.partition_graphs = outputs;
   TF_RETURN_IF_ERROR(OptimizationPassRegistry::Global()->RunGrouping(
       OptimizationPassRegistry::POST_PARTITIONING, optimization_options));
@@ -1757,9 +1979,7 @@ Status DirectSession::CreateGraphs(
       break;
     }
   }
-  *flib_def = std::move(client_graph->flib_def);
-  std::swap(*input_types, client_graph->feed_types);
-  std::swap(*output_types, client_graph->fetch_types);
+  *flib_def = std::move(client_flib_def);
   return s;
 }
 
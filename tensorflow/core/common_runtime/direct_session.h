@@ -263,6 +263,37 @@ class DirectSession : public Session {
       RunStateArgs* run_state_args, DataTypeVector* input_types,
       DataTypeVector* output_types, int64_t* collective_graph_key);
 
+  // Places, optimizes and partitions the client graph for `options`. If
+  // `cache_path` is non-empty the result is also written to the graph cache.
+  ::tensorflow::Status BuildAndPartitionGraph(
+      const BuildGraphOptions& options,
+      std::unique_ptr<FunctionLibraryDefinition>* flib_def,
+      RunStateArgs* run_state_args, const string& cache_path,
+      uint64 cache_key_fingerprint,
+      std::unordered_map<string, GraphDef>* partitions,
+      std::unique_ptr<FunctionLibraryDefinition>* client_flib_def,
+      DataTypeVector* input_types, DataTypeVector* output_types,
+      int64_t* collective_graph_key)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(graph_state_lock_);
+
+  // Looks up the placed, optimized and partitioned graphs stored at
+  // `cache_path` in the graph cache. Sets `*found` to false on a cache miss.
+  ::tensorflow::Status LookupGraphCache(
+      const string& cache_path, uint64 key_fingerprint,
+      std::unordered_map<string, GraphDef>* partitions,
+      std::unique_ptr<FunctionLibraryDefinition>* client_flib_def,
+      DataTypeVector* input_types, DataTypeVector* output_types,
+      int64_t* collective_graph_key, bool* found)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(graph_state_lock_);
+
+  // Returns the path of the graph cache entry for `options`, or an empty
+  // string if graph caching is disabled or not applicable. Sets
+  // `*key_fingerprint` to a fingerprint of the cache key that is independent
+  // of the one naming the entry.
+  string GraphCachePath(const BuildGraphOptions& options,
+                        uint64* key_fingerprint)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(graph_state_lock_);
+
   ::tensorflow::Status RunInternal(
       int64_t step_id, const RunOptions& run_options,
       CallFrameInterface* call_frame, ExecutorsAndKeys* executors_and_keys,
@@ -355,6 +386,12 @@ class DirectSession : public Session {
   // If true, blocks until device has finished all queued operations in a step.
   bool sync_on_finish_ = true;
 
+  // Directory of the persistent graph cache, set through
+  // ConfigProto.experimental.graph_cache_dir. When non-empty,
+  // CreateGraphs() stores the partitioned graphs it builds for each
+  // feed/fetch signature there, and reuses them on later session creations.
+  string graph_cache_dir_;
+
   std::vector<std::unique_ptr<FunctionInfo>> functions_
       TF_GUARDED_BY(executor_lock_);
 
@@ -46,6 +46,8 @@ limitations under the License.
 #include "tensorflow/core/lib/core/status.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/lib/monitoring/cell_reader.h"
 #include "tensorflow/core/lib/strings/str_util.h"
 #include "tensorflow/core/platform/protobuf.h"
 #include "tensorflow/core/platform/stacktrace.h"
@@ -156,6 +158,47 @@ TEST_F(DirectSessionMinusAXTest, RunSimpleNetwork) {
   EXPECT_FLOAT_EQ(5.0, mat(0, 0));
 }
 
+TEST_F(DirectSessionMinusAXTest, RunSimpleNetworkWithGraphCache) {
+  Initialize({3, 2, -1, 0});
+  const string cache_dir =
+      io::JoinPath(testing::TmpDir(), "RunSimpleNetworkWithGraphCache");
+  int64_t undeleted_files, undeleted_dirs;
+  Env::Default()
+      ->DeleteRecursively(cache_dir, &undeleted_files, &undeleted_dirs)
+      .IgnoreError();
+  SessionOptions options = DefaultSessionOptions();
+  options.config.mutable_experimental()->set_graph_cache_dir(cache_dir);
+  monitoring::testing::CellReader<int64_t> cache_lookups(
+      "/tensorflow/core/direct_session_graph_cache");
+
+  std::vector<string> output_names = {y_ + ":0"};
+  std::vector<string> target_nodes = {y_neg_};
+  // The first session populates the cache, the second one restores the
+  // partitioned graphs from it.
+  for (int i = 0; i < 2; ++i) {
+    std::unique_ptr<Session> session(NewSession(options));
+    ASSERT_TRUE(session != nullptr);
+    TF_ASSERT_OK(session->Create(def_));
+    std::vector<Tensor> outputs;
+    TF_ASSERT_OK(session->Run({}, output_names, target_nodes, &outputs));
+    ASSERT_EQ(1, outputs.size());
+    EXPECT_FLOAT_EQ(5.0, outputs[0].matrix<float>()(0, 0));
+    if (i == 1) {
+      // A signature partitioned after the cache hit must not reuse the
+      // send/recv edge names of the graphs restored from the cache.
+      TF_ASSERT_OK(session->Run({}, {y_neg_ + ":0"}, {}, &outputs));
+      ASSERT_EQ(1, outputs.size());
+      EXPECT_FLOAT_EQ(-5.0, outputs[0].matrix<float>()(0, 0));
+    }
+  }
+
+  EXPECT_EQ(2, cache_lookups.Delta("miss"));
+  EXPECT_EQ(1, cache_lookups.Delta("hit"));
+  std::vector<string> entries;
+  TF_ASSERT_OK(Env::Default()->GetChildren(cache_dir, &entries));
+  EXPECT_EQ(2, entries.size());
+}
+
 TEST_F(DirectSessionMinusAXTest, RunSimpleNetwork_Callable) {
   Initialize({3, 2, -1, 0});
   auto session = CreateSession();
@@ -2790,6 +2833,43 @@ void BM_FeedFetchCallableSingleThreadExecutor(
                            /* use_single_threaded_executor */ true);
 }
 
+// Measures the time to the first result of a freshly created session over a
+// chain of `num_nodes` nodes, with and without the on-disk graph cache.
+void BM_TimeToFirstRun(::testing::benchmark::State& state) {
+  const int num_nodes = state.range(0);
+  const bool use_graph_cache = state.range(1);
+
+  Graph g(OpRegistry::Global());
+  Tensor value(DT_FLOAT, TensorShape({16}));
+  value.flat<float>().setConstant(1.0f);
+  Node* node = test::graph::Constant(&g, value);
+  for (int i = 0; i < num_nodes; ++i) {
+    node = test::graph::Unary(&g, "Neg", node);
+  }
+  const string fetch = strings::StrCat(node->name(), ":0");
+  GraphDef gd;
+  g.ToGraphDef(&gd);
+
+  const string cache_dir = io::JoinPath(
+      testing::TmpDir(), strings::StrCat("BM_TimeToFirstRun_", num_nodes));
+  SessionOptions options;
+  if (use_graph_cache) {
+    options.config.mutable_experimental()->set_graph_cache_dir(cache_dir);
+  }
+  for (auto s : state) {
+    std::unique_ptr<Session> session(NewSession(options));
+    TF_CHECK_OK(session->Create(gd));
+    std::vector<Tensor> outputs;
+    TF_CHECK_OK(session->Run({}, {fetch}, {}, &outputs));
+  }
+}
+
+BENCHMARK(BM_TimeToFirstRun)
+    ->ArgPair(100, false)
+    ->ArgPair(100, true)
+    ->ArgPair(10000, false)
+    ->ArgPair(10000, true);
+
 BENCHMARK(BM_FeedFetch)->Arg(1)->Arg(2)->Arg(5)->Arg(10);
 BENCHMARK(BM_FeedFetchCallable)->Arg(1)->Arg(2)->Arg(5)->Arg(10);
 BENCHMARK(BM_FeedFetchCallableSingleThread)->Arg(1)->Arg(2)->Arg(5)->Arg(10);
@@ -31,6 +31,7 @@ limitations under the License.
 #include "tensorflow/core/common_runtime/executor_factory.h"
 #include "tensorflow/core/common_runtime/graph_view.h"
 #include "tensorflow/core/common_runtime/immutable_executor_state.h"
+#include "tensorflow/core/common_runtime/op_memory_sampler.h"
 #include "tensorflow/core/common_runtime/pending_counts.h"
 #include "tensorflow/core/common_runtime/propagator_state.h"
 #include "tensorflow/core/common_runtime/renamed_device.h"
@@ -586,6 +587,11 @@ Status ExecutorState<PropagatorStateType>::ProcessSync(
     const NodeItem& item, OpKernelContext::Params* params, EntryVector* outputs,
     NodeExecStatsInterface* stats) {
   Status s;
+  // Allocation tracking is only switched on for sampled invocations of nodes
+  // that are not already reporting to a step stats collector.
+  const bool sample_memory = stats == nullptr && !params->track_allocations &&
+                             OpMemorySampler::ShouldSample();
+  if (TF_PREDICT_FALSE(sample_memory)) params->track_allocations = true;
   OpKernelContext ctx(params, item.num_outputs);
   nodestats::SetOpStart(stats);
 
@@ -621,6 +627,10 @@ Status ExecutorState<PropagatorStateType>::ProcessSync(
   if (outputs->size() < item.num_outputs) outputs->resize(item.num_outputs);
   s = ProcessOutputs(item, &ctx, outputs->data(), stats);
   nodestats::SetMemory(stats, &ctx);
+  if (TF_PREDICT_FALSE(sample_memory)) {
+    OpMemorySampler::Record(*op_kernel, &ctx);
+    params->track_allocations = false;
+  }
   return s;
 }
 
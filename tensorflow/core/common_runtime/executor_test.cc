@@ -28,6 +28,7 @@ limitations under the License.
 #include "tensorflow/core/common_runtime/graph_constructor.h"
 #include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
 #include "tensorflow/core/common_runtime/lower_functional_ops.h"
+#include "tensorflow/core/common_runtime/op_memory_sampler.h"
 #include "tensorflow/core/common_runtime/process_util.h"
 #include "tensorflow/core/common_runtime/step_stats_collector.h"
 #include "tensorflow/core/framework/attr_value.pb.h"
@@ -40,6 +41,8 @@ limitations under the License.
 #include "tensorflow/core/graph/algorithm.h"
 #include "tensorflow/core/graph/testlib.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/monitoring/cell_reader.h"
+#include "tensorflow/core/lib/monitoring/test_utils.h"
 #include "tensorflow/core/lib/random/simple_philox.h"
 #include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/platform/logging.h"
@@ -78,10 +81,14 @@ class ExecutorTest : public ::testing::Test {
   }
 
   // Resets executor_ with a new executor based on a graph 'gdef'.
-  void Create(std::unique_ptr<const Graph> graph) {
+  void Create(std::unique_ptr<const Graph> graph,
+              bool parallel_kernel_creation = false) {
     const int version = graph->versions().producer();
     LocalExecutorParams params;
     params.device = device_.get();
+    if (parallel_kernel_creation) {
+      params.kernel_creation_thread_pool = thread_pool_;
+    }
     params.create_kernel =
         [this, version](const std::shared_ptr<const NodeProperties>& props,
                         OpKernel** kernel) {
@@ -440,6 +447,62 @@ TEST_F(ExecutorTest, NoInputTensors) {
   TF_ASSERT_OK(Run(rendez_));
 }
 
+TEST_F(ExecutorTest, ParallelKernelCreation) {
+  // Large enough for kernels to be created on the thread pool.
+  auto g = std::make_unique<Graph>(OpRegistry::Global());
+  auto in0 = test::graph::Recv(g.get(), "a", "float", ALICE, 1, BOB);
+  Node* tmp = in0;
+  for (int i = 0; i < 4096; ++i) {
+    tmp = test::graph::Identity(g.get(), tmp);
+  }
+  test::graph::Send(g.get(), tmp, "b", BOB, 1, ALICE);
+  Create(std::move(g), /*parallel_kernel_creation=*/true);
+  Rendezvous::Args args;
+  TF_ASSERT_OK(rendez_->Send(Key(ALICE, kIncarnation, BOB, "a"), args, V(1.0),
+                             false));
+  TF_ASSERT_OK(Run(rendez_));
+  Tensor out = V(-1);
+  bool is_dead = false;
+  TF_ASSERT_OK(
+      rendez_->Recv(Key(BOB, kIncarnation, ALICE, "b"), args, &out, &is_dead));
+  EXPECT_EQ(1.0, V(out));
+}
+
+TEST_F(ExecutorTest, SampledOpMemory) {
+  monitoring::testing::CellReader<monitoring::testing::Histogram> peak_bytes(
+      "/tensorflow/core/op_memory/peak_bytes");
+  monitoring::testing::CellReader<monitoring::testing::Histogram>
+      allocation_count("/tensorflow/core/op_memory/allocation_count");
+
+  // c = a + a, where the Add kernel allocates a fresh 4KB output.
+  auto g = std::make_unique<Graph>(OpRegistry::Global());
+  Tensor a(DT_FLOAT, TensorShape({1024}));
+  a.flat<float>().setConstant(1.0);
+  auto in = test::graph::Constant(g.get(), a);
+  test::graph::Add(g.get(), in, in);
+  FixupSourceAndSinkEdges(g.get());
+  Create(std::move(g));
+
+  const int64_t period = OpMemorySampler::SamplingPeriod();
+  OpMemorySampler::SetSamplingPeriod(1);
+  // Run without a step stats collector, and inline so that the samples end up
+  // in this thread's buffer.
+  Executor::Args args;
+  args.rendezvous = rendez_;
+  args.runner = [](std::function<void()> fn) { fn(); };
+  TF_ASSERT_OK(exec_->Run(args));
+  OpMemorySampler::Flush();
+  OpMemorySampler::SetSamplingPeriod(period);
+
+  const monitoring::testing::Histogram add_peak_bytes = peak_bytes.Delta("Add");
+  EXPECT_FLOAT_EQ(add_peak_bytes.num(), 1.0);
+  EXPECT_GE(add_peak_bytes.sum(), 1024 * sizeof(float));
+  const monitoring::testing::Histogram add_allocations =
+      allocation_count.Delta("Add");
+  EXPECT_FLOAT_EQ(add_allocations.num(), 1.0);
+  EXPECT_FLOAT_EQ(add_allocations.sum(), 1.0);
+}
+
 // Create a graph that is 'depth' deep. At each level, fan-in and fan-out a
 // maximum of 'width' nodes. All nodes are no-ops and all dependencies are
 // control dependencies.
@@ -494,6 +557,100 @@ BENCHMARK(BM_executor)->UseRealTime()->ArgPair(8192, 32);
 // Tall fat graph
 BENCHMARK(BM_executor)->UseRealTime()->ArgPair(1024, 1024);
 
+// Measures the time to load a graph of `num_nodes` chains of a constant and
+// several elementwise ops: converting the GraphDef and creating an executor
+// for it, optionally parallelizing the per-node work.
+static void BM_GraphLoad(::testing::benchmark::State& state) {
+  const int num_nodes = state.range(0);
+  const bool parallel = state.range(1);
+
+  Graph g(OpRegistry::Global());
+  while (g.num_op_nodes() < num_nodes) {
+    Node* n = test::graph::Constant(&g, V(1.0));
+    for (int j = 0; j < 7; ++j) {
+      n = test::graph::Unary(&g, "Neg", n);
+    }
+  }
+  GraphDef graph_def;
+  g.ToGraphDef(&graph_def);
+
+  std::unique_ptr<Device> device(
+      DeviceFactory::NewDevice("CPU", {}, "/job:localhost/replica:0/task:0"));
+  thread::ThreadPool* thread_pool = ComputePool(SessionOptions());
+  for (auto s : state) {
+    GraphConstructorOptions opts;
+    if (parallel) opts.thread_pool = thread_pool;
+    auto graph = std::make_unique<Graph>(OpRegistry::Global());
+    TF_CHECK_OK(ConvertGraphDefToGraph(opts, graph_def, graph.get()));
+
+    const int version = graph->versions().producer();
+    LocalExecutorParams params;
+    params.device = device.get();
+    if (parallel) params.kernel_creation_thread_pool = thread_pool;
+    params.create_kernel =
+        [&device, version](const std::shared_ptr<const NodeProperties>& props,
+                           OpKernel** kernel) {
+          return CreateNonCachedKernel(device.get(), nullptr, props, version,
+                                       kernel);
+        };
+    params.delete_kernel = [](OpKernel* kernel) {
+      DeleteNonCachedKernel(kernel);
+    };
+    Executor* executor;
+    TF_CHECK_OK(NewLocalExecutor(params, *graph, &executor));
+    delete executor;
+  }
+  state.SetItemsProcessed(num_nodes * static_cast<int64_t>(state.iterations()));
+}
+
+BENCHMARK(BM_GraphLoad)
+    ->UseRealTime()
+    ->ArgPair(1 << 12, false)
+    ->ArgPair(1 << 12, true)
+    ->ArgPair(1 << 16, false)
+    ->ArgPair(1 << 16, true)
+    ->ArgPair(1 << 19, false)
+    ->ArgPair(1 << 19, true);
+
+// Measures the overhead of sampling per-op memory statistics every
+// `sampling_period` kernel invocations (0 disables sampling) on `width` chains
+// of small elementwise ops.
+static void BM_OpMemorySampling(::testing::benchmark::State& state) {
+  const int width = state.range(0);
+  const int sampling_period = state.range(1);
+  constexpr int kDepth = 8;
+
+  Graph* g = new Graph(OpRegistry::Global());
+  Tensor t(DT_FLOAT, TensorShape({64}));
+  t.flat<float>().setConstant(1.0);
+  for (int i = 0; i < width; ++i) {
+    Node* n = test::graph::Constant(g, t);
+    for (int j = 0; j < kDepth; ++j) {
+      n = test::graph::Add(g, n, n);
+    }
+  }
+  FixupSourceAndSinkEdges(g);
+
+  const int64_t period = OpMemorySampler::SamplingPeriod();
+  OpMemorySampler::SetSamplingPeriod(sampling_period);
+  test::Benchmark("cpu", g, /*old_benchmark_api=*/false).Run(state);
+  OpMemorySampler::SetSamplingPeriod(period);
+
+  state.SetLabel(strings::StrCat("Nodes = ", (1 + kDepth) * width,
+                                 " sampling period = ", sampling_period));
+  state.SetItemsProcessed((1 + kDepth) * width *
+                          static_cast<int64_t>(state.iterations()));
+}
+
+BENCHMARK(BM_OpMemorySampling)
+    ->UseRealTime()
+    ->ArgPair(16, 0)
+    ->ArgPair(16, 1000)
+    ->ArgPair(16, 1)
+    ->ArgPair(1024, 0)
+    ->ArgPair(1024, 1000)
+    ->ArgPair(1024, 1);
+
 static void BM_const_identity(::testing::benchmark::State& state) {
   const int width = state.range(0);
   const int outputs_per_const = state.range(1);
@@ -0,0 +1,116 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/common_runtime/function_instantiation_cache.h"
+
+#include <utility>
+
+#include "tensorflow/core/lib/monitoring/counter.h"
+
+namespace tensorflow {
+namespace {
+
+auto* instantiation_cache_requests = monitoring::Counter<1>::New(
+    "/tensorflow/core/function_instantiation_cache/requests",
+    "The number of lookups in the process-wide function instantiation cache.",
+    "result");
+
+auto* instantiation_cache_saved_usecs = monitoring::Counter<0>::New(
+    "/tensorflow/core/function_instantiation_cache/saved_time_usecs",
+    "Graph optimization time avoided by hits in the process-wide function "
+    "instantiation cache, in microseconds.");
+
+auto* instantiation_cache_shared_library_bytes = monitoring::Counter<0>::New(
+    "/tensorflow/core/function_instantiation_cache/shared_library_bytes",
+    "Serialized size of the function definitions that hits in the "
+    "process-wide function instantiation cache share with another runtime "
+    "instead of holding their own copy, in bytes.");
+
+// Returns the serialized size of the function definitions in `lib_def`.
+int64_t LibraryBytes(const FunctionLibraryDefinition& lib_def) {
+  int64_t bytes = 0;
+  for (const string& name : lib_def.ListFunctionNames()) {
+    bytes += lib_def.Find(name)->ByteSizeLong();
+  }
+  return bytes;
+}
+
+}  // namespace
+
+/* static */
+FunctionInstantiationCache* FunctionInstantiationCache::Global() {
+  static FunctionInstantiationCache* cache = new FunctionInstantiationCache;
+  return cache;
+}
+
+FunctionInstantiationCache::Entry FunctionInstantiationCache::Lookup(
+    uint64 key) {
+  Entry entry;
+  int64_t library_bytes = 0;
+  {
+    tf_shared_lock l(mu_);
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+      entry = it->second.info.lock();
+      library_bytes = it->second.library_bytes;
+    }
+  }
+  if (entry == nullptr) {
+    instantiation_cache_requests->GetCell("miss")->IncrementBy(1);
+    return nullptr;
+  }
+  instantiation_cache_requests->GetCell("hit")->IncrementBy(1);
+  instantiation_cache_saved_usecs->GetCell()->IncrementBy(
+      entry->optimization_duration_usecs);
+  instantiation_cache_shared_library_bytes->GetCell()->IncrementBy(
+      library_bytes);
+  return entry;
+}
+
+FunctionInstantiationCache::Entry FunctionInstantiationCache::Insert(
+    uint64 key, OptimizedFunctionGraphInfo&& info) {
+  const int64_t library_bytes = LibraryBytes(info.lib_def);
+  mutex_lock l(mu_);
+  Slot& slot = entries_[key];
+  if (Entry existing = slot.info.lock()) return existing;
+  // The deleter runs without `mu_` held (the last reference is never dropped
+  // under the lock), so it can safely clean up the map slot.
+  Entry entry(new OptimizedFunctionGraphInfo(std::move(info)),
+              [this, key](const OptimizedFunctionGraphInfo* info) {
+                delete info;
+                Release(key);
+              });
+  slot.info = entry;
+  slot.library_bytes = library_bytes;
+  return entry;
+}
+
+size_t FunctionInstantiationCache::Size() const {
+  tf_shared_lock l(mu_);
+  size_t size = 0;
+  for (const auto& it : entries_) {
+    if (!it.second.info.expired()) ++size;
+  }
+  return size;
+}
+
+void FunctionInstantiationCache::Release(uint64 key) {
+  mutex_lock l(mu_);
+  auto it = entries_.find(key);
+  // The slot may already have been refilled by a newer entry for the same key.
+  if (it != entries_.end() && it->second.info.expired()) entries_.erase(it);
+}
+
+}  // namespace tensorflow
@@ -0,0 +1,79 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_COMMON_RUNTIME_FUNCTION_INSTANTIATION_CACHE_H_
+#define TENSORFLOW_CORE_COMMON_RUNTIME_FUNCTION_INSTANTIATION_CACHE_H_
+
+#include <memory>
+
+#include "absl/container/flat_hash_map.h"
+#include "tensorflow/core/common_runtime/optimized_function_graph_info.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/types.h"
+#include "tsl/platform/thread_annotations.h"
+
+namespace tensorflow {
+
+// A process-wide cache of optimized multi-device function graphs, shared by
+// all ProcessFunctionLibraryRuntime instances.
+//
+// Loading several versions of a model that share functions would otherwise run
+// the full set of function graph optimization passes once per
+// ProcessFunctionLibraryRuntime. Entries are keyed by a fingerprint of the
+// function, its reachable library and the instantiation options, and hold at
+// most one immutable OptimizedFunctionGraphInfo per key. Runtimes partition a
+// copy of the entry's graph, which shares its node definitions, and keep a
+// copy of its library, which shares its function records.
+//
+// Entries are reference counted: the cache itself only holds weak references,
+// and an entry is released as soon as the last runtime that looked it up goes
+// away. Entries must not outlive the cache that created them.
+class FunctionInstantiationCache {
+ public:
+  using Entry = std::shared_ptr<const OptimizedFunctionGraphInfo>;
+
+  // Returns the process-wide instance.
+  static FunctionInstantiationCache* Global();
+
+  // Returns the live entry for `key`, or nullptr if there is none.
+  Entry Lookup(uint64 key) TF_LOCKS_EXCLUDED(mu_);
+
+  // Publishes `info` under `key` and returns a reference to the cached entry.
+  // If a live entry for `key` already exists (e.g. another runtime raced with
+  // the caller), that entry is returned and `info` is discarded.
+  Entry Insert(uint64 key, OptimizedFunctionGraphInfo&& info)
+      TF_LOCKS_EXCLUDED(mu_);
+
+  // Returns the number of live entries.
+  size_t Size() const TF_LOCKS_EXCLUDED(mu_);
+
+ private:
+  // Drops the map slot for `key` if it no longer refers to a live entry.
+  void Release(uint64 key) TF_LOCKS_EXCLUDED(mu_);
+
+  struct Slot {
+    std::weak_ptr<const OptimizedFunctionGraphInfo> info;
+    // Serialized size of the function definitions in `info->lib_def`, which
+    // each runtime reusing the entry shares instead of holding its own copy.
+    int64_t library_bytes = 0;
+  };
+
+  mutable mutex mu_;
+  absl::flat_hash_map<uint64, Slot> entries_ TF_GUARDED_BY(mu_);
+};
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_COMMON_RUNTIME_FUNCTION_INSTANTIATION_CACHE_H_
@@ -0,0 +1,92 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/common_runtime/function_instantiation_cache.h"
+
+#include <memory>
+
+#include "tensorflow/core/common_runtime/optimized_function_graph_info.h"
+#include "tensorflow/core/framework/function_testlib.h"
+#include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/monitoring/cell_reader.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace {
+
+OptimizedFunctionGraphInfo MakeGraph(const string& name,
+                                     uint64 optimization_time_usecs) {
+  OptimizedFunctionGraphInfo info;
+  info.name = name;
+  info.function_graph = std::make_unique<Graph>(OpRegistry::Global());
+  info.optimization_duration_usecs = optimization_time_usecs;
+  return info;
+}
+
+TEST(FunctionInstantiationCacheTest, LookupMissesUnknownKey) {
+  FunctionInstantiationCache cache;
+  EXPECT_EQ(cache.Lookup(1), nullptr);
+  EXPECT_EQ(cache.Size(), 0);
+}
+
+TEST(FunctionInstantiationCacheTest, LookupSharesInsertedEntry) {
+  monitoring::testing::CellReader<int64_t> saved_usecs(
+      "/tensorflow/core/function_instantiation_cache/saved_time_usecs");
+  monitoring::testing::CellReader<int64_t> shared_library_bytes(
+      "/tensorflow/core/function_instantiation_cache/shared_library_bytes");
+  FunctionInstantiationCache cache;
+  OptimizedFunctionGraphInfo info = MakeGraph("f", 100);
+  const FunctionDef fdef = test::function::XTimesTwo();
+  TF_ASSERT_OK(info.lib_def.AddFunctionDef(fdef));
+  FunctionInstantiationCache::Entry inserted =
+      cache.Insert(1, std::move(info));
+  ASSERT_NE(inserted, nullptr);
+  EXPECT_EQ(inserted->name, "f");
+
+  FunctionInstantiationCache::Entry found = cache.Lookup(1);
+  EXPECT_EQ(found, inserted);
+  EXPECT_EQ(cache.Lookup(2), nullptr);
+  EXPECT_EQ(cache.Size(), 1);
+  EXPECT_EQ(saved_usecs.Delta(), 100);
+  EXPECT_EQ(shared_library_bytes.Delta(),
+            static_cast<int64_t>(fdef.ByteSizeLong()));
+}
+
+TEST(FunctionInstantiationCacheTest, InsertKeepsExistingEntry) {
+  FunctionInstantiationCache cache;
+  FunctionInstantiationCache::Entry first = cache.Insert(1, MakeGraph("f", 1));
+  FunctionInstantiationCache::Entry second = cache.Insert(1, MakeGraph("g", 1));
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(second->name, "f");
+}
+
+TEST(FunctionInstantiationCacheTest, EntryReleasedWithLastReference) {
+  FunctionInstantiationCache cache;
+  FunctionInstantiationCache::Entry first = cache.Insert(1, MakeGraph("f", 1));
+  FunctionInstantiationCache::Entry second = cache.Lookup(1);
+  first.reset();
+  EXPECT_EQ(cache.Size(), 1);
+  second.reset();
+  EXPECT_EQ(cache.Size(), 0);
+  EXPECT_EQ(cache.Lookup(1), nullptr);
+
+  // The key can be populated again after its entry was released.
+  FunctionInstantiationCache::Entry third = cache.Insert(1, MakeGraph("g", 1));
+  EXPECT_EQ(cache.Lookup(1)->name, "g");
+}
+
+}  // namespace
+}  // namespace tensorflow
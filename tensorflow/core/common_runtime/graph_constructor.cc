@@ -53,6 +53,7 @@ limitations under the License.
 #include "tensorflow/core/platform/errors.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/threadpool.h"
 #include "tensorflow/core/public/version.h"
 
 namespace tensorflow {
@@ -107,7 +108,8 @@ class GraphConstructor {
           importing(false),
           validate_nodes(in.validate_nodes),
           validate_colocation_constraints(false),
-          add_default_attributes(in.add_default_attributes) {}
+          add_default_attributes(in.add_default_attributes),
+          thread_pool(in.thread_pool) {}
     Options(const ImportGraphDefOptions& in)  // NOLINT(runtime/explicit)
         : allow_internal_ops(false),
           expect_device_spec(false),
@@ -162,6 +164,9 @@ class GraphConstructor {
     bool add_default_attributes = true;
 
     string default_device;
+
+    // Not owned. Only used when not importing.
+    thread::ThreadPool* thread_pool = nullptr;
   };
 
   typedef gtl::ArraySlice<const NodeDef*> NodeDefSlice;
@@ -222,6 +227,7 @@ class GraphConstructor {
   Status ValidateInputMapAndControlDependencies();
   Status BuildNodeIndex();
   Status InitFromEdges();
+  void PrepareNodeDefsInParallel();
   Status Convert();
   Status AddBackEdges();
   Status UpdateVersionDef();
@@ -406,6 +412,12 @@ class GraphConstructor {
   };
   std::vector<EdgeInfo> back_edges_;
 
+  // If non-empty, the consumed NodeDefs with default attributes added by
+  // PrepareNodeDefsInParallel(), indexed like node_defs_, along with the
+  // result of preparing each of them.
+  std::vector<NodeDef> prepared_node_defs_;
+  std::vector<Status> prepared_node_def_status_;
+
   GraphConstructor(const GraphConstructor&) = delete;
   void operator=(const GraphConstructor&) = delete;
 };
@@ -1161,6 +1173,45 @@ GraphConstructor::CreateStackTracesForFunctionDefLibrary(
   }
 }
 
+void GraphConstructor::PrepareNodeDefsInParallel() {
+  // Graphs smaller than this are not worth dispatching to a thread pool.
+  constexpr int kMinNodesForParallelPreparation = 4096;
+  // Rough estimate of the cost of adding default attributes to, and
+  // validating, one NodeDef.
+  constexpr int64_t kCostPerNodeDef = 5000;
+
+  if (opts_.importing || opts_.thread_pool == nullptr ||
+      node_def_count() < kMinNodesForParallelPreparation) {
+    return;
+  }
+
+  const int num_nodes = node_def_count();
+  prepared_node_defs_.resize(num_nodes);
+  prepared_node_def_status_.resize(num_nodes);
+  // Consuming is a move for owned GraphDefs, so it is done up front on this
+  // thread; the per-node work below only touches its own NodeDef.
+  for (int i = 0; i < num_nodes; ++i) {
+    prepared_node_defs_[i] = consume_node_def(i);
+  }
+  opts_.thread_pool->ParallelFor(
+      num_nodes, kCostPerNodeDef, [this](int64_t start, int64_t limit) {
+        for (int64_t i = start; i < limit; ++i) {
+          NodeDef& node_def = prepared_node_defs_[i];
+          const OpDef* op_def;
+          Status s = g_->op_registry()->LookUpOpDef(node_def.op(), &op_def);
+          if (s.ok()) {
+            if (opts_.add_default_attributes) {
+              AddDefaultsToNodeDef(*op_def, &node_def);
+            }
+            if (opts_.validate_nodes) {
+              s = ValidateNodeDef(node_def, *op_def);
+            }
+          }
+          prepared_node_def_status_[i] = s;
+        }
+      });
+}
+
 Status GraphConstructor::Convert() {
   if (debug_info() != nullptr) {
     traces_ = LoadTracesFromDebugInfo(*debug_info());
@@ -1185,6 +1236,10 @@ Status GraphConstructor::Convert() {
         g_->AddFunctionLibrary(*std::move(library), library_traces));
   }
 
+  // The op definitions of nodes calling library functions are only known once
+  // the library is added to the graph.
+  PrepareNodeDefsInParallel();
+
   std::vector<InputInfo> inputs;
   int processed = 0;
 
@@ -1201,7 +1256,9 @@ Status GraphConstructor::Convert() {
     inputs.clear();
     bool has_data_back_edge = false;
 
-    NodeDef node_def = consume_node_def(o);
+    const bool prepared = !prepared_node_defs_.empty();
+    NodeDef node_def =
+        prepared ? std::move(prepared_node_defs_[o]) : consume_node_def(o);
 
     // input_already_exists[i] is true iff the i-th input of the node we're
     // importing refers to a preexisting node in g_ (i.e. input[i] existed prior
@@ -1297,6 +1354,8 @@ Status GraphConstructor::Convert() {
 
     if (opts_.importing) {
       TF_RETURN_IF_ERROR(ModifyNodeDefForImport(&node_def));
+    } else if (prepared) {
+      TF_RETURN_IF_ERROR(prepared_node_def_status_[o]);
     } else {
       const OpDef* op_def;
       TF_RETURN_IF_ERROR(
@@ -1352,7 +1411,10 @@ Status GraphConstructor::Convert() {
                  << " NODES IN A CYCLE";
     for (int64_t i = 0; i < node_def_count(); i++) {
       if (pending_count_[i] != 0) {
-        LOG(WARNING) << "PENDING: " << SummarizeNodeDef(get_node_def(i))
+        LOG(WARNING) << "PENDING: "
+                     << SummarizeNodeDef(prepared_node_defs_.empty()
+                                             ? get_node_def(i)
+                                             : prepared_node_defs_[i])
                      << " WITH PENDING COUNT = " << pending_count_[i];
       }
     }
@@ -23,6 +23,9 @@ limitations under the License.
 
 namespace tensorflow {
 class ShapeRefiner;
+namespace thread {
+class ThreadPool;
+}  // namespace thread
 
 // Construct a Graph *g out of a GraphDef gdef. Returns non-OK on
 // error, in which case *g is left in an incomplete state.
@@ -52,6 +55,14 @@ struct GraphConstructorOptions {
   // If true, GraphConstructor will add attributes with their default
   // value to the Node when they are missing from the NodeDef.
   bool add_default_attributes = true;
+
+  // If set, the per-node work that does not depend on other nodes (adding
+  // default attributes and validation) is done concurrently on this pool for
+  // large graphs. The resulting graph is identical to a sequential
+  // conversion. The conversion blocks until the work is done, so this must
+  // not be a pool whose threads may be waiting for the conversion, such as
+  // the one it runs on. Not owned.
+  thread::ThreadPool* thread_pool = nullptr;
 };
 extern Status ConvertGraphDefToGraph(const GraphConstructorOptions& opts,
                                      const GraphDef& gdef, Graph* g);
@@ -33,9 +33,11 @@ limitations under the License.
 #include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/lib/strings/str_util.h"
 #include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/protobuf.h"
 #include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/threadpool.h"
 #include "tensorflow/core/public/session.h"
 #include "tensorflow/core/public/version.h"
 
@@ -3510,5 +3512,44 @@ TEST_F(GraphConstructorTest,
             "File \"delta.cc\", line 34, in jape");
 }
 
+TEST_F(GraphConstructorTest, ConvertLargeGraphWithFunctionCallsOnThreadPool) {
+  // Enough nodes to prepare the NodeDefs on the thread pool, some of which
+  // call a function of the library.
+  constexpr int kNumCalls = 5000;
+  GraphDef gdef;
+  *gdef.mutable_library()->add_function() = FunctionDefHelper::Define(
+      "Foo", {"x: float", "y: float"}, {"z: float"}, {},
+      {{{"z"}, "Add", {"x", "y"}, {{"T", DT_FLOAT}}}});
+  NodeDef* x = gdef.add_node();
+  x->set_name("x");
+  x->set_op("Placeholder");
+  (*x->mutable_attr())["dtype"].set_type(DT_FLOAT);
+  for (int i = 0; i < kNumCalls; ++i) {
+    NodeDef* call = gdef.add_node();
+    call->set_name(strings::StrCat("call", i));
+    call->set_op("Foo");
+    call->add_input("x");
+    call->add_input(i == 0 ? "x" : strings::StrCat("call", i - 1));
+  }
+
+  GraphConstructorOptions opts;
+  Graph expected(OpRegistry::Global());
+  TF_ASSERT_OK(ConvertGraphDefToGraph(opts, gdef, &expected));
+
+  thread::ThreadPool pool(Env::Default(), "test", 4);
+  opts.thread_pool = &pool;
+  TF_ASSERT_OK(ConvertGraphDefToGraph(opts, gdef, &graph_));
+  EXPECT_EQ(graph_.num_op_nodes(), kNumCalls + 1);
+  EXPECT_EQ(graph_.ToGraphDefDebug().DebugString(),
+            expected.ToGraphDefDebug().DebugString());
+
+  // Unknown ops are still reported.
+  gdef.mutable_node(kNumCalls)->set_op("Bar");
+  Graph graph(OpRegistry::Global());
+  Status status = ConvertGraphDefToGraph(opts, gdef, &graph);
+  EXPECT_TRUE(absl::StrContains(status.message(), "Op type not registered"))
+      << status;
+}
+
 }  // namespace
 }  // namespace tensorflow
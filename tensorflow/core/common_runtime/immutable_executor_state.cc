@@ -24,6 +24,7 @@ limitations under the License.
 #include "tensorflow/core/graph/graph_node_util.h"
 #include "tensorflow/core/platform/errors.h"
 #include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/threadpool.h"
 
 namespace tensorflow {
 
@@ -31,6 +32,14 @@ namespace {
 bool IsInitializationOp(const Node* node) {
   return node->op_def().allows_uninitialized_input();
 }
+
+// Graphs with fewer nodes than this create their kernels on the calling
+// thread, where the cost of dispatching to a thread pool would dominate.
+constexpr int kMinNodesForParallelKernelCreation = 1024;
+
+// Rough estimate of the cost of creating one kernel, used to shard kernel
+// creation across the thread pool.
+constexpr int64_t kKernelCreationCostPerNode = 10000;
 }  // namespace
 
 ImmutableExecutorState::~ImmutableExecutorState() {
@@ -81,6 +90,52 @@ ImmutableExecutorState::FrameInfo* ImmutableExecutorState::EnsureFrameInfo(
   }
 }
 
+Status ImmutableExecutorState::CreateKernels(const Graph& graph) {
+  std::vector<const Node*> nodes;
+  nodes.reserve(graph.num_nodes());
+  for (const Node* n : graph.nodes()) {
+    if (IsSink(n)) continue;
+    nodes.push_back(n);
+  }
+
+  if (params_.kernel_creation_thread_pool == nullptr ||
+      nodes.size() < kMinNodesForParallelKernelCreation) {
+    for (const Node* n : nodes) {
+      NodeItem* item = gview_.node(n->id());
+      Status s = params_.create_kernel(n->properties(), &item->kernel);
+      if (!s.ok()) {
+        params_.delete_kernel(item->kernel);
+        item->kernel = nullptr;
+        return AttachDef(s, *n);
+      }
+    }
+    return absl::OkStatus();
+  }
+
+  std::vector<Status> statuses(nodes.size());
+  params_.kernel_creation_thread_pool->ParallelFor(
+      nodes.size(), kKernelCreationCostPerNode,
+      [this, &nodes, &statuses](int64_t start, int64_t limit) {
+        for (int64_t i = start; i < limit; ++i) {
+          NodeItem* item = gview_.node(nodes[i]->id());
+          statuses[i] =
+              params_.create_kernel(nodes[i]->properties(), &item->kernel);
+        }
+      });
+
+  Status first_error;
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (statuses[i].ok()) continue;
+    NodeItem* item = gview_.node(nodes[i]->id());
+    params_.delete_kernel(item->kernel);
+    item->kernel = nullptr;
+    if (first_error.ok()) {
+      first_error = AttachDef(statuses[i], *nodes[i]);
+    }
+  }
+  return first_error;
+}
+
 Status ImmutableExecutorState::Initialize(const Graph& graph) {
   TF_RETURN_IF_ERROR(gview_.Initialize(&graph));
 
@@ -96,8 +151,9 @@ Status ImmutableExecutorState::Initialize(const Graph& graph) {
 
   pending_ids_.resize(gview_.num_nodes());
 
-  // Preprocess every node in the graph to create an instance of op
-  // kernel for each node.
+  // Create an instance of op kernel for each node, then preprocess every node
+  // in the graph.
+  TF_RETURN_IF_ERROR(CreateKernels(graph));
   requires_control_flow_ = false;
   for (const Node* n : graph.nodes()) {
     if (IsSink(n)) continue;
@@ -129,13 +185,6 @@ Status ImmutableExecutorState::Initialize(const Graph& graph) {
     item->input_start = frame_info->total_inputs;
     frame_info->total_inputs += n->num_inputs();
 
-    Status s = params_.create_kernel(n->properties(), &item->kernel);
-    if (!s.ok()) {
-      params_.delete_kernel(item->kernel);
-      item->kernel = nullptr;
-      s = AttachDef(s, *n);
-      return s;
-    }
     CHECK(item->kernel);
     item->kernel_is_async = (item->kernel->AsAsync() != nullptr);
     item->is_merge = IsMerge(n);
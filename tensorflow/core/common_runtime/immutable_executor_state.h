@@ -126,6 +126,13 @@ class ImmutableExecutorState {
                                      ControlFlowInfo* cf_info);
   void InitializePending(const Graph* graph, const ControlFlowInfo& cf_info);
 
+  // Creates the kernel of every node in `graph`, using
+  // `params_.kernel_creation_thread_pool` when it is set and the graph is
+  // large enough. On the calling thread, stops at the first failing node.
+  // On the pool, returns the error of the first failing node in node order,
+  // independent of the order in which kernels were created.
+  Status CreateKernels(const Graph& graph);
+
   FrameInfo* EnsureFrameInfo(const string& fname);
 
   // Owned.
@@ -22,6 +22,10 @@ limitations under the License.
 #include "tensorflow/core/lib/core/status.h"
 
 namespace tensorflow {
+namespace thread {
+class ThreadPool;
+}  // namespace thread
+
 class Device;
 class StepStatsCollector;
 class SessionMetadata;
@@ -48,6 +52,12 @@ struct LocalExecutorParams {
       create_kernel;
   std::function<void(OpKernel*)> delete_kernel;
 
+  // If set, kernels for large graphs are created concurrently on this pool
+  // when the executor is initialized. The caller must guarantee that
+  // `create_kernel` is thread-safe, and that the threads of the pool are not
+  // waiting for the executor to be created. Not owned.
+  thread::ThreadPool* kernel_creation_thread_pool = nullptr;
+
   // Whether control flow nodes are allowed to be executed synchronously.
   bool allow_control_flow_sync_execution = false;
 };
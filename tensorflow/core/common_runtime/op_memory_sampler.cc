@@ -0,0 +1,146 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/common_runtime/op_memory_sampler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/core/framework/tracking_allocator.h"
+#include "tensorflow/core/lib/monitoring/sampler.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/random.h"
+#include "tensorflow/core/util/env_var.h"
+
+namespace tensorflow {
+namespace {
+
+constexpr int64_t kDefaultSamplingPeriod = 1000;
+
+// Number of samples a thread buffers before publishing them.
+constexpr int kFlushThreshold = 64;
+
+auto* op_peak_bytes = monitoring::Sampler<1>::New(
+    {"/tensorflow/core/op_memory/peak_bytes",
+     "Sampled peak number of bytes held by a single kernel invocation across "
+     "all of its allocators.",
+     "op"},
+    // 1 byte to 256 GiB.
+    {monitoring::Buckets::Exponential(1, 4, 20)});
+
+auto* op_allocation_count = monitoring::Sampler<1>::New(
+    {"/tensorflow/core/op_memory/allocation_count",
+     "Sampled number of allocations made by a single kernel invocation.",
+     "op"},
+    {monitoring::Buckets::Exponential(1, 2, 16)});
+
+struct Sample {
+  std::string op;
+  int64_t peak_bytes;
+  int64_t num_allocations;
+};
+
+// Samples collected by one thread. Only the owning thread touches the buffer,
+// so recording a sample never takes a lock; the metric cells are updated in
+// batches of `kFlushThreshold`.
+class SampleBuffer {
+ public:
+  SampleBuffer() { samples_.reserve(kFlushThreshold); }
+  ~SampleBuffer() { Flush(); }
+
+  void Add(Sample sample) {
+    samples_.push_back(std::move(sample));
+    if (samples_.size() >= kFlushThreshold) Flush();
+  }
+
+  void Flush() {
+    for (const Sample& sample : samples_) {
+      op_peak_bytes->GetCell(sample.op)->Add(sample.peak_bytes);
+      op_allocation_count->GetCell(sample.op)->Add(sample.num_allocations);
+    }
+    samples_.clear();
+  }
+
+ private:
+  std::vector<Sample> samples_;
+};
+
+SampleBuffer* ThreadSampleBuffer() {
+  thread_local SampleBuffer buffer;
+  return &buffer;
+}
+
+std::atomic<int64_t>* SamplingPeriodFlag() {
+  static std::atomic<int64_t>* period = [] {
+    int64_t value;
+    Status s = ReadInt64FromEnvVar("TF_OP_MEMORY_SAMPLING_PERIOD",
+                                   kDefaultSamplingPeriod, &value);
+    if (!s.ok()) {
+      LOG(ERROR) << s;
+      value = kDefaultSamplingPeriod;
+    }
+    return new std::atomic<int64_t>(std::max<int64_t>(value, 0));
+  }();
+  return period;
+}
+
+}  // namespace
+
+std::atomic<int64_t> OpMemorySampler::epoch_{0};
+
+void OpMemorySampler::Record(const OpKernel& kernel, OpKernelContext* ctx) {
+  int64_t peak_bytes = 0;
+  int64_t num_allocations = 0;
+  for (const auto& wrapped : ctx->ConsumeWrappedAllocators()) {
+    // Kernels rarely allocate from more than one allocator, so the sum of the
+    // per-allocator high watermarks is a tight bound on the kernel's peak.
+    peak_bytes += std::get<1>(wrapped.second->GetSizes());
+    for (const auto& record : wrapped.second->GetRecordsAndUnRef()) {
+      if (record.alloc_bytes > 0) ++num_allocations;
+    }
+  }
+  ThreadSampleBuffer()->Add(
+      {std::string(kernel.type_string_view()), peak_bytes, num_allocations});
+}
+
+void OpMemorySampler::Flush() { ThreadSampleBuffer()->Flush(); }
+
+int64_t OpMemorySampler::SamplingPeriod() {
+  return SamplingPeriodFlag()->load(std::memory_order_relaxed);
+}
+
+void OpMemorySampler::SetSamplingPeriod(int64_t period) {
+  SamplingPeriodFlag()->store(std::max<int64_t>(period, 0),
+                              std::memory_order_relaxed);
+  epoch_.fetch_add(1, std::memory_order_relaxed);
+}
+
+int64_t OpMemorySampler::NextCountdown() {
+  const int64_t period = SamplingPeriod();
+  if (period == 0) return std::numeric_limits<int64_t>::max();
+  // xorshift64; the quality is more than enough to spread samples.
+  thread_local uint64 state = random::New64() | 1;
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return 1 + static_cast<int64_t>(state % static_cast<uint64>(2 * period - 1));
+}
+
+}  // namespace tensorflow
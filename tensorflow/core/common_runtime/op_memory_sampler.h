@@ -0,0 +1,84 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_COMMON_RUNTIME_OP_MEMORY_SAMPLER_H_
+#define TENSORFLOW_CORE_COMMON_RUNTIME_OP_MEMORY_SAMPLER_H_
+
+#include <atomic>
+
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+
+// Always-on, sampled collection of per-op memory statistics.
+//
+// Roughly one in every `SamplingPeriod()` kernel invocations on each thread is
+// run with allocation tracking enabled. For a sampled invocation, the peak
+// number of bytes the kernel held across all of its allocators and the number
+// of allocations it made are buffered in a thread-local buffer, and are
+// periodically flushed into the following histograms, labelled by op type:
+//
+//   /tensorflow/core/op_memory/peak_bytes
+//   /tensorflow/core/op_memory/allocation_count
+//
+// The sampling period defaults to 1000 and can be changed with the
+// TF_OP_MEMORY_SAMPLING_PERIOD environment variable. A period of 0 disables
+// sampling.
+class OpMemorySampler {
+ public:
+  // Returns true if the next kernel invocation on the calling thread should
+  // be sampled. The caller must then set `track_allocations` in the
+  // OpKernelContext::Params of that invocation and call `Record()` after the
+  // kernel has run.
+  static bool ShouldSample() {
+    thread_local int64_t countdown = 0;
+    thread_local int64_t epoch = -1;
+    const int64_t current_epoch = epoch_.load(std::memory_order_relaxed);
+    if (TF_PREDICT_FALSE(epoch != current_epoch)) {
+      epoch = current_epoch;
+      countdown = NextCountdown();
+    }
+    if (TF_PREDICT_TRUE(--countdown > 0)) return false;
+    countdown = NextCountdown();
+    return true;
+  }
+
+  // Consumes the allocators wrapped by `ctx` and buffers their statistics for
+  // `kernel`.
+  static void Record(const OpKernel& kernel, OpKernelContext* ctx);
+
+  // Flushes the calling thread's buffered samples into the exported metrics.
+  // Buffers are also flushed when they fill up and when their thread exits.
+  static void Flush();
+
+  static int64_t SamplingPeriod();
+  static void SetSamplingPeriod(int64_t period);
+
+ private:
+  // Returns the number of invocations until the next sample, jittered around
+  // the sampling period so that sampling does not alias with the structure of
+  // the graph being executed. When sampling is disabled, returns a countdown
+  // that never expires; `epoch_` makes threads pick up a new period
+  // immediately.
+  static int64_t NextCountdown();
+
+  // Incremented whenever the sampling period changes.
+  static std::atomic<int64_t> epoch_;
+};
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_COMMON_RUNTIME_OP_MEMORY_SAMPLER_H_
@@ -27,15 +27,19 @@ limitations under the License.
 #include "absl/container/flat_hash_map.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
 #include "absl/types/optional.h"
 #include "absl/types/variant.h"
 #include "tensorflow/core/common_runtime/build_graph_options.h"
 #include "tensorflow/core/common_runtime/device_set.h"
 #include "tensorflow/core/common_runtime/function.h"
+#include "tensorflow/core/common_runtime/function_instantiation_cache.h"
 #include "tensorflow/core/common_runtime/function_optimization_registry.h"
+#include "tensorflow/core/common_runtime/graph_constructor.h"
 #include "tensorflow/core/common_runtime/int32_fulltype.h"
 #include "tensorflow/core/common_runtime/optimization_registry.h"
 #include "tensorflow/core/common_runtime/optimize_function_graph_utils.h"
+#include "tensorflow/core/common_runtime/optimized_function_graph_info.h"
 #include "tensorflow/core/common_runtime/partitioning_utils.h"
 #include "tensorflow/core/common_runtime/placer.h"
 #include "tensorflow/core/common_runtime/rendezvous_util.h"
@@ -57,7 +61,9 @@ limitations under the License.
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/gtl/inlined_vector.h"
 #include "tensorflow/core/lib/gtl/map_util.h"
+#include "tensorflow/core/lib/strings/proto_serialization.h"
 #include "tensorflow/core/platform/blocking_counter.h"
+#include "tensorflow/core/platform/fingerprint.h"
 #include "tensorflow/core/platform/mutex.h"
 #include "tensorflow/core/platform/notification.h"
 #include "tensorflow/core/platform/random.h"
@@ -86,6 +92,100 @@ int64_t GetParallelSubgraphThreshold() {
   return parallel_subgraph_threshold;
 }
 
+bool InstantiationCacheEnabled() {
+  bool enabled;
+  TF_CHECK_OK(tsl::ReadBoolFromEnvVar("TF_FUNCTION_INSTANTIATION_CACHE",
+                                      /*default_val=*/false, &enabled));
+  return enabled;
+}
+
+// Returns true if the optimized graph of a multi-device function instantiated
+// with `options` only depends on state that is captured by
+// `InstantiationCacheKey` and can be shared with other runtimes.
+bool IsInstantiationCacheable(
+    const FunctionLibraryRuntime::InstantiateOptions& options) {
+  return !options.is_component_function && !options.optimize_graph_fn &&
+         options.graph_collector == nullptr;
+}
+
+// Computes the key of a multi-device function instantiation in the
+// process-wide FunctionInstantiationCache. The key covers the function and
+// everything reachable from it, the instantiation options that affect graph
+// optimization, and the devices the function may be placed on.
+StatusOr<uint64> InstantiationCacheKey(
+    const string& function_name, AttrSlice attrs,
+    const FunctionLibraryRuntime::InstantiateOptions& options,
+    const FunctionLibraryDefinition& lib_def, const DeviceSet& dev_set,
+    const std::vector<CompositeDevice*>& composite_devices,
+    const Device* default_device) {
+  const FunctionDef* fdef = lib_def.Find(function_name);
+  if (fdef == nullptr) {
+    return errors::NotFound("Failed to find function \"", function_name,
+                            "\" in function library.");
+  }
+
+  // The canonical key includes the address of `options.lib_def`, which is
+  // specific to this runtime. Its contents are hashed below instead.
+  FunctionLibraryRuntime::InstantiateOptions canonical_options = options;
+  canonical_options.lib_def = nullptr;
+  uint64 key =
+      Fingerprint64(Canonicalize(function_name, attrs, canonical_options));
+  key = FingerprintCat64(key, DeterministicProtoHash64(*fdef));
+  // Library iteration order is unspecified, so hash reachable functions in
+  // name order.
+  const FunctionLibraryDefinition reachable_lib_def =
+      lib_def.ReachableDefinitions(*fdef);
+  std::vector<string> reachable_functions =
+      reachable_lib_def.ListFunctionNames();
+  std::sort(reachable_functions.begin(), reachable_functions.end());
+  for (const string& name : reachable_functions) {
+    key = FingerprintCat64(
+        key, DeterministicProtoHash64(*reachable_lib_def.Find(name)));
+  }
+  key = FingerprintCat64(
+      key, Fingerprint64(absl::StrCat(
+               options.xla_compile_device_type, "|",
+               options.allow_soft_placement, options.default_device_to_target,
+               options.int_args_and_retvals_on_device,
+               options.allow_small_function_optimizations,
+               options.allow_control_flow_sync_execution,
+               options.shape_inference_on_tfe_dialect_import)));
+  if (options.ret_indices.has_value()) {
+    key = FingerprintCat64(
+        key, Fingerprint64(absl::StrJoin(*options.ret_indices, ",")));
+  }
+  std::vector<string> device_names;
+  device_names.reserve(dev_set.devices().size() + composite_devices.size());
+  for (const Device* device : dev_set.devices()) {
+    device_names.push_back(device->name());
+  }
+  for (const CompositeDevice* device : composite_devices) {
+    device_names.push_back(
+        absl::StrCat(device->name(), "=",
+                     absl::StrJoin(*device->underlying_devices(), ",")));
+  }
+  std::sort(device_names.begin(), device_names.end());
+  for (const string& device_name : device_names) {
+    key = FingerprintCat64(key, Fingerprint64(device_name));
+  }
+  if (default_device != nullptr) {
+    key = FingerprintCat64(key, Fingerprint64(default_device->name()));
+  }
+  return key;
+}
+
+// Returns a copy of the shared `info` that the caller may partition. The copy
+// shares the node definitions and function records of `info`.
+OptimizedFunctionGraphInfo CopyOptimizedFunctionGraphInfo(
+    const OptimizedFunctionGraphInfo& info) {
+  auto graph = std::make_unique<Graph>(OpRegistry::Global());
+  CopyGraph(*info.function_graph, graph.get());
+  return OptimizedFunctionGraphInfo(
+      info.name, std::move(graph), FunctionLibraryDefinition(info.lib_def),
+      info.node_name_to_control_ret, info.ret_types, info.num_return_nodes,
+      info.optimization_duration_usecs, info.optimization_source);
+}
+
 }  // namespace
 
 const char ProcessFunctionLibraryRuntime::kDefaultFLRDevice[] = "null";
@@ -135,7 +235,8 @@ ProcessFunctionLibraryRuntime::ProcessFunctionLibraryRuntime(
       rendezvous_factory_(std::move(rendezvous_factory)),
       optimizer_options_(optimizer_options),
       graph_def_version_(graph_def_version),
-      stats_publisher_factory_(std::move(stats_publisher_factory)) {
+      stats_publisher_factory_(std::move(stats_publisher_factory)),
+      use_instantiation_cache_(InstantiationCacheEnabled()) {
   if (device_mgr == nullptr) {
     (*flr_map_)[nullptr] = NewFunctionLibraryRuntime(
         nullptr, env, config_ ? &(*config_) : nullptr, nullptr,
@@ -573,14 +674,40 @@ Status ProcessFunctionLibraryRuntime::InstantiateMultiDevice(
     }
   }
 
-  StatusOr<OptimizedFunctionGraphInfo> optimized_graph_info =
-      (!optimized_graph_proto.has_value() ||
-       !optimized_graph_proto.value().ok())
-          ? OptimizeFunctionGraphOrReadFromFileCache(
-                function_name, attrs, options, *dev_set, lib_def_,
-                composite_devices, cpu_device, default_device, env_)
-          : OptimizedFunctionGraphInfo::FromProto(
-                std::move(optimized_graph_proto.value().value()));
+  StatusOr<OptimizedFunctionGraphInfo> optimized_graph_info;
+  if (optimized_graph_proto.has_value() && optimized_graph_proto->ok()) {
+    optimized_graph_info = OptimizedFunctionGraphInfo::FromProto(
+        std::move(optimized_graph_proto.value().value()));
+  } else if (use_instantiation_cache_ && IsInstantiationCacheable(options)) {
+    // Share the optimized graph with every other runtime in this process that
+    // instantiates the same function on the same devices.
+    TF_ASSIGN_OR_RETURN(
+        const uint64 cache_key,
+        InstantiationCacheKey(
+            function_name, attrs, options,
+            options.lib_def != nullptr ? *options.lib_def : *lib_def_,
+            *dev_set, composite_devices, default_device));
+    FunctionInstantiationCache* cache = FunctionInstantiationCache::Global();
+    FunctionInstantiationCache::Entry entry = cache->Lookup(cache_key);
+    if (entry != nullptr) {
+      VLOG(1) << "Reusing the optimized graph of function \"" << function_name
+              << "\" from the function instantiation cache.";
+    } else {
+      StatusOr<OptimizedFunctionGraphInfo> optimized =
+          OptimizeFunctionGraphOrReadFromFileCache(
+              function_name, attrs, options, *dev_set, lib_def_,
+              composite_devices, cpu_device, default_device, env_);
+      if (!optimized.ok()) return optimized.status();
+      entry = cache->Insert(cache_key, std::move(*optimized));
+    }
+    optimized_graph_info = CopyOptimizedFunctionGraphInfo(*entry);
+    mutex_lock l(mu_);
+    instantiation_cache_entries_.emplace(cache_key, std::move(entry));
+  } else {
+    optimized_graph_info = OptimizeFunctionGraphOrReadFromFileCache(
+        function_name, attrs, options, *dev_set, lib_def_, composite_devices,
+        cpu_device, default_device, env_);
+  }
   if (!optimized_graph_info.ok()) return optimized_graph_info.status();
 
   // Resets the library registration correctly.
@@ -22,9 +22,11 @@ limitations under the License.
 #include <unordered_map>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "tensorflow/core/common_runtime/composite_device.h"
 #include "tensorflow/core/common_runtime/device_mgr.h"
 #include "tensorflow/core/common_runtime/device_set.h"
+#include "tensorflow/core/common_runtime/function_instantiation_cache.h"
 #include "tensorflow/core/common_runtime/stats_publisher_interface.h"
 #include "tensorflow/core/framework/function.h"
 #include "tensorflow/core/framework/graph.pb.h"
@@ -536,6 +538,17 @@ class ProcessFunctionLibraryRuntime {
   // instantiated function.
   std::vector<std::unique_ptr<StatsPublisherInterface>> stats_publishers_
       TF_GUARDED_BY(mu_);
+
+  // Whether multi-device function instantiations consult the process-wide
+  // FunctionInstantiationCache. Set by the TF_FUNCTION_INSTANTIATION_CACHE
+  // environment variable.
+  const bool use_instantiation_cache_;
+  // References to the FunctionInstantiationCache entries used by this runtime,
+  // by cache key. They keep the shared optimized graphs alive for other
+  // runtimes loading the same functions, and are released when this runtime
+  // is destroyed.
+  absl::flat_hash_map<uint64, FunctionInstantiationCache::Entry>
+      instantiation_cache_entries_ TF_GUARDED_BY(mu_);
 };
 
 }  // namespace tensorflow
@@ -37,6 +37,7 @@ limitations under the License.
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/lib/monitoring/cell_reader.h"
 #include "tensorflow/core/lib/strings/str_util.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/protobuf/config.pb.h"
@@ -1409,5 +1410,87 @@ TEST_F(ProcessFunctionLibraryRuntimeTest, RecordAotSavingTimeAndHitCount) {
             1);
 }
 
+TEST_F(ProcessFunctionLibraryRuntimeTest, ShareInstantiationAcrossRuntimes) {
+  monitoring::testing::CellReader<int64_t> cache_requests(
+      "/tensorflow/core/function_instantiation_cache/requests");
+  setenv("TF_FUNCTION_INSTANTIATION_CACHE", "1", /*overwrite=*/1);
+  const FunctionLibraryRuntime::InstantiateOptions inst_opts =
+      MakeOptions("CPU:0", {"CPU:0"}, {"CPU:0"});
+  FunctionLibraryRuntime::Options opts;
+  const Tensor x = test::AsTensor<float>({3, 5, 17, 257});
+
+  Init({test::function::ControlFlow()});
+  Tensor y;
+  TF_CHECK_OK(Run("ControlFlow", opts, {}, inst_opts, {x}, {&y}));
+  test::ExpectTensorEqual<float>(y, x);
+  EXPECT_EQ(cache_requests.Delta("miss"), 1);
+  EXPECT_EQ(cache_requests.Delta("hit"), 0);
+  EXPECT_EQ(FunctionInstantiationCache::Global()->Size(), 1);
+
+  // A second runtime over an identical library reuses the optimized graph for
+  // as long as the first one is alive.
+  std::unique_ptr<FunctionLibraryDefinition> first_lib_def =
+      std::move(lib_def_);
+  std::unique_ptr<TestClusterFLR> first_cluster_flr = std::move(cluster_flr_);
+  std::unique_ptr<ProcessFunctionLibraryRuntime> first_proc_flr =
+      std::move(proc_flr_);
+  Init({test::function::ControlFlow()});
+  TF_CHECK_OK(Run("ControlFlow", opts, {}, inst_opts, {x}, {&y}));
+  test::ExpectTensorEqual<float>(y, x);
+  EXPECT_EQ(cache_requests.Delta("miss"), 0);
+  EXPECT_EQ(cache_requests.Delta("hit"), 1);
+
+  // The entry is released together with the last runtime that uses it.
+  first_proc_flr.reset();
+  EXPECT_EQ(FunctionInstantiationCache::Global()->Size(), 1);
+  proc_flr_.reset();
+  EXPECT_EQ(FunctionInstantiationCache::Global()->Size(), 0);
+  unsetenv("TF_FUNCTION_INSTANTIATION_CACHE");
+}
+
+// Measures the time to instantiate the same multi-device function in
+// `num_runtimes` runtimes that are alive at the same time, as when several
+// versions of a model are loaded side by side.
+void BM_InstantiateInManyRuntimes(::testing::benchmark::State& state) {
+  const int num_runtimes = state.range(0);
+  const bool use_cache = state.range(1);
+  if (use_cache) {
+    setenv("TF_FUNCTION_INSTANTIATION_CACHE", "1", /*overwrite=*/1);
+  } else {
+    unsetenv("TF_FUNCTION_INSTANTIATION_CACHE");
+  }
+
+  SessionOptions session_options;
+  (*session_options.config.mutable_device_count())["CPU"] = 2;
+  std::vector<std::unique_ptr<Device>> devices;
+  TF_CHECK_OK(DeviceFactory::AddDevices(
+      session_options, "/job:a/replica:0/task:0", &devices));
+  StaticDeviceMgr device_mgr(std::move(devices));
+  FunctionDefLibrary proto;
+  *proto.add_function() = test::function::ControlFlow();
+  FunctionLibraryDefinition lib_def(OpRegistry::Global(), proto);
+  const FunctionLibraryRuntime::InstantiateOptions inst_opts =
+      MakeOptions("CPU:0", {"CPU:0"}, {"CPU:0"});
+
+  for (auto s : state) {
+    std::vector<std::unique_ptr<ProcessFunctionLibraryRuntime>> runtimes;
+    for (int i = 0; i < num_runtimes; ++i) {
+      runtimes.push_back(std::make_unique<ProcessFunctionLibraryRuntime>(
+          &device_mgr, Env::Default(), /*config=*/nullptr,
+          TF_GRAPH_DEF_VERSION, &lib_def, OptimizerOptions()));
+      FunctionLibraryRuntime::Handle handle;
+      TF_CHECK_OK(runtimes.back()->Instantiate("ControlFlow", AttrSlice(),
+                                               inst_opts, &handle));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * num_runtimes);
+  unsetenv("TF_FUNCTION_INSTANTIATION_CACHE");
+}
+BENCHMARK(BM_InstantiateInManyRuntimes)
+    ->ArgPair(1, 0)
+    ->ArgPair(1, 1)
+    ->ArgPair(16, 0)
+    ->ArgPair(16, 1);
+
 }  // anonymous namespace
 }  // namespace tensorflow
@@ -15,18 +15,26 @@ limitations under the License.
 
 #include "tensorflow/core/common_runtime/single_threaded_executor.h"
 
+#include <algorithm>
 #include <utility>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "Eigen/Core"  // from @eigen_archive
 #include "tensorflow/core/common_runtime/entry.h"
 #include "tensorflow/core/common_runtime/executor.h"
 #include "tensorflow/core/common_runtime/executor_factory.h"
 #include "tensorflow/core/common_runtime/renamed_device.h"
+#include "tensorflow/core/framework/memory_types.h"
 #include "tensorflow/core/graph/algorithm.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/status.h"
 #include "tensorflow/core/lib/gtl/cleanup.h"
 #include "tensorflow/core/platform/errors.h"
 #include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/profiler/lib/traceme.h"
+#include "tensorflow/core/profiler/lib/traceme_encode.h"
+#include "tensorflow/core/util/env_var.h"
 
 namespace tensorflow {
 
@@ -68,10 +76,176 @@ typedef gtl::InlinedVector<AllocatorAttributes, 4> AllocatorAttributeVec;
 static const string& kSingleThreadedExecutor =
     *new string("SINGLE_THREADED_EXECUTOR");
 
+// Unary elementwise ops on float tensors that the executor runs as a single
+// fused loop when they form a chain.
+enum class FusedCwiseOp {
+  kIdentity,
+  kNeg,
+  kAbs,
+  kSquare,
+  kSqrt,
+  kRsqrt,
+  kExp,
+  kLog,
+  kTanh,
+  kSigmoid,
+  kRelu,
+  kReciprocal,
+  kFloor,
+  kCeil,
+  kSin,
+  kCos,
+};
+
+// Returns true and sets `*op` if `type_string` names a fusible op.
+bool LookUpFusedCwiseOp(absl::string_view type_string, FusedCwiseOp* op) {
+  static const auto* const kFusibleOps =
+      new absl::flat_hash_map<absl::string_view, FusedCwiseOp>({
+          {"Identity", FusedCwiseOp::kIdentity},
+          {"Neg", FusedCwiseOp::kNeg},
+          {"Abs", FusedCwiseOp::kAbs},
+          {"Square", FusedCwiseOp::kSquare},
+          {"Sqrt", FusedCwiseOp::kSqrt},
+          {"Rsqrt", FusedCwiseOp::kRsqrt},
+          {"Exp", FusedCwiseOp::kExp},
+          {"Log", FusedCwiseOp::kLog},
+          {"Tanh", FusedCwiseOp::kTanh},
+          {"Sigmoid", FusedCwiseOp::kSigmoid},
+          {"Relu", FusedCwiseOp::kRelu},
+          {"Reciprocal", FusedCwiseOp::kReciprocal},
+          {"Inv", FusedCwiseOp::kReciprocal},
+          {"Floor", FusedCwiseOp::kFloor},
+          {"Ceil", FusedCwiseOp::kCeil},
+          {"Sin", FusedCwiseOp::kSin},
+          {"Cos", FusedCwiseOp::kCos},
+      });
+  auto it = kFusibleOps->find(type_string);
+  if (it == kFusibleOps->end()) return false;
+  *op = it->second;
+  return true;
+}
+
+bool IsFusibleCwiseNode(const Node* n) {
+  FusedCwiseOp op;
+  return LookUpFusedCwiseOp(n->type_string(), &op) && n->num_inputs() == 1 &&
+         n->num_outputs() == 1 && n->input_type(0) == DT_FLOAT &&
+         n->output_type(0) == DT_FLOAT;
+}
+
+// Applies `Functor` to `n` elements of `in`, writing them to `out`. `in` and
+// `out` may alias. The functors are the Eigen ones that the corresponding
+// kernels in cwise_ops.h are built from, so results match the unfused ops.
+template <typename Functor>
+void ApplyCwiseFunctor(const float* in, float* out, int64_t n) {
+  Eigen::Map<Eigen::ArrayXf>(out, n) =
+      Eigen::Map<const Eigen::ArrayXf>(in, n).unaryExpr(Functor());
+}
+
+void ApplyFusedCwiseOp(FusedCwiseOp op, const float* in, float* out,
+                       int64_t n) {
+  using namespace Eigen::internal;  // NOLINT
+  switch (op) {
+    case FusedCwiseOp::kIdentity:
+      if (in != out) std::copy_n(in, n, out);
+      return;
+    case FusedCwiseOp::kNeg:
+      return ApplyCwiseFunctor<scalar_opposite_op<float>>(in, out, n);
+    case FusedCwiseOp::kAbs:
+      return ApplyCwiseFunctor<scalar_abs_op<float>>(in, out, n);
+    case FusedCwiseOp::kSquare:
+      return ApplyCwiseFunctor<scalar_square_op<float>>(in, out, n);
+    case FusedCwiseOp::kSqrt:
+      return ApplyCwiseFunctor<scalar_sqrt_op<float>>(in, out, n);
+    case FusedCwiseOp::kRsqrt:
+      return ApplyCwiseFunctor<scalar_rsqrt_op<float>>(in, out, n);
+    case FusedCwiseOp::kExp:
+      return ApplyCwiseFunctor<scalar_exp_op<float>>(in, out, n);
+    case FusedCwiseOp::kLog:
+      return ApplyCwiseFunctor<scalar_log_op<float>>(in, out, n);
+    case FusedCwiseOp::kTanh:
+      return ApplyCwiseFunctor<scalar_tanh_op<float>>(in, out, n);
+    case FusedCwiseOp::kSigmoid:
+      return ApplyCwiseFunctor<scalar_logistic_op<float>>(in, out, n);
+    case FusedCwiseOp::kRelu:
+      // Matches the Relu kernel, which computes `cwiseMax(0)`.
+      Eigen::Map<Eigen::ArrayXf>(out, n) =
+          Eigen::Map<const Eigen::ArrayXf>(in, n).cwiseMax(0.0f);
+      return;
+    case FusedCwiseOp::kReciprocal:
+      return ApplyCwiseFunctor<scalar_inverse_op<float>>(in, out, n);
+    case FusedCwiseOp::kFloor:
+      return ApplyCwiseFunctor<scalar_floor_op<float>>(in, out, n);
+    case FusedCwiseOp::kCeil:
+      return ApplyCwiseFunctor<scalar_ceil_op<float>>(in, out, n);
+    case FusedCwiseOp::kSin:
+      return ApplyCwiseFunctor<scalar_sin_op<float>>(in, out, n);
+    case FusedCwiseOp::kCos:
+      return ApplyCwiseFunctor<scalar_cos_op<float>>(in, out, n);
+  }
+}
+
+// Runs `ops` in order over `n` elements of `in`, writing the result to `out`,
+// which may alias `in`. The input is processed in blocks small enough to stay
+// in L1 cache, so the intermediate results of the chain never reach memory.
+void RunFusedCwiseOps(const std::vector<FusedCwiseOp>& ops, const float* in,
+                      float* out, int64_t n) {
+  constexpr int64_t kBlockSize = 1024;
+  for (int64_t start = 0; start < n; start += kBlockSize) {
+    const int64_t block_size = std::min(kBlockSize, n - start);
+    const float* block_in = in + start;
+    float* block_out = out + start;
+    for (FusedCwiseOp op : ops) {
+      ApplyFusedCwiseOp(op, block_in, block_out, block_size);
+      block_in = block_out;
+    }
+  }
+}
+
+// Finds maximal chains of at least two fusible elementwise nodes in which
+// each node's only consumer is the next node, and the next node has no other
+// inputs (including control inputs). Such a chain can be evaluated at the
+// position of its head in `ordered_nodes` without affecting any other node.
+// Fills `chains` with the remaining members of the chain keyed by its head,
+// and `fused_nodes` with all non-head members.
+void FindFusibleCwiseChains(
+    const std::vector<Node*>& ordered_nodes,
+    absl::flat_hash_map<const Node*, std::vector<const Node*>>* chains,
+    absl::flat_hash_set<const Node*>* fused_nodes) {
+  for (const Node* n : ordered_nodes) {
+    if (fused_nodes->contains(n) || !IsFusibleCwiseNode(n)) continue;
+    std::vector<const Node*> rest;
+    const Node* cur = n;
+    while (cur->out_edges().size() == 1) {
+      const Edge* e = *cur->out_edges().begin();
+      const Node* next = e->dst();
+      if (e->IsControlEdge() || next->in_edges().size() != 1 ||
+          !IsFusibleCwiseNode(next)) {
+        break;
+      }
+      rest.push_back(next);
+      cur = next;
+    }
+    if (rest.empty()) continue;
+    fused_nodes->insert(rest.begin(), rest.end());
+    (*chains)[n] = std::move(rest);
+  }
+}
+
 class SingleThreadedExecutorImpl : public Executor {
  public:
   explicit SingleThreadedExecutorImpl(const LocalExecutorParams& params)
-      : params_(params) {}
+      : params_(params) {
+    // Off by default: the interior nodes of a fused chain are not run as
+    // kernels, so they don't show in step stats or profiles of their own.
+    bool fuse_cwise_ops = false;
+    const Status s = ReadBoolFromEnvVar(
+        "TF_SINGLE_THREADED_EXECUTOR_FUSE_CWISE_OPS", false, &fuse_cwise_ops);
+    if (!s.ok()) {
+      LOG(ERROR) << s.message();
+    }
+    fuse_cwise_ops_ = fuse_cwise_ops && params_.device != nullptr &&
+                      params_.device->device_type() == DEVICE_CPU;
+  }
 
   ~SingleThreadedExecutorImpl() override {
     for (const KernelState& kernel_state : kernels_) {
@@ -104,6 +278,14 @@ class SingleThreadedExecutorImpl : public Executor {
     std::map<size_t, Node*> arg_index_to_node_map;
     absl::flat_hash_map<Node*, size_t> node_to_index_map;
 
+    // Chains of elementwise ops are run as a single kernel: the head of the
+    // chain keeps its kernel, and the remaining members get none.
+    absl::flat_hash_map<const Node*, std::vector<const Node*>> fused_chains;
+    absl::flat_hash_set<const Node*> fused_nodes;
+    if (fuse_cwise_ops_) {
+      FindFusibleCwiseChains(ordered_nodes, &fused_chains, &fused_nodes);
+    }
+
     // Create the kernel and input-related structures for each node in `graph`.
     for (Node* n : ordered_nodes) {
       if (n->IsSource() || n->IsSink()) {
@@ -123,6 +305,9 @@ class SingleThreadedExecutorImpl : public Executor {
         // argument handling directly in the executor code.
         continue;
       }
+      if (fused_nodes.contains(n)) {
+        continue;
+      }
 
       OpKernel* kernel;
       TF_RETURN_IF_ERROR(params_.create_kernel(n->properties(), &kernel));
@@ -147,6 +332,15 @@ class SingleThreadedExecutorImpl : public Executor {
         kernel_state.kernel = kernel;
         kernel_state.num_inputs = n->num_inputs();
         kernel_state.num_outputs = n->num_outputs();
+        auto chain = fused_chains.find(n);
+        if (chain != fused_chains.end()) {
+          kernel_state.fused_ops.resize(chain->second.size() + 1);
+          LookUpFusedCwiseOp(n->type_string(), &kernel_state.fused_ops[0]);
+          for (size_t j = 0; j < chain->second.size(); ++j) {
+            LookUpFusedCwiseOp(chain->second[j]->type_string(),
+                               &kernel_state.fused_ops[j + 1]);
+          }
+        }
         node_to_index_map[n] = kernel_index;
         if (kernel_index == 0) {
           kernel_state.input_start_index = 0;
@@ -210,7 +404,11 @@ class SingleThreadedExecutorImpl : public Executor {
       Node* n = nodes_with_kernels[i];
       KernelState& kernel_state = kernels_[i];
       kernel_state.output_locations.resize(kernel_state.num_outputs);
-      for (const Edge* e : n->out_edges()) {
+      // The outputs of a fused chain are those of its last member.
+      auto chain = fused_chains.find(n);
+      const Node* output_node =
+          chain == fused_chains.end() ? n : chain->second.back();
+      for (const Edge* e : output_node->out_edges()) {
         if (!e->IsControlEdge()) {
           kernel_state.output_locations[e->src_output()].push_back(
               kernels_[node_to_index_map[e->dst()]].input_start_index +
@@ -224,9 +422,21 @@ class SingleThreadedExecutorImpl : public Executor {
       AllocatorAttributes* attrs = kernel_state.output_alloc_attrs.data();
 
       OpKernel* op_kernel = kernel_state.kernel;
+      MemoryTypeVector output_memory_types = op_kernel->output_memory_types();
+      if (output_node != n) {
+        // The interior and last members of a fused chain have no kernel.
+        MemoryTypeVector tail_input_memory_types;
+        TF_RETURN_IF_ERROR(MemoryTypesForNode(
+            graph.op_registry(), DeviceType(params_.device->device_type()),
+            output_node->def(), &tail_input_memory_types,
+            &output_memory_types));
+        kernel_state.fused_input_memory_type =
+            op_kernel->input_memory_types()[0];
+        kernel_state.fused_output_memory_type = output_memory_types[0];
+      }
       for (int out = 0; out < n->num_outputs(); out++) {
-        DCHECK_LT(out, op_kernel->output_memory_types().size());
-        bool on_host = op_kernel->output_memory_types()[out] == HOST_MEMORY;
+        DCHECK_LT(out, output_memory_types.size());
+        bool on_host = output_memory_types[out] == HOST_MEMORY;
         if (on_host) {
           AllocatorAttributes h;
           h.set_on_host(on_host);
@@ -414,6 +624,15 @@ class SingleThreadedExecutorImpl : public Executor {
       const size_t num_inputs = kernel_state.num_inputs;
       const size_t num_outputs = kernel_state.num_outputs;
 
+      if (!kernel_state.fused_ops.empty()) {
+        Tensor output;
+        TF_RETURN_IF_ERROR(RunFusedCwiseKernel(
+            kernel_state, device, &inputs[input_start_index], &output));
+        inputs[input_start_index].ClearVal();
+        PropagateOutput(kernel_state, 0, &output, &inputs);
+        continue;
+      }
+
       node_inputs.clear();
       node_inputs.resize(num_inputs);
       input_alloc_attrs.clear();
@@ -454,31 +673,7 @@ class SingleThreadedExecutorImpl : public Executor {
       // Forward the outputs of the kernel to the inputs of subsequent kernels.
       for (size_t j = 0; j < num_outputs; ++j) {
         TensorValue val = ctx.release_output(j);
-        const size_t num_destinations = kernel_state.output_locations[j].size();
-        if (num_destinations > 0) {
-          // TODO(mrry): Consider flattening the `output_locations` vector
-          // to improve the cache-friendliness of this loop.
-          for (size_t k = 0; k < num_destinations - 1; ++k) {
-            // TODO(mrry): Validate that the types match the expected values or
-            // ensure that the necessary validation has already happened.
-            Entry& input = inputs[kernel_state.output_locations[j][k]];
-            input.state = Entry::State::HAS_VALUE;
-            if (val.tensor != nullptr) {
-              input.val.Init(*val.tensor);
-            } else {
-              input.val.Init(Tensor(kernel_state.kernel->output_type(j)));
-            }
-          }
-          // Move `arg` to the last consumer to avoid the cost of copying it.
-          Entry& input =
-              inputs[kernel_state.output_locations[j][num_destinations - 1]];
-          input.state = Entry::State::HAS_VALUE;
-          if (val.tensor != nullptr) {
-            input.val.Init(std::move(*val.tensor));
-          } else {
-            input.val.Init(Tensor(kernel_state.kernel->output_type(j)));
-          }
-        }
+        PropagateOutput(kernel_state, j, val.tensor, &inputs);
         delete val.tensor;
       }
     }
@@ -486,6 +681,92 @@ class SingleThreadedExecutorImpl : public Executor {
   }
 
  private:
+  struct KernelState;
+
+  // Forwards output `j` of the kernel in `kernel_state` to the inputs of
+  // subsequent kernels. `val` may be null if the kernel did not produce the
+  // output; its contents are moved to the last consumer.
+  void PropagateOutput(const KernelState& kernel_state, size_t j, Tensor* val,
+                       std::vector<Entry>* inputs) const {
+    const size_t num_destinations = kernel_state.output_locations[j].size();
+    if (num_destinations == 0) return;
+    // TODO(mrry): Consider flattening the `output_locations` vector
+    // to improve the cache-friendliness of this loop.
+    for (size_t k = 0; k < num_destinations - 1; ++k) {
+      // TODO(mrry): Validate that the types match the expected values or
+      // ensure that the necessary validation has already happened.
+      Entry& input = (*inputs)[kernel_state.output_locations[j][k]];
+      input.state = Entry::State::HAS_VALUE;
+      if (val != nullptr) {
+        input.val.Init(*val);
+      } else {
+        input.val.Init(Tensor(kernel_state.kernel->output_type(j)));
+      }
+    }
+    // Move `arg` to the last consumer to avoid the cost of copying it.
+    Entry& input =
+        (*inputs)[kernel_state.output_locations[j][num_destinations - 1]];
+    input.state = Entry::State::HAS_VALUE;
+    if (val != nullptr) {
+      input.val.Init(std::move(*val));
+    } else {
+      input.val.Init(Tensor(kernel_state.kernel->output_type(j)));
+    }
+  }
+
+  // Runs the fused chain of elementwise ops in `kernel_state` on `input`,
+  // computing in place when `OpKernelContext::forward_input()` would forward
+  // `input` to the output of the chain.
+  Status RunFusedCwiseKernel(const KernelState& kernel_state, Device* device,
+                             Entry* input, Tensor* output) const {
+    profiler::TraceMe activity(
+        [&] {
+          return profiler::TraceMeEncode(
+              kernel_state.kernel->name(),
+              {{"fused_ops", kernel_state.fused_ops.size()}});
+        },
+        profiler::TraceMeLevel::kInfo);
+    const Tensor* in;
+    switch (input->state) {
+      case Entry::State::HAS_CONST_TENSOR:
+        in = input->const_tensor;
+        break;
+      case Entry::State::HAS_VALUE:
+        in = input->val.get();
+        break;
+      default:
+        return errors::Internal("Input did not have a valid value.");
+    }
+    if (TF_PREDICT_FALSE(in->dtype() != DT_FLOAT)) {
+      return errors::InvalidArgument(
+          "Expected a float input to fused elementwise op ",
+          kernel_state.kernel->name(), ", but got ",
+          DataTypeString(in->dtype()));
+    }
+    const AllocatorAttributes& output_attr = kernel_state.output_alloc_attrs[0];
+    if (input->state == Entry::State::HAS_VALUE && in->RefCountIsOne() &&
+        kernel_state.fused_input_memory_type ==
+            kernel_state.fused_output_memory_type &&
+        output_attr.IsEqualOrLessRestrictiveThan(
+            input_alloc_attrs_[kernel_state.input_start_index])) {
+      *output = std::move(*input->val);
+      float* data = output->flat<float>().data();
+      RunFusedCwiseOps(kernel_state.fused_ops, data, data,
+                       output->NumElements());
+      return absl::OkStatus();
+    }
+    *output = Tensor(device->GetAllocator(output_attr), DT_FLOAT, in->shape());
+    if (TF_PREDICT_FALSE(!output->IsInitialized())) {
+      return errors::ResourceExhausted(
+          "OOM when allocating output of fused elementwise op ",
+          kernel_state.kernel->name(), " with shape ",
+          in->shape().DebugString());
+    }
+    RunFusedCwiseOps(kernel_state.fused_ops, in->flat<float>().data(),
+                     output->flat<float>().data(), output->NumElements());
+    return absl::OkStatus();
+  }
+
   // Execute all operations in the calling thread when asynchronous execution
   // is requested. Callers may expect to perform expensive work in the calling
   // thread even when the execution itself is single-threaded.
@@ -497,6 +778,9 @@ class SingleThreadedExecutorImpl : public Executor {
 
   const LocalExecutorParams params_;
 
+  // Whether chains of elementwise ops are fused. Only supported on CPU.
+  bool fuse_cwise_ops_;
+
   // All following members are read-only after Initialize().
 
   // The sum of the number of inputs for each node in the graph. This determines
@@ -528,6 +812,16 @@ class SingleThreadedExecutorImpl : public Executor {
     // Memory space information for each output of `kernel`.
     std::vector<AllocatorAttributes>
         output_alloc_attrs;  // Length = `num_outputs`.
+
+    // If non-empty, `kernel` is the head of a chain of elementwise ops that
+    // are run together as these fused ops, instead of calling `kernel`.
+    // `output_alloc_attrs` are then those of the last op of the chain.
+    std::vector<FusedCwiseOp> fused_ops;
+
+    // Memory types of the input of the first op and of the output of the
+    // last op of the fused chain.
+    MemoryType fused_input_memory_type = DEVICE_MEMORY;
+    MemoryType fused_output_memory_type = DEVICE_MEMORY;
   };
   std::vector<KernelState> kernels_;
 
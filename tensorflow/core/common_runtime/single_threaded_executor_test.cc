@@ -14,6 +14,7 @@ limitations under the License.
 ==============================================================================*/
 
 #include <algorithm>
+#include <cmath>
 #include <functional>
 #include <string>
 #include <utility>
@@ -357,6 +358,66 @@ TEST_F(ExecutorTest, ControlDependenciesFromSpecialNodes) {
   EXPECT_EQ(3.0, V(retvals[0]));  // out = 1.0 + 2.0 = 3.0
 }
 
+TEST_F(ExecutorTest, FusedCwiseChain) {
+  // out = square(exp(neg(in))), which is run as a single fused kernel.
+  auto g = std::make_unique<Graph>(OpRegistry::Global());
+  auto in = test::graph::Arg(g.get(), 0, DT_FLOAT);
+  auto neg = test::graph::Unary(g.get(), "Neg", in);
+  auto exp = test::graph::Unary(g.get(), "Exp", neg);
+  auto square = test::graph::Unary(g.get(), "Square", exp);
+  test::graph::Retval(g.get(), 0, square);
+  FixupSourceAndSinkEdges(g.get());
+  // Fusion is off by default.
+  setenv("TF_SINGLE_THREADED_EXECUTOR_FUSE_CWISE_OPS", "1", 1);
+  Create(std::move(g));
+  unsetenv("TF_SINGLE_THREADED_EXECUTOR_FUSE_CWISE_OPS");
+
+  // Spans several blocks of the fused loop.
+  const int kSize = 3000;
+  Tensor arg(DT_FLOAT, TensorShape({kSize}));
+  for (int i = 0; i < kSize; ++i) {
+    arg.flat<float>()(i) = i / 1000.0f;
+  }
+  FunctionCallFrame call_frame({DT_FLOAT}, {DT_FLOAT});
+  TF_ASSERT_OK(call_frame.SetArgs({arg}));
+  TF_ASSERT_OK(Run(&call_frame));
+  std::vector<Tensor> retvals;
+  TF_ASSERT_OK(call_frame.ConsumeRetvals(&retvals, false));
+  ASSERT_EQ(kSize, retvals[0].NumElements());
+  for (int i = 0; i < kSize; ++i) {
+    const float expected = std::exp(-(i / 1000.0f));
+    EXPECT_FLOAT_EQ(expected * expected, retvals[0].flat<float>()(i));
+  }
+  // The argument is not modified in place.
+  const Tensor* arg_0;
+  TF_ASSERT_OK(call_frame.GetArg(0, &arg_0));
+  EXPECT_EQ(1.0f, arg_0->flat<float>()(1000));
+}
+
+TEST_F(ExecutorTest, FusedCwiseChainWithFanOut) {
+  // out = exp(neg(in)) + abs(neg(in)): `neg` has two consumers, so only the
+  // chains that do not cross it are fused.
+  auto g = std::make_unique<Graph>(OpRegistry::Global());
+  auto in = test::graph::Arg(g.get(), 0, DT_FLOAT);
+  auto neg = test::graph::Unary(g.get(), "Neg", in);
+  auto exp = test::graph::Unary(g.get(), "Exp", neg);
+  auto exp_sqrt = test::graph::Unary(g.get(), "Sqrt", exp);
+  auto abs = test::graph::Unary(g.get(), "Abs", neg);
+  auto add = test::graph::Add(g.get(), exp_sqrt, abs);
+  test::graph::Retval(g.get(), 0, add);
+  FixupSourceAndSinkEdges(g.get());
+  // Fusion is off by default.
+  setenv("TF_SINGLE_THREADED_EXECUTOR_FUSE_CWISE_OPS", "1", 1);
+  Create(std::move(g));
+  unsetenv("TF_SINGLE_THREADED_EXECUTOR_FUSE_CWISE_OPS");
+  FunctionCallFrame call_frame({DT_FLOAT}, {DT_FLOAT});
+  TF_ASSERT_OK(call_frame.SetArgs({V(2.0)}));
+  TF_ASSERT_OK(Run(&call_frame));
+  std::vector<Tensor> retvals;
+  TF_ASSERT_OK(call_frame.ConsumeRetvals(&retvals, false));
+  EXPECT_FLOAT_EQ(std::exp(-1.0f) + 2.0f, V(retvals[0]));
+}
+
 void BM_executor(::testing::benchmark::State& state) {
   const int width = state.range(0);
   const int depth = state.range(1);
@@ -436,6 +497,39 @@ BENCHMARK(BM_const_identity)->UseRealTime()->ArgPair(1, 100);
 BENCHMARK(BM_const_identity)->UseRealTime()->ArgPair(100, 1);
 BENCHMARK(BM_const_identity)->UseRealTime()->ArgPair(100, 100);
 
+// Runs a chain of `chain_length` elementwise ops over a 64K-element float
+// tensor, with or without fusing the chain into a single loop.
+void BM_CwiseChain(::testing::benchmark::State& state) {
+  const int chain_length = state.range(0);
+  const bool fuse = state.range(1);
+
+  Graph* g = new Graph(OpRegistry::Global());
+  Tensor input(DT_FLOAT, TensorShape({64 << 10}));
+  input.flat<float>().setConstant(0.5f);
+  Node* n = test::graph::Constant(g, input);
+  static const char* const kOps[] = {"Neg", "Exp", "Tanh", "Abs", "Sqrt"};
+  for (int i = 0; i < chain_length; ++i) {
+    n = test::graph::Unary(g, kOps[i % 5], n);
+  }
+  FixupSourceAndSinkEdges(g);
+  setenv("TF_SINGLE_THREADED_EXECUTOR_FUSE_CWISE_OPS", fuse ? "1" : "0", 1);
+  test::Benchmark("cpu", g, nullptr, nullptr, nullptr,
+                  "SINGLE_THREADED_EXECUTOR", /*old_benchmark_api=*/false)
+      .Run(state);
+  unsetenv("TF_SINGLE_THREADED_EXECUTOR_FUSE_CWISE_OPS");
+  state.SetItemsProcessed(input.NumElements() * chain_length *
+                          static_cast<int64_t>(state.iterations()));
+}
+
+BENCHMARK(BM_CwiseChain)
+    ->UseRealTime()
+    ->ArgPair(10, false)
+    ->ArgPair(10, true)
+    ->ArgPair(20, false)
+    ->ArgPair(20, true)
+    ->ArgPair(50, false)
+    ->ArgPair(50, true);
+
 // TODO(mrry): This benchmark currently crashes with a use-after free, because
 // test::Benchmark::RunWithArgs() assumes that the executor will take ownership
 // of the given graph, *and* keep its nodes (`x`, `y` and `z`) alive for the
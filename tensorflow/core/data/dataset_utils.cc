@@ -91,6 +91,7 @@ constexpr char kShuffleAndRepeatFusionOpt[] = "shuffle_and_repeat_fusion";
 constexpr char kFilterFusionOpt[] = "filter_fusion";
 constexpr char kMapAndFilterFusionOpt[] = "map_and_filter_fusion";
 constexpr char kMapFusionOpt[] = "map_fusion";
+constexpr char kMapVectorizationOpt[] = "map_vectorization";
 constexpr char kParallelBatchOpt[] = "parallel_batch";
 constexpr char kAutotuneBufferSizesOpt[] = "autotune_buffer_sizes";
 constexpr char kDisablePrefetchLegacyAutotuneOpt[] =
@@ -233,6 +234,14 @@ void DefaultOptimizationGraphRewrites(
       optimization_disabled->insert(kSeqInterleavePrefetchOpt);
     }
   }
+  if (optimization_options.optional_map_vectorization_case() ==
+      OptimizationOptions::kMapVectorization) {
+    if (optimization_options.map_vectorization()) {
+      optimization_enabled->insert(kMapVectorizationOpt);
+    } else {
+      optimization_disabled->insert(kMapVectorizationOpt);
+    }
+  }
 }
 
 // Returns whether an op has been allowlisted as stateless. Uses a heuristic to
@@ -673,6 +673,7 @@ GetOptimizationsTestCase GetOptimizationTestCase4() {
   options.mutable_optimization_options()->set_shuffle_and_repeat_fusion(true);
   options.mutable_optimization_options()->set_inject_prefetch(true);
   options.mutable_optimization_options()->set_seq_interleave_prefetch(true);
+  options.mutable_optimization_options()->set_map_vectorization(true);
   options.set_slack(true);
   return {options,
           /*expected_enabled=*/
@@ -680,7 +681,7 @@ GetOptimizationsTestCase GetOptimizationTestCase4() {
            "map_and_batch_fusion", "map_and_filter_fusion", "map_fusion",
            "map_parallelization", "noop_elimination", "parallel_batch",
            "shuffle_and_repeat_fusion", "slack", "inject_prefetch",
-           "seq_interleave_prefetch"},
+           "seq_interleave_prefetch", "map_vectorization"},
           /*expected_disabled=*/{},
           /*expected_default=*/{}};
 }
@@ -29,6 +29,7 @@ limitations under the License.
 #include "tensorflow/core/grappler/grappler_item.h"
 #include "tensorflow/core/grappler/op_types.h"
 #include "tensorflow/core/grappler/utils.h"
+#include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/util/overflow.h"
 
 namespace tensorflow {
@@ -154,6 +155,14 @@ Status AnalyticalCostEstimator::Initialize(const GrapplerItem& item) {
   return absl::OkStatus();
 }
 
+Status AnalyticalCostEstimator::LoadCalibration(const string& filename) {
+  OpCostCalibration calibration;
+  TF_RETURN_IF_ERROR(
+      ReadTextOrBinaryProto(Env::Default(), filename, &calibration));
+  node_estimator_->SetCalibration(calibration);
+  return absl::OkStatus();
+}
+
 Status AnalyticalCostEstimator::PredictCosts(const GraphDef& optimized_graph,
                                              RunMetadata* run_metadata,
                                              Costs* costs) const {
@@ -58,6 +58,10 @@ class AnalyticalCostEstimator : public CostEstimator {
   // This implementation always returns OK.
   Status Initialize(const GrapplerItem& item) override;
 
+  // Loads a calibration of the op level cost estimator, as written by
+  // WriteOpCostCalibration(), from a text or binary proto file.
+  Status LoadCalibration(const string& filename);
+
   // Predict the performance of each node of the optimized graph and annotate
   // the RunMetadata with the corresponding estimates. Also returns the
   // expected cost for the whole graph.
@@ -18,7 +18,9 @@ limitations under the License.
 #include "tensorflow/cc/ops/standard_ops.h"
 #include "tensorflow/core/grappler/clusters/virtual_cluster.h"
 #include "tensorflow/core/grappler/costs/analytical_cost_estimator.h"
+#include "tensorflow/core/grappler/costs/op_cost_calibration.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/io/path.h"
 #include "tensorflow/core/platform/test.h"
 
 namespace tensorflow {
@@ -115,5 +117,33 @@ TEST_F(AnalyticalCostEstimatorTest, SimpleTest) {
   EXPECT_EQ(0, summary.num_ops_with_unknown_shapes);
 }
 
+TEST_F(AnalyticalCostEstimatorTest, LoadCalibration) {
+  GrapplerItem item = CreateMiniGraph();
+
+  // A GPU much slower at convolutions than its peak performance. The graph is
+  // placed on the GPU.
+  OpCostCalibration calibration;
+  calibration.mutable_device()->set_type("GPU");
+  calibration.mutable_device()->set_num_cores(12);
+  (*calibration.mutable_op_class())["Convolution"].set_gigaops(0.1);
+  const string filename =
+      io::JoinPath(testing::TmpDir(), "op_cost_calibration.pbtxt");
+  TF_ASSERT_OK(WriteOpCostCalibration(filename, calibration));
+
+  AnalyticalCostEstimator estimator(cluster_.get(), /*use_static_shapes=*/true,
+                                    /*use_aggressive_shape_inference=*/true);
+  EXPECT_FALSE(estimator.LoadCalibration(filename + ".missing").ok());
+  TF_ASSERT_OK(estimator.LoadCalibration(filename));
+  TF_ASSERT_OK(estimator.Initialize(item));
+
+  RunMetadata run_metadata;
+  Costs summary;
+  TF_ASSERT_OK(estimator.PredictCosts(item.graph, &run_metadata, &summary));
+
+  // The 451584 operations of the convolution take 4.5ms.
+  EXPECT_GT(summary.execution_time, Costs::MicroSeconds(4500));
+  EXPECT_EQ(15, summary.num_ops_total);
+}
+
 }  // end namespace grappler
 }  // end namespace tensorflow
@@ -37,7 +37,10 @@ limitations under the License.
 #include "tensorflow/core/grappler/utils/topological_sort.h"
 #include "tensorflow/core/lib/gtl/cleanup.h"
 #include "tensorflow/core/lib/gtl/flatset.h"
+#include "tensorflow/core/lib/strings/proto_serialization.h"
 #include "tensorflow/core/lib/strings/str_util.h"
+#include "tensorflow/core/platform/fingerprint.h"
+#include "tensorflow/core/platform/mutex.h"
 
 namespace tensorflow {
 namespace grappler {
@@ -491,6 +494,42 @@ uint64 NumElementsFromTensorProto(const TensorProto& tensor_proto) {
   return num_elements;
 }
 
+// Output properties of the function bodies inferred so far, keyed by a
+// fingerprint of the body with the shapes and values of its arguments, and of
+// the functions it calls. Every call site of a function, every round of the
+// refiner and every grappler pass otherwise infers the same body again. The
+// cache is shared by all the GraphProperties of the process, and is dropped
+// when it grows too large.
+class FunctionShapeCache {
+ public:
+  static FunctionShapeCache* Global() {
+    static FunctionShapeCache* cache = new FunctionShapeCache;
+    return cache;
+  }
+
+  bool Lookup(uint64 key, std::vector<OpInfo::TensorProperties>* outputs) {
+    mutex_lock l(mu_);
+    auto it = entries_.find(key);
+    if (it == entries_.end()) return false;
+    *outputs = it->second;
+    return true;
+  }
+
+  void Insert(uint64 key,
+              const std::vector<OpInfo::TensorProperties>& outputs) {
+    mutex_lock l(mu_);
+    if (entries_.size() >= kMaxEntries) entries_.clear();
+    entries_.emplace(key, outputs);
+  }
+
+ private:
+  static constexpr int kMaxEntries = 4096;
+
+  mutex mu_;
+  absl::flat_hash_map<uint64, std::vector<OpInfo::TensorProperties>> entries_
+      TF_GUARDED_BY(mu_);
+};
+
 }  // namespace
 
 // Note that tensor_as_shape input should not include kUnknownDimFromConst.
@@ -936,42 +975,53 @@ class SymbolicShapeRefiner {
       output_node->mutable_attr()->erase("index");
     }
 
-    // Perform inference on function body.
-    GraphProperties gp(grappler_function_item);
-    TF_RETURN_IF_ERROR(gp.InferStatically(
-        /*assume_valid_feeds=*/true,
-        /*aggressive_shape_inference=*/aggressive_shape_inference_,
-        /*include_tensor_values=*/true));
-
-    // Add return nodes for output shapes.
-    int output = 0;
-    ctx->output_tensors_as_shapes.resize(grappler_function_item.output_size());
-    ctx->output_tensor_protos.resize(grappler_function_item.output_size(),
-                                     nullptr);
-    for (auto const& out_arg : grappler_function_item.outputs()) {
-      // It is guaranteed that output_tensors does not contain any control
-      // inputs, so port_id >= 0.
-      TensorId out_tensor = ParseTensorName(out_arg.node_name);
-
-      if (output_nodes.count(out_tensor.node()) <= 0) {
-        return errors::FailedPrecondition(
-            "Unable to find return function_node ", out_tensor.node(), " for ",
-            function_node->name());
+    // Perform inference on function body, unless the same body was inferred
+    // before with the same argument shapes and values.
+    const uint64 cache_key =
+        FunctionShapeCacheKey(function.name(), grappler_function_item.graph);
+    std::vector<OpInfo::TensorProperties> function_outputs;
+    if (!FunctionShapeCache::Global()->Lookup(cache_key, &function_outputs)) {
+      GraphProperties gp(grappler_function_item);
+      TF_RETURN_IF_ERROR(gp.InferStatically(
+          /*assume_valid_feeds=*/true,
+          /*aggressive_shape_inference=*/aggressive_shape_inference_,
+          /*include_tensor_values=*/true));
+
+      for (auto const& out_arg : grappler_function_item.outputs()) {
+        // It is guaranteed that output_tensors does not contain any control
+        // inputs, so port_id >= 0.
+        TensorId out_tensor = ParseTensorName(out_arg.node_name);
+
+        if (output_nodes.count(out_tensor.node()) <= 0) {
+          return errors::FailedPrecondition(
+              "Unable to find return function_node ", out_tensor.node(),
+              " for ", function_node->name());
+        }
+        const NodeDef* retnode = output_nodes[out_tensor.node()];
+
+        auto output_properties = gp.GetOutputProperties(retnode->name());
+        int output_properties_size = output_properties.size();
+        if (out_tensor.index() >= output_properties_size) {
+          return errors::InvalidArgument(
+              out_tensor.ToString(), " has invalid position ",
+              out_tensor.index(),
+              " (output_properties.size() = ", output_properties.size(), ").");
+        }
+        function_outputs.push_back(
+            std::move(output_properties[out_tensor.index()]));
+        NormalizeShapeForOutput(function_outputs.back().mutable_shape());
       }
-      const NodeDef* retnode = output_nodes[out_tensor.node()];
+      FunctionShapeCache::Global()->Insert(cache_key, function_outputs);
+    }
 
-      auto output_properties = gp.GetOutputProperties(retnode->name());
-      int output_properties_size = output_properties.size();
-      if (out_tensor.index() >= output_properties_size) {
-        return errors::InvalidArgument(
-            out_tensor.ToString(), " has invalid position ", out_tensor.index(),
-            " (output_properties.size() = ", output_properties.size(), ").");
-      }
-      auto& outprop = output_properties[out_tensor.index()];
-      TensorShapeProto shape = outprop.shape();
-      NormalizeShapeForOutput(&shape);
+    // Add return nodes for output shapes.
+    ctx->output_tensors_as_shapes.resize(function_outputs.size());
+    ctx->output_tensor_protos.resize(function_outputs.size(), nullptr);
+    for (int output = 0, end = function_outputs.size(); output < end;
+         ++output) {
+      const OpInfo::TensorProperties& outprop = function_outputs[output];
       ShapeHandle out;
-      TF_RETURN_IF_ERROR(ic->MakeShapeFromShapeProto(shape, &out));
+      TF_RETURN_IF_ERROR(ic->MakeShapeFromShapeProto(outprop.shape(), &out));
       ic->set_output(output, out);
       if (outprop.has_value()) {
         // Forward tensor value to output_tensors_as_shape.
@@ -980,12 +1030,36 @@ class SymbolicShapeRefiner {
         const_tensors_to_propagate_.push_back(outprop.value());
         ctx->output_tensor_protos[output] = &const_tensors_to_propagate_.back();
       }
-      output++;
     }
 
     return absl::OkStatus();
   }
 
+  // Returns the key of the output properties of the function body `body`,
+  // prepared for one of the calls of `function_name`, in the
+  // FunctionShapeCache.
+  uint64 FunctionShapeCacheKey(const string& function_name,
+                               const GraphDef& body) {
+    // The library of the body holds the functions reachable from
+    // `function_name`, and is the same for all of its calls.
+    auto it = function_library_fingerprints_.find(function_name);
+    if (it == function_library_fingerprints_.end()) {
+      string serialized;
+      SerializeToStringDeterministic(body.library(), &serialized);
+      it = function_library_fingerprints_
+               .emplace(function_name, Fingerprint64(serialized))
+               .first;
+    }
+    uint64 key = FingerprintCat64(it->second, graph_def_version_);
+    key = FingerprintCat64(key, aggressive_shape_inference_);
+    string serialized;
+    for (const NodeDef& node : body.node()) {
+      SerializeToStringDeterministic(node, &serialized);
+      key = FingerprintCat64(key, Fingerprint64(serialized));
+    }
+    return key;
+  }
+
   // Prepares input shapes/values/handles, then runs shape inference, and
   // finally sets output shapes/values/handles.
   Status UpdateNode(const NodeDef* node, bool* refined) {
@@ -2051,6 +2125,8 @@ class SymbolicShapeRefiner {
   // instantiation failed it will have an `absl::nullopt`.
   absl::flat_hash_map<string, absl::optional<GrapplerFunctionItem>>
       fun_to_grappler_function_item_;
+  // Fingerprints of the functions reachable from the instantiated functions.
+  absl::flat_hash_map<string, uint64> function_library_fingerprints_;
   FunctionLibraryDefinition function_library_;
   const absl::flat_hash_map<string, absl::flat_hash_set<int>>& fed_ports_;
   // Store TensorProtos for tensor value propagation. Note that we use deque,
@@ -2518,6 +2594,12 @@ Status GraphProperties::InferStatically(bool assume_valid_feeds,
                                         bool aggressive_shape_inference,
                                         bool include_input_tensor_values,
                                         bool include_output_tensor_values) {
+  inferred_statically_ = true;
+  assume_valid_feeds_ = assume_valid_feeds;
+  aggressive_shape_inference_ = aggressive_shape_inference;
+  include_input_tensor_values_ = include_input_tensor_values;
+  include_output_tensor_values_ = include_output_tensor_values;
+
   FunctionLibraryDefinition function_library(OpRegistry::Global(),
                                              item_.graph.library());
   absl::flat_hash_map<string, absl::flat_hash_set<int>> fed_ports;
@@ -2759,6 +2841,227 @@ Status GraphProperties::InferStatically(bool assume_valid_feeds,
   return absl::OkStatus();
 }
 
+Status GraphProperties::UpdateStatically(
+    const absl::flat_hash_set<string>& updated_nodes) {
+  if (!inferred_statically_) {
+    return errors::FailedPrecondition(
+        "UpdateStatically must be called after InferStatically.");
+  }
+  const auto infer_again = [this]() {
+    Clear();
+    incompatible_shape_nodes_.clear();
+    return InferStatically(assume_valid_feeds_, aggressive_shape_inference_,
+                           include_input_tensor_values_,
+                           include_output_tensor_values_);
+  };
+
+  GraphView graph_view(&item_.graph);
+
+  // Drop the properties of the nodes removed from the graph.
+  for (auto* properties : {&input_properties_, &output_properties_}) {
+    for (auto it = properties->begin(); it != properties->end();) {
+      if (graph_view.GetNode(it->first) == nullptr) {
+        properties->erase(it++);
+      } else {
+        ++it;
+      }
+    }
+  }
+  for (auto it = incompatible_shape_nodes_.begin();
+       it != incompatible_shape_nodes_.end();) {
+    if (graph_view.GetNode(*it) == nullptr) {
+      it = incompatible_shape_nodes_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  // Collect the transitive fanout of the updated nodes.
+  absl::flat_hash_set<const NodeDef*> fanout;
+  std::vector<const NodeDef*> to_visit;
+  for (const string& node_name : updated_nodes) {
+    const NodeDef* node = graph_view.GetNode(node_name);
+    if (node != nullptr && fanout.insert(node).second) {
+      to_visit.push_back(node);
+    }
+  }
+  while (!to_visit.empty()) {
+    const NodeDef* node = to_visit.back();
+    to_visit.pop_back();
+    for (const GraphView::InputPort& port :
+         graph_view.GetFanouts(*node, /*include_controlled_nodes=*/false)) {
+      if (fanout.insert(port.node).second) to_visit.push_back(port.node);
+    }
+  }
+  if (fanout.empty()) return absl::OkStatus();
+  if (2 * fanout.size() > static_cast<size_t>(item_.graph.node_size())) {
+    return infer_again();
+  }
+  for (const NodeDef* node : fanout) {
+    // Loops and queues propagate shapes out of the fanout of their inputs.
+    if (IsEnter(*node) || IsExit(*node) || IsMerge(*node) ||
+        IsNextIteration(*node) || IsQueue(*node) || IsEnqueue(*node) ||
+        IsDequeue(*node)) {
+      return infer_again();
+    }
+  }
+
+  // Infer the properties of the fanout alone, reading the tensors produced by
+  // the rest of the graph from Const nodes when their values are known, and
+  // from Placeholder nodes of their inferred shapes otherwise.
+  GrapplerItem fanout_item;
+  fanout_item.id = item_.id;
+  *fanout_item.graph.mutable_versions() = item_.graph.versions();
+  *fanout_item.graph.mutable_library() = item_.graph.library();
+  absl::flat_hash_set<string> fed_nodes;
+  if (!assume_valid_feeds_) {
+    for (const auto& feed : item_.feed) fed_nodes.insert(NodeName(feed.first));
+  }
+  absl::flat_hash_map<string, string> stand_ins;
+  std::vector<std::pair<string, TensorShapeProto>> placeholder_shapes;
+  for (const NodeDef& node : item_.graph.node()) {
+    if (!fanout.contains(&node)) continue;
+    NodeDef* fanout_node = fanout_item.graph.add_node();
+    *fanout_node = node;
+    fanout_node->clear_input();
+    for (const string& input : node.input()) {
+      const TensorId tensor = ParseTensorName(input);
+      const NodeDef* fanin = graph_view.GetNode(tensor.node());
+      if (fanin == nullptr) return infer_again();
+      if (fanout.contains(fanin)) {
+        fanout_node->add_input(input);
+        continue;
+      }
+      if (tensor.index() < 0) continue;
+
+      // The values of fed nodes can't be trusted.
+      const bool fed = fed_nodes.contains(fanin->name());
+      string& stand_in = stand_ins[tensor.ToString()];
+      if (stand_in.empty() && IsConstant(*fanin) && !fed) {
+        stand_in = fanin->name();
+        NodeDef* const_node = fanout_item.graph.add_node();
+        *const_node = *fanin;
+        const_node->clear_input();
+      } else if (stand_in.empty()) {
+        const std::vector<OpInfo::TensorProperties>& outputs =
+            GetOutputProperties(fanin->name());
+        if (tensor.index() >= static_cast<int>(outputs.size())) {
+          return infer_again();
+        }
+        const OpInfo::TensorProperties& properties = outputs[tensor.index()];
+        if (properties.dtype() == DT_RESOURCE ||
+            properties.dtype() == DT_VARIANT) {
+          return infer_again();
+        }
+        stand_in = strings::StrCat(fanin->name(), "/_stand_in_",
+                                   tensor.index());
+        while (graph_view.GetNode(stand_in) != nullptr) {
+          strings::StrAppend(&stand_in, "_");
+        }
+        NodeDef* stand_in_node = fanout_item.graph.add_node();
+        stand_in_node->set_name(stand_in);
+        stand_in_node->set_device(fanin->device());
+        auto* attr = stand_in_node->mutable_attr();
+        (*attr)["dtype"].set_type(properties.dtype());
+        if (properties.has_value() && !fed) {
+          stand_in_node->set_op("Const");
+          *(*attr)["value"].mutable_tensor() = properties.value();
+        } else {
+          stand_in_node->set_op("Placeholder");
+          TensorShapeProto* shape = (*attr)["shape"].mutable_shape();
+          *shape = properties.shape();
+          NormalizeShapeForOutput(shape);
+          placeholder_shapes.emplace_back(stand_in, properties.shape());
+        }
+      }
+      fanout_node->add_input(stand_in);
+    }
+  }
+  for (const auto& feed : item_.feed) {
+    const NodeDef* node = graph_view.GetNode(NodeName(feed.first));
+    if (node != nullptr && fanout.contains(node)) {
+      fanout_item.feed.push_back(feed);
+    }
+  }
+
+  GraphProperties fanout_properties(fanout_item);
+  if (!fanout_properties
+           .InferStatically(assume_valid_feeds_, aggressive_shape_inference_,
+                            include_input_tensor_values_,
+                            include_output_tensor_values_)
+           .ok()) {
+    return infer_again();
+  }
+
+  // The symbolic dimensions of the fanout are numbered independently of the
+  // ones of the rest of the graph: map the dimensions of the placeholders back
+  // to the dimensions they stand for, and the other ones to new symbols.
+  int64_t next_symbol = -2;
+  for (const auto* properties : {&input_properties_, &output_properties_}) {
+    for (const auto& node_properties : *properties) {
+      for (const OpInfo::TensorProperties& tensor : node_properties.second) {
+        for (const auto& dim : tensor.shape().dim()) {
+          next_symbol = std::min(next_symbol, dim.size() - 1);
+        }
+      }
+    }
+  }
+  absl::flat_hash_map<int64_t, int64_t> symbols;
+  for (const auto& placeholder : placeholder_shapes) {
+    const TensorShapeProto& original = placeholder.second;
+    const std::vector<OpInfo::TensorProperties>& outputs =
+        fanout_properties.GetOutputProperties(placeholder.first);
+    if (outputs.empty() || outputs[0].shape().unknown_rank() ||
+        outputs[0].shape().dim_size() != original.dim_size()) {
+      continue;
+    }
+    for (int i = 0; i < original.dim_size(); ++i) {
+      const int64_t symbol = outputs[0].shape().dim(i).size();
+      if (symbol < -1 && original.dim(i).size() < -1) {
+        symbols.emplace(symbol, original.dim(i).size());
+      }
+    }
+  }
+  const auto remap_symbols =
+      [&](std::vector<OpInfo::TensorProperties> properties) {
+        for (OpInfo::TensorProperties& tensor : properties) {
+          for (auto& dim : *tensor.mutable_shape()->mutable_dim()) {
+            if (dim.size() >= -1) continue;
+            auto it = symbols.find(dim.size());
+            if (it == symbols.end()) {
+              it = symbols.emplace(dim.size(), next_symbol--).first;
+            }
+            dim.set_size(it->second);
+          }
+        }
+        return properties;
+      };
+
+  for (const NodeDef& node : item_.graph.node()) {
+    if (!fanout.contains(&node)) continue;
+    const string& node_name = node.name();
+    if (fanout_properties.HasInputProperties(node_name)) {
+      input_properties_[node_name] =
+          remap_symbols(fanout_properties.GetInputProperties(node_name));
+    } else {
+      input_properties_.erase(node_name);
+    }
+    if (fanout_properties.HasOutputProperties(node_name)) {
+      output_properties_[node_name] =
+          remap_symbols(fanout_properties.GetOutputProperties(node_name));
+    } else {
+      output_properties_.erase(node_name);
+    }
+    if (fanout_properties.CheckShapeIncompatible(node_name)) {
+      incompatible_shape_nodes_.insert(node_name);
+    } else {
+      incompatible_shape_nodes_.erase(node_name);
+    }
+  }
+
+  return absl::OkStatus();
+}
+
 Status GraphProperties::InferDynamically(Cluster* cluster) {
   TF_RETURN_IF_ERROR(cluster->Initialize(item_));
 
@@ -21,6 +21,7 @@ limitations under the License.
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
 #include "tensorflow/core/framework/shape_inference.h"
 #include "tensorflow/core/grappler/clusters/cluster.h"
 #include "tensorflow/core/grappler/costs/op_performance_data.pb.h"
@@ -114,6 +115,20 @@ class GraphProperties {
                            /*aggressive_shape_inference=*/false,
                            /*include_tensor_values=*/true);
   }
+  // Updates the properties inferred by InferStatically, with the same options,
+  // after the nodes named in `updated_nodes` were added to the graph of the
+  // item or modified in place (e.g. through a MutableGraphView). Only the
+  // transitive fanout of these nodes is inferred again, from the properties of
+  // its fanin, and the properties of the nodes that were removed from the
+  // graph are dropped. Since the fanin is summarized by its inferred shapes and
+  // values, the updated shapes can be less precise than the ones inferred by
+  // InferStatically when they depend on partially known shape tensors computed
+  // outside of the fanout. The feeds in the fanout are inferred again as fed
+  // nodes, and unless assume_valid_feeds was set, the values of the fed nodes
+  // outside of it are not propagated. Falls back to InferStatically when the
+  // fanout contains loops or queues, reads resources or variants, or is most of
+  // the graph.
+  Status UpdateStatically(const absl::flat_hash_set<string>& updated_nodes);
   // Infer the shape by running the graph on the specified cluster and recording
   // the shapes of the processed tensors.
   Status InferDynamically(Cluster* cluster);
@@ -211,6 +226,13 @@ class GraphProperties {
   // Nodes with output shape incompatible between shape inference and
   // annotation.
   std::unordered_set<string> incompatible_shape_nodes_;
+
+  // Options of the last call to InferStatically, reused by UpdateStatically.
+  bool inferred_statically_ = false;
+  bool assume_valid_feeds_ = false;
+  bool aggressive_shape_inference_ = false;
+  bool include_input_tensor_values_ = false;
+  bool include_output_tensor_values_ = false;
 };
 
 // Helper function for GraphProperties.
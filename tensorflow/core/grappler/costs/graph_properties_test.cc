@@ -15,6 +15,7 @@ limitations under the License.
 
 #include "tensorflow/core/grappler/costs/graph_properties.h"
 
+#include "absl/container/flat_hash_map.h"
 #include "tensorflow/cc/framework/scope.h"
 #include "tensorflow/cc/ops/functional_ops.h"
 #include "tensorflow/cc/ops/standard_ops.h"
@@ -29,6 +30,7 @@ limitations under the License.
 #include "tensorflow/core/grappler/grappler_item.h"
 #include "tensorflow/core/grappler/inputs/trivial_test_graph_input_yielder.h"
 #include "tensorflow/core/grappler/inputs/utils.h"
+#include "tensorflow/core/grappler/mutable_graph_view.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/lib/io/path.h"
 #include "tensorflow/core/lib/strings/strcat.h"
@@ -112,6 +114,59 @@ class GraphPropertiesTest : public ::testing::Test {
     return s;
   }
 
+  // Expects `properties` to hold the same properties as `expected` for all the
+  // nodes of `graph`, up to a renaming of the symbolic dimensions.
+  void ExpectSameProperties(const GraphDef& graph,
+                            const GraphProperties& properties,
+                            const GraphProperties& expected) {
+    absl::flat_hash_map<int64_t, int64_t> symbols;
+    absl::flat_hash_map<int64_t, int64_t> expected_symbols;
+    const auto expect_same =
+        [&](const string& node_name,
+            const std::vector<OpInfo::TensorProperties>& actual,
+            const std::vector<OpInfo::TensorProperties>& wanted) {
+          ASSERT_EQ(wanted.size(), actual.size()) << node_name;
+          for (int i = 0; i < wanted.size(); ++i) {
+            EXPECT_EQ(wanted[i].dtype(), actual[i].dtype()) << node_name;
+            EXPECT_EQ(wanted[i].value().DebugString(),
+                      actual[i].value().DebugString())
+                << node_name;
+            const TensorShapeProto& shape = actual[i].shape();
+            const TensorShapeProto& expected_shape = wanted[i].shape();
+            ASSERT_EQ(expected_shape.unknown_rank(), shape.unknown_rank())
+                << node_name;
+            ASSERT_EQ(expected_shape.dim_size(), shape.dim_size())
+                << node_name;
+            for (int d = 0; d < shape.dim_size(); ++d) {
+              const int64_t dim = shape.dim(d).size();
+              const int64_t expected_dim = expected_shape.dim(d).size();
+              if (expected_dim < -1) {
+                EXPECT_EQ(expected_dim, symbols.emplace(dim, expected_dim)
+                                            .first->second)
+                    << node_name;
+                EXPECT_EQ(dim, expected_symbols.emplace(expected_dim, dim)
+                                   .first->second)
+                    << node_name;
+              } else {
+                EXPECT_EQ(expected_dim, dim) << node_name;
+              }
+            }
+          }
+        };
+    for (const NodeDef& node : graph.node()) {
+      EXPECT_EQ(expected.HasInputProperties(node.name()),
+                properties.HasInputProperties(node.name()))
+          << node.name();
+      expect_same(node.name(), properties.GetInputProperties(node.name()),
+                  expected.GetInputProperties(node.name()));
+      EXPECT_EQ(expected.HasOutputProperties(node.name()),
+                properties.HasOutputProperties(node.name()))
+          << node.name();
+      expect_same(node.name(), properties.GetOutputProperties(node.name()),
+                  expected.GetOutputProperties(node.name()));
+    }
+  }
+
   // Compare values of integer (DT_INT32 or DT_INT64) tensor against expected
   // ones.
   void ExpectTensorValues(const std::vector<int64_t>& expected,
@@ -233,6 +288,87 @@ TEST_F(GraphPropertiesTest, Clear) {
   EXPECT_FALSE(properties.has_properties());
 }
 
+TEST_F(GraphPropertiesTest, UpdateStatically) {
+  Scope s = Scope::NewRootScope();
+  Output x =
+      ops::Placeholder(s.WithOpName("x"), DT_FLOAT,
+                       ops::Placeholder::Shape(PartialTensorShape({-1, 16})));
+  Output relu = ops::Relu(s.WithOpName("relu"), x);
+  Output tanh = ops::Tanh(s.WithOpName("tanh"), relu);
+  Output sigmoid = ops::Sigmoid(s.WithOpName("sigmoid"), tanh);
+  Output square = ops::Square(s.WithOpName("square"), sigmoid);
+  Output w = ops::Const(s.WithOpName("w"), 1.0f, {16, 4});
+  Output matmul = ops::MatMul(s.WithOpName("matmul"), square, w);
+  Output shape = ops::Shape(s.WithOpName("shape"), matmul);
+  Output reshape = ops::Reshape(s.WithOpName("reshape"), matmul, shape);
+  Output out = ops::Identity(s.WithOpName("out"), reshape);
+
+  GrapplerItem item;
+  TF_ASSERT_OK(s.ToGraphDef(&item.graph));
+  GraphProperties properties(item);
+  TF_ASSERT_OK(properties.InferStatically(/*assume_valid_feeds=*/false));
+
+  // Widen the MatMul.
+  MutableGraphView graph_view(&item.graph);
+  Scope s2 = Scope::NewRootScope();
+  Output w2 = ops::Const(s2.WithOpName("w2"), 1.0f, {16, 32});
+  GraphDef w2_graph;
+  TF_ASSERT_OK(s2.ToGraphDef(&w2_graph));
+  graph_view.AddNode(std::move(*w2_graph.mutable_node(0)));
+  TF_ASSERT_OK(graph_view.UpdateFanin("matmul", {"w", 0}, {"w2", 0}));
+  TF_ASSERT_OK(properties.UpdateStatically({"w2", "matmul"}));
+
+  EXPECT_EQ("float: [-1,32]",
+            PropToString(properties.GetOutputProperties("out")[0]));
+  // The batch dimension is still known to be the one of x.
+  EXPECT_EQ(properties.GetOutputProperties("x")[0].shape().dim(0).size(),
+            properties.GetOutputProperties("out")[0].shape().dim(0).size());
+  EXPECT_LT(properties.GetOutputProperties("out")[0].shape().dim(0).size(),
+            -1);
+
+  GraphProperties expected(item);
+  TF_ASSERT_OK(expected.InferStatically(/*assume_valid_feeds=*/false));
+  ExpectSameProperties(item.graph, properties, expected);
+}
+
+TEST_F(GraphPropertiesTest, UpdateStaticallyAfterRemovingNodes) {
+  Scope s = Scope::NewRootScope();
+  Output x =
+      ops::Placeholder(s.WithOpName("x"), DT_FLOAT,
+                       ops::Placeholder::Shape(PartialTensorShape({-1, 8})));
+  Output y =
+      ops::Placeholder(s.WithOpName("y"), DT_FLOAT,
+                       ops::Placeholder::Shape(PartialTensorShape({-1, 8})));
+  Output add = ops::Add(s.WithOpName("add"), x, y);
+  Output relu = ops::Relu(s.WithOpName("relu"), add);
+  Output neg = ops::Neg(s.WithOpName("neg"), relu);
+  Output size = ops::Size(s.WithOpName("size"), x);
+  Output out = ops::Identity(s.WithOpName("out"), neg);
+
+  GrapplerItem item;
+  TF_ASSERT_OK(s.ToGraphDef(&item.graph));
+  GraphProperties properties(item);
+  TF_ASSERT_OK(properties.InferStatically(/*assume_valid_feeds=*/false));
+
+  // Bypass the Relu.
+  MutableGraphView graph_view(&item.graph);
+  TF_ASSERT_OK(graph_view.UpdateFanin("neg", {"relu", 0}, {"add", 0}));
+  TF_ASSERT_OK(graph_view.DeleteNodes({"relu"}));
+  TF_ASSERT_OK(properties.UpdateStatically({"neg"}));
+
+  EXPECT_FALSE(properties.HasInputProperties("relu"));
+  EXPECT_FALSE(properties.HasOutputProperties("relu"));
+  GraphProperties expected(item);
+  TF_ASSERT_OK(expected.InferStatically(/*assume_valid_feeds=*/false));
+  ExpectSameProperties(item.graph, properties, expected);
+}
+
+TEST_F(GraphPropertiesTest, UpdateStaticallyRequiresInferStatically) {
+  GrapplerItem item;
+  GraphProperties properties(item);
+  EXPECT_TRUE(errors::IsFailedPrecondition(properties.UpdateStatically({})));
+}
+
 TEST_F(GraphPropertiesTest, DynamicProperties) {
   TrivialTestGraphInputYielder fake_input(4, 1, 10, false,
                                           cluster_->GetDeviceNames());
@@ -2466,6 +2602,47 @@ TEST_F(GraphPropertiesTest, NonTrivialInputPartitionedCallOp) {
             PropToString(properties.GetOutputProperties("add_call")[0]));
 }
 
+TEST_F(GraphPropertiesTest, FunctionCalledWithDifferentShapes) {
+  auto f = FunctionDefHelper::Create(
+      "MySquareFunc", {"x: float"}, {"y: float"}, /*attr_def=*/{},
+      {{{"square"}, "Square", {"x"}, {{"T", DT_FLOAT}}}},
+      /*ret_def=*/{{"y", "square:y:0"}});
+  FunctionDefLibrary function_lib;
+  function_lib.add_function()->Swap(&f);
+  Scope root = Scope::NewRootScope();
+  TF_ASSERT_OK(root.graph()->AddFunctionLibrary(function_lib));
+
+  Output a =
+      ops::Placeholder(root, DT_FLOAT,
+                       ops::Placeholder::Shape(PartialTensorShape({2, 3})));
+  Output b =
+      ops::Placeholder(root, DT_FLOAT,
+                       ops::Placeholder::Shape(PartialTensorShape({5})));
+  NameAttrList function;
+  function.set_name("MySquareFunc");
+  ops::PartitionedCall call_a(root.WithOpName("call_a"), {a}, {DT_FLOAT},
+                              function);
+  ops::PartitionedCall call_b(root.WithOpName("call_b"), {b}, {DT_FLOAT},
+                              function);
+
+  GrapplerItem item;
+  TF_ASSERT_OK(root.ToGraphDef(&item.graph));
+
+  // The second inference reuses the shapes of the function bodies inferred by
+  // the first one.
+  for (int i = 0; i < 2; ++i) {
+    GraphProperties properties(item);
+    TF_ASSERT_OK(properties.InferStatically(
+        /*assume_valid_feeds=*/true,
+        /*aggressive_shape_inference=*/false,
+        /*include_tensor_values=*/true));
+    EXPECT_EQ("float: [2,3]",
+              PropToString(properties.GetOutputProperties("call_a")[0]));
+    EXPECT_EQ("float: [5]",
+              PropToString(properties.GetOutputProperties("call_b")[0]));
+  }
+}
+
 TEST_F(GraphPropertiesTest, ShapeAnnotatedFunctionOp) {
   // A function, which we cannot infer output shape statically.
   auto f = FunctionDefHelper::Create(
@@ -0,0 +1,405 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/grappler/costs/op_cost_calibration.h"
+
+#include <array>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <unordered_map>
+#include <utility>
+
+#include "absl/strings/str_cat.h"
+#include "tensorflow/core/framework/cost_graph.pb.h"
+#include "tensorflow/core/framework/node_def.pb.h"
+#include "tensorflow/core/framework/node_def_util.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/grappler/clusters/cluster.h"
+#include "tensorflow/core/grappler/costs/graph_properties.h"
+#include "tensorflow/core/grappler/costs/measuring_cost_estimator.h"
+#include "tensorflow/core/grappler/costs/op_context.h"
+#include "tensorflow/core/grappler/costs/op_level_cost_estimator.h"
+#include "tensorflow/core/grappler/costs/utils.h"
+#include "tensorflow/core/grappler/grappler_item.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/protobuf/config.pb.h"
+
+namespace tensorflow {
+namespace grappler {
+namespace {
+
+constexpr char kKernelName[] = "kernel";
+
+// The coefficients of the execution time, in nanoseconds per operation,
+// nanoseconds per byte, and nanoseconds.
+constexpr int kNumCoefficients = 3;
+using Coefficients = std::array<double, kNumCoefficients>;
+
+// Solves min sum_i (rows[i] . x - 1)^2 over the coefficients selected by the
+// bits of `mask`, the others being 0. Returns false if the selected columns
+// are linearly dependent.
+bool SolveLeastSquares(const std::vector<Coefficients>& rows, int mask,
+                       Coefficients* x) {
+  std::vector<int> columns;
+  Coefficients scale = {0, 0, 0};
+  for (int j = 0; j < kNumCoefficients; ++j) {
+    if ((mask & (1 << j)) == 0) continue;
+    for (const Coefficients& row : rows) {
+      scale[j] = std::max(scale[j], std::abs(row[j]));
+    }
+    if (scale[j] == 0) return false;
+    columns.push_back(j);
+  }
+  // Normal equations of the rescaled columns, as an augmented matrix.
+  const int n = columns.size();
+  std::vector<std::vector<double>> m(n, std::vector<double>(n + 1, 0));
+  for (const Coefficients& row : rows) {
+    for (int a = 0; a < n; ++a) {
+      const double row_a = row[columns[a]] / scale[columns[a]];
+      for (int b = 0; b < n; ++b) {
+        m[a][b] += row_a * row[columns[b]] / scale[columns[b]];
+      }
+      m[a][n] += row_a;
+    }
+  }
+  // Gaussian elimination with partial pivoting.
+  for (int a = 0; a < n; ++a) {
+    int pivot = a;
+    for (int b = a + 1; b < n; ++b) {
+      if (std::abs(m[b][a]) > std::abs(m[pivot][a])) pivot = b;
+    }
+    if (std::abs(m[pivot][a]) < 1e-12 * rows.size()) return false;
+    std::swap(m[a], m[pivot]);
+    for (int b = 0; b < n; ++b) {
+      if (b == a) continue;
+      const double factor = m[b][a] / m[a][a];
+      for (int c = a; c <= n; ++c) m[b][c] -= factor * m[a][c];
+    }
+  }
+  *x = {0, 0, 0};
+  for (int a = 0; a < n; ++a) {
+    (*x)[columns[a]] = m[a][n] / m[a][a] / scale[columns[a]];
+  }
+  return true;
+}
+
+// Adds a float input of the given shape, produced by a RandomUniform op so
+// that the kernel can't be constant folded.
+void AddRandomInput(const string& name, const TensorShape& shape,
+                    const string& device, GraphDef* graph) {
+  Tensor dims(DT_INT32, TensorShape({shape.dims()}));
+  for (int d = 0; d < shape.dims(); ++d) {
+    dims.vec<int32>()(d) = shape.dim_size(d);
+  }
+  NodeDef* dims_node = graph->add_node();
+  dims_node->set_name(absl::StrCat(name, "/shape"));
+  dims_node->set_op("Const");
+  dims_node->set_device(device);
+  AddNodeAttr("dtype", DT_INT32, dims_node);
+  AddNodeAttr("value", dims, dims_node);
+
+  NodeDef* node = graph->add_node();
+  node->set_name(name);
+  node->set_op("RandomUniform");
+  node->set_device(device);
+  node->add_input(dims_node->name());
+  AddNodeAttr("T", DT_INT32, node);
+  AddNodeAttr("dtype", DT_FLOAT, node);
+  AddNodeAttr("seed", 0, node);
+  AddNodeAttr("seed2", 0, node);
+}
+
+Tensor Int32Tensor(const std::vector<int32>& values) {
+  Tensor tensor(DT_INT32, TensorShape({static_cast<int64_t>(values.size())}));
+  for (int i = 0; i < values.size(); ++i) tensor.vec<int32>()(i) = values[i];
+  return tensor;
+}
+
+Tensor Int32Scalar(int32_t value) {
+  Tensor tensor(DT_INT32, TensorShape({}));
+  tensor.scalar<int32>()() = value;
+  return tensor;
+}
+
+// A kernel to measure: `kernel` applied to random float inputs of the shapes
+// `inputs`, followed by the constant inputs `constant_inputs`.
+struct KernelBenchmark {
+  NodeDef kernel;
+  std::vector<TensorShape> inputs;
+  std::vector<Tensor> constant_inputs;
+};
+
+KernelBenchmark Benchmark(const string& op, std::vector<TensorShape> inputs,
+                          std::vector<Tensor> constant_inputs = {}) {
+  KernelBenchmark benchmark;
+  benchmark.kernel.set_op(op);
+  AddNodeAttr("T", DT_FLOAT, &benchmark.kernel);
+  benchmark.inputs = std::move(inputs);
+  benchmark.constant_inputs = std::move(constant_inputs);
+  return benchmark;
+}
+
+// Kernels representative of each class of ops, of sizes ranging from latency
+// bound to compute or bandwidth bound.
+std::vector<KernelBenchmark> KernelBenchmarks() {
+  std::vector<KernelBenchmark> benchmarks;
+  const std::vector<std::array<int64_t, 3>> matmul_sizes = {
+      {256, 256, 256}, {512, 512, 512}, {1024, 1024, 1024},
+      {1, 4096, 4096}, {8, 1024, 4096}, {4096, 256, 64}};
+  for (const auto& size : matmul_sizes) {
+    benchmarks.push_back(Benchmark(
+        "MatMul", {TensorShape({size[0], size[1]}),
+                   TensorShape({size[1], size[2]})}));
+    AddNodeAttr("transpose_a", false, &benchmarks.back().kernel);
+    AddNodeAttr("transpose_b", false, &benchmarks.back().kernel);
+  }
+
+  const std::vector<std::pair<TensorShape, TensorShape>> conv_sizes = {
+      {TensorShape({8, 56, 56, 64}), TensorShape({3, 3, 64, 64})},
+      {TensorShape({8, 28, 28, 128}), TensorShape({1, 1, 128, 256})},
+      {TensorShape({1, 112, 112, 32}), TensorShape({3, 3, 32, 32})},
+      {TensorShape({16, 14, 14, 256}), TensorShape({3, 3, 256, 256})}};
+  for (const auto& size : conv_sizes) {
+    benchmarks.push_back(Benchmark("Conv2D", {size.first, size.second}));
+    AddNodeAttr("strides", std::vector<int32>{1, 1, 1, 1},
+                &benchmarks.back().kernel);
+    AddNodeAttr("padding", "SAME", &benchmarks.back().kernel);
+    AddNodeAttr("data_format", "NHWC", &benchmarks.back().kernel);
+  }
+
+  const std::vector<int64_t> elementwise_sizes = {1 << 14, 1 << 18, 1 << 22,
+                                                  1 << 24};
+  for (int64_t size : elementwise_sizes) {
+    const TensorShape shape({size});
+    benchmarks.push_back(Benchmark("Add", {shape, shape}));
+    benchmarks.push_back(Benchmark("Mul", {shape, shape}));
+    benchmarks.push_back(Benchmark("Relu", {shape}));
+    benchmarks.push_back(Benchmark("Tanh", {shape}));
+  }
+
+  const std::vector<int64_t> data_movement_sizes = {1 << 16, 1 << 20, 1 << 24};
+  for (int64_t size : data_movement_sizes) {
+    benchmarks.push_back(Benchmark("Transpose",
+                                   {TensorShape({size / 4096, 64, 64})},
+                                   {Int32Tensor({0, 2, 1})}));
+    AddNodeAttr("Tperm", DT_INT32, &benchmarks.back().kernel);
+    const TensorShape half({size / 2048, 1024});
+    benchmarks.push_back(
+        Benchmark("ConcatV2", {half, half}, {Int32Scalar(0)}));
+    AddNodeAttr("N", 2, &benchmarks.back().kernel);
+    AddNodeAttr("Tidx", DT_INT32, &benchmarks.back().kernel);
+    benchmarks.push_back(Benchmark("Tile", {TensorShape({size / 4})},
+                                   {Int32Tensor({4})}));
+    AddNodeAttr("Tmultiples", DT_INT32, &benchmarks.back().kernel);
+  }
+  return benchmarks;
+}
+
+GrapplerItem BenchmarkItem(const KernelBenchmark& benchmark, int index,
+                           const string& device) {
+  GrapplerItem item;
+  NodeDef kernel = benchmark.kernel;
+  kernel.set_name(kKernelName);
+  kernel.set_device(device);
+  for (int i = 0; i < benchmark.inputs.size(); ++i) {
+    const string name = absl::StrCat("input_", i);
+    AddRandomInput(name, benchmark.inputs[i], device, &item.graph);
+    kernel.add_input(name);
+  }
+  for (int i = 0; i < benchmark.constant_inputs.size(); ++i) {
+    NodeDef* node = item.graph.add_node();
+    node->set_name(absl::StrCat("constant_input_", i));
+    node->set_op("Const");
+    node->set_device(device);
+    AddNodeAttr("dtype", DT_INT32, node);
+    AddNodeAttr("value", benchmark.constant_inputs[i], node);
+    kernel.add_input(node->name());
+  }
+  *item.graph.add_node() = std::move(kernel);
+  item.fetch.push_back(kKernelName);
+  item.id = absl::StrCat("calibration/", benchmark.kernel.op(), "_", index);
+  return item;
+}
+
+// Exposes the number of operations and bytes accessed the
+// OpLevelCostEstimator counts for an op.
+class OpCounter : public OpLevelCostEstimator {
+ public:
+  Status Count(const OpContext& op_context, KernelTiming* timing) const {
+    NodeCosts node_costs;
+    TF_RETURN_IF_ERROR(PredictNodeCosts(op_context, &node_costs));
+    if (node_costs.has_costs || node_costs.minimum_cost_op ||
+        node_costs.inaccurate) {
+      return errors::Unimplemented("Can't count the operations of ",
+                                   op_context.op_info.op());
+    }
+    timing->operations = node_costs.num_compute_ops;
+    timing->bytes = node_costs.num_bytes_accessed();
+    return absl::OkStatus();
+  }
+};
+
+Status CountKernel(const OpCounter& counter, const GrapplerItem& item,
+                   const DeviceProperties& device, KernelTiming* timing) {
+  GraphProperties properties(item);
+  TF_RETURN_IF_ERROR(
+      properties.InferStatically(/*assume_valid_feeds=*/false,
+                                 /*aggressive_shape_inference=*/false,
+                                 /*include_tensor_values=*/true));
+  std::unordered_map<string, const NodeDef*> name_to_node;
+  for (const NodeDef& node : item.graph.node()) {
+    name_to_node[node.name()] = &node;
+  }
+  const NodeDef& kernel = *name_to_node.at(kKernelName);
+  OpContext op_context;
+  op_context.name = kernel.name();
+  op_context.device_name = kernel.device();
+  op_context.op_info = BuildOpInfoWithoutDevice(
+      kernel, name_to_node, properties.GetInputProperties(kernel.name()));
+  for (const auto& output : properties.GetOutputProperties(kernel.name())) {
+    *op_context.op_info.add_outputs() = output;
+  }
+  *op_context.op_info.mutable_device() = device;
+  return counter.Count(op_context, timing);
+}
+
+Status MeasureKernel(Cluster* cluster, const GrapplerItem& item,
+                     int measurement_steps, KernelTiming* timing) {
+  MeasuringCostEstimator estimator(cluster, measurement_steps,
+                                   /*measurement_threads=*/0);
+  TF_RETURN_IF_ERROR(estimator.Initialize(item));
+  RunMetadata metadata;
+  Costs costs;
+  TF_RETURN_IF_ERROR(estimator.PredictCosts(item.graph, &metadata, &costs));
+  for (const auto& node : metadata.cost_graph().node()) {
+    if (node.name() == kKernelName) {
+      // The cost model averages the compute cost, in microseconds, over the
+      // measurement steps.
+      timing->time_ns = node.compute_cost() * 1e3;
+      return absl::OkStatus();
+    }
+  }
+  return errors::FailedPrecondition(
+      "The cluster doesn't report the execution time of kernels, detailed "
+      "stats must be enabled to calibrate op costs");
+}
+
+}  // namespace
+
+OpCostCalibration::OpClass FitOpClassThroughput(
+    const std::vector<KernelTiming>& timings) {
+  // Dividing by the measured time turns the relative error into a linear
+  // least squares problem.
+  std::vector<Coefficients> rows;
+  for (const KernelTiming& timing : timings) {
+    if (timing.time_ns <= 0) continue;
+    rows.push_back({timing.operations / timing.time_ns,
+                    timing.bytes / timing.time_ns, 1.0 / timing.time_ns});
+  }
+  OpCostCalibration::OpClass op_class;
+  op_class.set_num_samples(rows.size());
+  if (rows.empty()) return op_class;
+
+  // Dropping coefficients from the fit is the exact solution of the non
+  // negative least squares problem when some coefficient would be negative,
+  // and there are few enough subsets of them to try them all.
+  Coefficients best_fit = {0, 0, 0};
+  double best_error = std::numeric_limits<double>::infinity();
+  for (int mask = 1; mask < (1 << kNumCoefficients); ++mask) {
+    Coefficients fit;
+    if (!SolveLeastSquares(rows, mask, &fit)) continue;
+    if (fit[0] < 0 || fit[1] < 0 || fit[2] < 0) continue;
+    double error = 0;
+    for (const Coefficients& row : rows) {
+      const double relative_time =
+          row[0] * fit[0] + row[1] * fit[1] + row[2] * fit[2];
+      error += (relative_time - 1) * (relative_time - 1);
+    }
+    if (error < best_error) {
+      best_error = error;
+      best_fit = fit;
+    }
+  }
+  if (std::isinf(best_error)) return op_class;
+
+  // A throughput of 0 stands for the peak performance of the device, which
+  // would overestimate the cost of ops that the fit found not to matter.
+  const auto throughput = [](double coefficient) {
+    return coefficient > 1.0 / kUnboundedThroughput ? 1.0 / coefficient
+                                                     : kUnboundedThroughput;
+  };
+  op_class.set_gigaops(throughput(best_fit[0]));
+  op_class.set_gb_per_sec(throughput(best_fit[1]));
+  op_class.set_overhead_ns(best_fit[2]);
+  op_class.set_rms_relative_error(std::sqrt(best_error / rows.size()));
+  return op_class;
+}
+
+Status CalibrateOpCosts(Cluster* cluster,
+                        const OpCostCalibrationOptions& options,
+                        OpCostCalibration* calibration) {
+  string device_name;
+  for (const auto& device : cluster->GetDevices()) {
+    if (device.second.type() == options.device_type) {
+      device_name = device.first;
+      *calibration->mutable_device() = device.second;
+      break;
+    }
+  }
+  if (device_name.empty()) {
+    return errors::NotFound("The cluster has no ", options.device_type,
+                            " device to calibrate");
+  }
+
+  const OpCounter counter;
+  std::map<string, std::vector<KernelTiming>> timings;
+  const std::vector<KernelBenchmark> benchmarks = KernelBenchmarks();
+  for (int i = 0; i < benchmarks.size(); ++i) {
+    const KernelBenchmark& benchmark = benchmarks[i];
+    const GrapplerItem item = BenchmarkItem(benchmark, i, device_name);
+    KernelTiming timing;
+    TF_RETURN_IF_ERROR(
+        CountKernel(counter, item, calibration->device(), &timing));
+    TF_RETURN_IF_ERROR(
+        MeasureKernel(cluster, item, options.measurement_steps, &timing));
+    VLOG(1) << "Calibration of " << item.id << ": " << timing.operations
+            << " operations, " << timing.bytes << " bytes, " << timing.time_ns
+            << " ns";
+    timings[counter.GetOpClass(benchmark.kernel.op())].push_back(timing);
+  }
+
+  calibration->clear_op_class();
+  for (const auto& op_class_timings : timings) {
+    const OpCostCalibration::OpClass op_class =
+        FitOpClassThroughput(op_class_timings.second);
+    VLOG(1) << "Calibrated " << op_class_timings.first << " ops: "
+            << op_class.ShortDebugString();
+    if (op_class.gigaops() > 0 || op_class.gb_per_sec() > 0) {
+      (*calibration->mutable_op_class())[op_class_timings.first] = op_class;
+    }
+  }
+  return absl::OkStatus();
+}
+
+Status WriteOpCostCalibration(const string& filename,
+                              const OpCostCalibration& calibration) {
+  return WriteTextProto(Env::Default(), filename, calibration);
+}
+
+}  // end namespace grappler
+}  // end namespace tensorflow
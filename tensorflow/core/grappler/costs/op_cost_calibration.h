@@ -0,0 +1,73 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_GRAPPLER_COSTS_OP_COST_CALIBRATION_H_
+#define TENSORFLOW_CORE_GRAPPLER_COSTS_OP_COST_CALIBRATION_H_
+
+#include <vector>
+
+#include "tensorflow/core/grappler/costs/op_performance_data.pb.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+namespace grappler {
+
+class Cluster;
+
+struct OpCostCalibrationOptions {
+  // Type of the device to calibrate.
+  string device_type = "CPU";
+  // Number of times each kernel is run to measure its execution time.
+  int measurement_steps = 10;
+};
+
+// Execution time of a kernel measured on a device, along with the number of
+// operations and bytes accessed counted by the OpLevelCostEstimator.
+struct KernelTiming {
+  double operations = 0;
+  double bytes = 0;
+  double time_ns = 0;
+};
+
+// Throughput reported for a class of ops whose execution time doesn't depend
+// on the number of operations or bytes, so that the cost estimator neither
+// falls back to the peak performance of the device nor charges for them.
+constexpr double kUnboundedThroughput = 1e12;
+
+// Fits the throughput of a class of ops, i.e. the execution time
+//   overhead_ns + operations / gigaops + bytes / gb_per_sec,
+// to `timings` with non negative coefficients. Minimizes the relative rather
+// than the absolute error, since the timings span several orders of magnitude.
+// A coefficient fitted to 0 is reported as kUnboundedThroughput.
+OpCostCalibration::OpClass FitOpClassThroughput(
+    const std::vector<KernelTiming>& timings);
+
+// Runs a suite of kernels representative of each class of ops on a device of
+// `cluster`, measures them with a MeasuringCostEstimator, and fits the
+// throughput of the classes of ops to the measurements.
+Status CalibrateOpCosts(Cluster* cluster,
+                        const OpCostCalibrationOptions& options,
+                        OpCostCalibration* calibration);
+
+// Writes `calibration` to `filename` as a text proto, to be loaded with
+// AnalyticalCostEstimator::LoadCalibration().
+Status WriteOpCostCalibration(const string& filename,
+                              const OpCostCalibration& calibration);
+
+}  // end namespace grappler
+}  // end namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_GRAPPLER_COSTS_OP_COST_CALIBRATION_H_
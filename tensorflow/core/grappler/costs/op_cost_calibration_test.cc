@@ -0,0 +1,107 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/grappler/costs/op_cost_calibration.h"
+
+#include "tensorflow/core/grappler/clusters/virtual_cluster.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace grappler {
+namespace {
+
+KernelTiming Timing(double operations, double bytes, double time_ns) {
+  KernelTiming timing;
+  timing.operations = operations;
+  timing.bytes = bytes;
+  timing.time_ns = time_ns;
+  return timing;
+}
+
+TEST(OpCostCalibrationTest, FitsThroughput) {
+  // 50 Gops/s, 10 GB/s and 2us of overhead.
+  std::vector<KernelTiming> timings;
+  for (double operations : {1e4, 1e6, 1e8}) {
+    for (double bytes : {1e3, 1e5, 1e7}) {
+      timings.push_back(Timing(operations, bytes,
+                               2000 + operations / 50 + bytes / 10));
+    }
+  }
+  const OpCostCalibration::OpClass op_class = FitOpClassThroughput(timings);
+  EXPECT_NEAR(op_class.gigaops(), 50, 1e-3);
+  EXPECT_NEAR(op_class.gb_per_sec(), 10, 1e-3);
+  EXPECT_NEAR(op_class.overhead_ns(), 2000, 1e-3);
+  EXPECT_EQ(op_class.num_samples(), 9);
+  EXPECT_NEAR(op_class.rms_relative_error(), 0, 1e-6);
+}
+
+TEST(OpCostCalibrationTest, FitsPureMemoryOps) {
+  std::vector<KernelTiming> timings;
+  for (double bytes : {1e4, 1e6, 1e8}) {
+    timings.push_back(Timing(0, bytes, 500 + bytes / 20));
+  }
+  const OpCostCalibration::OpClass op_class = FitOpClassThroughput(timings);
+  EXPECT_EQ(op_class.gigaops(), kUnboundedThroughput);
+  EXPECT_NEAR(op_class.gb_per_sec(), 20, 1e-3);
+  EXPECT_NEAR(op_class.overhead_ns(), 500, 1e-3);
+}
+
+TEST(OpCostCalibrationTest, TimeIndependentOfOperations) {
+  // The operations are counted, but don't contribute to the execution time.
+  std::vector<KernelTiming> timings;
+  for (double operations : {1e4, 1e6, 1e8}) {
+    for (double bytes : {1e4, 1e6, 1e8}) {
+      timings.push_back(Timing(operations, bytes, 500 + bytes / 20));
+    }
+  }
+  const OpCostCalibration::OpClass op_class = FitOpClassThroughput(timings);
+  EXPECT_EQ(op_class.gigaops(), kUnboundedThroughput);
+  EXPECT_NEAR(op_class.gb_per_sec(), 20, 1e-3);
+  EXPECT_NEAR(op_class.overhead_ns(), 500, 1e-3);
+}
+
+TEST(OpCostCalibrationTest, KeepsCoefficientsNonNegative) {
+  // A least squares fit would predict a negative overhead.
+  const std::vector<KernelTiming> timings = {
+      Timing(0, 1000, 50), Timing(0, 2000, 150), Timing(0, 3000, 250)};
+  const OpCostCalibration::OpClass op_class = FitOpClassThroughput(timings);
+  EXPECT_EQ(op_class.overhead_ns(), 0);
+  EXPECT_GT(op_class.gb_per_sec(), 0);
+  EXPECT_GT(op_class.rms_relative_error(), 0);
+}
+
+TEST(OpCostCalibrationTest, NoTimings) {
+  const OpCostCalibration::OpClass op_class = FitOpClassThroughput({});
+  EXPECT_EQ(op_class.num_samples(), 0);
+  EXPECT_EQ(op_class.gigaops(), 0);
+  EXPECT_EQ(op_class.gb_per_sec(), 0);
+}
+
+TEST(OpCostCalibrationTest, MissingDevice) {
+  DeviceProperties cpu_device;
+  cpu_device.set_type("CPU");
+  VirtualCluster cluster({{"/job:localhost/replica:0/task:0/cpu:0",
+                           cpu_device}});
+  OpCostCalibrationOptions options;
+  options.device_type = "GPU";
+  OpCostCalibration calibration;
+  EXPECT_TRUE(errors::IsNotFound(
+      CalibrateOpCosts(&cluster, options, &calibration)));
+}
+
+}  // namespace
+}  // namespace grappler
+}  // namespace tensorflow
@@ -133,6 +133,11 @@ constexpr char kMerge[] = "Merge";
 constexpr char kEnter[] = "Enter";
 constexpr char kExit[] = "Exit";
 constexpr char kNextIteration[] = "NextIteration";
+// Classes of ops sharing a calibrated throughput.
+constexpr char kMatMulOpClass[] = "MatMul";
+constexpr char kConvolutionOpClass[] = "Convolution";
+constexpr char kElementwiseOpClass[] = "Elementwise";
+constexpr char kDataMovementOpClass[] = "DataMovement";
 // Persistent ops.
 constexpr char kConst[] = "Const";
 constexpr char kVariable[] = "Variable";
@@ -653,6 +658,27 @@ OpLevelCostEstimator::OpLevelCostEstimator() {
 
 #undef EIGEN_COST
 
+  for (const char* op : {kMatMul, kSparseMatMul, kBatchMatMul, kBatchMatMulV2,
+                         kEinsum, kXlaEinsum}) {
+    op_classes_[op] = kMatMulOpClass;
+  }
+  for (const char* op :
+       {kConv2d, kConv2dBackpropFilter, kConv2dBackpropInput,
+        kFusedConv2dBiasActivation, kDepthwiseConv2dNative,
+        kDepthwiseConv2dNativeBackpropFilter,
+        kDepthwiseConv2dNativeBackpropInput}) {
+    op_classes_[op] = kConvolutionOpClass;
+  }
+  for (const auto& elementwise_op : elementwise_ops_) {
+    op_classes_[elementwise_op.first] = kElementwiseOpClass;
+  }
+  op_classes_[kAddN] = kElementwiseOpClass;
+  for (const char* op :
+       {kConcatV2, kDepthToSpace, kGather, kGatherNd, kGatherV2, kPack, kSlice,
+        kSpaceToDepth, kSplit, kStridedSlice, kTile, kTranspose, kUnpack}) {
+    op_classes_[op] = kDataMovementOpClass;
+  }
+
   // By default, use sum of memory_time and compute_time for execution_time.
   compute_memory_overlap_ = false;
 }
@@ -791,6 +817,28 @@ DeviceInfo OpLevelCostEstimator::GetDeviceInfo(
   return DeviceInfo(gflops, gb_per_sec);
 }
 
+string OpLevelCostEstimator::GetOpClass(const string& op) const {
+  auto it = op_classes_.find(op);
+  return it != op_classes_.end() ? it->second : "";
+}
+
+void OpLevelCostEstimator::SetCalibration(
+    const OpCostCalibration& calibration) {
+  calibration_ = calibration;
+}
+
+const OpCostCalibration::OpClass* OpLevelCostEstimator::FindCalibration(
+    const OpInfo& op_info) const {
+  if (calibration_.op_class().empty() ||
+      op_info.device().type() != calibration_.device().type()) {
+    return nullptr;
+  }
+  auto class_it = op_classes_.find(op_info.op());
+  if (class_it == op_classes_.end()) return nullptr;
+  auto it = calibration_.op_class().find(class_it->second);
+  return it != calibration_.op_class().end() ? &it->second : nullptr;
+}
+
 absl::Status OpLevelCostEstimator::PredictCwiseOp(const OpContext& op_context,
                                                   NodeCosts* node_costs) const {
   const auto& op_info = op_context.op_info;
@@ -850,7 +898,30 @@ Costs OpLevelCostEstimator::PredictOpCountBasedCost(
     double operations, double input_io_bytes, double output_io_bytes,
     const OpInfo& op_info) const {
   double total_io_bytes = input_io_bytes + output_io_bytes;
-  const DeviceInfo device_info = GetDeviceInfo(op_info.device());
+  DeviceInfo device_info = GetDeviceInfo(op_info.device());
+  double overhead_ns = 0;
+  const OpCostCalibration::OpClass* calibration = FindCalibration(op_info);
+  if (calibration != nullptr) {
+    // The throughput was measured with all the cores and the full bandwidth of
+    // the calibration device, so scale it to the resources of this device.
+    const DeviceProperties& device = op_info.device();
+    const DeviceProperties& calibration_device = calibration_.device();
+    if (calibration->gigaops() > 0) {
+      device_info.gigaops = calibration->gigaops();
+      if (device.num_cores() > 0 && calibration_device.num_cores() > 0) {
+        device_info.gigaops *= static_cast<double>(device.num_cores()) /
+                               calibration_device.num_cores();
+      }
+    }
+    if (calibration->gb_per_sec() > 0) {
+      device_info.gb_per_sec = calibration->gb_per_sec();
+      if (device.bandwidth() > 0 && calibration_device.bandwidth() > 0) {
+        device_info.gb_per_sec *= static_cast<double>(device.bandwidth()) /
+                                  calibration_device.bandwidth();
+      }
+    }
+    overhead_ns = calibration->overhead_ns();
+  }
   if (device_info.gigaops <= 0 || device_info.gb_per_sec <= 0 ||
       device_info.intermediate_read_gb_per_sec <= 0 ||
       device_info.intermediate_write_gb_per_sec <= 0) {
@@ -859,7 +930,8 @@ Costs OpLevelCostEstimator::PredictOpCountBasedCost(
             << " device model:" << op_info.device().model();
   }
 
-  Costs::NanoSeconds compute_cost(std::ceil(operations / device_info.gigaops));
+  Costs::NanoSeconds compute_cost(
+      std::ceil(operations / device_info.gigaops + overhead_ns));
   VLOG(1) << "Op:" << op_info.op() << " GOps:" << operations / 1e9
           << " Compute Time (ns):" << compute_cost.count();
 
@@ -106,6 +106,15 @@ class OpLevelCostEstimator {
   // Returns basic device performance info.
   virtual DeviceInfo GetDeviceInfo(const DeviceProperties& device) const;
 
+  // Returns the class of ops that `op` belongs to, e.g. "MatMul" or
+  // "Elementwise", or an empty string if its throughput can't be calibrated.
+  string GetOpClass(const string& op) const;
+
+  // Predicts the costs of the ops run on devices of the type of
+  // `calibration.device()` from the fitted throughput of their op class,
+  // instead of the peak performance of the device.
+  void SetCalibration(const OpCostCalibration& calibration);
+
  protected:
   // TODO(dyoon): Consider to remove PredictOpCountBasedCosts() with OpInfo.
   // Naive cost estimate based on the given operations count and total
@@ -335,8 +344,16 @@ class OpLevelCostEstimator {
   // compute_time and memory_time, instead of sum of those two.
   bool compute_memory_overlap_;
   std::set<string> persistent_ops_;
+  // Indexed by op name.
+  std::map<string, string> op_classes_;
+  OpCostCalibration calibration_;
 
  private:
+  // Returns the calibrated throughput of the class of the op in `op_info`, or
+  // nullptr if there's none.
+  const OpCostCalibration::OpClass* FindCalibration(
+      const OpInfo& op_info) const;
+
   friend class OpLevelCostEstimatorTest;
 };
 
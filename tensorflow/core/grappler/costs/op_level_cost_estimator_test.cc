@@ -852,6 +852,46 @@ TEST_F(OpLevelCostEstimatorTest, Conv2DExecutionTime) {
   EXPECT_EQ(cost.persistent_memory, 0);
 }
 
+TEST_F(OpLevelCostEstimatorTest, CalibratedExecutionTime) {
+  EXPECT_EQ(estimator_.GetOpClass("Conv2D"), "Convolution");
+  EXPECT_EQ(estimator_.GetOpClass("BatchMatMulV2"), "MatMul");
+  EXPECT_EQ(estimator_.GetOpClass("Relu"), "Elementwise");
+  EXPECT_EQ(estimator_.GetOpClass("Transpose"), "DataMovement");
+  EXPECT_EQ(estimator_.GetOpClass("NoOp"), "");
+
+  OpCostCalibration calibration;
+  calibration.mutable_device()->set_type("CPU");
+  calibration.mutable_device()->set_num_cores(10);
+  calibration.mutable_device()->set_bandwidth(10000000);
+  auto* convolution = &(*calibration.mutable_op_class())["Convolution"];
+  convolution->set_gigaops(20);
+  convolution->set_gb_per_sec(5);
+  convolution->set_overhead_ns(1000);
+  const Costs matmul_cost = PredictCosts(DescribeMatMul(1000, 100, 100, 1000));
+  estimator_.SetCalibration(calibration);
+
+  // 3548774400 operations at 20 Gops/s, plus the overhead, and 2337792 bytes
+  // at 5 GB/s.
+  OpContext op_context = DescribeConvolution(16, 19, 19, 48, 48, 5, 5, 256);
+  auto cost = PredictCosts(op_context);
+  EXPECT_EQ(Costs::Duration(467559), cost.memory_time);
+  EXPECT_EQ(Costs::Duration(177439720), cost.compute_time);
+  EXPECT_EQ(Costs::Duration(177907279), cost.execution_time);
+
+  // The throughput scales with the cores and the bandwidth of the device.
+  op_context.op_info.mutable_device()->set_num_cores(5);
+  op_context.op_info.mutable_device()->set_bandwidth(20000000);
+  cost = PredictCosts(op_context);
+  EXPECT_EQ(Costs::Duration(233780), cost.memory_time);
+  EXPECT_EQ(Costs::Duration(354878440), cost.compute_time);
+
+  // Other op classes and device types keep the peak performance.
+  EXPECT_EQ(matmul_cost.execution_time,
+            PredictCosts(DescribeMatMul(1000, 100, 100, 1000)).execution_time);
+  op_context.op_info.mutable_device()->set_type("GPU");
+  EXPECT_NE(Costs::Duration(354878440), PredictCosts(op_context).compute_time);
+}
+
 TEST_F(OpLevelCostEstimatorTest, InvalidConv2DConfig) {
   // Convolution ops.
   const std::vector<std::string> conv_ops = {
@@ -0,0 +1,481 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/grappler/optimizers/cold_branch_outliner.h"
+
+#include <algorithm>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/str_cat.h"
+#include "tensorflow/core/common_runtime/graph_constructor.h"
+#include "tensorflow/core/framework/attr_value.pb.h"
+#include "tensorflow/core/framework/function.h"
+#include "tensorflow/core/framework/graph_to_functiondef.h"
+#include "tensorflow/core/framework/node_def_util.h"
+#include "tensorflow/core/framework/op.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/graph/tensor_id.h"
+#include "tensorflow/core/grappler/graph_view.h"
+#include "tensorflow/core/grappler/grappler_item.h"
+#include "tensorflow/core/grappler/op_types.h"
+#include "tensorflow/core/grappler/optimizers/custom_graph_optimizer_registry.h"
+#include "tensorflow/core/grappler/utils.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/platform/env.h"
+
+namespace tensorflow {
+namespace grappler {
+namespace {
+
+// The Switch nodes sharing a predicate, and the output they never took in the
+// profile, if any.
+struct Conditional {
+  std::vector<const NodeDef*> switches;
+  int cold_port = -1;
+};
+
+// The interface of a branch moved to a function.
+struct ColdBranch {
+  // Tensors read by the branch, in the order of the function arguments.
+  std::vector<string> inputs;
+  std::vector<DataType> input_types;
+  // Nodes outside of the branch it has a control dependency on.
+  std::vector<string> control_inputs;
+  // Tensors of the branch read by Merge nodes, in the order of the function
+  // outputs.
+  std::vector<string> outputs;
+  std::vector<DataType> output_types;
+  bool is_stateful = false;
+};
+
+// Returns the type of `tensor`, which must be passed to or from a function.
+Status GetTensorType(const GraphView& graph_view,
+                     const FunctionLibraryDefinition& flib,
+                     const TensorId& tensor, DataType* type) {
+  const NodeDef* node = graph_view.GetNode(tensor.node());
+  if (node == nullptr) {
+    return errors::NotFound("Node ", tensor.node(), " not found");
+  }
+  const OpDef* op_def = nullptr;
+  TF_RETURN_IF_ERROR(flib.LookUpOpDef(node->op(), &op_def));
+  TF_RETURN_IF_ERROR(OutputTypeForNode(*node, *op_def, tensor.index(), type));
+  if (IsRefType(*type)) {
+    return errors::Unimplemented("Can't pass reference ", tensor.ToString(),
+                                 " to a function");
+  }
+  return absl::OkStatus();
+}
+
+// Returns true if `node` is in the transitive fanout of a Switch, without a
+// Merge in between, i.e. if its output can be dead. `live` holds the nodes
+// already known not to be, and is extended with the nodes visited otherwise.
+bool MightBeDead(const GraphView& graph_view, const NodeDef* node,
+                 absl::flat_hash_set<const NodeDef*>* live) {
+  absl::flat_hash_set<const NodeDef*> visited;
+  std::vector<const NodeDef*> to_visit = {node};
+  while (!to_visit.empty()) {
+    const NodeDef* current = to_visit.back();
+    to_visit.pop_back();
+    if (live->contains(current) || !visited.insert(current).second) continue;
+    if (IsSwitch(*current)) return true;
+    if (IsMerge(*current)) continue;
+    for (const GraphView::OutputPort& fanin :
+         graph_view.GetFanins(*current, /*include_controlling_nodes=*/true)) {
+      to_visit.push_back(fanin.node);
+    }
+  }
+  live->insert(visited.begin(), visited.end());
+  return false;
+}
+
+// Collects the nodes that only run when `conditional` takes its cold output,
+// i.e. its transitive fanout up to the Merge nodes, and the interface of the
+// function they can be moved to. Returns an error if they can't be moved.
+Status FindColdBranch(const GraphView& graph_view,
+                      const FunctionLibraryDefinition& flib,
+                      const Conditional& conditional,
+                      const std::unordered_set<string>& nodes_to_preserve,
+                      const absl::flat_hash_map<string, int64_t>& executions,
+                      absl::flat_hash_set<const NodeDef*>* branch,
+                      ColdBranch* cold_branch) {
+  const GraphDef& graph = *graph_view.graph();
+  std::vector<const NodeDef*> to_visit;
+  for (const NodeDef* switch_node : conditional.switches) {
+    for (const GraphView::InputPort& fanout : graph_view.GetFanout(
+             GraphView::OutputPort(switch_node, conditional.cold_port))) {
+      to_visit.push_back(fanout.node);
+    }
+  }
+  absl::flat_hash_set<const NodeDef*> merges;
+  while (!to_visit.empty()) {
+    const NodeDef* node = to_visit.back();
+    to_visit.pop_back();
+    if (IsMerge(*node)) {
+      merges.insert(node);
+      continue;
+    }
+    if (!branch->insert(node).second) continue;
+    if (nodes_to_preserve.count(node->name()) > 0) {
+      return errors::FailedPrecondition(node->name(), " must be preserved");
+    }
+    if (IsControlFlow(*node) || IsSwitch(*node)) {
+      return errors::Unimplemented("Nested control flow node ", node->name());
+    }
+    if (executions.contains(node->name())) {
+      return errors::FailedPrecondition(node->name(), " was executed");
+    }
+    for (const GraphView::InputPort& fanout :
+         graph_view.GetFanouts(*node, /*include_controlled_nodes=*/true)) {
+      to_visit.push_back(fanout.node);
+    }
+  }
+
+  absl::flat_hash_set<string> inputs;
+  absl::flat_hash_set<const NodeDef*> live;
+  for (const NodeDef& node : graph.node()) {
+    if (!branch->contains(&node)) continue;
+    for (const string& input : node.input()) {
+      const TensorId tensor = ParseTensorName(input);
+      const NodeDef* producer = graph_view.GetNode(tensor.node());
+      if (branch->contains(producer)) continue;
+      // A dead input would kill the whole call, including the outputs of the
+      // branch that were alive in the original graph.
+      const bool is_cold_output =
+          producer != nullptr && tensor.index() == conditional.cold_port &&
+          std::find(conditional.switches.begin(), conditional.switches.end(),
+                    producer) != conditional.switches.end();
+      if (producer != nullptr && !is_cold_output &&
+          MightBeDead(graph_view, producer, &live)) {
+        return errors::Unimplemented("Input ", input, " of ", node.name(),
+                                     " depends on another Switch");
+      }
+      const string tensor_name = TensorIdToString(tensor);
+      if (!inputs.insert(tensor_name).second) continue;
+      if (IsTensorIdControl(tensor)) {
+        cold_branch->control_inputs.emplace_back(tensor.node());
+        continue;
+      }
+      DataType type;
+      TF_RETURN_IF_ERROR(GetTensorType(graph_view, flib, tensor, &type));
+      cold_branch->inputs.push_back(tensor_name);
+      cold_branch->input_types.push_back(type);
+    }
+    cold_branch->is_stateful |= IsStateful(node, &flib);
+  }
+
+  absl::flat_hash_set<string> outputs;
+  for (const NodeDef& node : graph.node()) {
+    if (!merges.contains(&node)) continue;
+    bool has_other_input = false;
+    for (const string& input : node.input()) {
+      const TensorId tensor = ParseTensorName(input);
+      if (!branch->contains(graph_view.GetNode(tensor.node()))) {
+        has_other_input |= !IsTensorIdControl(tensor);
+        continue;
+      }
+      if (IsTensorIdControl(tensor)) {
+        return errors::Unimplemented("Control dependency of Merge ",
+                                     node.name(), " on the branch");
+      }
+      const string tensor_name = TensorIdToString(tensor);
+      if (!outputs.insert(tensor_name).second) continue;
+      DataType type;
+      TF_RETURN_IF_ERROR(GetTensorType(graph_view, flib, tensor, &type));
+      cold_branch->outputs.push_back(tensor_name);
+      cold_branch->output_types.push_back(type);
+    }
+    if (!has_other_input) {
+      return errors::Unimplemented("All the inputs of Merge ", node.name(),
+                                   " are in the branch");
+    }
+  }
+  if (cold_branch->outputs.empty()) {
+    return errors::Unimplemented("The branch doesn't feed any Merge");
+  }
+
+  // The call of the function reads the inputs of the branch, which must not
+  // depend on the Merge nodes it feeds, other than through a loop.
+  absl::flat_hash_set<const NodeDef*> producers;
+  for (const string& input : cold_branch->inputs) {
+    producers.insert(graph_view.GetNode(NodeName(input)));
+  }
+  for (const string& control_input : cold_branch->control_inputs) {
+    producers.insert(graph_view.GetNode(control_input));
+  }
+  absl::flat_hash_set<const NodeDef*> visited;
+  to_visit.assign(merges.begin(), merges.end());
+  while (!to_visit.empty()) {
+    const NodeDef* node = to_visit.back();
+    to_visit.pop_back();
+    if (!visited.insert(node).second || IsNextIteration(*node)) continue;
+    if (producers.contains(node)) {
+      return errors::Unimplemented("The inputs of the branch depend on ",
+                                   node->name(), " in its fanout");
+    }
+    for (const GraphView::InputPort& fanout :
+         graph_view.GetFanouts(*node, /*include_controlled_nodes=*/true)) {
+      if (!branch->contains(fanout.node)) to_visit.push_back(fanout.node);
+    }
+  }
+  return absl::OkStatus();
+}
+
+// Makes the function `function_name` running the nodes of `branch`.
+Status MakeColdBranchFunction(const GraphDef& graph,
+                              const FunctionLibraryDefinition& flib,
+                              const absl::flat_hash_set<const NodeDef*>& branch,
+                              const ColdBranch& cold_branch,
+                              const string& function_name,
+                              FunctionDef* function) {
+  GraphDef body;
+  *body.mutable_versions() = graph.versions();
+  absl::flat_hash_map<string, string> args;
+  for (int i = 0; i < cold_branch.inputs.size(); ++i) {
+    NodeDef* arg = body.add_node();
+    arg->set_name(absl::StrCat("_cold_branch_arg_", i));
+    arg->set_op("_Arg");
+    AddNodeAttr("T", cold_branch.input_types[i], arg);
+    AddNodeAttr("index", i, arg);
+    args[cold_branch.inputs[i]] = arg->name();
+  }
+  absl::flat_hash_set<absl::string_view> branch_nodes;
+  for (const NodeDef* node : branch) branch_nodes.insert(node->name());
+  for (const NodeDef& node : graph.node()) {
+    if (!branch.contains(&node)) continue;
+    NodeDef* body_node = body.add_node();
+    *body_node = node;
+    body_node->clear_input();
+    for (const string& input : node.input()) {
+      const TensorId tensor = ParseTensorName(input);
+      if (IsTensorIdControl(tensor)) {
+        // Control dependencies on the rest of the graph move to the call.
+        if (branch_nodes.contains(tensor.node())) body_node->add_input(input);
+        continue;
+      }
+      auto it = args.find(TensorIdToString(tensor));
+      body_node->add_input(it != args.end() ? it->second : input);
+    }
+  }
+  for (int i = 0; i < cold_branch.outputs.size(); ++i) {
+    NodeDef* retval = body.add_node();
+    retval->set_name(absl::StrCat("_cold_branch_retval_", i));
+    retval->set_op("_Retval");
+    retval->add_input(cold_branch.outputs[i]);
+    AddNodeAttr("T", cold_branch.output_types[i], retval);
+    AddNodeAttr("index", i, retval);
+  }
+
+  Graph function_graph(flib);
+  GraphConstructorOptions options;
+  options.allow_internal_ops = true;
+  TF_RETURN_IF_ERROR(
+      ConvertGraphDefToGraph(options, std::move(body), &function_graph));
+  return GraphToFunctionDef(function_graph, function_name, function);
+}
+
+// Returns the name of the function the cold branch of `switch_node` is moved
+// to, which is not in `flib` yet.
+string ColdBranchFunctionName(const NodeDef& switch_node,
+                              const FunctionLibraryDefinition& flib) {
+  string base = absl::StrCat("__cold_branch_", switch_node.name());
+  std::replace_if(
+      base.begin(), base.end(),
+      [](char c) { return !absl::ascii_isalnum(c) && c != '_'; }, '_');
+  string function_name = base;
+  for (int i = 1; flib.Find(function_name) != nullptr; ++i) {
+    function_name = absl::StrCat(base, "_", i);
+  }
+  return function_name;
+}
+
+}  // namespace
+
+Status ColdBranchOutliner::Init(
+    const tensorflow::RewriterConfig_CustomGraphOptimizer* config) {
+  if (config == nullptr) return absl::OkStatus();
+  const auto& parameters = config->parameter_map();
+  auto it = parameters.find(kColdBranchOutlinerMinSwitchExecutions);
+  if (it != parameters.end()) {
+    min_switch_executions_ = it->second.i();
+    if (min_switch_executions_ < 1) {
+      return errors::InvalidArgument("Invalid value for parameter ",
+                                     kColdBranchOutlinerMinSwitchExecutions,
+                                     ": ", min_switch_executions_);
+    }
+  }
+  it = parameters.find(kColdBranchOutlinerStepStatsFiles);
+  if (it != parameters.end()) {
+    std::vector<string> files;
+    if (it->second.value_case() == AttrValue::kList) {
+      files.assign(it->second.list().s().begin(), it->second.list().s().end());
+    } else {
+      files.push_back(it->second.s());
+    }
+    for (const string& file : files) {
+      StepStats step_stats;
+      if (!ReadBinaryProto(Env::Default(), file, &step_stats).ok()) {
+        TF_RETURN_IF_ERROR(ReadTextProto(Env::Default(), file, &step_stats));
+      }
+      AddStepStats(step_stats);
+    }
+  }
+  return absl::OkStatus();
+}
+
+void ColdBranchOutliner::AddStepStats(const StepStats& step_stats) {
+  for (const DeviceStepStats& device_stats : step_stats.dev_stats()) {
+    for (const NodeExecStats& node_stats : device_stats.node_stats()) {
+      ++executions_[node_stats.node_name()];
+    }
+  }
+}
+
+Status ColdBranchOutliner::Optimize(Cluster* cluster, const GrapplerItem& item,
+                                    GraphDef* optimized_graph) {
+  if (executions_.empty()) return errors::Aborted("Nothing to do.");
+
+  // Group the Switch nodes by predicate, and find the output they never took.
+  std::vector<Conditional> conditionals;
+  absl::flat_hash_map<string, int> conditional_index;
+  for (const NodeDef& node : item.graph.node()) {
+    if (node.op() != "Switch" || node.input_size() < 2) continue;
+    const string predicate = TensorIdToString(ParseTensorName(node.input(1)));
+    auto inserted = conditional_index.emplace(predicate, conditionals.size());
+    if (inserted.second) conditionals.emplace_back();
+    conditionals[inserted.first->second].switches.push_back(&node);
+  }
+  GraphView graph_view(&item.graph);
+  bool has_cold_port = false;
+  for (Conditional& conditional : conditionals) {
+    int64_t switch_executions = 0;
+    bool taken[2] = {false, false};
+    for (const NodeDef* switch_node : conditional.switches) {
+      auto it = executions_.find(switch_node->name());
+      if (it != executions_.end()) {
+        switch_executions = std::max(switch_executions, it->second);
+      }
+      for (int port = 0; port < 2; ++port) {
+        for (const GraphView::InputPort& fanout :
+             graph_view.GetFanout(GraphView::OutputPort(switch_node, port))) {
+          taken[port] |= executions_.contains(fanout.node->name());
+        }
+      }
+    }
+    if (switch_executions >= min_switch_executions_ && taken[0] != taken[1]) {
+      conditional.cold_port = taken[0] ? 1 : 0;
+      has_cold_port = true;
+    }
+  }
+  if (!has_cold_port) return errors::Aborted("Nothing to do.");
+
+  const std::unordered_set<string> nodes_to_preserve = item.NodesToPreserve();
+  FunctionLibraryDefinition flib(OpRegistry::Global(), item.graph.library());
+  absl::flat_hash_set<const NodeDef*> outlined_nodes;
+  // Outputs of the calls replacing the outputs of the branches in Merge nodes.
+  absl::flat_hash_map<string, string> merge_inputs;
+  std::vector<NodeDef> calls;
+  std::vector<FunctionDef> functions;
+  for (const Conditional& conditional : conditionals) {
+    if (conditional.cold_port < 0) continue;
+    const NodeDef& switch_node = *conditional.switches.front();
+    absl::flat_hash_set<const NodeDef*> branch;
+    ColdBranch cold_branch;
+    Status status =
+        FindColdBranch(graph_view, flib, conditional, nodes_to_preserve,
+                       executions_, &branch, &cold_branch);
+    for (const NodeDef* node : branch) {
+      if (status.ok() && outlined_nodes.contains(node)) {
+        status = errors::Unimplemented(node->name(), " is already outlined");
+      }
+    }
+    FunctionDef function;
+    const string function_name = ColdBranchFunctionName(switch_node, flib);
+    if (status.ok()) {
+      status = MakeColdBranchFunction(item.graph, flib, branch, cold_branch,
+                                      function_name, &function);
+    }
+    if (!status.ok()) {
+      VLOG(2) << "Can't outline the cold branch of " << switch_node.name()
+              << ": " << status;
+      continue;
+    }
+    TF_RETURN_IF_ERROR(flib.AddFunctionDef(function));
+    functions.push_back(std::move(function));
+
+    NodeDef& call = calls.emplace_back();
+    string call_name = AddPrefixToNodeName("cold_branch", switch_node.name());
+    for (int i = 1; graph_view.GetNode(call_name) != nullptr; ++i) {
+      call_name = absl::StrCat(
+          AddPrefixToNodeName("cold_branch", switch_node.name()), "_", i);
+    }
+    call.set_name(call_name);
+    call.set_op(cold_branch.is_stateful ? "StatefulPartitionedCall"
+                                        : "PartitionedCall");
+    call.set_device(switch_node.device());
+    for (const string& input : cold_branch.inputs) call.add_input(input);
+    for (const string& control_input : cold_branch.control_inputs) {
+      call.add_input(AsControlDependency(control_input));
+    }
+    AddNodeAttr("Tin", cold_branch.input_types, &call);
+    AddNodeAttr("Tout", cold_branch.output_types, &call);
+    NameAttrList f;
+    f.set_name(function_name);
+    AddNodeAttr("f", f, &call);
+    for (int i = 0; i < cold_branch.outputs.size(); ++i) {
+      merge_inputs[cold_branch.outputs[i]] =
+          i == 0 ? call_name : absl::StrCat(call_name, ":", i);
+    }
+    outlined_nodes.insert(branch.begin(), branch.end());
+    VLOG(1) << "Outlined " << branch.size() << " nodes of the cold branch of "
+            << switch_node.name() << " to " << function_name;
+  }
+  if (calls.empty()) return errors::Aborted("Nothing to do.");
+
+  optimized_graph->Clear();
+  *optimized_graph->mutable_versions() = item.graph.versions();
+  *optimized_graph->mutable_library() = item.graph.library();
+  for (FunctionDef& function : functions) {
+    *optimized_graph->mutable_library()->add_function() = std::move(function);
+  }
+  for (const NodeDef& node : item.graph.node()) {
+    if (outlined_nodes.contains(&node)) continue;
+    NodeDef* new_node = optimized_graph->add_node();
+    *new_node = node;
+    if (!IsMerge(node)) continue;
+    for (int i = 0; i < new_node->input_size(); ++i) {
+      auto it =
+          merge_inputs.find(TensorIdToString(ParseTensorName(node.input(i))));
+      if (it != merge_inputs.end()) new_node->set_input(i, it->second);
+    }
+  }
+  for (NodeDef& call : calls) {
+    *optimized_graph->add_node() = std::move(call);
+  }
+  VLOG(1) << "Outlined " << outlined_nodes.size() << " of "
+          << item.graph.node_size() << " nodes into " << calls.size()
+          << " cold branches";
+  return absl::OkStatus();
+}
+
+REGISTER_GRAPH_OPTIMIZER_AS(ColdBranchOutliner, "ColdBranchOutliner");
+
+}  // end namespace grappler
+}  // end namespace tensorflow
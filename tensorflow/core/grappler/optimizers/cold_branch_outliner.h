@@ -0,0 +1,81 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_GRAPPLER_OPTIMIZERS_COLD_BRANCH_OUTLINER_H_
+#define TENSORFLOW_CORE_GRAPPLER_OPTIMIZERS_COLD_BRANCH_OUTLINER_H_
+
+#include "absl/container/flat_hash_map.h"
+#include "tensorflow/core/framework/step_stats.pb.h"
+#include "tensorflow/core/grappler/optimizers/custom_graph_optimizer.h"
+
+namespace tensorflow {
+namespace grappler {
+
+// Parameters of the ColdBranchOutliner in the parameter_map of its
+// RewriterConfig::CustomGraphOptimizer.
+constexpr char kColdBranchOutlinerStepStatsFiles[] = "step_stats_files";
+constexpr char kColdBranchOutlinerMinSwitchExecutions[] =
+    "min_switch_executions";
+
+// Moves the branches of the Switch/Merge conditionals that were never taken
+// while profiling the graph into functions, which only get instantiated the
+// first time the branch is taken. The profile is made of the StepStats of
+// traced runs of the graph (RunMetadata::step_stats with a SOFTWARE_TRACE or
+// FULL_TRACE RunOptions), which only hold the nodes that were executed: an
+// output of a Switch was taken if one of its consumers was executed.
+//
+// The Switch nodes with the same predicate are outlined together, since they
+// all take the same branch. Their never taken outputs, and the other tensors
+// read by the branch, are passed to a PartitionedCall of the function, whose
+// outputs replace the ones of the branch in its Merge nodes. The Switch nodes
+// are kept: the call is dead, and not run, for as long as the branch isn't
+// taken, and runs the original branch otherwise. The outlined nodes are no
+// longer placed, optimized and allocated with the rest of the graph.
+//
+// A conditional is only outlined when its Switch nodes were executed at least
+// min_switch_executions times in the profile, and when its branch contains
+// no control flow or nodes to preserve, and reads no tensors computed from
+// other outputs of Switch nodes, whose dead outputs would kill the whole call.
+//
+// This optimizer runs after the built-in optimizers when it's listed in the
+// custom_optimizers of the RewriterConfig as "ColdBranchOutliner".
+class ColdBranchOutliner : public CustomGraphOptimizer {
+ public:
+  ColdBranchOutliner() = default;
+  ~ColdBranchOutliner() override {}
+
+  Status Init(
+      const tensorflow::RewriterConfig_CustomGraphOptimizer* config) override;
+
+  string name() const override { return "cold_branch_outliner"; };
+
+  bool UsesFunctionLibrary() const override { return false; }
+
+  // Adds the nodes executed in `step_stats` to the profile.
+  void AddStepStats(const StepStats& step_stats);
+
+  Status Optimize(Cluster* cluster, const GrapplerItem& item,
+                  GraphDef* optimized_graph) override;
+
+ private:
+  // Number of times each node was executed in the profile.
+  absl::flat_hash_map<string, int64_t> executions_;
+  int64_t min_switch_executions_ = 10;
+};
+
+}  // end namespace grappler
+}  // end namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_GRAPPLER_OPTIMIZERS_COLD_BRANCH_OUTLINER_H_
@@ -0,0 +1,295 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/grappler/optimizers/cold_branch_outliner.h"
+
+#include "absl/strings/str_cat.h"
+#include "tensorflow/cc/ops/standard_ops.h"
+#include "tensorflow/core/framework/node_def_util.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/grappler/grappler_item.h"
+#include "tensorflow/core/grappler/utils/grappler_test.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/core/public/session.h"
+
+namespace tensorflow {
+namespace grappler {
+namespace {
+
+// Returns the StepStats of `steps` runs executing `nodes`.
+StepStats MakeStepStats(const std::vector<string>& nodes, int steps) {
+  StepStats step_stats;
+  DeviceStepStats* device_stats = step_stats.add_dev_stats();
+  device_stats->set_device("/job:localhost/replica:0/task:0/device:CPU:0");
+  for (int step = 0; step < steps; ++step) {
+    for (const string& node : nodes) {
+      device_stats->add_node_stats()->set_node_name(node);
+    }
+  }
+  return step_stats;
+}
+
+class ColdBranchOutlinerTest : public GrapplerTest {
+ protected:
+  // Builds out = Merge(Exp(Sqrt(x)) if not pred, Square(x) if pred).
+  GrapplerItem MakeConditional() {
+    tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+    Output x = ops::Placeholder(s.WithOpName("x"), DT_FLOAT,
+                                ops::Placeholder::Shape({4}));
+    Output pred = ops::Placeholder(s.WithOpName("pred"), DT_BOOL,
+                                   ops::Placeholder::Shape({}));
+    ops::Switch branches(s.WithOpName("switch"), x, pred);
+    Output sqrt = ops::Sqrt(s.WithOpName("cold/sqrt"), branches.output_false);
+    Output exp = ops::Exp(s.WithOpName("cold/exp"), sqrt);
+    Output square = ops::Square(s.WithOpName("hot"), branches.output_true);
+    ops::Merge merge(s.WithOpName("merge"), {exp, square});
+    Output out = ops::Identity(s.WithOpName("out"), merge.output);
+
+    GrapplerItem item;
+    item.fetch = {"out"};
+    TF_CHECK_OK(s.ToGraphDef(&item.graph));
+    return item;
+  }
+};
+
+TEST_F(ColdBranchOutlinerTest, OutlinesBranchNeverTaken) {
+  GrapplerItem item = MakeConditional();
+  ColdBranchOutliner optimizer;
+  optimizer.AddStepStats(
+      MakeStepStats({"x", "pred", "switch", "hot", "merge", "out"}, 10));
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+
+  // The two nodes of the cold branch move to a function called from the
+  // output of the Switch they read.
+  EXPECT_EQ(output.node_size(), item.graph.node_size() - 1);
+  const NodeDef* call = nullptr;
+  for (const NodeDef& node : output.node()) {
+    EXPECT_NE(node.name(), "cold/sqrt");
+    EXPECT_NE(node.name(), "cold/exp");
+    if (node.op() == "PartitionedCall") call = &node;
+  }
+  ASSERT_NE(call, nullptr);
+  ASSERT_EQ(call->input_size(), 1);
+  EXPECT_EQ(call->input(0), "switch");
+  ASSERT_EQ(output.library().function_size(), 1);
+  const FunctionDef& function = output.library().function(0);
+  EXPECT_EQ(call->attr().at("f").func().name(), function.signature().name());
+  EXPECT_EQ(function.node_def_size(), 2);
+  for (const NodeDef& node : output.node()) {
+    if (node.name() == "merge") EXPECT_EQ(node.input(0), call->name());
+  }
+
+  // The cold branch still runs when it's taken.
+  auto x_t = GenerateRandomTensor<DT_FLOAT>(TensorShape({4}));
+  x_t.flat<float>() = x_t.flat<float>().abs();
+  for (bool pred : {true, false}) {
+    Tensor pred_t(DT_BOOL, TensorShape({}));
+    pred_t.scalar<bool>()() = pred;
+    const std::vector<std::pair<string, Tensor>> feed = {{"x", x_t},
+                                                         {"pred", pred_t}};
+    auto expected = EvaluateNodes(item.graph, item.fetch, feed);
+    auto tensors = EvaluateNodes(output, item.fetch, feed);
+    ASSERT_EQ(tensors.size(), 1);
+    test::ExpectTensorNear<float>(tensors[0], expected[0], 1e-6);
+  }
+}
+
+TEST_F(ColdBranchOutlinerTest, ReadsProfileFromFiles) {
+  GrapplerItem item = MakeConditional();
+  const string file =
+      io::JoinPath(testing::TmpDir(), "cold_branch_outliner_step_stats.pb");
+  TF_ASSERT_OK(WriteBinaryProto(
+      Env::Default(), file,
+      MakeStepStats({"x", "pred", "switch", "hot", "merge", "out"}, 2)));
+
+  ColdBranchOutliner optimizer;
+  RewriterConfig_CustomGraphOptimizer config;
+  (*config.mutable_parameter_map())[kColdBranchOutlinerStepStatsFiles]
+      .mutable_list()
+      ->add_s(file);
+  (*config.mutable_parameter_map())[kColdBranchOutlinerMinSwitchExecutions]
+      .set_i(2);
+  TF_ASSERT_OK(optimizer.Init(&config));
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+  EXPECT_EQ(output.library().function_size(), 1);
+}
+
+TEST_F(ColdBranchOutlinerTest, KeepsBranchesWithoutEnoughExecutions) {
+  GrapplerItem item = MakeConditional();
+  ColdBranchOutliner optimizer;
+  optimizer.AddStepStats(
+      MakeStepStats({"x", "pred", "switch", "hot", "merge", "out"}, 9));
+  GraphDef output;
+  EXPECT_TRUE(errors::IsAborted(optimizer.Optimize(nullptr, item, &output)));
+}
+
+TEST_F(ColdBranchOutlinerTest, KeepsBranchesTakenInProfile) {
+  GrapplerItem item = MakeConditional();
+  ColdBranchOutliner optimizer;
+  optimizer.AddStepStats(
+      MakeStepStats({"x", "pred", "switch", "hot", "merge", "out"}, 10));
+  optimizer.AddStepStats(MakeStepStats({"cold/sqrt", "cold/exp"}, 1));
+  GraphDef output;
+  EXPECT_TRUE(errors::IsAborted(optimizer.Optimize(nullptr, item, &output)));
+}
+
+TEST_F(ColdBranchOutlinerTest, KeepsBranchesToPreserve) {
+  GrapplerItem item = MakeConditional();
+  item.fetch.push_back("cold/sqrt");
+  ColdBranchOutliner optimizer;
+  optimizer.AddStepStats(
+      MakeStepStats({"x", "pred", "switch", "hot", "merge", "out"}, 10));
+  GraphDef output;
+  EXPECT_TRUE(errors::IsAborted(optimizer.Optimize(nullptr, item, &output)));
+}
+
+TEST_F(ColdBranchOutlinerTest, KeepsBranchesReadingOtherSwitches) {
+  // The cold branch also reads an output of a Switch with another predicate,
+  // either directly or through an Identity, which isn't executed enough in the
+  // profile to be outlined itself. Its dead output would kill the call of the
+  // whole branch.
+  for (const bool through_identity : {false, true}) {
+    tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+    Output x = ops::Placeholder(s.WithOpName("x"), DT_FLOAT,
+                                ops::Placeholder::Shape({4}));
+    Output pred = ops::Placeholder(s.WithOpName("pred"), DT_BOOL,
+                                   ops::Placeholder::Shape({}));
+    Output other_pred = ops::Placeholder(s.WithOpName("other_pred"), DT_BOOL,
+                                         ops::Placeholder::Shape({}));
+    ops::Switch branches(s.WithOpName("switch"), x, pred);
+    ops::Switch other_branches(s.WithOpName("other_switch"), x, other_pred);
+    Output other = other_branches.output_true;
+    if (through_identity) {
+      other = ops::Identity(s.WithOpName("other_identity"), other);
+    }
+    Output sqrt = ops::Sqrt(s.WithOpName("cold/sqrt"), branches.output_false);
+    Output add = ops::Add(s.WithOpName("cold/add"), sqrt, other);
+    Output square = ops::Square(s.WithOpName("hot"), branches.output_true);
+    ops::Merge merge(s.WithOpName("merge"), {add, square});
+    ops::Identity(s.WithOpName("out"), merge.output);
+
+    GrapplerItem item;
+    item.fetch = {"out"};
+    TF_ASSERT_OK(s.ToGraphDef(&item.graph));
+    ColdBranchOutliner optimizer;
+    optimizer.AddStepStats(
+        MakeStepStats({"x", "pred", "switch", "hot", "merge", "out"}, 10));
+    GraphDef output;
+    EXPECT_TRUE(errors::IsAborted(optimizer.Optimize(nullptr, item, &output)))
+        << "through_identity=" << through_identity;
+  }
+}
+
+// Builds out = Merge(cold branch if not pred, Square(x) if pred), where the
+// cold branch is a chain of `num_nodes` MatMuls by constant matrices, and
+// returns its profile when pred is always true in `step_stats`.
+GrapplerItem MakeLargeConditional(int num_nodes, StepStats* step_stats) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+  Output x = ops::Placeholder(s.WithOpName("x"), DT_FLOAT,
+                              ops::Placeholder::Shape({1, 64}));
+  Output pred = ops::Placeholder(s.WithOpName("pred"), DT_BOOL,
+                                 ops::Placeholder::Shape({}));
+  ops::Switch branches(s.WithOpName("switch"), x, pred);
+  Output cold = branches.output_false;
+  for (int i = 0; i < num_nodes; ++i) {
+    Output weights = ops::Const(s.WithOpName(absl::StrCat("cold/w", i)),
+                                0.01f, TensorShape({64, 64}));
+    cold = ops::MatMul(s.WithOpName(absl::StrCat("cold/matmul", i)), cold,
+                       weights);
+  }
+  Output hot = ops::Square(s.WithOpName("hot"), branches.output_true);
+  ops::Merge merge(s.WithOpName("merge"), {cold, hot});
+  ops::Identity(s.WithOpName("out"), merge.output);
+
+  GrapplerItem item;
+  item.fetch = {"out"};
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  *step_stats =
+      MakeStepStats({"x", "pred", "switch", "hot", "merge", "out"}, 10);
+  return item;
+}
+
+// Returns the graph of `item`, with its cold branch outlined if `outline`.
+GraphDef MaybeOutline(const GrapplerItem& item, const StepStats& step_stats,
+                      bool outline) {
+  if (!outline) return item.graph;
+  ColdBranchOutliner optimizer;
+  optimizer.AddStepStats(step_stats);
+  GraphDef output;
+  TF_CHECK_OK(optimizer.Optimize(nullptr, item, &output));
+  return output;
+}
+
+std::vector<std::pair<string, Tensor>> HotBranchFeed() {
+  Tensor x_t(DT_FLOAT, TensorShape({1, 64}));
+  x_t.flat<float>().setConstant(1.0f);
+  Tensor pred_t(DT_BOOL, TensorShape({}));
+  pred_t.scalar<bool>()() = true;
+  return {{"x", x_t}, {"pred", pred_t}};
+}
+
+// Creates a session for a graph with a large cold branch, which isn't (0) or
+// is (1) outlined, and runs it once, i.e. the time to load a model and serve
+// its first request.
+static void BM_LoadColdBranch(::testing::benchmark::State& state) {
+  const bool outline = state.range(0);
+  StepStats step_stats;
+  const GrapplerItem item =
+      MakeLargeConditional(/*num_nodes=*/256, &step_stats);
+  const GraphDef graph = MaybeOutline(item, step_stats, outline);
+  const auto feed = HotBranchFeed();
+
+  for (auto s : state) {
+    std::unique_ptr<Session> session(NewSession(SessionOptions()));
+    TF_CHECK_OK(session->Create(graph));
+    std::vector<Tensor> outputs;
+    TF_CHECK_OK(session->Run(feed, {"out"}, {}, &outputs));
+    TF_CHECK_OK(session->Close());
+  }
+  state.SetLabel(absl::StrCat("Nodes: ", graph.node_size()));
+}
+BENCHMARK(BM_LoadColdBranch)->Arg(0)->Arg(1);
+
+// Runs the graph of BM_LoadColdBranch in an existing session, taking its hot
+// branch.
+static void BM_RunColdBranch(::testing::benchmark::State& state) {
+  const bool outline = state.range(0);
+  StepStats step_stats;
+  const GrapplerItem item =
+      MakeLargeConditional(/*num_nodes=*/256, &step_stats);
+  const GraphDef graph = MaybeOutline(item, step_stats, outline);
+  const auto feed = HotBranchFeed();
+
+  std::unique_ptr<Session> session(NewSession(SessionOptions()));
+  TF_CHECK_OK(session->Create(graph));
+  std::vector<Tensor> outputs;
+  TF_CHECK_OK(session->Run(feed, {"out"}, {}, &outputs));
+  for (auto s : state) {
+    TF_CHECK_OK(session->Run(feed, {"out"}, {}, &outputs));
+  }
+  TF_CHECK_OK(session->Close());
+  state.SetLabel(absl::StrCat("Nodes: ", graph.node_size()));
+}
+BENCHMARK(BM_RunColdBranch)->Arg(0)->Arg(1);
+
+}  // namespace
+}  // namespace grappler
+}  // namespace tensorflow
@@ -17,8 +17,11 @@ limitations under the License.
 
 #include "tensorflow/core/grappler/optimizers/constant_folding.h"
 
+#include <algorithm>
 #include <cmath>
+#include <set>
 
+#include "absl/algorithm/container.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
@@ -43,15 +46,20 @@ limitations under the License.
 #include "tensorflow/core/grappler/optimizers/evaluation_utils.h"
 #include "tensorflow/core/grappler/utils.h"
 #include "tensorflow/core/grappler/utils/symbolic_shapes.h"
+#include "tensorflow/core/grappler/utils/topological_sort.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/stringpiece.h"
 #include "tensorflow/core/lib/gtl/cleanup.h"
 #include "tensorflow/core/lib/gtl/inlined_vector.h"
+#include "tensorflow/core/lib/io/path.h"
 #include "tensorflow/core/lib/strings/numbers.h"
+#include "tensorflow/core/lib/strings/proto_serialization.h"
 #include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/byte_order.h"
 #include "tensorflow/core/platform/cpu_info.h"
 #include "tensorflow/core/platform/denormal.h"
 #include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/fingerprint.h"
 #include "tensorflow/core/platform/setround.h"
 #include "tensorflow/core/platform/tensor_coding.h"
 #include "tensorflow/core/public/version.h"
@@ -65,6 +73,10 @@ using TensorVector = gtl::InlinedVector<TensorValue, 4>;
 
 // We only fold/materialize constants smaller than 100kB.
 const int64_t kMaxConstantSize = 100 * 1024;
+// Unless they are stored in the folded constant cache instead of the graph.
+// They are still materialized in the GraphDef while folding, which must stay
+// well below the 2GB limit of protocol buffers.
+const int64_t kMaxCachedConstantSize = int64_t{32} << 20;
 
 namespace {
 template <typename T>
@@ -193,21 +205,24 @@ float QuantizedTypeMaxAsFloat(DataType data_type) {
 ConstantFolding::ConstantFolding(RewriterConfig::Toggle opt_level,
                                  DeviceBase* cpu_device,
                                  bool disable_compressed_tensor_optimization,
-                                 bool fold_quantization_emulation)
+                                 bool fold_quantization_emulation,
+                                 const string& folded_constant_cache_dir)
     : opt_level_(opt_level),
       cpu_device_(cpu_device),
       disable_compressed_tensor_optimization_(
           disable_compressed_tensor_optimization),
-      fold_quantization_emulation_(fold_quantization_emulation) {
+      fold_quantization_emulation_(fold_quantization_emulation),
+      folded_constant_cache_dir_(folded_constant_cache_dir) {
   resource_mgr_.reset(new ResourceMgr());
 }
 
 ConstantFolding::ConstantFolding(DeviceBase* cpu_device,
                                  bool disable_compressed_tensor_optimization,
-                                 bool fold_quantization_ops)
+                                 bool fold_quantization_ops,
+                                 const string& folded_constant_cache_dir)
     : ConstantFolding(RewriterConfig::ON, cpu_device,
                       disable_compressed_tensor_optimization,
-                      fold_quantization_ops) {}
+                      fold_quantization_ops, folded_constant_cache_dir) {}
 
 // static
 string ConstantFolding::AddControlDependency(const string& input_name,
@@ -1037,7 +1052,8 @@ bool ConstantFolding::IsFoldableUncached(
         if (num_bytes < 0) {  // Overflown
           return false;
         }
-        if (num_bytes > input_size_bytes && num_bytes > kMaxConstantSize) {
+        if (num_bytes > input_size_bytes &&
+            num_bytes > MaxConstantSize(node, output_prop.dtype())) {
           // Do not fold nodes if the in-memory size of output is too large.
           // Notice that this is not exactly the same check used in
           // CreateNodeDef() where the actual encoded size is checked.
@@ -1247,7 +1263,8 @@ bool IsValidConstShapeForMulConvPushDown(
 // static
 Status ConstantFolding::CreateNodeDef(const string& name,
                                       const TensorValue& tensor, NodeDef* node,
-                                      size_t original_size) {
+                                      size_t original_size,
+                                      int64_t max_constant_size) {
   node->set_name(name);
   node->set_op("Const");
 
@@ -1326,10 +1343,10 @@ Status ConstantFolding::CreateNodeDef(const string& name,
   }
   node->mutable_attr()->insert({"value", attr_tensor});
 
-  if (encoded_size > original_size && encoded_size >= kMaxConstantSize) {
+  if (encoded_size > original_size && encoded_size >= max_constant_size) {
     return absl::InvalidArgumentError(
         absl::StrCat("Can't fold ", name, ", its size would be too large (",
-                     encoded_size, " >= ", kMaxConstantSize, " bytes)"));
+                     encoded_size, " >= ", max_constant_size, " bytes)"));
   }
   return absl::OkStatus();
 }
@@ -1408,8 +1425,9 @@ Status ConstantFolding::EvaluateOneFoldable(const NodeDef& node,
       node_name = strings::StrCat(node_name, "-", i);
     }
     if (output_tensors[i].tensor) {
-      Status s = CreateNodeDef(node_name, output_tensors[i], &outputs->at(i),
-                               total_inputs_size);
+      Status s = CreateNodeDef(
+          node_name, output_tensors[i], &outputs->at(i), total_inputs_size,
+          MaxConstantSize(node, output_tensors[i]->dtype()));
       if (!s.ok()) {
         *result_too_large = true;
         return s;
@@ -4018,6 +4036,266 @@ Status ConstantFolding::AddQuantizedMatMulMinMaxOutConstNodes(
   return absl::OkStatus();
 }
 
+void ConstantFolding::ComputeSubgraphFingerprints(const GrapplerItem& item) {
+  subgraph_fingerprints_.clear();
+  cacheable_nodes_.clear();
+  std::vector<const NodeDef*> topo_order;
+  if (!ComputeTopologicalOrder(item.graph, &topo_order).ok()) {
+    return;
+  }
+  // Fetch nodes keep their name when they are replaced by an ImmutableConst.
+  absl::flat_hash_set<string> fetch_nodes;
+  for (const string& fetch : item.fetch) {
+    fetch_nodes.insert(NodeName(fetch));
+  }
+  // The cached values are raw tensor buffers computed by the kernels of this
+  // build, so they are only valid for the same version and byte order.
+  const uint64 environment_fingerprint = Fingerprint64(
+      absl::StrCat(tf_git_version(), "/", port::kLittleEndian));
+  for (const NodeDef* node : topo_order) {
+    if (feed_nodes_.contains(node->name()) || IsControlFlow(*node) ||
+        !IsFreeOfSideEffect(*node)) {
+      continue;
+    }
+    const bool is_constant = IsConstant(*node);
+    if (!is_constant && node->input_size() == 0) {
+      continue;
+    }
+    bool has_fingerprint = true;
+    uint64 fingerprint =
+        FingerprintCat64(environment_fingerprint, Fingerprint64(node->op()));
+    std::vector<string> attr_names;
+    for (const auto& attr : node->attr()) {
+      // Skip the internal attributes, such as the colocation constraints.
+      if (!absl::StartsWith(attr.first, "_")) {
+        attr_names.push_back(attr.first);
+      }
+    }
+    std::sort(attr_names.begin(), attr_names.end());
+    for (const string& attr_name : attr_names) {
+      string serialized;
+      if (!SerializeToStringDeterministic(node->attr().at(attr_name),
+                                          &serialized)) {
+        has_fingerprint = false;
+        break;
+      }
+      fingerprint = FingerprintCat64(fingerprint, Fingerprint64(attr_name));
+      fingerprint = FingerprintCat64(fingerprint, Fingerprint64(serialized));
+    }
+    for (int i = 0; has_fingerprint && i < node->input_size(); ++i) {
+      int port;
+      const string input_node = ParseNodeName(node->input(i), &port);
+      auto it = subgraph_fingerprints_.find(input_node);
+      // Control dependencies could delay the evaluation of the subgraph.
+      if (port < 0 || it == subgraph_fingerprints_.end()) {
+        has_fingerprint = false;
+        break;
+      }
+      fingerprint = FingerprintCat64(fingerprint, it->second);
+      fingerprint = FingerprintCat64(fingerprint, port);
+    }
+    if (!has_fingerprint) continue;
+    subgraph_fingerprints_[node->name()] = fingerprint;
+
+    // Only the nodes that are folded in place can be cached.
+    const OpDef* op_def = nullptr;
+    int num_outputs = 0;
+    if (!is_constant &&
+        (nodes_to_preserve_.find(node->name()) == nodes_to_preserve_.end() ||
+         fetch_nodes.contains(node->name())) &&
+        (node->device().empty() || NodeIsOnCpu(node)) &&
+        OpRegistry::Global()->LookUpOpDef(node->op(), &op_def).ok() &&
+        NumOutputsForNode(*node, *op_def, &num_outputs).ok() &&
+        num_outputs == 1) {
+      cacheable_nodes_.insert(node->name());
+    }
+  }
+}
+
+int64_t ConstantFolding::MaxConstantSize(const NodeDef& node,
+                                         DataType dtype) const {
+  if (cacheable_nodes_.contains(node.name()) && DataTypeCanUseMemcpy(dtype)) {
+    return kMaxCachedConstantSize;
+  }
+  return kMaxConstantSize;
+}
+
+string ConstantFolding::FoldedConstantPath(uint64 fingerprint) const {
+  return io::JoinPath(
+      folded_constant_cache_dir_,
+      absl::StrCat(absl::Hex(fingerprint, absl::kZeroPad16), ".tensor"));
+}
+
+string ConstantFolding::FoldedConstantMetadataPath(uint64 fingerprint) const {
+  return io::JoinPath(
+      folded_constant_cache_dir_,
+      absl::StrCat(absl::Hex(fingerprint, absl::kZeroPad16), ".meta"));
+}
+
+void ConstantFolding::ReplaceWithImmutableConst(uint64 fingerprint,
+                                                DataType dtype,
+                                                const TensorShapeProto& shape,
+                                                NodeDef* node) {
+  node->set_op("ImmutableConst");
+  node->mutable_attr()->clear();
+  (*node->mutable_attr())["dtype"].set_type(dtype);
+  *(*node->mutable_attr())["shape"].mutable_shape() = shape;
+  (*node->mutable_attr())["memory_region_name"].set_s(
+      FoldedConstantPath(fingerprint));
+}
+
+Status ConstantFolding::LoadFoldedConstants(const GraphProperties& properties,
+                                            GraphDef* graph) {
+  Env* env = Env::Default();
+  absl::flat_hash_map<string, int> node_index;
+  for (int i = 0; i < graph->node_size(); ++i) {
+    node_index[graph->node(i).name()] = i;
+  }
+  std::vector<std::vector<int>> fanouts(graph->node_size());
+  std::vector<int> num_fanouts(graph->node_size(), 0);
+  for (int i = 0; i < graph->node_size(); ++i) {
+    for (const string& input : graph->node(i).input()) {
+      auto it = node_index.find(NodeName(input));
+      if (it == node_index.end()) continue;
+      fanouts[it->second].push_back(i);
+      ++num_fanouts[it->second];
+    }
+  }
+
+  // The metadata is written last, so the value is complete if it exists.
+  absl::flat_hash_map<int, TensorProto> cached;
+  for (int i = 0; i < graph->node_size(); ++i) {
+    const NodeDef& node = graph->node(i);
+    if (!cacheable_nodes_.contains(node.name())) continue;
+    const std::vector<OpInfo::TensorProperties>& outputs =
+        properties.GetOutputProperties(node.name());
+    if (!outputs.empty()) {
+      const PartialTensorShape shape(outputs[0].shape());
+      if (shape.IsFullyDefined() &&
+          shape.num_elements() * DataTypeSize(outputs[0].dtype()) <
+              kMaxConstantSize) {
+        continue;
+      }
+    }
+    const uint64 fingerprint = subgraph_fingerprints_.at(node.name());
+    const string metadata_path = FoldedConstantMetadataPath(fingerprint);
+    TensorProto metadata;
+    if (!env->FileExists(metadata_path).ok() ||
+        !ReadBinaryProto(env, metadata_path, &metadata).ok()) {
+      continue;
+    }
+    uint64 file_size = 0;
+    if (!TensorShape::IsValid(metadata.tensor_shape()) ||
+        !DataTypeCanUseMemcpy(metadata.dtype()) ||
+        !env->GetFileSize(FoldedConstantPath(fingerprint), &file_size).ok() ||
+        file_size != TensorShape(metadata.tensor_shape()).num_elements() *
+                         DataTypeSize(metadata.dtype())) {
+      LOG(WARNING) << "Ignoring invalid folded constant "
+                   << FoldedConstantPath(fingerprint);
+      continue;
+    }
+    cached[i] = std::move(metadata);
+  }
+
+  std::vector<int> maybe_dead;
+  for (auto& entry : cached) {
+    NodeDef* node = graph->mutable_node(entry.first);
+    // Consumers that only depend on constants are still folded from the
+    // subgraph, since an ImmutableConst can't be folded.
+    const bool has_foldable_consumer =
+        absl::c_any_of(fanouts[entry.first], [&](int fanout) {
+          return subgraph_fingerprints_.contains(graph->node(fanout).name()) &&
+                 !cached.contains(fanout);
+        });
+    if (has_foldable_consumer) continue;
+    const uint64 fingerprint = subgraph_fingerprints_.at(node->name());
+    VLOG(1) << "Loading the value of " << node->name() << " from "
+            << FoldedConstantPath(fingerprint);
+    for (const string& input : node->input()) {
+      auto it = node_index.find(NodeName(input));
+      if (it != node_index.end() && --num_fanouts[it->second] == 0) {
+        maybe_dead.push_back(it->second);
+      }
+    }
+    node->clear_input();
+    ReplaceWithImmutableConst(fingerprint, entry.second.dtype(),
+                              entry.second.tensor_shape(), node);
+  }
+
+  // Remove the nodes that are no longer needed to compute the constants.
+  std::set<int> nodes_to_delete;
+  while (!maybe_dead.empty()) {
+    const int index = maybe_dead.back();
+    maybe_dead.pop_back();
+    const NodeDef& node = graph->node(index);
+    if (num_fanouts[index] > 0 ||
+        nodes_to_preserve_.find(node.name()) != nodes_to_preserve_.end() ||
+        feed_nodes_.contains(node.name()) || !IsFreeOfSideEffect(node) ||
+        !nodes_to_delete.insert(index).second) {
+      continue;
+    }
+    for (const string& input : node.input()) {
+      auto it = node_index.find(NodeName(input));
+      if (it != node_index.end() && --num_fanouts[it->second] == 0) {
+        maybe_dead.push_back(it->second);
+      }
+    }
+  }
+  EraseNodesFromGraph(nodes_to_delete, graph);
+  return absl::OkStatus();
+}
+
+Status ConstantFolding::StoreFoldedConstants(GraphDef* graph) {
+  Env* env = Env::Default();
+  bool created_dir = false;
+  for (NodeDef& node : *graph->mutable_node()) {
+    if (!IsConstant(node) || !cacheable_nodes_.contains(node.name())) {
+      continue;
+    }
+    const uint64 fingerprint = subgraph_fingerprints_.at(node.name());
+    Tensor value;
+    if (!value.FromProto(node.attr().at("value").tensor()) ||
+        !DataTypeCanUseMemcpy(value.dtype()) ||
+        static_cast<int64_t>(value.TotalBytes()) < kMaxConstantSize) {
+      continue;
+    }
+    const string path = FoldedConstantPath(fingerprint);
+    const string metadata_path = FoldedConstantMetadataPath(fingerprint);
+    if (!env->FileExists(metadata_path).ok()) {
+      if (!created_dir) {
+        TF_RETURN_IF_ERROR(
+            env->RecursivelyCreateDir(folded_constant_cache_dir_));
+        created_dir = true;
+      }
+      // Write to temporary files and rename them, so that concurrent loads
+      // never see partial files.
+      string tmp_path = path;
+      if (!env->CreateUniqueFileName(&tmp_path, ".tmp")) {
+        return errors::Internal("Failed to create a temporary file for ",
+                                path);
+      }
+      TF_RETURN_IF_ERROR(WriteStringToFile(env, tmp_path, value.tensor_data()));
+      TF_RETURN_IF_ERROR(env->RenameFile(tmp_path, path));
+      TensorProto metadata;
+      metadata.set_dtype(value.dtype());
+      value.shape().AsProto(metadata.mutable_tensor_shape());
+      string tmp_metadata_path = metadata_path;
+      if (!env->CreateUniqueFileName(&tmp_metadata_path, ".tmp")) {
+        return errors::Internal("Failed to create a temporary file for ",
+                                metadata_path);
+      }
+      TF_RETURN_IF_ERROR(WriteBinaryProto(env, tmp_metadata_path, metadata));
+      TF_RETURN_IF_ERROR(env->RenameFile(tmp_metadata_path, metadata_path));
+      VLOG(1) << "Stored the value of " << node.name() << " in " << path;
+    }
+    // Keep the control dependencies of the folded node.
+    TensorShapeProto shape;
+    value.shape().AsProto(&shape);
+    ReplaceWithImmutableConst(fingerprint, value.dtype(), shape, &node);
+  }
+  return absl::OkStatus();
+}
+
 Status ConstantFolding::RunOptimizationPass(Cluster* cluster,
                                             GrapplerItem* item,
                                             GraphProperties* properties,
@@ -4083,6 +4361,20 @@ Status ConstantFolding::Optimize(Cluster* cluster, const GrapplerItem& item,
 
   has_fetch_ = !item.fetch.empty();
   GrapplerItem item_to_optimize = item;
+  if (!folded_constant_cache_dir_.empty()) {
+    ComputeSubgraphFingerprints(item);
+    GraphProperties original_properties(item);
+    if (!original_properties
+             .InferStatically(/*assume_valid_feeds=*/false,
+                              /*aggressive_shape_inference=*/false,
+                              /*include_input_tensor_values=*/false,
+                              /*include_output_tensor_values=*/false)
+             .ok()) {
+      original_properties.Clear();
+    }
+    TF_RETURN_IF_ERROR(
+        LoadFoldedConstants(original_properties, &item_to_optimize.graph));
+  }
   GraphProperties properties(item_to_optimize);
   // It's possible to feed a placeholder with a tensor of any shape: make sure
   // that the shape inference deals with this conservatively unless we're in
@@ -4109,6 +4401,9 @@ Status ConstantFolding::Optimize(Cluster* cluster, const GrapplerItem& item,
     TF_RETURN_IF_ERROR(RunOptimizationPass(cluster, &item_to_optimize,
                                            &properties, optimized_graph));
   } while (graph_modified_ || optimized_graph->node_size() != node_count);
+  if (!folded_constant_cache_dir_.empty()) {
+    TF_RETURN_IF_ERROR(StoreFoldedConstants(optimized_graph));
+  }
   *optimized_graph->mutable_library() = item.graph.library();
   *optimized_graph->mutable_versions() = item.graph.versions();
 
@@ -41,16 +41,23 @@ class ConstantFolding : public GraphOptimizer {
   // The size limit will only be considered if the newly created node is greater
   // than original_size (optional).
   static Status CreateNodeDef(const string& name, const TensorValue& tensor,
-                              NodeDef* node, size_t original_size = 0);
+                              NodeDef* node, size_t original_size = 0,
+                              int64_t max_constant_size = kMaxConstantSize);
   static string AddControlDependency(const string& input_name, GraphDef* graph,
                                      NodeMap* node_map);
 
+  // If `folded_constant_cache_dir` is non-empty, large folded constants are
+  // written to files in this directory and memory mapped with ImmutableConst
+  // nodes instead of being inlined in the graph, and the subgraphs whose value
+  // is already in the directory are not evaluated again.
   explicit ConstantFolding(DeviceBase* cpu_device,
                            bool disable_compressed_tensor_optimization = false,
-                           bool fold_quantization_emulation = true);
+                           bool fold_quantization_emulation = true,
+                           const string& folded_constant_cache_dir = "");
   ConstantFolding(RewriterConfig::Toggle opt_level, DeviceBase* cpu_device,
                   bool disable_compressed_tensor_optimization = false,
-                  bool fold_quantization_emulation = true);
+                  bool fold_quantization_emulation = true,
+                  const string& folded_constant_cache_dir = "");
 
   ~ConstantFolding() override {}
 
@@ -322,6 +329,30 @@ class ConstantFolding : public GraphOptimizer {
   Status AddQuantizedMatMulMinMaxOutConstNodes(NodeDef* node,
                                                GraphDef* optimized_graph);
 
+  // Fingerprints the subgraph computing each node of the graph of `item` that
+  // only depends on constants, regardless of the names of the nodes.
+  void ComputeSubgraphFingerprints(const GrapplerItem& item);
+  // Returns the maximum size of the constant of type `dtype` created by folding
+  // `node`, which is larger if the constant is stored in the cache.
+  int64_t MaxConstantSize(const NodeDef& node, DataType dtype) const;
+  // Returns the paths of the files holding the value and the dtype and shape
+  // of the folded constant with the given fingerprint.
+  string FoldedConstantPath(uint64 fingerprint) const;
+  string FoldedConstantMetadataPath(uint64 fingerprint) const;
+  // Replaces the nodes of `graph` whose value is in the folded constant cache
+  // with ImmutableConst nodes, and removes the nodes that only fed them. The
+  // nodes that `properties` show to be smaller than kMaxConstantSize are never
+  // cached, and aren't looked up.
+  Status LoadFoldedConstants(const GraphProperties& properties,
+                             GraphDef* graph);
+  // Writes the large constants folded in `graph` to the folded constant cache
+  // and replaces them with ImmutableConst nodes.
+  Status StoreFoldedConstants(GraphDef* graph);
+  // Replaces `node` by an ImmutableConst node memory mapping the value of the
+  // folded constant with the given fingerprint.
+  void ReplaceWithImmutableConst(uint64 fingerprint, DataType dtype,
+                                 const TensorShapeProto& shape, NodeDef* node);
+
   // Points to an externally provided device or to owned_device_;
   RewriterConfig::Toggle opt_level_;
   DeviceBase* cpu_device_;
@@ -340,6 +371,13 @@ class ConstantFolding : public GraphOptimizer {
   bool graph_contains_assign_or_inplace_op_;
   bool disable_compressed_tensor_optimization_;
   bool fold_quantization_emulation_;
+  string folded_constant_cache_dir_;
+  // Fingerprints of the subgraphs computing the nodes of the original graph
+  // that only depend on constants, keyed by node name.
+  absl::flat_hash_map<string, uint64> subgraph_fingerprints_;
+  // Nodes of the original graph whose value can be stored in the folded
+  // constant cache, i.e. the non constant nodes folded in place.
+  absl::flat_hash_set<string> cacheable_nodes_;
 };
 
 }  // end namespace grappler
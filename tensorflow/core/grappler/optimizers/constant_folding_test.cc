@@ -31,9 +31,12 @@ limitations under the License.
 #include "tensorflow/core/grappler/utils.h"
 #include "tensorflow/core/grappler/utils/grappler_test.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/io/path.h"
 #include "tensorflow/core/lib/strings/str_util.h"
 #include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/platform/tensor_coding.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/core/public/session.h"
 
 namespace tensorflow {
 namespace grappler {
@@ -3246,6 +3249,120 @@ TEST_F(ConstantFoldingTest, LargeConstant) {
   test::ExpectTensorEqual<float>(tensors_expected[0], tensors[0]);
 }
 
+TEST_F(ConstantFoldingTest, LargeConstantFoldedIntoCache) {
+  const string cache_dir =
+      io::JoinPath(testing::TmpDir(), "large_constant_folded_into_cache");
+  int64_t undeleted_files, undeleted_dirs;
+  if (Env::Default()->FileExists(cache_dir).ok()) {
+    TF_ASSERT_OK(Env::Default()->DeleteRecursively(cache_dir, &undeleted_files,
+                                                   &undeleted_dirs));
+  }
+
+  tensorflow::Scope scope = tensorflow::Scope::NewRootScope();
+  Output x = ops::Placeholder(scope.WithOpName("x"), DT_FLOAT,
+                              ops::Placeholder::Shape({1, 1024}));
+  Output mat_diag =
+      ops::Const(scope.WithOpName("mat_diag"), 3.14f, TensorShape({1024}));
+  Output mat = ops::Diag(scope.WithOpName("mat"), mat_diag);
+  Output out = ops::MatMul(scope.WithOpName("out"), x, mat);
+
+  GrapplerItem item;
+  TF_CHECK_OK(scope.ToGraphDef(&item.graph));
+  item.fetch.push_back("out");
+
+  // The 4MB constant is written to the cache instead of the graph.
+  ConstantFolding optimizer(/*cpu_device=*/nullptr,
+                            /*disable_compressed_tensor_optimization=*/false,
+                            /*fold_quantization_emulation=*/true, cache_dir);
+  GraphDef output;
+  TF_EXPECT_OK(optimizer.Optimize(/*cluster=*/nullptr, item, &output));
+  string memory_region_name;
+  for (const NodeDef& node : output.node()) {
+    if (node.name() == "mat") {
+      EXPECT_EQ(node.op(), "ImmutableConst");
+      EXPECT_EQ(node.attr().at("dtype").type(), DT_FLOAT);
+      EXPECT_EQ(TensorShape(node.attr().at("shape").shape()),
+                TensorShape({1024, 1024}));
+      memory_region_name = node.attr().at("memory_region_name").s();
+    }
+  }
+  EXPECT_TRUE(absl::StartsWith(memory_region_name, cache_dir));
+  TF_EXPECT_OK(Env::Default()->FileExists(memory_region_name));
+  EXPECT_LT(output.ByteSizeLong(), sizeof(float) * 1024 + 1000);
+
+  auto x_t = GenerateRandomTensor<DT_FLOAT>(TensorShape({1, 1024}));
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, {{"x", x_t}});
+  ASSERT_EQ(tensors_expected.size(), 1);
+  auto tensors = EvaluateNodes(output, item.fetch, {{"x", x_t}});
+  ASSERT_EQ(tensors.size(), 1);
+  test::ExpectTensorEqual<float>(tensors_expected[0], tensors[0]);
+
+  // The same subgraph with other node names is loaded from the cache, and the
+  // nodes that computed it are removed without being evaluated.
+  tensorflow::Scope other_scope = tensorflow::Scope::NewRootScope();
+  Output other_x =
+      ops::Placeholder(other_scope.WithOpName("other_x"), DT_FLOAT,
+                       ops::Placeholder::Shape({1, 1024}));
+  Output other_diag = ops::Const(other_scope.WithOpName("other_diag"), 3.14f,
+                                 TensorShape({1024}));
+  Output other_mat = ops::Diag(other_scope.WithOpName("other_mat"), other_diag);
+  Output other_out =
+      ops::MatMul(other_scope.WithOpName("other_out"), other_x, other_mat);
+
+  GrapplerItem other_item;
+  TF_CHECK_OK(other_scope.ToGraphDef(&other_item.graph));
+  other_item.fetch.push_back("other_out");
+
+  ConstantFolding other_optimizer(
+      /*cpu_device=*/nullptr,
+      /*disable_compressed_tensor_optimization=*/false,
+      /*fold_quantization_emulation=*/true, cache_dir);
+  GraphDef other_output;
+  TF_EXPECT_OK(
+      other_optimizer.Optimize(/*cluster=*/nullptr, other_item, &other_output));
+  int found = 0;
+  for (const NodeDef& node : other_output.node()) {
+    EXPECT_NE(node.name(), "other_diag");
+    if (node.name() == "other_mat") {
+      EXPECT_EQ(node.op(), "ImmutableConst");
+      EXPECT_EQ(node.input_size(), 0);
+      EXPECT_EQ(node.attr().at("memory_region_name").s(), memory_region_name);
+      ++found;
+    }
+  }
+  EXPECT_EQ(found, 1);
+
+  tensors = EvaluateNodes(other_output, other_item.fetch, {{"other_x", x_t}});
+  ASSERT_EQ(tensors.size(), 1);
+  test::ExpectTensorEqual<float>(tensors_expected[0], tensors[0]);
+}
+
+TEST_F(ConstantFoldingTest, SmallConstantNotFoldedIntoCache) {
+  const string cache_dir =
+      io::JoinPath(testing::TmpDir(), "small_constant_not_folded_into_cache");
+  tensorflow::Scope scope = tensorflow::Scope::NewRootScope();
+  Output mat_diag =
+      ops::Const(scope.WithOpName("mat_diag"), 3.14f, TensorShape({16}));
+  Output mat = ops::Diag(scope.WithOpName("mat"), mat_diag);
+  Output out = ops::Identity(scope.WithOpName("out"), mat);
+
+  GrapplerItem item;
+  TF_CHECK_OK(scope.ToGraphDef(&item.graph));
+  item.fetch.push_back("out");
+
+  ConstantFolding optimizer(/*cpu_device=*/nullptr,
+                            /*disable_compressed_tensor_optimization=*/false,
+                            /*fold_quantization_emulation=*/true, cache_dir);
+  GraphDef output;
+  TF_EXPECT_OK(optimizer.Optimize(/*cluster=*/nullptr, item, &output));
+  for (const NodeDef& node : output.node()) {
+    if (node.name() == "mat") {
+      EXPECT_EQ(node.op(), "Const");
+    }
+  }
+  EXPECT_FALSE(Env::Default()->FileExists(cache_dir).ok());
+}
+
 TEST_F(ConstantFoldingTest, SwitchIdenticalInputs) {
   tensorflow::Scope s = tensorflow::Scope::NewRootScope();
   Output x = ops::Placeholder(s.WithOpName("x"), DT_BOOL,
@@ -4411,6 +4528,52 @@ TEST_F(ConstantFoldingTest, RedundantVariableUpdateAddZerosToHandle) {
   }
 }
 
+// Optimizes a graph computing a large constant, creates a session and runs it
+// once, i.e. the time to load a model and serve its first request. The 16MB
+// constant is above kMaxConstantSize, so without the cache (0) it isn't folded
+// and the Diag and Transpose run in the first request. With a warm cache (1)
+// it's memory mapped from the cache instead.
+static void BM_LoadLargeFoldedConstant(::testing::benchmark::State& state) {
+  const bool use_cache = state.range(0);
+  const string cache_dir =
+      io::JoinPath(testing::TmpDir(), "load_large_folded_constant");
+  tensorflow::Scope scope = tensorflow::Scope::NewRootScope();
+  Output x = ops::Placeholder(scope.WithOpName("x"), DT_FLOAT,
+                              ops::Placeholder::Shape({1, 2048}));
+  Output mat_diag =
+      ops::Const(scope.WithOpName("mat_diag"), 0.5f, TensorShape({2048}));
+  Output mat = ops::Transpose(scope.WithOpName("mat"),
+                              ops::Diag(scope.WithOpName("diag"), mat_diag),
+                              {1, 0});
+  ops::MatMul(scope.WithOpName("out"), x, mat);
+
+  GrapplerItem item;
+  TF_CHECK_OK(scope.ToGraphDef(&item.graph));
+  item.fetch.push_back("out");
+  Tensor x_t(DT_FLOAT, TensorShape({1, 2048}));
+  x_t.flat<float>().setConstant(1.0f);
+
+  ConstantFolding warmup(/*cpu_device=*/nullptr,
+                         /*disable_compressed_tensor_optimization=*/false,
+                         /*fold_quantization_emulation=*/true, cache_dir);
+  GraphDef output;
+  TF_CHECK_OK(warmup.Optimize(/*cluster=*/nullptr, item, &output));
+
+  for (auto s : state) {
+    ConstantFolding optimizer(/*cpu_device=*/nullptr,
+                              /*disable_compressed_tensor_optimization=*/false,
+                              /*fold_quantization_emulation=*/true,
+                              use_cache ? cache_dir : "");
+    TF_CHECK_OK(optimizer.Optimize(/*cluster=*/nullptr, item, &output));
+    std::unique_ptr<Session> session(NewSession(SessionOptions()));
+    TF_CHECK_OK(session->Create(output));
+    std::vector<Tensor> outputs;
+    TF_CHECK_OK(session->Run({{"x", x_t}}, {"out"}, {}, &outputs));
+    TF_CHECK_OK(session->Close());
+  }
+}
+BENCHMARK(BM_LoadLargeFoldedConstant)->Arg(0)->Arg(1);
+
 }  // namespace
 }  // namespace grappler
 }  // namespace tensorflow
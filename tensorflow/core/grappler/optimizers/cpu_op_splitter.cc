@@ -0,0 +1,381 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/grappler/optimizers/cpu_op_splitter.h"
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "tensorflow/core/framework/node_def_util.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/tensor_shape.pb.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/grappler/clusters/cluster.h"
+#include "tensorflow/core/grappler/clusters/utils.h"
+#include "tensorflow/core/grappler/costs/graph_properties.h"
+#include "tensorflow/core/grappler/costs/op_context.h"
+#include "tensorflow/core/grappler/costs/op_level_cost_estimator.h"
+#include "tensorflow/core/grappler/grappler_item.h"
+#include "tensorflow/core/grappler/op_types.h"
+#include "tensorflow/core/grappler/utils.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/math/math_util.h"
+#include "tensorflow/core/util/device_name_utils.h"
+
+namespace tensorflow {
+namespace grappler {
+namespace {
+
+constexpr char kOptimizerScope[] = "CpuOpSplitter";
+
+// Eigen's tensor contraction shards its output between threads in blocks of
+// roughly this many elements, so an op with a skinny output keeps fewer threads
+// busy than there are cores. Independent sub-ops each get at least a thread.
+constexpr int64_t kMinOutputsPerThread = 4096;
+
+// Ops predicted to be faster than this are not split, since the overhead of
+// scheduling the sub-ops would dominate.
+constexpr int64_t kMinOpTimeMicros = 50;
+
+// Minimum predicted speedup to split an op.
+constexpr double kMinSpeedup = 1.3;
+
+constexpr int kMaxNumSplits = 16;
+
+// Default memory bandwidth of the OpLevelCostEstimator for CPUs, in KB/s.
+constexpr int64_t kDefaultBandwidth = 32 * 1000 * 1000;
+
+// A way to split an op: its input `input` is split along `input_dim`, and the
+// outputs of the sub-ops are concatenated along `output_dim`.
+struct SplitDimension {
+  int input;
+  int input_dim;
+  int output_dim;
+};
+
+struct Split {
+  SplitDimension dimension;
+  int num_splits = 1;
+  double speedup = 1.0;
+};
+
+bool IsSupportedType(DataType dtype) {
+  return dtype == DT_FLOAT || dtype == DT_DOUBLE || dtype == DT_HALF ||
+         dtype == DT_BFLOAT16;
+}
+
+// Returns the ways to split `node` along its batch and output channel
+// dimensions, if it is a MatMul or an NHWC Conv2D.
+std::vector<SplitDimension> GetSplitDimensions(const NodeDef& node) {
+  if (IsMatMul(node)) {
+    bool transpose_a = false;
+    bool transpose_b = false;
+    TryGetNodeAttr(node, "transpose_a", &transpose_a);
+    TryGetNodeAttr(node, "transpose_b", &transpose_b);
+    return {{0, transpose_a ? 1 : 0, 0}, {1, transpose_b ? 0 : 1, 1}};
+  }
+  if (IsConv2D(node)) {
+    string data_format = "NHWC";
+    TryGetNodeAttr(node, "data_format", &data_format);
+    if (data_format == "NHWC") return {{0, 0, 0}, {1, 3, 3}};
+  }
+  return {};
+}
+
+bool IsOnCpu(const NodeDef& node, bool has_gpu) {
+  if (node.device().empty()) return !has_gpu;
+  DeviceNameUtils::ParsedName parsed;
+  return DeviceNameUtils::ParseFullName(node.device(), &parsed) &&
+         parsed.has_type && parsed.type == DEVICE_CPU;
+}
+
+bool IsFullyDefined(const OpInfo::TensorProperties& tensor) {
+  return PartialTensorShape(tensor.shape()).IsFullyDefined();
+}
+
+int64_t NumElements(const OpInfo::TensorProperties& tensor) {
+  int64_t num_elements = 1;
+  for (const auto& dim : tensor.shape().dim()) {
+    num_elements *= dim.size();
+  }
+  return num_elements;
+}
+
+// Returns one of `num_splits` equal parts of `tensor` along `dim`.
+OpInfo::TensorProperties SplitTensor(const OpInfo::TensorProperties& tensor,
+                                     int dim, int num_splits) {
+  OpInfo::TensorProperties part = tensor;
+  auto* part_dim = part.mutable_shape()->mutable_dim(dim);
+  part_dim->set_size(part_dim->size() / num_splits);
+  return part;
+}
+
+OpInfo::TensorProperties ScalarInt32() {
+  OpInfo::TensorProperties scalar;
+  scalar.set_dtype(DT_INT32);
+  scalar.mutable_shape();
+  return scalar;
+}
+
+// Predicts the execution time of an op, running concurrently with
+// `num_concurrent_ops` - 1 other ops that use the same memory bandwidth.
+Costs::Duration PredictTime(
+    const OpLevelCostEstimator& estimator, const string& op,
+    const AttrValueMap& attr,
+    const std::vector<OpInfo::TensorProperties>& inputs,
+    const std::vector<OpInfo::TensorProperties>& outputs,
+    const DeviceProperties& device, int num_cores, int num_concurrent_ops) {
+  OpContext op_context;
+  op_context.op_info.set_op(op);
+  *op_context.op_info.mutable_attr() = attr;
+  for (const auto& input : inputs) {
+    *op_context.op_info.add_inputs() = input;
+  }
+  for (const auto& output : outputs) {
+    *op_context.op_info.add_outputs() = output;
+  }
+  DeviceProperties* op_device = op_context.op_info.mutable_device();
+  *op_device = device;
+  op_device->set_num_cores(num_cores);
+  const int64_t bandwidth =
+      device.bandwidth() > 0 ? device.bandwidth() : kDefaultBandwidth;
+  op_device->set_bandwidth(bandwidth / num_concurrent_ops);
+  return estimator.PredictCosts(op_context).execution_time;
+}
+
+// Number of cores the intra-op sharding of a contraction with `num_outputs`
+// output elements keeps busy.
+int IntraOpParallelism(int64_t num_outputs, int num_cores) {
+  return std::max<int64_t>(
+      1, std::min<int64_t>(num_cores, MathUtil::CeilOfRatio(
+                                          num_outputs, kMinOutputsPerThread)));
+}
+
+// Searches for the split of `node` with the highest predicted speedup, among
+// all the ways to split it in up to `num_cores` sub-ops that run concurrently.
+Split FindBestSplit(const NodeDef& node,
+                    const std::vector<OpInfo::TensorProperties>& inputs,
+                    const OpInfo::TensorProperties& output,
+                    const std::vector<bool>& input_is_constant,
+                    const OpLevelCostEstimator& estimator,
+                    const DeviceProperties& device, int num_cores) {
+  Split best_split;
+  const int64_t num_outputs = NumElements(output);
+  const Costs::Duration time = PredictTime(
+      estimator, node.op(), node.attr(), inputs, {output}, device,
+      IntraOpParallelism(num_outputs, num_cores), /*num_concurrent_ops=*/1);
+  if (time.asMicroSeconds().count() < kMinOpTimeMicros) return best_split;
+
+  for (const SplitDimension& dimension : GetSplitDimensions(node)) {
+    const int64_t size =
+        inputs[dimension.input].shape().dim(dimension.input_dim).size();
+    for (int num_splits = 2;
+         num_splits <= std::min(kMaxNumSplits, num_cores) && num_splits <= size;
+         num_splits *= 2) {
+      if (size % num_splits != 0) break;
+      std::vector<OpInfo::TensorProperties> part_inputs = inputs;
+      part_inputs[dimension.input] = SplitTensor(
+          inputs[dimension.input], dimension.input_dim, num_splits);
+      const OpInfo::TensorProperties part_output =
+          SplitTensor(output, dimension.output_dim, num_splits);
+      const int part_cores =
+          std::min(IntraOpParallelism(num_outputs / num_splits, num_cores),
+                   std::max(1, num_cores / num_splits));
+      Costs::Duration split_time = PredictTime(
+          estimator, node.op(), node.attr(), part_inputs, {part_output}, device,
+          part_cores, num_splits);
+
+      // Splitting a constant input is free, since it gets constant folded.
+      if (!input_is_constant[dimension.input]) {
+        split_time += PredictTime(
+            estimator, "Split", {},
+            {ScalarInt32(), inputs[dimension.input]},
+            std::vector<OpInfo::TensorProperties>(
+                num_splits, part_inputs[dimension.input]),
+            device, num_cores, /*num_concurrent_ops=*/1);
+      }
+      std::vector<OpInfo::TensorProperties> concat_inputs(num_splits,
+                                                          part_output);
+      concat_inputs.push_back(ScalarInt32());
+      split_time +=
+          PredictTime(estimator, "ConcatV2", {}, concat_inputs, {output},
+                      device, num_cores, /*num_concurrent_ops=*/1);
+
+      const double speedup = static_cast<double>(time.count()) /
+                             std::max<int64_t>(1, split_time.count());
+      VLOG(3) << "Splitting " << node.name() << " in " << num_splits
+              << " along dimension " << dimension.input_dim << " of input "
+              << dimension.input << ": predicted speedup " << speedup;
+      if (speedup > best_split.speedup) {
+        best_split = {dimension, num_splits, speedup};
+      }
+    }
+  }
+  return best_split;
+}
+
+void AddScalarConst(const string& name, int32_t value, const string& device,
+                    const string& control_input, NodeDef* node) {
+  node->set_name(name);
+  node->set_op("Const");
+  node->set_device(device);
+  // The control input places the constant in the frame of the split op.
+  node->add_input(AsControlDependency(control_input));
+  (*node->mutable_attr())["dtype"].set_type(DT_INT32);
+  Tensor tensor(DT_INT32, TensorShape({}));
+  tensor.scalar<int32>()() = value;
+  tensor.AsProtoTensorContent(
+      (*node->mutable_attr())["value"].mutable_tensor());
+}
+
+// Replaces `node` with `split.num_splits` copies computing a part of its
+// output each, and a ConcatV2 of their outputs under the name of `node`.
+void SplitNode(const Split& split, NodeDef* node, GraphDef* graph) {
+  const NodeDef original = *node;
+  const string prefix = absl::StrCat(original.name(), "/", kOptimizerScope);
+  const string& split_input = original.input(split.dimension.input);
+  const DataType dtype = original.attr().at("T").type();
+
+  AddScalarConst(absl::StrCat(prefix, "/split_dim"), split.dimension.input_dim,
+                 original.device(), NodeName(split_input), graph->add_node());
+  NodeDef* split_node = graph->add_node();
+  split_node->set_name(absl::StrCat(prefix, "/split"));
+  split_node->set_op("Split");
+  split_node->set_device(original.device());
+  split_node->add_input(absl::StrCat(prefix, "/split_dim"));
+  split_node->add_input(split_input);
+  (*split_node->mutable_attr())["T"].set_type(dtype);
+  (*split_node->mutable_attr())["num_split"].set_i(split.num_splits);
+
+  std::vector<string> part_names;
+  for (int i = 0; i < split.num_splits; ++i) {
+    NodeDef* part = graph->add_node();
+    *part = original;
+    part->set_name(absl::StrCat(prefix, "/part_", i));
+    part->set_input(split.dimension.input,
+                    absl::StrCat(split_node->name(), ":", i));
+    part_names.push_back(part->name());
+  }
+  const string axis_name = absl::StrCat(prefix, "/axis");
+  AddScalarConst(axis_name, split.dimension.output_dim, original.device(),
+                 part_names[0], graph->add_node());
+
+  node->set_op("ConcatV2");
+  node->clear_input();
+  node->clear_attr();
+  for (const string& part_name : part_names) {
+    node->add_input(part_name);
+  }
+  node->add_input(axis_name);
+  (*node->mutable_attr())["T"].set_type(dtype);
+  (*node->mutable_attr())["N"].set_i(split.num_splits);
+  (*node->mutable_attr())["Tidx"].set_type(DT_INT32);
+}
+
+}  // namespace
+
+Status CpuOpSplitter::Optimize(Cluster* cluster, const GrapplerItem& item,
+                               GraphDef* optimized_graph) {
+  DeviceProperties device;
+  bool has_cpu = false;
+  bool has_gpu = false;
+  if (cluster != nullptr) {
+    for (const auto& cluster_device : cluster->GetDevices()) {
+      if (cluster_device.second.type() == "GPU") has_gpu = true;
+      if (cluster_device.second.type() == "CPU" && !has_cpu) {
+        device = cluster_device.second;
+        has_cpu = true;
+      }
+    }
+  }
+  if (!has_cpu) device = GetLocalCPUInfo();
+  int num_cores = device.num_cores();
+  const int intra_op_threads =
+      item.optimization_options().intra_op_parallelism_threads;
+  if (intra_op_threads > 0) num_cores = std::min(num_cores, intra_op_threads);
+  if (num_cores < 2) return errors::Aborted("Nothing to do.");
+
+  const std::unordered_set<string> nodes_to_preserve = item.NodesToPreserve();
+  std::vector<int> candidates;
+  for (int i = 0; i < item.graph.node_size(); ++i) {
+    const NodeDef& node = item.graph.node(i);
+    if (GetSplitDimensions(node).empty() || !IsOnCpu(node, has_gpu) ||
+        nodes_to_preserve.count(node.name()) > 0 ||
+        node.attr().count("_class") > 0 ||
+        absl::StrContains(node.name(), kOptimizerScope)) {
+      continue;
+    }
+    const auto it = node.attr().find("T");
+    if (it == node.attr().end() || !IsSupportedType(it->second.type())) {
+      continue;
+    }
+    candidates.push_back(i);
+  }
+  if (candidates.empty()) return errors::Aborted("Nothing to do.");
+
+  GraphProperties properties(item);
+  TF_RETURN_IF_ERROR(
+      properties.InferStatically(/*assume_valid_feeds=*/false,
+                                 /*aggressive_shape_inference=*/false,
+                                 /*include_tensor_values=*/false));
+  std::unordered_map<string, const NodeDef*> node_map;
+  for (const NodeDef& node : item.graph.node()) {
+    node_map[node.name()] = &node;
+  }
+
+  *optimized_graph = item.graph;
+  const OpLevelCostEstimator estimator;
+  bool changed = false;
+  for (int i : candidates) {
+    GRAPPLER_RETURN_IF_DEADLINE_EXCEEDED();
+    const NodeDef& node = item.graph.node(i);
+    const std::vector<OpInfo::TensorProperties>& inputs =
+        properties.GetInputProperties(node.name());
+    const std::vector<OpInfo::TensorProperties>& outputs =
+        properties.GetOutputProperties(node.name());
+    if (inputs.size() != 2 || outputs.size() != 1 ||
+        !IsFullyDefined(inputs[0]) || !IsFullyDefined(inputs[1]) ||
+        !IsFullyDefined(outputs[0])) {
+      continue;
+    }
+    std::vector<bool> input_is_constant;
+    for (int input = 0; input < 2; ++input) {
+      const auto it = node_map.find(NodeName(node.input(input)));
+      input_is_constant.push_back(it != node_map.end() &&
+                                  IsConstant(*it->second));
+    }
+    const Split split = FindBestSplit(node, inputs, outputs[0],
+                                      input_is_constant, estimator, device,
+                                      num_cores);
+    if (split.speedup < kMinSpeedup) continue;
+    VLOG(2) << "Splitting " << node.name() << " in " << split.num_splits
+            << " along dimension " << split.dimension.input_dim
+            << " of input " << split.dimension.input
+            << ", predicted speedup " << split.speedup;
+    SplitNode(split, optimized_graph->mutable_node(i), optimized_graph);
+    changed = true;
+  }
+  if (!changed) return errors::Aborted("Nothing to do.");
+  return absl::OkStatus();
+}
+
+}  // end namespace grappler
+}  // end namespace tensorflow
@@ -0,0 +1,49 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_GRAPPLER_OPTIMIZERS_CPU_OP_SPLITTER_H_
+#define TENSORFLOW_CORE_GRAPPLER_OPTIMIZERS_CPU_OP_SPLITTER_H_
+
+#include "tensorflow/core/grappler/optimizers/graph_optimizer.h"
+#include "tensorflow/core/protobuf/rewriter_config.pb.h"
+
+namespace tensorflow {
+namespace grappler {
+
+// Splits large MatMul and Conv2D ops placed on CPU into independent sub-ops
+// along their batch or output channel dimension, and concatenates their
+// outputs. The sub-ops run concurrently on the inter-op thread pool, which
+// keeps more cores busy than the intra-op sharding of a single op with a
+// skinny output, e.g. in batch size one inference. An op is only split when
+// the OpLevelCostEstimator predicts a significant speedup.
+class CpuOpSplitter : public GraphOptimizer {
+ public:
+  CpuOpSplitter() {}
+  explicit CpuOpSplitter(RewriterConfig::Toggle opt_level) {}
+
+  ~CpuOpSplitter() override {}
+
+  string name() const override { return "cpu_op_splitter"; };
+
+  bool UsesFunctionLibrary() const override { return false; }
+
+  Status Optimize(Cluster* cluster, const GrapplerItem& item,
+                  GraphDef* optimized_graph) override;
+};
+
+}  // end namespace grappler
+}  // end namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_GRAPPLER_OPTIMIZERS_CPU_OP_SPLITTER_H_
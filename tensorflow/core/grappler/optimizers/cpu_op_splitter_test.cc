@@ -0,0 +1,223 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/grappler/optimizers/cpu_op_splitter.h"
+
+#include "tensorflow/cc/ops/standard_ops.h"
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/node_def.pb.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/graph/graph_constructor.h"
+#include "tensorflow/core/grappler/clusters/virtual_cluster.h"
+#include "tensorflow/core/grappler/grappler_item.h"
+#include "tensorflow/core/grappler/utils/grappler_test.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace grappler {
+namespace {
+
+class CpuOpSplitterTest : public GrapplerTest {
+ protected:
+  void SetUp() override {
+    DeviceProperties cpu_device;
+    cpu_device.set_type("CPU");
+    cpu_device.set_num_cores(16);
+    cpu_device.set_frequency(2000);
+    cpu_device.set_bandwidth(32 * 1000 * 1000);
+    cluster_.reset(
+        new VirtualCluster({{"/job:localhost/replica:0/task:0/cpu:0",
+                             cpu_device}}));
+    TF_ASSERT_OK(cluster_->Provision());
+  }
+
+  void TearDown() override { TF_ASSERT_OK(cluster_->Shutdown()); }
+
+  std::unique_ptr<VirtualCluster> cluster_;
+};
+
+TEST_F(CpuOpSplitterTest, SplitsSkinnyMatMul) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+  Output x = ops::Placeholder(s.WithOpName("x"), DT_FLOAT,
+                              ops::Placeholder::Shape({1, 1024}));
+  Tensor w_t = GenerateRandomTensor<DT_FLOAT>(TensorShape({1024, 4096}));
+  Output w = ops::Const(s.WithOpName("w"), Input::Initializer(w_t));
+  Output m = ops::MatMul(s.WithOpName("m"), x, w);
+  Output out = ops::Identity(s.WithOpName("out"), m);
+
+  GrapplerItem item;
+  item.fetch = {"out"};
+  TF_ASSERT_OK(s.ToGraphDef(&item.graph));
+
+  GraphDef output;
+  CpuOpSplitter optimizer;
+  TF_ASSERT_OK(optimizer.Optimize(cluster_.get(), item, &output));
+
+  int num_parts = 0;
+  for (const NodeDef& node : output.node()) {
+    if (node.name() == "m") {
+      EXPECT_EQ(node.op(), "ConcatV2");
+      num_parts = node.attr().at("N").i();
+      ASSERT_EQ(node.input_size(), num_parts + 1);
+      EXPECT_EQ(node.input(num_parts), "m/CpuOpSplitter/axis");
+    } else if (node.name() == "m/CpuOpSplitter/split") {
+      // The weights are split along their columns.
+      EXPECT_EQ(node.op(), "Split");
+      EXPECT_EQ(node.input(1), "w");
+    } else if (node.name() == "m/CpuOpSplitter/part_0") {
+      EXPECT_EQ(node.op(), "MatMul");
+      EXPECT_EQ(node.input(0), "x");
+      EXPECT_EQ(node.input(1), "m/CpuOpSplitter/split");
+    }
+  }
+  EXPECT_GE(num_parts, 2);
+  // The split dimension, the Split, the parts and the concat axis.
+  EXPECT_EQ(output.node_size(), item.graph.node_size() + num_parts + 3);
+
+  auto x_t = GenerateRandomTensor<DT_FLOAT>(TensorShape({1, 1024}));
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, {{"x", x_t}});
+  auto tensors = EvaluateNodes(output, item.fetch, {{"x", x_t}});
+  ASSERT_EQ(tensors_expected.size(), 1);
+  ASSERT_EQ(tensors.size(), 1);
+  test::ExpectTensorNear<float>(tensors[0], tensors_expected[0], 1e-3);
+}
+
+TEST_F(CpuOpSplitterTest, KeepsLargeBatchMatMul) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+  Output x = ops::Placeholder(s.WithOpName("x"), DT_FLOAT,
+                              ops::Placeholder::Shape({4096, 256}));
+  Output w = ops::Const(s.WithOpName("w"), 1.0f, {256, 256});
+  Output m = ops::MatMul(s.WithOpName("m"), x, w);
+
+  GrapplerItem item;
+  item.fetch = {"m"};
+  TF_ASSERT_OK(s.ToGraphDef(&item.graph));
+
+  // The intra-op sharding of the MatMul already keeps all the cores busy.
+  GraphDef output;
+  CpuOpSplitter optimizer;
+  EXPECT_TRUE(
+      errors::IsAborted(optimizer.Optimize(cluster_.get(), item, &output)));
+}
+
+TEST_F(CpuOpSplitterTest, SplitsConv2D) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+  Output x = ops::Placeholder(s.WithOpName("x"), DT_FLOAT,
+                              ops::Placeholder::Shape({16, 8, 8, 32}));
+  Output f = ops::Const(s.WithOpName("f"), 0.5f, {1, 1, 32, 16});
+  Output c = ops::Conv2D(s.WithOpName("c"), x, f, {1, 1, 1, 1}, "SAME");
+
+  GrapplerItem item;
+  item.fetch = {"c"};
+  TF_ASSERT_OK(s.ToGraphDef(&item.graph));
+
+  GraphDef output;
+  CpuOpSplitter optimizer;
+  TF_ASSERT_OK(optimizer.Optimize(cluster_.get(), item, &output));
+
+  bool found = false;
+  for (const NodeDef& node : output.node()) {
+    if (node.name() == "c") {
+      EXPECT_EQ(node.op(), "ConcatV2");
+      found = true;
+    } else if (node.name() == "c/CpuOpSplitter/part_0") {
+      EXPECT_EQ(node.op(), "Conv2D");
+    }
+  }
+  EXPECT_TRUE(found);
+
+  auto x_t = GenerateRandomTensor<DT_FLOAT>(TensorShape({16, 8, 8, 32}));
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, {{"x", x_t}});
+  auto tensors = EvaluateNodes(output, item.fetch, {{"x", x_t}});
+  ASSERT_EQ(tensors_expected.size(), 1);
+  ASSERT_EQ(tensors.size(), 1);
+  test::ExpectTensorNear<float>(tensors[0], tensors_expected[0], 1e-4);
+}
+
+TEST_F(CpuOpSplitterTest, KeepsPreservedNodes) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+  Output x = ops::Const(s.WithOpName("x"), 1.0f, {1, 1024});
+  Output w = ops::Const(s.WithOpName("w"), 1.0f, {1024, 4096});
+  Output m = ops::MatMul(s.WithOpName("m"), x, w);
+
+  GrapplerItem item;
+  item.fetch = {"m"};
+  item.keep_ops = {"m"};
+  TF_ASSERT_OK(s.ToGraphDef(&item.graph));
+
+  GraphDef output;
+  CpuOpSplitter optimizer;
+  EXPECT_TRUE(
+      errors::IsAborted(optimizer.Optimize(cluster_.get(), item, &output)));
+}
+
+// Returns the graph built in `s`, split by the CpuOpSplitter if `split` is
+// true.
+Graph* OptimizedGraph(const tensorflow::Scope& s, bool split) {
+  GrapplerItem item;
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  GraphDef graph_def = item.graph;
+  if (split) {
+    CpuOpSplitter optimizer;
+    Status status = optimizer.Optimize(nullptr, item, &graph_def);
+    if (!status.ok()) graph_def = item.graph;
+  }
+  Graph* g = new Graph(OpRegistry::Global());
+  TF_CHECK_OK(ConvertGraphDefToGraph(GraphConstructorOptions(), graph_def, g));
+  return g;
+}
+
+// A batch size one MLP, as in online inference.
+static void BM_SplitMlp(::testing::benchmark::State& state) {
+  const bool split = state.range(0);
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+  Output x = ops::RandomUniform(s, {1, 1024}, DT_FLOAT);
+  Output w1 = ops::Const(s, 0.01f, {1024, 4096});
+  Output w2 = ops::Const(s, 0.01f, {4096, 1024});
+  Output h = ops::Relu(s, ops::MatMul(s, x, w1));
+  ops::MatMul(s, h, w2);
+  test::Benchmark("cpu", OptimizedGraph(s, split), /*old_benchmark_api*/ false)
+      .Run(state);
+}
+BENCHMARK(BM_SplitMlp)->Arg(0)->Arg(1);
+
+// The projections and the feed forward network of a transformer layer,
+// decoding a few tokens at a time.
+static void BM_SplitTransformerLayer(::testing::benchmark::State& state) {
+  const bool split = state.range(0);
+  constexpr int kTokens = 16;
+  constexpr int kDepth = 1024;
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+  Output x = ops::RandomUniform(s, {kTokens, kDepth}, DT_FLOAT);
+  Output w = ops::Const(s, 0.01f, {kDepth, kDepth});
+  Output q = ops::MatMul(s, x, w);
+  Output k = ops::MatMul(s, x, w);
+  Output v = ops::MatMul(s, x, w);
+  Output attention = ops::AddN(s, {q, k, v});
+  Output w1 = ops::Const(s, 0.01f, {kDepth, 4 * kDepth});
+  Output w2 = ops::Const(s, 0.01f, {4 * kDepth, kDepth});
+  Output h = ops::Relu(s, ops::MatMul(s, attention, w1));
+  ops::MatMul(s, h, w2);
+  test::Benchmark("cpu", OptimizedGraph(s, split), /*old_benchmark_api*/ false)
+      .Run(state);
+}
+BENCHMARK(BM_SplitTransformerLayer)->Arg(0)->Arg(1);
+
+}  // namespace
+}  // namespace grappler
+}  // namespace tensorflow
@@ -0,0 +1,451 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/grappler/optimizers/data/map_vectorization.h"
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "tensorflow/core/framework/attr_value.pb.h"
+#include "tensorflow/core/framework/function.h"
+#include "tensorflow/core/framework/node_def.pb.h"
+#include "tensorflow/core/framework/node_def_util.h"
+#include "tensorflow/core/framework/op.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/grappler/clusters/cluster.h"
+#include "tensorflow/core/grappler/grappler_item.h"
+#include "tensorflow/core/grappler/mutable_graph_view.h"
+#include "tensorflow/core/grappler/optimizers/custom_graph_optimizer_registry.h"
+#include "tensorflow/core/grappler/optimizers/data/function_utils.h"
+#include "tensorflow/core/grappler/optimizers/data/graph_utils.h"
+#include "tensorflow/core/grappler/utils.h"
+#include "tensorflow/core/lib/gtl/map_util.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/protobuf.h"
+
+namespace tensorflow {
+namespace grappler {
+namespace {
+
+constexpr char kBatchDataset[] = "BatchDataset";
+constexpr char kBatchV2Dataset[] = "BatchDatasetV2";
+constexpr char kMapDataset[] = "MapDataset";
+constexpr char kParallelMapDataset[] = "ParallelMapDatasetV2";
+constexpr char kOutputShapes[] = "output_shapes";
+constexpr char kOutputTypes[] = "output_types";
+
+// Ops applied to each element of their input.
+constexpr std::array<const char*, 37> kElementwiseUnaryOps = {
+    "Abs",
+    "AsString",
+    "Cast",
+    "Ceil",
+    "Cos",
+    "Exp",
+    "Expm1",
+    "Floor",
+    "Identity",
+    "IsFinite",
+    "IsInf",
+    "IsNan",
+    "Log",
+    "Log1p",
+    "LogicalNot",
+    "Neg",
+    "Reciprocal",
+    "Relu",
+    "Relu6",
+    "Rint",
+    "Round",
+    "Rsqrt",
+    "Sigmoid",
+    "Sign",
+    "Sin",
+    "Softplus",
+    "Sqrt",
+    "Square",
+    "StaticRegexFullMatch",
+    "StaticRegexReplace",
+    "StringLength",
+    "StringLower",
+    "StringStrip",
+    "StringToNumber",
+    "StringUpper",
+    "Tanh",
+    "ZerosLike",
+};
+
+// Ops applied to each pair of elements of their broadcast inputs.
+constexpr std::array<const char*, 20> kElementwiseBinaryOps = {
+    "Add",
+    "AddV2",
+    "Div",
+    "DivNoNan",
+    "Equal",
+    "FloorDiv",
+    "FloorMod",
+    "Greater",
+    "GreaterEqual",
+    "Less",
+    "LessEqual",
+    "LogicalAnd",
+    "LogicalOr",
+    "Maximum",
+    "Minimum",
+    "Mul",
+    "NotEqual",
+    "Pow",
+    "RealDiv",
+    "Sub",
+};
+
+// A tensor computed by the map function.
+struct Value {
+  // Whether the tensor is computed from the input element, in which case it
+  // gets a leading batch dimension in the vectorized function.
+  bool batched = false;
+  // Rank of the tensor without the batch dimension, or -1 if unknown.
+  int rank = -1;
+};
+
+// Returns the name of the node or function argument producing the tensor of
+// `input`, e.g. "mul" for "mul:z:0".
+absl::string_view ProducerName(absl::string_view input) {
+  return input.substr(0, input.find(':'));
+}
+
+// Returns the positive dimensions of the int32 or int64 constant `node`.
+Status GetShapeConstValue(const NodeDef& node, std::vector<int64_t>* dims) {
+  Tensor tensor;
+  if (node.op() != "Const" ||
+      !tensor.FromProto(node.attr().at("value").tensor()) ||
+      tensor.dims() != 1) {
+    return errors::Unimplemented("Reshape to the non constant shape ",
+                                 node.name());
+  }
+  for (int64_t i = 0; i < tensor.NumElements(); ++i) {
+    if (tensor.dtype() == DT_INT32) {
+      dims->push_back(tensor.vec<int32>()(i));
+    } else if (tensor.dtype() == DT_INT64) {
+      dims->push_back(tensor.vec<int64_t>()(i));
+    } else {
+      return errors::Unimplemented("Reshape to a shape of type ",
+                                   DataTypeString(tensor.dtype()));
+    }
+    // The batch dimension is inferred from the size of the input, so the
+    // other ones must be given.
+    if (dims->back() <= 0) {
+      return errors::Unimplemented("Reshape to the partially known shape ",
+                                   node.name());
+    }
+  }
+  return absl::OkStatus();
+}
+
+// Computes the tensor of `node` given the ones of its inputs.
+Status ComputeValue(const NodeDef& node, const std::vector<Value>& inputs,
+                    const std::vector<int64_t>& shape, Value* value) {
+  if (node.op() == "Const") {
+    value->batched = false;
+    value->rank = node.attr().at("value").tensor().tensor_shape().dim_size();
+  } else if (absl::c_linear_search(kElementwiseUnaryOps, node.op())) {
+    *value = inputs[0];
+  } else if (absl::c_linear_search(kElementwiseBinaryOps, node.op())) {
+    const Value& x = inputs[0];
+    const Value& y = inputs[1];
+    if (!x.batched && !y.batched) {
+      value->batched = false;
+      value->rank = x.rank < 0 || y.rank < 0 ? -1 : std::max(x.rank, y.rank);
+    } else if (x.batched && y.batched) {
+      // Broadcasting aligns the trailing dimensions, so the batch dimensions
+      // only line up when the elements have the same rank.
+      if (x.rank != y.rank) {
+        return errors::Unimplemented("Broadcast between elements of ranks ",
+                                     x.rank, " and ", y.rank, " in ",
+                                     node.name());
+      }
+      *value = x;
+    } else {
+      // The unbatched operand is broadcast the same way against a batch as
+      // against an element as long as it doesn't reach the batch dimension.
+      const Value& batched = x.batched ? x : y;
+      const Value& unbatched = x.batched ? y : x;
+      if (unbatched.rank < 0 || unbatched.rank > batched.rank) {
+        return errors::Unimplemented("Broadcast of an element of rank ",
+                                     batched.rank, " to rank ", unbatched.rank,
+                                     " in ", node.name());
+      }
+      *value = batched;
+    }
+  } else if (node.op() == "Reshape") {
+    value->batched = inputs[0].batched;
+    value->rank = static_cast<int>(shape.size());
+  } else {
+    return errors::Unimplemented("Op ", node.op(), " of ", node.name(),
+                                 " can't be vectorized");
+  }
+  return absl::OkStatus();
+}
+
+// Builds the function applying `function`, whose arguments are elements of
+// shapes `input_shapes`, to batches of these elements.
+Status VectorizeFunction(const FunctionDef& function,
+                         const std::vector<PartialTensorShape>& input_shapes,
+                         FunctionDef* vectorized) {
+  const OpDef& signature = function.signature();
+  if (signature.attr_size() > 0) {
+    return errors::Unimplemented("Polymorphic function ", signature.name());
+  }
+  if (signature.input_arg_size() != static_cast<int>(input_shapes.size())) {
+    return errors::Unimplemented("Function ", signature.name(),
+                                 " has captured inputs");
+  }
+
+  absl::flat_hash_map<string, Value> values;
+  for (int i = 0; i < signature.input_arg_size(); ++i) {
+    values[signature.input_arg(i).name()] = {/*batched=*/true,
+                                             input_shapes[i].dims()};
+  }
+  absl::flat_hash_map<string, const NodeDef*> nodes;
+  for (const NodeDef& node : function.node_def()) {
+    nodes[node.name()] = &node;
+  }
+
+  // Computes the tensors of the nodes once the ones of their inputs are
+  // known, as the nodes of a function aren't sorted.
+  std::vector<const NodeDef*> pending;
+  for (const NodeDef& node : function.node_def()) pending.push_back(&node);
+  absl::flat_hash_map<string, std::vector<int64_t>> reshapes;
+  while (!pending.empty()) {
+    std::vector<const NodeDef*> blocked;
+    for (const NodeDef* node : pending) {
+      std::vector<Value> inputs;
+      for (const string& input : node->input()) {
+        if (IsControlInput(input)) {
+          return errors::Unimplemented("Control input of ", node->name());
+        }
+        auto it = values.find(ProducerName(input));
+        if (it == values.end()) break;
+        inputs.push_back(it->second);
+      }
+      if (static_cast<int>(inputs.size()) < node->input_size()) {
+        blocked.push_back(node);
+        continue;
+      }
+
+      std::vector<int64_t> shape;
+      if (node->op() == "Reshape") {
+        auto shape_node = nodes.find(ProducerName(node->input(1)));
+        if (shape_node == nodes.end()) {
+          return errors::Unimplemented("Reshape to the non constant shape ",
+                                       node->input(1));
+        }
+        TF_RETURN_IF_ERROR(GetShapeConstValue(*shape_node->second, &shape));
+        if (inputs[0].batched) reshapes[node->name()] = shape;
+      }
+      TF_RETURN_IF_ERROR(
+          ComputeValue(*node, inputs, shape, &values[node->name()]));
+    }
+    if (blocked.size() == pending.size()) {
+      return errors::Unimplemented("Function ", signature.name(),
+                                   " reads a missing or cyclic input");
+    }
+    pending.swap(blocked);
+  }
+
+  // An output that doesn't depend on the element would be computed once for
+  // the whole batch.
+  for (const auto& ret : function.ret()) {
+    auto it = values.find(ProducerName(ret.second));
+    if (it == values.end() || !it->second.batched) {
+      return errors::Unimplemented("Output ", ret.first, " of ",
+                                   signature.name(),
+                                   " doesn't depend on the input element");
+    }
+  }
+
+  *vectorized = function;
+  // The arguments are now batches, whose shapes differ from the elements.
+  vectorized->clear_arg_attr();
+  for (NodeDef& node : *vectorized->mutable_node_def()) {
+    node.mutable_attr()->erase("_output_shapes");
+  }
+  // The batched reshapes get the batch dimension prepended to their shape.
+  // They are rewritten in the order of the nodes to get deterministic names.
+  for (const NodeDef& node : function.node_def()) {
+    auto reshape = reshapes.find(node.name());
+    if (reshape == reshapes.end()) continue;
+
+    const std::vector<int64_t>& shape = reshape->second;
+    Tensor batch_shape(DT_INT64,
+                       TensorShape({static_cast<int64_t>(shape.size()) + 1}));
+    batch_shape.vec<int64_t>()(0) = -1;
+    for (size_t i = 0; i < shape.size(); ++i) {
+      batch_shape.vec<int64_t>()(i + 1) = shape[i];
+    }
+    AttrValue value;
+    batch_shape.AsProtoTensorContent(value.mutable_tensor());
+    AttrValue dtype;
+    dtype.set_type(DT_INT64);
+    const NodeDef* shape_node = function_utils::AddNode(
+        "", "Const", {}, {{"value", value}, {"dtype", dtype}}, vectorized);
+    NodeDef* vectorized_reshape = vectorized->mutable_node_def(
+        function_utils::FindFunctionNodeWithName(node.name(), *vectorized));
+    vectorized_reshape->set_input(
+        1, absl::StrCat(shape_node->name(), ":output:0"));
+    (*vectorized_reshape->mutable_attr())["Tshape"].set_type(DT_INT64);
+  }
+  return absl::OkStatus();
+}
+
+// Returns the types and shapes of the elements produced by the dataset `node`
+// if their shapes are all fully defined.
+Status GetFullyDefinedElementSpec(const NodeDef& node, DataTypeVector* types,
+                                  std::vector<PartialTensorShape>* shapes) {
+  TF_RETURN_IF_ERROR(graph_utils::GetDatasetOutputTypesAttr(node, types));
+  TF_RETURN_IF_ERROR(GetNodeAttr(node, kOutputShapes, shapes));
+  for (const PartialTensorShape& shape : *shapes) {
+    if (!shape.IsFullyDefined()) {
+      return errors::Unimplemented("Element of ", node.name(),
+                                   " with the partially known shape ",
+                                   shape.DebugString());
+    }
+  }
+  return absl::OkStatus();
+}
+
+// Makes the batch of the elements of types `input_types` and shapes
+// `input_shapes` of the dataset `input`, with the parameters of `batch_node`.
+NodeDef MakeBatchNode(const NodeDef& batch_node, const string& input,
+                      const DataTypeVector& input_types,
+                      const std::vector<PartialTensorShape>& input_shapes,
+                      MutableGraphView* graph) {
+  NodeDef new_batch_node = batch_node;
+  graph_utils::SetUniqueGraphNodeName(batch_node.op(), graph->graph(),
+                                      &new_batch_node);
+  new_batch_node.set_input(0, input);
+
+  // The batch dimension is known when the remainder is dropped.
+  int64_t batch_dim = -1;
+  const AttrValue* batch_shapes =
+      gtl::FindOrNull(batch_node.attr(), kOutputShapes);
+  if (batch_shapes != nullptr && batch_shapes->list().shape_size() > 0 &&
+      batch_shapes->list().shape(0).dim_size() > 0) {
+    batch_dim = batch_shapes->list().shape(0).dim(0).size();
+  }
+  std::vector<PartialTensorShape> shapes;
+  for (const PartialTensorShape& shape : input_shapes) {
+    shapes.push_back(PartialTensorShape({batch_dim}).Concatenate(shape));
+  }
+  AddNodeAttr(kOutputTypes, input_types, &new_batch_node);
+  AddNodeAttr(kOutputShapes, shapes, &new_batch_node);
+  return new_batch_node;
+}
+
+// Makes the map of `vectorized_function` over the batches of
+// `new_batch_node`, which replaces `batch_node` of the elements of
+// `map_node`.
+NodeDef MakeMapNode(const NodeDef& map_node, const NodeDef& batch_node,
+                    const NodeDef& new_batch_node,
+                    const FunctionDef& vectorized_function,
+                    MutableGraphView* graph) {
+  NodeDef new_map_node = map_node;
+  graph_utils::SetUniqueGraphNodeName(map_node.op(), graph->graph(),
+                                      &new_map_node);
+  new_map_node.set_input(0, new_batch_node.name());
+  (*new_map_node.mutable_attr())["f"].mutable_func()->set_name(
+      vectorized_function.signature().name());
+  graph_utils::CopyShapesAndTypesAttrs(batch_node, &new_map_node);
+  return new_map_node;
+}
+
+}  // namespace
+
+Status MapVectorization::OptimizeAndCollectStats(Cluster* cluster,
+                                                 const GrapplerItem& item,
+                                                 GraphDef* output,
+                                                 OptimizationStats* stats) {
+  *output = item.graph;
+  MutableGraphView graph(output);
+  absl::flat_hash_set<string> nodes_to_delete;
+  FunctionLibraryDefinition function_library(OpRegistry::Global(),
+                                             item.graph.library());
+
+  for (const NodeDef& node : item.graph.node()) {
+    if (node.op() != kBatchDataset && node.op() != kBatchV2Dataset) continue;
+
+    const NodeDef* map_node = graph_utils::GetInputNode(node, graph);
+    if (map_node == nullptr ||
+        (map_node->op() != kMapDataset &&
+         map_node->op() != kParallelMapDataset)) {
+      continue;
+    }
+    // The unbatched elements must not be read by other datasets.
+    if (graph.GetFanouts(*map_node, /*include_controlled_nodes=*/true)
+            .size() != 1) {
+      continue;
+    }
+    if (map_node->attr().at("Targuments").list().type_size() > 0) continue;
+
+    const NodeDef* input_node = graph_utils::GetInputNode(*map_node, graph);
+    const FunctionDef* function =
+        function_library.Find(map_node->attr().at("f").func().name());
+    if (input_node == nullptr || function == nullptr) continue;
+
+    DataTypeVector input_types;
+    std::vector<PartialTensorShape> input_shapes;
+    FunctionDef vectorized_function;
+    Status status =
+        GetFullyDefinedElementSpec(*input_node, &input_types, &input_shapes);
+    if (status.ok()) {
+      status = VectorizeFunction(*function, input_shapes, &vectorized_function);
+    }
+    if (!status.ok()) {
+      VLOG(1) << "Not vectorizing " << map_node->name() << ": " << status;
+      continue;
+    }
+    graph_utils::SetUniqueGraphFunctionName(
+        absl::StrCat("vectorized_", function->signature().name()),
+        output->mutable_library(), &vectorized_function);
+    *output->mutable_library()->add_function() = vectorized_function;
+    TF_RETURN_IF_ERROR(function_library.AddFunctionDef(vectorized_function));
+
+    const NodeDef* new_batch_node =
+        graph.AddNode(MakeBatchNode(node, map_node->input(0), input_types,
+                                    input_shapes, &graph));
+    const NodeDef* new_map_node = graph.AddNode(MakeMapNode(
+        *map_node, node, *new_batch_node, vectorized_function, &graph));
+    TF_RETURN_IF_ERROR(graph.UpdateFanouts(node.name(), new_map_node->name()));
+
+    nodes_to_delete.insert(map_node->name());
+    nodes_to_delete.insert(node.name());
+    stats->num_changes++;
+  }
+
+  TF_RETURN_IF_ERROR(graph.DeleteNodes(nodes_to_delete));
+  return absl::OkStatus();
+}
+
+REGISTER_GRAPH_OPTIMIZER_AS(MapVectorization, "map_vectorization");
+
+}  // namespace grappler
+}  // namespace tensorflow
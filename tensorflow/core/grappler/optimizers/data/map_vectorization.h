@@ -0,0 +1,55 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_GRAPPLER_OPTIMIZERS_DATA_MAP_VECTORIZATION_H_
+#define TENSORFLOW_CORE_GRAPPLER_OPTIMIZERS_DATA_MAP_VECTORIZATION_H_
+
+#include "tensorflow/core/grappler/optimizers/data/optimizer_base.h"
+
+namespace tensorflow {
+namespace grappler {
+
+// Rewrites `map(f).batch(n)` into `batch(n).map(f')`, where `f'` applies `f`
+// to a whole batch at once, when `f` is only made of ops that are applied to
+// each element of their inputs (cwise ops, casts, string ops, and reshapes to
+// a constant shape, which get the batch dimension prepended). This calls the
+// map function once per batch instead of once per element.
+//
+// The map must be stateless, have no captured inputs, and the elements of its
+// input must have fully defined shapes, so that batching them can't fail
+// where batching the mapped elements wouldn't. Other maps are left unchanged.
+class MapVectorization : public TFDataOptimizerBase {
+ public:
+  MapVectorization() = default;
+  ~MapVectorization() override = default;
+
+  string name() const override { return "map_vectorization"; };
+
+  bool UsesFunctionLibrary() const override { return false; }
+
+  Status Init(
+      const tensorflow::RewriterConfig_CustomGraphOptimizer* config) override {
+    return absl::OkStatus();
+  }
+
+  Status OptimizeAndCollectStats(Cluster* cluster, const GrapplerItem& item,
+                                 GraphDef* output,
+                                 OptimizationStats* stats) override;
+};
+
+}  // namespace grappler
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_GRAPPLER_OPTIMIZERS_DATA_MAP_VECTORIZATION_H_
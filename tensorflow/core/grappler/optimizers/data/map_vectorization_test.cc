@@ -0,0 +1,357 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/grappler/optimizers/data/map_vectorization.h"
+
+#include "tensorflow/core/data/standalone.h"
+#include "tensorflow/core/framework/attr_value_util.h"
+#include "tensorflow/core/framework/function_testlib.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/grappler/grappler_item.h"
+#include "tensorflow/core/grappler/optimizers/data/function_utils.h"
+#include "tensorflow/core/grappler/optimizers/data/graph_test_utils.h"
+#include "tensorflow/core/grappler/optimizers/data/graph_utils.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace grappler {
+namespace {
+
+using graph_tests_utils::MakeBatchV2Node;
+using graph_tests_utils::MakeMapNode;
+using test::function::NDef;
+using FDH = FunctionDefHelper;
+
+// Returns x * 2 for int64 elements.
+FunctionDef TimesTwo() {
+  return FDH::Define(
+      // Name
+      "TimesTwo",
+      // Args
+      {"x: int64"},
+      // Return values
+      {"y: int64"},
+      // Attr def
+      {},
+      // Nodes
+      {
+          {{"two"},
+           "Const",
+           {},
+           {{"value", test::AsScalar<int64_t>(2)}, {"dtype", DT_INT64}}},
+          {{"y"}, "Mul", {"x", "two"}, {{"T", DT_INT64}}},
+      });
+}
+
+// Returns Sqrt(x) reshaped to [2, 2] for float elements of 4 values.
+FunctionDef SqrtAndReshape() {
+  return FDH::Define(
+      // Name
+      "SqrtAndReshape",
+      // Args
+      {"x: float"},
+      // Return values
+      {"y: float"},
+      // Attr def
+      {},
+      // Nodes
+      {
+          {{"sqrt"}, "Sqrt", {"x"}, {{"T", DT_FLOAT}}},
+          {{"shape"},
+           "Const",
+           {},
+           {{"value", test::AsTensor<int32>({2, 2})}, {"dtype", DT_INT32}}},
+          {{"y"},
+           "Reshape",
+           {"sqrt", "shape"},
+           {{"T", DT_FLOAT}, {"Tshape", DT_INT32}}},
+      });
+}
+
+// Returns x + [1, 2, 3] for int64 elements.
+FunctionDef AddVector() {
+  return FDH::Define(
+      // Name
+      "AddVector",
+      // Args
+      {"x: int64"},
+      // Return values
+      {"y: int64"},
+      // Attr def
+      {},
+      // Nodes
+      {
+          {{"v"},
+           "Const",
+           {},
+           {{"value", test::AsTensor<int64_t>({1, 2, 3})},
+            {"dtype", DT_INT64}}},
+          {{"y"}, "AddV2", {"x", "v"}, {{"T", DT_INT64}}},
+      });
+}
+
+// Returns x * RandomUniform() for float elements.
+FunctionDef TimesRandom() {
+  return FDH::Define(
+      // Name
+      "TimesRandom",
+      // Args
+      {"x: float"},
+      // Return values
+      {"y: float"},
+      // Attr def
+      {},
+      // Nodes
+      {
+          {{"shape"},
+           "Const",
+           {},
+           {{"value", test::AsTensor<int32>({1})}, {"dtype", DT_INT32}}},
+          {{"random"},
+           "RandomUniform",
+           {"shape"},
+           {{"T", DT_INT32}, {"dtype", DT_FLOAT}, {"seed", 0}, {"seed2", 0}}},
+          {{"y"}, "Mul", {"x", "random"}, {{"T", DT_FLOAT}}},
+      });
+}
+
+// Builds input.map(function).batch(5), where the input dataset produces
+// elements of type `dtype` and shape `shape`.
+GrapplerItem MakeMapAndBatch(const FunctionDef& function, DataType dtype,
+                             const PartialTensorShape& shape) {
+  GrapplerItem item;
+  item.graph = test::function::GDef(
+      {NDef("components", "Placeholder", {}, {{"dtype", dtype}}),
+       NDef("input", "TensorSliceDataset", {"components"},
+            {{"Toutput_types", gtl::ArraySlice<DataType>{dtype}},
+             {"output_shapes", gtl::ArraySlice<PartialTensorShape>{shape}}}),
+       MakeMapNode("map", "input", function.signature().name()),
+       NDef("batch_size", "Const", {}, {{"value", 5}, {"dtype", DT_INT64}}),
+       NDef("drop_remainder", "Const", {},
+            {{"value", false}, {"dtype", DT_BOOL}}),
+       MakeBatchV2Node("batch", "map", "batch_size", "drop_remainder",
+                       /*parallel_copy=*/false),
+       NDef("Sink", "Identity", {"batch"}, {})},
+      // FunctionLib
+      {function});
+  item.fetch.push_back("Sink");
+  return item;
+}
+
+TEST(MapVectorizationTest, VectorizeCwiseFunction) {
+  GrapplerItem item =
+      MakeMapAndBatch(TimesTwo(), DT_INT64, PartialTensorShape({}));
+  MapVectorization optimizer;
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+
+  EXPECT_FALSE(graph_utils::ContainsGraphNodeWithName("map", output));
+  EXPECT_FALSE(graph_utils::ContainsGraphNodeWithName("batch", output));
+  const NodeDef& batch = output.node(
+      graph_utils::FindGraphNodeWithOp("BatchDatasetV2", output));
+  const NodeDef& map =
+      output.node(graph_utils::FindGraphNodeWithOp("MapDataset", output));
+  const NodeDef& sink =
+      output.node(graph_utils::FindGraphNodeWithName("Sink", output));
+  EXPECT_EQ(batch.input(0), "input");
+  EXPECT_EQ(batch.input(1), "batch_size");
+  EXPECT_EQ(batch.input(2), "drop_remainder");
+  EXPECT_EQ(map.input(0), batch.name());
+  EXPECT_EQ(sink.input(0), map.name());
+
+  // The batches of the input have an unknown leading dimension.
+  std::vector<PartialTensorShape> batch_shapes;
+  TF_ASSERT_OK(GetNodeAttr(batch, "output_shapes", &batch_shapes));
+  ASSERT_EQ(batch_shapes.size(), 1);
+  EXPECT_TRUE(batch_shapes[0].IsIdenticalTo(PartialTensorShape({-1})));
+  EXPECT_EQ(batch.attr().at("output_types").list().type(0), DT_INT64);
+
+  // The map applies a copy of the function to the batches.
+  const string& function_name = map.attr().at("f").func().name();
+  EXPECT_NE(function_name, "TimesTwo");
+  ASSERT_TRUE(graph_utils::ContainsGraphFunctionWithName(function_name,
+                                                         output.library()));
+  const FunctionDef& function = output.library().function(
+      graph_utils::FindGraphFunctionWithName(function_name, output.library()));
+  EXPECT_EQ(function.node_def_size(), 2);
+  EXPECT_TRUE(function_utils::ContainsFunctionNodeWithOp("Mul", function));
+}
+
+TEST(MapVectorizationTest, VectorizeReshape) {
+  GrapplerItem item =
+      MakeMapAndBatch(SqrtAndReshape(), DT_FLOAT, PartialTensorShape({4}));
+  MapVectorization optimizer;
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+
+  const NodeDef& map =
+      output.node(graph_utils::FindGraphNodeWithOp("MapDataset", output));
+  const FunctionDef& function =
+      output.library().function(graph_utils::FindGraphFunctionWithName(
+          map.attr().at("f").func().name(), output.library()));
+
+  // The batch dimension is prepended to the shape of the reshape.
+  const NodeDef& reshape = function.node_def(
+      function_utils::FindFunctionNodeWithName("y", function));
+  EXPECT_EQ(reshape.attr().at("Tshape").type(), DT_INT64);
+  const string& shape_input = reshape.input(1);
+  const NodeDef& shape =
+      function.node_def(function_utils::FindFunctionNodeWithName(
+          shape_input.substr(0, shape_input.find(':')), function));
+  Tensor shape_value;
+  ASSERT_TRUE(shape_value.FromProto(shape.attr().at("value").tensor()));
+  test::ExpectTensorEqual<int64_t>(shape_value,
+                                   test::AsTensor<int64_t>({-1, 2, 2}));
+
+  std::vector<PartialTensorShape> batch_shapes;
+  TF_ASSERT_OK(GetNodeAttr(
+      output.node(graph_utils::FindGraphNodeWithOp("BatchDatasetV2", output)),
+      "output_shapes", &batch_shapes));
+  ASSERT_EQ(batch_shapes.size(), 1);
+  EXPECT_TRUE(batch_shapes[0].IsIdenticalTo(PartialTensorShape({-1, 4})));
+}
+
+TEST(MapVectorizationTest, KeepStatefulFunction) {
+  GrapplerItem item =
+      MakeMapAndBatch(TimesRandom(), DT_FLOAT, PartialTensorShape({1}));
+  MapVectorization optimizer;
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+  EXPECT_TRUE(graph_utils::ContainsGraphNodeWithName("map", output));
+  EXPECT_TRUE(graph_utils::ContainsGraphNodeWithName("batch", output));
+}
+
+TEST(MapVectorizationTest, KeepElementsOfUnknownShape) {
+  GrapplerItem item =
+      MakeMapAndBatch(TimesTwo(), DT_INT64, PartialTensorShape({-1}));
+  MapVectorization optimizer;
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+  EXPECT_TRUE(graph_utils::ContainsGraphNodeWithName("map", output));
+  EXPECT_TRUE(graph_utils::ContainsGraphNodeWithName("batch", output));
+}
+
+TEST(MapVectorizationTest, KeepBroadcastToHigherRank) {
+  // Adding a vector to a scalar element would add it to the whole batch.
+  GrapplerItem item =
+      MakeMapAndBatch(AddVector(), DT_INT64, PartialTensorShape({}));
+  MapVectorization optimizer;
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+  EXPECT_TRUE(graph_utils::ContainsGraphNodeWithName("map", output));
+
+  // It's applied to each element when they have the rank of the vector.
+  item = MakeMapAndBatch(AddVector(), DT_INT64, PartialTensorShape({3}));
+  TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+  EXPECT_FALSE(graph_utils::ContainsGraphNodeWithName("map", output));
+}
+
+TEST(MapVectorizationTest, KeepMapWithOtherConsumers) {
+  GrapplerItem item =
+      MakeMapAndBatch(TimesTwo(), DT_INT64, PartialTensorShape({}));
+  *item.graph.add_node() = NDef("Sink2", "Identity", {"map"}, {});
+  item.fetch.push_back("Sink2");
+  MapVectorization optimizer;
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+  EXPECT_TRUE(graph_utils::ContainsGraphNodeWithName("map", output));
+  EXPECT_TRUE(graph_utils::ContainsGraphNodeWithName("batch", output));
+}
+
+// Builds input.map(TimesTwo).batch(batch_size) of `num_elements` int64
+// scalars, with the element specs needed to run it.
+GrapplerItem MakeRunnableMapAndBatch(int64_t num_elements,
+                                     int64_t batch_size) {
+  Tensor components(DT_INT64, TensorShape({num_elements}));
+  components.flat<int64_t>().setConstant(1);
+  const gtl::ArraySlice<DataType> types = {DT_INT64};
+  GrapplerItem item;
+  item.graph = test::function::GDef(
+      {NDef("components", "Const", {},
+            {{"value", components}, {"dtype", DT_INT64}}),
+       NDef("input", "TensorSliceDataset", {"components"},
+            {{"Toutput_types", types},
+             {"output_shapes",
+              gtl::ArraySlice<PartialTensorShape>{PartialTensorShape({})}}}),
+       NDef("map", "MapDataset", {"input"},
+            {{"f", FDH::FunctionRef("TimesTwo")},
+             {"Targuments", gtl::ArraySlice<DataType>{}},
+             {"output_types", types},
+             {"output_shapes",
+              gtl::ArraySlice<PartialTensorShape>{PartialTensorShape({})}}}),
+       NDef("batch_size", "Const", {},
+            {{"value", test::AsScalar<int64_t>(batch_size)},
+             {"dtype", DT_INT64}}),
+       NDef("drop_remainder", "Const", {},
+            {{"value", test::AsScalar<bool>(false)}, {"dtype", DT_BOOL}}),
+       NDef("batch", "BatchDatasetV2", {"map", "batch_size", "drop_remainder"},
+            {{"parallel_copy", false},
+             {"output_types", types},
+             {"output_shapes",
+              gtl::ArraySlice<PartialTensorShape>{PartialTensorShape({-1})}}}),
+       NDef("dataset", "_Retval", {"batch"},
+            {{"T", DT_VARIANT}, {"index", 0}})},
+      // FunctionLib
+      {TimesTwo()});
+  item.fetch.push_back("dataset");
+  return item;
+}
+
+// Produces the batches of map(f).batch(n) (0) or of the batch(n).map(f') it's
+// vectorized into (1), for batches of n elements. Both pipelines also get the
+// default tf.data optimizations, e.g. the map of the original pipeline is
+// fused with the batch.
+static void BM_MapAndBatch(::testing::benchmark::State& state) {
+  const bool vectorize = state.range(0);
+  const int64_t batch_size = state.range(1);
+  GrapplerItem item = MakeRunnableMapAndBatch(/*num_elements=*/1 << 16,
+                                              batch_size);
+  GraphDef graph = item.graph;
+  if (vectorize) {
+    MapVectorization optimizer;
+    TF_CHECK_OK(optimizer.Optimize(nullptr, item, &graph));
+    CHECK(!graph_utils::ContainsGraphNodeWithName("map", graph));
+  }
+
+  std::unique_ptr<data::standalone::Dataset> dataset;
+  TF_CHECK_OK(data::standalone::Dataset::FromGraph({}, graph, &dataset));
+  std::unique_ptr<data::standalone::Iterator> iterator;
+  TF_CHECK_OK(dataset->MakeIterator(&iterator));
+  std::vector<Tensor> outputs;
+  bool end_of_input = false;
+  for (auto s : state) {
+    TF_CHECK_OK(iterator->GetNext(&outputs, &end_of_input));
+    if (end_of_input) {
+      state.PauseTiming();
+      TF_CHECK_OK(dataset->MakeIterator(&iterator));
+      state.ResumeTiming();
+    }
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          batch_size);
+}
+BENCHMARK(BM_MapAndBatch)
+    ->ArgPair(0, 8)
+    ->ArgPair(1, 8)
+    ->ArgPair(0, 64)
+    ->ArgPair(1, 64)
+    ->ArgPair(0, 512)
+    ->ArgPair(1, 512);
+
+}  // namespace
+}  // namespace grappler
+}  // namespace tensorflow
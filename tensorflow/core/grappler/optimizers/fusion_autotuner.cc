@@ -0,0 +1,646 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/grappler/optimizers/fusion_autotuner.h"
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/str_split.h"
+#include "tensorflow/core/framework/attr_value_util.h"
+#include "tensorflow/core/framework/node_def_util.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/grappler/clusters/single_machine.h"
+#include "tensorflow/core/grappler/clusters/utils.h"
+#include "tensorflow/core/grappler/costs/graph_properties.h"
+#include "tensorflow/core/grappler/costs/measuring_cost_estimator.h"
+#include "tensorflow/core/grappler/costs/op_context.h"
+#include "tensorflow/core/grappler/costs/op_level_cost_estimator.h"
+#include "tensorflow/core/grappler/grappler_item.h"
+#include "tensorflow/core/grappler/optimizers/custom_graph_optimizer_registry.h"
+#include "tensorflow/core/grappler/utils.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/gtl/cleanup.h"
+#include "tensorflow/core/platform/cpu_info.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/util/device_name_utils.h"
+
+namespace tensorflow {
+namespace grappler {
+namespace {
+
+constexpr char kOptimizerScope[] = "FusionAutotuner";
+
+constexpr int kMeasurementTimeoutSeconds = 60;
+// The device of the SingleMachine the candidates are measured on.
+constexpr char kMeasurementDevice[] =
+    "/job:localhost/replica:0/task:0/device:CPU:0";
+
+// Minimum measured speedup to replace a fused op, since the measurements are
+// noisy.
+constexpr double kMinSpeedup = 1.05;
+
+// An implementation of a fused contraction.
+struct Candidate {
+  bool fused = true;
+  bool nchw = false;
+};
+
+// The CPU kernel of _FusedConv2D only supports NHWC, so only the unfused ops
+// are converted to NCHW.
+const Candidate kCandidates[] = {
+    {/*fused=*/true, /*nchw=*/false},
+    {/*fused=*/false, /*nchw=*/false},
+    {/*fused=*/false, /*nchw=*/true},
+};
+
+string CandidateName(const Candidate& candidate) {
+  return absl::StrCat(candidate.fused ? "fused" : "unfused", "_",
+                      candidate.nchw ? "nchw" : "nhwc");
+}
+
+bool ParseCandidate(const string& name, Candidate* candidate) {
+  for (const Candidate& c : kCandidates) {
+    if (CandidateName(c) == name) {
+      *candidate = c;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Decisions of all the FusionAutotuners of the process, keyed by the signature
+// of the contractions.
+struct DecisionCache {
+  mutex mu;
+  absl::flat_hash_map<string, string> decisions TF_GUARDED_BY(mu);
+};
+
+DecisionCache* GetDecisionCache() {
+  static DecisionCache* cache = new DecisionCache;
+  return cache;
+}
+
+// The decision cache file has a line per contraction, with its signature and
+// the name of its fastest candidate separated by a tab.
+Status ReadDecisions(const string& filename,
+                     absl::flat_hash_map<string, string>* decisions) {
+  Env* env = Env::Default();
+  if (!env->FileExists(filename).ok()) return absl::OkStatus();
+  string contents;
+  TF_RETURN_IF_ERROR(ReadFileToString(env, filename, &contents));
+  for (absl::string_view line :
+       absl::StrSplit(contents, '\n', absl::SkipEmpty())) {
+    std::vector<string> fields = absl::StrSplit(line, '\t');
+    Candidate candidate;
+    if (fields.size() != 2 || !ParseCandidate(fields[1], &candidate)) {
+      return errors::InvalidArgument("Invalid line in ", filename, ": ", line);
+    }
+    (*decisions)[fields[0]] = fields[1];
+  }
+  return absl::OkStatus();
+}
+
+Status WriteDecisions(const string& filename,
+                      const absl::flat_hash_map<string, string>& decisions) {
+  std::vector<string> lines;
+  for (const auto& decision : decisions) {
+    lines.push_back(absl::StrCat(decision.first, "\t", decision.second));
+  }
+  std::sort(lines.begin(), lines.end());
+  // Write to a temporary file and rename it, so that concurrent reads never
+  // see a partial file.
+  Env* env = Env::Default();
+  string tmp_filename = filename;
+  if (!env->CreateUniqueFileName(&tmp_filename, ".tmp")) {
+    return errors::Internal("Failed to create a temporary file for ",
+                            filename);
+  }
+  TF_RETURN_IF_ERROR(WriteStringToFile(
+      env, tmp_filename, absl::StrCat(absl::StrJoin(lines, "\n"), "\n")));
+  return env->RenameFile(tmp_filename, filename);
+}
+
+bool IsSupportedActivation(const string& op) {
+  return op == "Relu" || op == "Relu6" || op == "Elu" || op == "LeakyRelu" ||
+         op == "Tanh" || op == "Sigmoid";
+}
+
+// Returns true if `node` is a float contraction fused with a BiasAdd and an
+// optional activation.
+bool IsTunableContraction(const NodeDef& node) {
+  const bool is_conv = node.op() == "_FusedConv2D";
+  if (!is_conv && node.op() != "_FusedMatMul") return false;
+  DataType dtype;
+  int num_args;
+  std::vector<string> fused_ops;
+  if (!TryGetNodeAttr(node, "T", &dtype) || dtype != DT_FLOAT ||
+      !TryGetNodeAttr(node, "num_args", &num_args) || num_args != 1 ||
+      !TryGetNodeAttr(node, "fused_ops", &fused_ops) || fused_ops.empty() ||
+      fused_ops.size() > 2 || fused_ops[0] != "BiasAdd" ||
+      (fused_ops.size() == 2 && !IsSupportedActivation(fused_ops[1]))) {
+    return false;
+  }
+  if (is_conv) {
+    string data_format = "NHWC";
+    string filter_format = "HWIO";
+    int num_host_args = 0;
+    TryGetNodeAttr(node, "data_format", &data_format);
+    TryGetNodeAttr(node, "filter_format", &filter_format);
+    TryGetNodeAttr(node, "num_host_args", &num_host_args);
+    if (data_format != "NHWC" || filter_format != "HWIO" ||
+        num_host_args != 0) {
+      return false;
+    }
+  }
+  return node.input_size() >= 3 && !IsControlInput(node.input(2));
+}
+
+bool IsOnCpu(const NodeDef& node, bool has_gpu) {
+  if (node.device().empty()) return !has_gpu;
+  DeviceNameUtils::ParsedName parsed;
+  return DeviceNameUtils::ParseFullName(node.device(), &parsed) &&
+         parsed.has_type && parsed.type == DEVICE_CPU;
+}
+
+bool IsFullyDefined(const OpInfo::TensorProperties& tensor) {
+  return PartialTensorShape(tensor.shape()).IsFullyDefined();
+}
+
+string ContractionOp(const NodeDef& fused) {
+  return fused.op() == "_FusedConv2D" ? "Conv2D" : "MatMul";
+}
+
+// Returns the signature of a contraction, i.e. its op, attributes and input
+// shapes, and the number of cores of the machine.
+string Signature(const NodeDef& node,
+                 const std::vector<OpInfo::TensorProperties>& inputs,
+                 int num_cores) {
+  std::vector<string> attrs;
+  for (const auto& attr : node.attr()) {
+    if (absl::StartsWith(attr.first, "_")) continue;
+    attrs.push_back(
+        absl::StrCat(attr.first, "=", SummarizeAttrValue(attr.second)));
+  }
+  std::sort(attrs.begin(), attrs.end());
+  std::vector<string> shapes;
+  for (const auto& input : inputs) {
+    shapes.push_back(PartialTensorShape(input.shape()).DebugString());
+  }
+  return absl::StrCat(node.op(), ";", absl::StrJoin(attrs, ";"), ";",
+                      absl::StrJoin(shapes, ","), ";cores=", num_cores);
+}
+
+// Permutes the NHWC attribute `values`, with `values_per_dim` values per
+// dimension, to NCHW.
+void PermuteToNchw(int values_per_dim, AttrValue* values) {
+  auto* list = values->mutable_list()->mutable_i();
+  if (list->size() != 4 * values_per_dim) return;
+  const std::vector<int64_t> nhwc(list->begin(), list->end());
+  int i = 0;
+  for (int dim : {0, 3, 1, 2}) {
+    for (int j = 0; j < values_per_dim; ++j) {
+      list->Set(i++, nhwc[dim * values_per_dim + j]);
+    }
+  }
+}
+
+NodeDef* AddNode(const string& name, const string& op, const string& device,
+                 std::vector<NodeDef>* nodes) {
+  nodes->emplace_back();
+  NodeDef* node = &nodes->back();
+  node->set_name(name);
+  node->set_op(op);
+  node->set_device(device);
+  return node;
+}
+
+// Adds a Transpose of `input` by `perm`, whose constant permutation runs in the
+// frame of `input`.
+string AddTranspose(const string& name, const string& input,
+                    const std::vector<int32>& perm, const string& device,
+                    std::vector<NodeDef>* nodes) {
+  NodeDef* perm_node =
+      AddNode(absl::StrCat(name, "/perm"), "Const", device, nodes);
+  perm_node->add_input(AsControlDependency(NodeName(input)));
+  (*perm_node->mutable_attr())["dtype"].set_type(DT_INT32);
+  Tensor perm_tensor(DT_INT32, TensorShape({4}));
+  for (int i = 0; i < 4; ++i) perm_tensor.vec<int32>()(i) = perm[i];
+  perm_tensor.AsProtoTensorContent(
+      (*perm_node->mutable_attr())["value"].mutable_tensor());
+
+  const string perm_name = perm_node->name();
+
+  NodeDef* transpose = AddNode(name, "Transpose", device, nodes);
+  transpose->add_input(input);
+  transpose->add_input(perm_name);
+  (*transpose->mutable_attr())["T"].set_type(DT_FLOAT);
+  (*transpose->mutable_attr())["Tperm"].set_type(DT_INT32);
+  return name;
+}
+
+// Returns the nodes implementing the fused contraction `fused` as `candidate`.
+// The last node computes the output of `fused` and has its name.
+std::vector<NodeDef> ExpandCandidate(const NodeDef& fused,
+                                     const Candidate& candidate) {
+  const string prefix = absl::StrCat(fused.name(), "/", kOptimizerScope);
+  const string& device = fused.device();
+  const bool is_conv = fused.op() == "_FusedConv2D";
+  std::vector<string> fused_ops;
+  TryGetNodeAttr(fused, "fused_ops", &fused_ops);
+  std::vector<NodeDef> nodes;
+  nodes.reserve(8);
+
+  string input = fused.input(0);
+  if (candidate.nchw) {
+    input = AddTranspose(absl::StrCat(prefix, "/to_nchw"), input, {0, 3, 1, 2},
+                         device, &nodes);
+  }
+  const int contraction_index = nodes.size();
+
+  string output;
+  if (candidate.fused) {
+    NodeDef* node =
+        AddNode(absl::StrCat(prefix, "/fused"), fused.op(), device, &nodes);
+    *node->mutable_attr() = fused.attr();
+    node->add_input(input);
+    node->add_input(fused.input(1));
+    node->add_input(fused.input(2));
+    output = node->name();
+  } else {
+    NodeDef* contraction = AddNode(absl::StrCat(prefix, "/contraction"),
+                                   ContractionOp(fused), device, &nodes);
+    const std::vector<string> attrs =
+        is_conv ? std::vector<string>{"T", "strides", "padding",
+                                      "explicit_paddings", "data_format",
+                                      "dilations", "use_cudnn_on_gpu"}
+                : std::vector<string>{"T", "transpose_a", "transpose_b"};
+    for (const string& attr : attrs) {
+      auto it = fused.attr().find(attr);
+      if (it != fused.attr().end()) {
+        (*contraction->mutable_attr())[attr] = it->second;
+      }
+    }
+    contraction->add_input(input);
+    contraction->add_input(fused.input(1));
+
+    NodeDef* bias_add =
+        AddNode(absl::StrCat(prefix, "/bias_add"), "BiasAdd", device, &nodes);
+    bias_add->add_input(nodes[nodes.size() - 2].name());
+    bias_add->add_input(fused.input(2));
+    (*bias_add->mutable_attr())["T"].set_type(DT_FLOAT);
+    (*bias_add->mutable_attr())["data_format"].set_s(
+        candidate.nchw ? "NCHW" : "NHWC");
+    output = bias_add->name();
+
+    if (fused_ops.size() == 2) {
+      NodeDef* activation = AddNode(absl::StrCat(prefix, "/activation"),
+                                    fused_ops[1], device, &nodes);
+      activation->add_input(output);
+      (*activation->mutable_attr())["T"].set_type(DT_FLOAT);
+      if (fused_ops[1] == "LeakyRelu") {
+        float alpha = 0.2f;
+        TryGetNodeAttr(fused, "leakyrelu_alpha", &alpha);
+        (*activation->mutable_attr())["alpha"].set_f(alpha);
+      }
+      output = activation->name();
+    }
+  }
+
+  // The control dependencies of the fused op delay its first op.
+  NodeDef* first_op = &nodes[candidate.nchw ? contraction_index - 1
+                                            : contraction_index];
+  for (int i = 3; i < fused.input_size(); ++i) {
+    first_op->add_input(fused.input(i));
+  }
+  if (candidate.nchw) {
+    auto* attr = nodes[contraction_index].mutable_attr();
+    (*attr)["data_format"].set_s("NCHW");
+    PermuteToNchw(/*values_per_dim=*/1, &(*attr)["strides"]);
+    if (attr->count("dilations") > 0) {
+      PermuteToNchw(/*values_per_dim=*/1, &(*attr)["dilations"]);
+    }
+    if (attr->count("explicit_paddings") > 0) {
+      PermuteToNchw(/*values_per_dim=*/2, &(*attr)["explicit_paddings"]);
+    }
+    AddTranspose(absl::StrCat(prefix, "/to_nhwc"), output, {0, 2, 3, 1},
+                 device, &nodes);
+  }
+  nodes.back().set_name(fused.name());
+  return nodes;
+}
+
+// Adds a float input of the given shape, produced by a RandomUniform op so
+// that the candidates can't be constant folded.
+void AddRandomInput(const string& name,
+                    const OpInfo::TensorProperties& properties,
+                    GraphDef* graph) {
+  const TensorShape shape(properties.shape());
+  Tensor dims(DT_INT32, TensorShape({shape.dims()}));
+  for (int d = 0; d < shape.dims(); ++d) {
+    dims.vec<int32>()(d) = shape.dim_size(d);
+  }
+  NodeDef* dims_node = graph->add_node();
+  dims_node->set_name(absl::StrCat(name, "/shape"));
+  dims_node->set_op("Const");
+  AddNodeAttr("dtype", DT_INT32, dims_node);
+  AddNodeAttr("value", dims, dims_node);
+
+  NodeDef* node = graph->add_node();
+  node->set_name(name);
+  node->set_op("RandomUniform");
+  node->add_input(dims_node->name());
+  AddNodeAttr("T", DT_INT32, node);
+  AddNodeAttr("dtype", DT_FLOAT, node);
+  AddNodeAttr("seed", 0, node);
+  AddNodeAttr("seed2", 0, node);
+}
+
+// Measures the execution time of `candidate` on random inputs of the shapes
+// `inputs` of the fused contraction `fused`.
+Status MeasureCandidate(Cluster* cluster, const NodeDef& fused,
+                        const std::vector<OpInfo::TensorProperties>& inputs,
+                        const Candidate& candidate, int measurement_steps,
+                        double* time_us) {
+  constexpr char kCandidateName[] = "candidate";
+  GrapplerItem item;
+  item.id = absl::StrCat(kOptimizerScope, "/", fused.name(), "/",
+                         CandidateName(candidate));
+  NodeDef node = fused;
+  node.set_name(kCandidateName);
+  node.set_device(kMeasurementDevice);
+  node.clear_input();
+  for (int i = 0; i < 3; ++i) {
+    const string input = absl::StrCat("input_", i);
+    AddRandomInput(input, inputs[i], &item.graph);
+    node.add_input(input);
+  }
+  for (NodeDef& candidate_node : ExpandCandidate(node, candidate)) {
+    item.graph.add_node()->Swap(&candidate_node);
+  }
+  for (NodeDef& input_node : *item.graph.mutable_node()) {
+    input_node.set_device(kMeasurementDevice);
+  }
+  item.fetch = {kCandidateName};
+
+  MeasuringCostEstimator estimator(cluster, measurement_steps,
+                                   /*measurement_threads=*/0);
+  TF_RETURN_IF_ERROR(estimator.Initialize(item));
+  RunMetadata metadata;
+  Costs costs;
+  TF_RETURN_IF_ERROR(estimator.PredictCosts(item.graph, &metadata, &costs));
+  // Exclude the generation of the random inputs when the cluster reports the
+  // execution time of each kernel, averaged over the measurement steps.
+  double time = 0;
+  bool has_compute_costs = false;
+  for (const auto& cost_node : metadata.cost_graph().node()) {
+    if (absl::StartsWith(cost_node.name(), kCandidateName)) {
+      time += cost_node.compute_cost();
+      has_compute_costs = true;
+    }
+  }
+  *time_us = has_compute_costs
+                 ? time
+                 : costs.execution_time.asMicroSeconds().count();
+  return absl::OkStatus();
+}
+
+// Provisions in `owned_cluster`, unless it already is, the SingleMachine that
+// the candidates are measured on. The cluster of the caller is never used: it
+// might have GPUs, or run grappler on the candidates, which would fuse them
+// again.
+Status ProvisionMeasurementCluster(std::unique_ptr<Cluster>* owned_cluster) {
+  if (*owned_cluster == nullptr) {
+    std::unique_ptr<Cluster> single_machine(
+        new SingleMachine(kMeasurementTimeoutSeconds,
+                          std::max(1, port::MaxParallelism()),
+                          /*num_gpus=*/0));
+    // The candidates must run as they are, and report the execution time of
+    // each kernel.
+    single_machine->DisableOptimizer(true);
+    single_machine->DisableDetailedStats(false);
+    TF_RETURN_IF_ERROR(single_machine->Provision());
+    *owned_cluster = std::move(single_machine);
+  }
+  return absl::OkStatus();
+}
+
+// Predicts the execution time of the contraction of `fused`.
+int64_t PredictContractionMicros(
+    const OpLevelCostEstimator& estimator, const NodeDef& fused,
+    const std::vector<OpInfo::TensorProperties>& inputs,
+    const OpInfo::TensorProperties& output, const DeviceProperties& device) {
+  OpContext op_context;
+  op_context.name = fused.name();
+  op_context.op_info.set_op(ContractionOp(fused));
+  *op_context.op_info.mutable_attr() = fused.attr();
+  *op_context.op_info.add_inputs() = inputs[0];
+  *op_context.op_info.add_inputs() = inputs[1];
+  *op_context.op_info.add_outputs() = output;
+  *op_context.op_info.mutable_device() = device;
+  return estimator.PredictCosts(op_context)
+      .execution_time.asMicroSeconds()
+      .count();
+}
+
+}  // namespace
+
+void FusionAutotuner::ClearDecisionCache() {
+  DecisionCache* cache = GetDecisionCache();
+  mutex_lock l(cache->mu);
+  cache->decisions.clear();
+}
+
+Status FusionAutotuner::Init(
+    const tensorflow::RewriterConfig_CustomGraphOptimizer* config) {
+  if (config == nullptr) return absl::OkStatus();
+  const auto& parameters = config->parameter_map();
+  auto it = parameters.find(kFusionAutotunerMeasurementSteps);
+  if (it != parameters.end()) {
+    measurement_steps_ = it->second.i();
+    if (measurement_steps_ < 1) {
+      return errors::InvalidArgument("Invalid value for parameter ",
+                                     kFusionAutotunerMeasurementSteps, ": ",
+                                     measurement_steps_);
+    }
+  }
+  it = parameters.find(kFusionAutotunerMinOpTimeMicros);
+  if (it != parameters.end()) min_op_time_us_ = it->second.i();
+  it = parameters.find(kFusionAutotunerDecisionCacheFile);
+  if (it != parameters.end()) {
+    decision_cache_file_ = it->second.s();
+    file_decisions_.clear();
+    TF_RETURN_IF_ERROR(ReadDecisions(decision_cache_file_, &file_decisions_));
+    DecisionCache* cache = GetDecisionCache();
+    mutex_lock l(cache->mu);
+    for (const auto& decision : file_decisions_) {
+      cache->decisions[decision.first] = decision.second;
+    }
+  }
+  return absl::OkStatus();
+}
+
+Status FusionAutotuner::Optimize(Cluster* cluster, const GrapplerItem& item,
+                                 GraphDef* optimized_graph) {
+  bool has_gpu = false;
+  if (cluster != nullptr) {
+    for (const auto& device : cluster->GetDevices()) {
+      if (device.second.type() == "GPU") has_gpu = true;
+    }
+  }
+  const std::unordered_set<string> nodes_to_preserve = item.NodesToPreserve();
+  std::vector<int> candidates;
+  for (int i = 0; i < item.graph.node_size(); ++i) {
+    const NodeDef& node = item.graph.node(i);
+    if (IsTunableContraction(node) && IsOnCpu(node, has_gpu) &&
+        nodes_to_preserve.count(node.name()) == 0) {
+      candidates.push_back(i);
+    }
+  }
+  if (candidates.empty()) return errors::Aborted("Nothing to do.");
+
+  GraphProperties properties(item);
+  TF_RETURN_IF_ERROR(
+      properties.InferStatically(/*assume_valid_feeds=*/false,
+                                 /*aggressive_shape_inference=*/false,
+                                 /*include_tensor_values=*/false));
+
+  const DeviceProperties device = GetLocalCPUInfo();
+  const OpLevelCostEstimator estimator;
+  DecisionCache* cache = GetDecisionCache();
+  // Only one SingleMachine can be provisioned at a time in a process, so it's
+  // shut down as soon as the candidates are measured.
+  std::unique_ptr<Cluster> owned_cluster;
+  auto shutdown = gtl::MakeCleanup([&owned_cluster]() {
+    if (owned_cluster != nullptr) owned_cluster->Shutdown().IgnoreError();
+  });
+  *optimized_graph = item.graph;
+  bool changed = false;
+  // Whether a decision used isn't in the decision cache file yet.
+  bool file_is_stale = false;
+  for (int i : candidates) {
+    GRAPPLER_RETURN_IF_DEADLINE_EXCEEDED();
+    const NodeDef& node = item.graph.node(i);
+    const std::vector<OpInfo::TensorProperties>& inputs =
+        properties.GetInputProperties(node.name());
+    const std::vector<OpInfo::TensorProperties>& outputs =
+        properties.GetOutputProperties(node.name());
+    if (inputs.size() != 3 || outputs.size() != 1 ||
+        !IsFullyDefined(inputs[0]) || !IsFullyDefined(inputs[1]) ||
+        !IsFullyDefined(inputs[2]) || !IsFullyDefined(outputs[0])) {
+      continue;
+    }
+    if (PredictContractionMicros(estimator, node, inputs, outputs[0], device) <
+        min_op_time_us_) {
+      continue;
+    }
+
+    const string signature = Signature(node, inputs, device.num_cores());
+    string decision;
+    {
+      mutex_lock l(cache->mu);
+      auto it = cache->decisions.find(signature);
+      if (it != cache->decisions.end()) decision = it->second;
+    }
+    if (decision.empty()) {
+      const Status status = ProvisionMeasurementCluster(&owned_cluster);
+      if (!status.ok()) {
+        VLOG(1) << "Can't measure " << node.name() << ": " << status;
+        continue;
+      }
+      double fused_time = std::numeric_limits<double>::infinity();
+      double best_time = std::numeric_limits<double>::infinity();
+      for (const Candidate& candidate : kCandidates) {
+        // Matrix multiplications have no data format.
+        if (candidate.nchw && node.op() != "_FusedConv2D") continue;
+        double time_us;
+        const Status status = MeasureCandidate(
+            owned_cluster.get(), node, inputs, candidate, measurement_steps_,
+            &time_us);
+        if (!status.ok()) {
+          VLOG(2) << "Failed to measure " << CandidateName(candidate)
+                  << " for " << node.name() << ": " << status;
+          continue;
+        }
+        VLOG(2) << "Measured " << CandidateName(candidate) << " for "
+                << node.name() << ": " << time_us << "us";
+        if (candidate.fused && !candidate.nchw) fused_time = time_us;
+        if (time_us < best_time) {
+          best_time = time_us;
+          decision = CandidateName(candidate);
+        }
+      }
+      if (decision.empty()) continue;
+      if (best_time * kMinSpeedup > fused_time) {
+        decision = CandidateName(kCandidates[0]);
+      }
+      mutex_lock l(cache->mu);
+      cache->decisions[signature] = decision;
+    }
+    if (!decision_cache_file_.empty()) {
+      auto it = file_decisions_.find(signature);
+      if (it == file_decisions_.end() || it->second != decision) {
+        file_decisions_[signature] = decision;
+        file_is_stale = true;
+      }
+    }
+
+    Candidate candidate;
+    if (!ParseCandidate(decision, &candidate) ||
+        (candidate.fused && !candidate.nchw)) {
+      continue;
+    }
+    VLOG(1) << "Rewriting " << node.name() << " as " << decision;
+    std::vector<NodeDef> nodes = ExpandCandidate(node, candidate);
+    optimized_graph->mutable_node(i)->Swap(&nodes.back());
+    nodes.pop_back();
+    for (NodeDef& new_node : nodes) {
+      optimized_graph->add_node()->Swap(&new_node);
+    }
+    changed = true;
+  }
+
+  if (file_is_stale) {
+    // Keep the decisions added to the file by other processes.
+    absl::flat_hash_map<string, string> decisions;
+    if (!ReadDecisions(decision_cache_file_, &decisions).ok()) {
+      decisions.clear();
+    }
+    for (const auto& decision : file_decisions_) {
+      decisions[decision.first] = decision.second;
+    }
+    TF_RETURN_IF_ERROR(WriteDecisions(decision_cache_file_, decisions));
+    file_decisions_ = std::move(decisions);
+  }
+  if (!changed) return errors::Aborted("Nothing to do.");
+  return absl::OkStatus();
+}
+
+REGISTER_GRAPH_OPTIMIZER_AS(FusionAutotuner, "FusionAutotuner");
+
+}  // end namespace grappler
+}  // end namespace tensorflow
@@ -0,0 +1,82 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_GRAPPLER_OPTIMIZERS_FUSION_AUTOTUNER_H_
+#define TENSORFLOW_CORE_GRAPPLER_OPTIMIZERS_FUSION_AUTOTUNER_H_
+
+#include "absl/container/flat_hash_map.h"
+#include "tensorflow/core/grappler/optimizers/custom_graph_optimizer.h"
+
+namespace tensorflow {
+namespace grappler {
+
+// Parameters of the FusionAutotuner in the parameter_map of its
+// RewriterConfig::CustomGraphOptimizer.
+constexpr char kFusionAutotunerMeasurementSteps[] = "measurement_steps";
+constexpr char kFusionAutotunerMinOpTimeMicros[] = "min_op_time_us";
+constexpr char kFusionAutotunerDecisionCacheFile[] = "decision_cache_file";
+
+// Picks the fastest implementation of the contractions fused by the Remapper
+// on CPU, i.e. _FusedConv2D and _FusedMatMul with a BiasAdd and an optional
+// activation. The candidates are the fused op and the unfused ops, and for
+// convolutions the unfused ops in the NCHW data format, since the CPU kernel of
+// _FusedConv2D only supports NHWC. Each candidate is run on random
+// inputs of the same shapes as in the graph, and timed with a
+// MeasuringCostEstimator. The candidates that fail to run, e.g. because the
+// CPU kernels don't support a data format, are skipped.
+//
+// Only the contractions predicted to take at least min_op_time_us are tuned.
+// The decisions are cached in the process by op, attributes and input shapes,
+// and in decision_cache_file if set, so that loading a model with the same
+// contractions doesn't measure them again. The decisions used by an optimizer
+// are added to its file even if they were measured for another model.
+//
+// This optimizer runs after the built-in optimizers when it's listed in the
+// custom_optimizers of the RewriterConfig as "FusionAutotuner".
+class FusionAutotuner : public CustomGraphOptimizer {
+ public:
+  FusionAutotuner() = default;
+  ~FusionAutotuner() override {}
+
+  Status Init(
+      const tensorflow::RewriterConfig_CustomGraphOptimizer* config) override;
+
+  string name() const override { return "fusion_autotuner"; };
+
+  bool UsesFunctionLibrary() const override { return false; }
+
+  // Measures the candidates on a CPU-only SingleMachine provisioned for the
+  // optimization, with the TensorFlow optimizer disabled. `cluster` is not
+  // used. No candidate is measured while another SingleMachine is
+  // provisioned in the process.
+  Status Optimize(Cluster* cluster, const GrapplerItem& item,
+                  GraphDef* optimized_graph) override;
+
+  // Clears the decisions cached in the process, e.g. between tests.
+  static void ClearDecisionCache();
+
+ private:
+  int measurement_steps_ = 10;
+  int64_t min_op_time_us_ = 20;
+  string decision_cache_file_;
+  // Decisions in decision_cache_file_, keyed by the signature of the
+  // contractions.
+  absl::flat_hash_map<string, string> file_decisions_;
+};
+
+}  // end namespace grappler
+}  // end namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_GRAPPLER_OPTIMIZERS_FUSION_AUTOTUNER_H_
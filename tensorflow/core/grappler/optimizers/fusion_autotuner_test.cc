@@ -0,0 +1,336 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/grappler/optimizers/fusion_autotuner.h"
+
+#include <algorithm>
+
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_replace.h"
+#include "tensorflow/cc/ops/standard_ops.h"
+#include "tensorflow/core/framework/node_def_util.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/grappler/grappler_item.h"
+#include "tensorflow/core/grappler/utils/grappler_test.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace grappler {
+namespace {
+
+class FusionAutotunerTest : public GrapplerTest {
+ protected:
+  // Each test measures its candidates, or reads its decisions from its file.
+  void SetUp() override { FusionAutotuner::ClearDecisionCache(); }
+
+  // Returns a graph computing a convolution of `x`, fused with a BiasAdd and a
+  // Relu, as rewritten by the Remapper.
+  GrapplerItem FusedConv2DItem(const TensorShape& x_shape,
+                               const TensorShape& filter_shape) {
+    tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+    Output x = ops::Placeholder(s.WithOpName("x"), DT_FLOAT,
+                                ops::Placeholder::Shape(x_shape));
+    Output filter = ops::Const(
+        s.WithOpName("filter"),
+        Input::Initializer(GenerateRandomTensor<DT_FLOAT>(filter_shape)));
+    Output bias = ops::Const(
+        s.WithOpName("bias"),
+        Input::Initializer(GenerateRandomTensor<DT_FLOAT>(
+            TensorShape({filter_shape.dim_size(3)}))));
+    Output conv =
+        ops::Conv2D(s.WithOpName("conv"), x, filter, {1, 1, 1, 1}, "SAME");
+    ops::Identity(s.WithOpName("out"), conv);
+
+    GrapplerItem item;
+    item.fetch = {"out"};
+    TF_CHECK_OK(s.ToGraphDef(&item.graph));
+    for (NodeDef& node : *item.graph.mutable_node()) {
+      if (node.name() != "conv") continue;
+      node.set_op("_FusedConv2D");
+      node.add_input("bias");
+      AddNodeAttr("num_args", 1, &node);
+      AddNodeAttr("TArgs", DataTypeVector{DT_FLOAT}, &node);
+      AddNodeAttr("fused_ops", std::vector<string>{"BiasAdd", "Relu"}, &node);
+    }
+    return item;
+  }
+
+  // Returns a graph computing a matrix multiplication of `x`, fused with a
+  // BiasAdd.
+  GrapplerItem FusedMatMulItem() {
+    tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+    Output x = ops::Placeholder(s.WithOpName("x"), DT_FLOAT,
+                                ops::Placeholder::Shape({64, 256}));
+    Output w = ops::Const(s.WithOpName("w"),
+                          Input::Initializer(GenerateRandomTensor<DT_FLOAT>(
+                              TensorShape({256, 512}))));
+    Output bias = ops::Const(s.WithOpName("bias"),
+                             Input::Initializer(GenerateRandomTensor<DT_FLOAT>(
+                                 TensorShape({512}))));
+    Output matmul = ops::MatMul(s.WithOpName("matmul"), x, w);
+    ops::Identity(s.WithOpName("out"), matmul);
+
+    GrapplerItem item;
+    item.fetch = {"out"};
+    TF_CHECK_OK(s.ToGraphDef(&item.graph));
+    for (NodeDef& node : *item.graph.mutable_node()) {
+      if (node.name() != "matmul") continue;
+      node.set_op("_FusedMatMul");
+      node.add_input("bias");
+      AddNodeAttr("num_args", 1, &node);
+      AddNodeAttr("fused_ops", std::vector<string>{"BiasAdd"}, &node);
+    }
+    return item;
+  }
+
+  RewriterConfig::CustomGraphOptimizer Config(const string& cache_file,
+                                              int64_t min_op_time_us) {
+    RewriterConfig::CustomGraphOptimizer config;
+    config.set_name("FusionAutotuner");
+    auto& parameters = *config.mutable_parameter_map();
+    parameters[kFusionAutotunerMeasurementSteps].set_i(2);
+    parameters[kFusionAutotunerMinOpTimeMicros].set_i(min_op_time_us);
+    parameters[kFusionAutotunerDecisionCacheFile].set_s(cache_file);
+    return config;
+  }
+
+  string CacheFile(const string& name) {
+    const string cache_file = io::JoinPath(testing::TmpDir(), name);
+    Env::Default()->DeleteFile(cache_file).IgnoreError();
+    return cache_file;
+  }
+
+  // Measures the candidates for `item`, and replaces the decision in
+  // `cache_file` by `decision`.
+  void ForceDecision(const GrapplerItem& item, const string& cache_file,
+                     const string& decision) {
+    FusionAutotuner optimizer;
+    const auto config = Config(cache_file, /*min_op_time_us=*/0);
+    TF_ASSERT_OK(optimizer.Init(&config));
+    GraphDef output;
+    optimizer.Optimize(/*cluster=*/nullptr, item, &output).IgnoreError();
+
+    string contents;
+    TF_ASSERT_OK(ReadFileToString(Env::Default(), cache_file, &contents));
+    for (const char* candidate :
+         {"\tfused_nhwc", "\tunfused_nhwc", "\tunfused_nchw"}) {
+      absl::StrReplaceAll({{candidate, absl::StrCat("\t", decision)}},
+                          &contents);
+    }
+    TF_ASSERT_OK(WriteStringToFile(Env::Default(), cache_file, contents));
+  }
+};
+
+TEST_F(FusionAutotunerTest, MeasuresCandidates) {
+  GrapplerItem item = FusedConv2DItem(TensorShape({8, 32, 32, 16}),
+                                      TensorShape({3, 3, 16, 32}));
+  const string cache_file = CacheFile("measures_candidates");
+
+  FusionAutotuner optimizer;
+  const auto config = Config(cache_file, /*min_op_time_us=*/0);
+  TF_ASSERT_OK(optimizer.Init(&config));
+  GraphDef output;
+  Status status = optimizer.Optimize(/*cluster=*/nullptr, item, &output);
+  if (errors::IsAborted(status)) {
+    // The fused op is the fastest.
+    output = item.graph;
+  } else {
+    TF_ASSERT_OK(status);
+  }
+
+  // The decision is cached for later loads.
+  string contents;
+  TF_ASSERT_OK(ReadFileToString(Env::Default(), cache_file, &contents));
+  EXPECT_TRUE(absl::StartsWith(contents, "_FusedConv2D;"));
+  EXPECT_EQ(std::count(contents.begin(), contents.end(), '\n'), 1);
+
+  auto x_t = GenerateRandomTensor<DT_FLOAT>(TensorShape({8, 32, 32, 16}));
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, {{"x", x_t}});
+  auto tensors = EvaluateNodes(output, item.fetch, {{"x", x_t}});
+  ASSERT_EQ(tensors_expected.size(), 1);
+  ASSERT_EQ(tensors.size(), 1);
+  test::ExpectTensorNear<float>(tensors[0], tensors_expected[0], 1e-3);
+}
+
+TEST_F(FusionAutotunerTest, UnfusesConv2D) {
+  GrapplerItem item = FusedConv2DItem(TensorShape({8, 32, 32, 16}),
+                                      TensorShape({3, 3, 16, 32}));
+  const string cache_file = CacheFile("unfuses_conv2d");
+  ForceDecision(item, cache_file, "unfused_nhwc");
+
+  FusionAutotuner optimizer;
+  const auto config = Config(cache_file, /*min_op_time_us=*/0);
+  TF_ASSERT_OK(optimizer.Init(&config));
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(/*cluster=*/nullptr, item, &output));
+
+  int found = 0;
+  for (const NodeDef& node : output.node()) {
+    if (node.name() == "conv") {
+      EXPECT_EQ(node.op(), "Relu");
+      ASSERT_EQ(node.input_size(), 1);
+      EXPECT_EQ(node.input(0), "conv/FusionAutotuner/bias_add");
+      ++found;
+    } else if (node.name() == "conv/FusionAutotuner/bias_add") {
+      EXPECT_EQ(node.op(), "BiasAdd");
+      ASSERT_EQ(node.input_size(), 2);
+      EXPECT_EQ(node.input(0), "conv/FusionAutotuner/contraction");
+      EXPECT_EQ(node.input(1), "bias");
+      ++found;
+    } else if (node.name() == "conv/FusionAutotuner/contraction") {
+      EXPECT_EQ(node.op(), "Conv2D");
+      ASSERT_EQ(node.input_size(), 2);
+      EXPECT_EQ(node.input(0), "x");
+      EXPECT_EQ(node.input(1), "filter");
+      EXPECT_EQ(node.attr().count("fused_ops"), 0);
+      ++found;
+    }
+  }
+  EXPECT_EQ(found, 3);
+
+  auto x_t = GenerateRandomTensor<DT_FLOAT>(TensorShape({8, 32, 32, 16}));
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, {{"x", x_t}});
+  auto tensors = EvaluateNodes(output, item.fetch, {{"x", x_t}});
+  ASSERT_EQ(tensors_expected.size(), 1);
+  ASSERT_EQ(tensors.size(), 1);
+  test::ExpectTensorNear<float>(tensors[0], tensors_expected[0], 1e-3);
+}
+
+TEST_F(FusionAutotunerTest, ConvertsConv2DToNchw) {
+  GrapplerItem item = FusedConv2DItem(TensorShape({8, 32, 32, 16}),
+                                      TensorShape({3, 3, 16, 32}));
+  const string cache_file = CacheFile("converts_conv2d_to_nchw");
+  ForceDecision(item, cache_file, "unfused_nchw");
+
+  FusionAutotuner optimizer;
+  const auto config = Config(cache_file, /*min_op_time_us=*/0);
+  TF_ASSERT_OK(optimizer.Init(&config));
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(/*cluster=*/nullptr, item, &output));
+
+  int found = 0;
+  for (const NodeDef& node : output.node()) {
+    if (node.name() == "conv") {
+      EXPECT_EQ(node.op(), "Transpose");
+      ASSERT_EQ(node.input_size(), 2);
+      EXPECT_EQ(node.input(0), "conv/FusionAutotuner/activation");
+      ++found;
+    } else if (node.name() == "conv/FusionAutotuner/activation") {
+      EXPECT_EQ(node.op(), "Relu");
+      ++found;
+    } else if (node.name() == "conv/FusionAutotuner/bias_add") {
+      EXPECT_EQ(node.op(), "BiasAdd");
+      EXPECT_EQ(node.attr().at("data_format").s(), "NCHW");
+      ++found;
+    } else if (node.name() == "conv/FusionAutotuner/contraction") {
+      EXPECT_EQ(node.op(), "Conv2D");
+      ASSERT_EQ(node.input_size(), 2);
+      EXPECT_EQ(node.input(0), "conv/FusionAutotuner/to_nchw");
+      EXPECT_EQ(node.attr().at("data_format").s(), "NCHW");
+      ++found;
+    } else if (node.name() == "conv/FusionAutotuner/to_nchw") {
+      EXPECT_EQ(node.op(), "Transpose");
+      ASSERT_EQ(node.input_size(), 2);
+      EXPECT_EQ(node.input(0), "x");
+      ++found;
+    } else if (node.op() == "_FusedConv2D") {
+      ADD_FAILURE() << "Unexpected fused convolution " << node.name();
+    }
+  }
+  EXPECT_EQ(found, 5);
+}
+
+TEST_F(FusionAutotunerTest, WritesCachedDecisionsToEachFile) {
+  GrapplerItem item = FusedConv2DItem(TensorShape({8, 32, 32, 16}),
+                                      TensorShape({3, 3, 16, 32}));
+  const string first_file = CacheFile("writes_cached_decisions_first");
+  const string second_file = CacheFile("writes_cached_decisions_second");
+
+  FusionAutotuner first;
+  const auto first_config = Config(first_file, /*min_op_time_us=*/0);
+  TF_ASSERT_OK(first.Init(&first_config));
+  GraphDef first_output;
+  first.Optimize(/*cluster=*/nullptr, item, &first_output).IgnoreError();
+  string first_contents;
+  TF_ASSERT_OK(
+      ReadFileToString(Env::Default(), first_file, &first_contents));
+
+  // The second optimizer reuses the decision measured by the first one, and
+  // still writes it to its own file.
+  FusionAutotuner second;
+  const auto second_config = Config(second_file, /*min_op_time_us=*/0);
+  TF_ASSERT_OK(second.Init(&second_config));
+  GraphDef second_output;
+  second.Optimize(/*cluster=*/nullptr, item, &second_output).IgnoreError();
+  string second_contents;
+  TF_ASSERT_OK(
+      ReadFileToString(Env::Default(), second_file, &second_contents));
+  EXPECT_EQ(second_contents, first_contents);
+}
+
+TEST_F(FusionAutotunerTest, UnfusesMatMul) {
+  GrapplerItem item = FusedMatMulItem();
+  const string cache_file = CacheFile("unfuses_matmul");
+  ForceDecision(item, cache_file, "unfused_nhwc");
+
+  FusionAutotuner optimizer;
+  const auto config = Config(cache_file, /*min_op_time_us=*/0);
+  TF_ASSERT_OK(optimizer.Init(&config));
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(/*cluster=*/nullptr, item, &output));
+
+  int found = 0;
+  for (const NodeDef& node : output.node()) {
+    if (node.name() == "matmul") {
+      EXPECT_EQ(node.op(), "BiasAdd");
+      ASSERT_EQ(node.input_size(), 2);
+      EXPECT_EQ(node.input(0), "matmul/FusionAutotuner/contraction");
+      ++found;
+    } else if (node.name() == "matmul/FusionAutotuner/contraction") {
+      EXPECT_EQ(node.op(), "MatMul");
+      ++found;
+    }
+  }
+  EXPECT_EQ(found, 2);
+
+  auto x_t = GenerateRandomTensor<DT_FLOAT>(TensorShape({64, 256}));
+  auto tensors_expected = EvaluateNodes(item.graph, item.fetch, {{"x", x_t}});
+  auto tensors = EvaluateNodes(output, item.fetch, {{"x", x_t}});
+  ASSERT_EQ(tensors_expected.size(), 1);
+  ASSERT_EQ(tensors.size(), 1);
+  test::ExpectTensorNear<float>(tensors[0], tensors_expected[0], 1e-3);
+}
+
+TEST_F(FusionAutotunerTest, SkipsSmallContractions) {
+  GrapplerItem item =
+      FusedConv2DItem(TensorShape({1, 4, 4, 2}), TensorShape({1, 1, 2, 2}));
+  const string cache_file = CacheFile("skips_small_contractions");
+
+  FusionAutotuner optimizer;
+  const auto config = Config(cache_file, /*min_op_time_us=*/20);
+  TF_ASSERT_OK(optimizer.Init(&config));
+  GraphDef output;
+  Status status = optimizer.Optimize(/*cluster=*/nullptr, item, &output);
+  EXPECT_TRUE(errors::IsAborted(status));
+  EXPECT_FALSE(Env::Default()->FileExists(cache_file).ok());
+}
+
+}  // namespace
+}  // namespace grappler
+}  // namespace tensorflow
@@ -16,8 +16,10 @@ limitations under the License.
 #include "tensorflow/core/grappler/optimizers/memory_optimizer.h"
 
 #include <algorithm>
+#include <map>
 #include <queue>
 #include <set>
+#include <tuple>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -30,7 +32,10 @@ limitations under the License.
 #include "tensorflow/core/grappler/clusters/virtual_cluster.h"
 #include "tensorflow/core/grappler/costs/graph_memory.h"
 #include "tensorflow/core/grappler/costs/graph_properties.h"
+#include "tensorflow/core/grappler/costs/op_level_cost_estimator.h"
 #include "tensorflow/core/grappler/costs/utils.h"
+#include "tensorflow/core/grappler/costs/virtual_placer.h"
+#include "tensorflow/core/grappler/costs/virtual_scheduler.h"
 #include "tensorflow/core/grappler/graph_topology_view.h"
 #include "tensorflow/core/grappler/grappler_item.h"
 #include "tensorflow/core/grappler/mutable_graph_view.h"
@@ -41,6 +46,7 @@ limitations under the License.
 #include "tensorflow/core/grappler/utils/traversal.h"
 #include "tensorflow/core/lib/math/math_util.h"
 #include "tensorflow/core/lib/strings/str_util.h"
+#include "tensorflow/core/platform/numbers.h"
 #include "tensorflow/core/protobuf/rewriter_config.pb.h"
 #include "tensorflow/core/util/device_name_utils.h"
 
@@ -1270,6 +1276,386 @@ bool SwappingPass(RewriterConfig::MemOptType optimization_level,
   return updated_graph;
 }
 
+// Nodes allocating at least 1/kLargeAllocationFraction of the estimated peak
+// memory usage are kept from starting before the memory released earlier in
+// the schedule is freed.
+constexpr int64_t kLargeAllocationFraction = 16;
+
+// A schedule is only enforced if it reduces the estimated peak memory usage by
+// at least 10%, since the control dependencies limit the parallelism.
+bool SignificantMemorySavings(int64_t peak_memory, int64_t new_peak_memory) {
+  return new_peak_memory * 10 <= peak_memory * 9;
+}
+
+// The tensors of a graph and their consumers, used to track the memory
+// allocated and released by the nodes when executed in a given order.
+struct MemoryTrackingGraph {
+  // Per node: size of the non persistent outputs, unique regular inputs,
+  // unique fanouts (including control fanouts), number of unique fanins and
+  // position in a topological order of the graph.
+  std::vector<int64_t> output_bytes;
+  std::vector<std::vector<int>> input_tensors;
+  std::vector<std::vector<int>> fanouts;
+  std::vector<int> num_fanins;
+  std::vector<int> topo_rank;
+
+  // Per tensor: size, consumer nodes, and number of references which is the
+  // number of consumers plus one if the tensor is fetched.
+  std::vector<int64_t> tensor_bytes;
+  std::vector<std::vector<int>> consumers;
+  std::vector<int> num_references;
+};
+
+Status BuildMemoryTrackingGraph(const GrapplerItem& item,
+                                const GraphProperties& properties,
+                                MemoryTrackingGraph* graph) {
+  const GraphDef& graph_def = item.graph;
+  const int num_nodes = graph_def.node_size();
+  std::unordered_map<string, int> node_index;
+  std::unordered_map<const NodeDef*, int> node_ptr_index;
+  for (int i = 0; i < num_nodes; ++i) {
+    node_index[graph_def.node(i).name()] = i;
+    node_ptr_index[&graph_def.node(i)] = i;
+  }
+  std::vector<const NodeDef*> topo_order;
+  TF_RETURN_IF_ERROR(ComputeTopologicalOrder(graph_def, &topo_order));
+  graph->topo_rank.resize(num_nodes);
+  for (int i = 0; i < static_cast<int>(topo_order.size()); ++i) {
+    graph->topo_rank[node_ptr_index.at(topo_order[i])] = i;
+  }
+
+  std::map<std::pair<int, int>, int> tensor_ids;
+  auto get_tensor_id = [&](int node, int port) {
+    auto it = tensor_ids.emplace(std::make_pair(node, port),
+                                 graph->tensor_bytes.size());
+    if (it.second) {
+      const NodeDef& producer = graph_def.node(node);
+      int64_t bytes = 0;
+      if (!IsPersistent(producer) &&
+          properties.HasOutputProperties(producer.name())) {
+        const auto& outputs = properties.GetOutputProperties(producer.name());
+        if (port < static_cast<int>(outputs.size())) {
+          bytes = CalculateTensorSize(outputs[port]);
+        }
+      }
+      graph->tensor_bytes.push_back(bytes);
+      graph->consumers.emplace_back();
+      graph->num_references.push_back(0);
+    }
+    return it.first->second;
+  };
+
+  graph->output_bytes.assign(num_nodes, 0);
+  graph->input_tensors.resize(num_nodes);
+  graph->fanouts.resize(num_nodes);
+  graph->num_fanins.assign(num_nodes, 0);
+  for (int i = 0; i < num_nodes; ++i) {
+    const NodeDef& node = graph_def.node(i);
+    if (!IsPersistent(node) && properties.HasOutputProperties(node.name())) {
+      for (const auto& output : properties.GetOutputProperties(node.name())) {
+        graph->output_bytes[i] += CalculateTensorSize(output);
+      }
+    }
+    std::unordered_set<int> fanins;
+    for (const string& input : node.input()) {
+      int port;
+      const auto it = node_index.find(ParseNodeName(input, &port));
+      if (it == node_index.end()) {
+        return errors::InvalidArgument("Unknown input ", input, " of node ",
+                                       node.name());
+      }
+      const int fanin = it->second;
+      if (fanins.insert(fanin).second) {
+        graph->fanouts[fanin].push_back(i);
+      }
+      if (port < 0) continue;
+      const int tensor = get_tensor_id(fanin, port);
+      if (graph->consumers[tensor].empty() ||
+          graph->consumers[tensor].back() != i) {
+        graph->consumers[tensor].push_back(i);
+        graph->num_references[tensor]++;
+        graph->input_tensors[i].push_back(tensor);
+      }
+    }
+    graph->num_fanins[i] = fanins.size();
+  }
+  // Fetched tensors are never released.
+  for (const string& fetch : item.fetch) {
+    int port;
+    const auto it = node_index.find(ParseNodeName(fetch, &port));
+    if (it != node_index.end()) {
+      graph->num_references[get_tensor_id(it->second, std::max(port, 0))]++;
+    }
+  }
+  return absl::OkStatus();
+}
+
+// Returns a topological order of the graph that picks, among the ready nodes,
+// the one that increases the memory usage the least, i.e. that allocates the
+// smallest outputs and releases the largest inputs. Ties are broken in the
+// original topological order.
+std::vector<int> MinMemoryIncreaseOrder(const MemoryTrackingGraph& graph) {
+  const int num_nodes = graph.output_bytes.size();
+  std::vector<int> num_references = graph.num_references;
+  std::vector<int> missing_fanins = graph.num_fanins;
+  // The score of a ready node changes when it becomes the last consumer of
+  // one of its inputs: it is then queued again with a new version, and the
+  // stale entries are skipped.
+  std::vector<int> version(num_nodes, 0);
+  std::vector<bool> scheduled(num_nodes, false);
+  auto memory_increase = [&](int node) {
+    int64_t increase = graph.output_bytes[node];
+    for (int tensor : graph.input_tensors[node]) {
+      if (num_references[tensor] == 1) increase -= graph.tensor_bytes[tensor];
+    }
+    return increase;
+  };
+  // (memory increase, topological rank, node, version)
+  using ReadyNode = std::tuple<int64_t, int, int, int>;
+  std::priority_queue<ReadyNode, std::vector<ReadyNode>,
+                      std::greater<ReadyNode>>
+      ready_nodes;
+  auto add_ready_node = [&](int node) {
+    ready_nodes.emplace(memory_increase(node), graph.topo_rank[node], node,
+                        ++version[node]);
+  };
+  for (int i = 0; i < num_nodes; ++i) {
+    if (missing_fanins[i] == 0) add_ready_node(i);
+  }
+
+  std::vector<int> order;
+  order.reserve(num_nodes);
+  while (!ready_nodes.empty()) {
+    const int node = std::get<2>(ready_nodes.top());
+    const int node_version = std::get<3>(ready_nodes.top());
+    ready_nodes.pop();
+    if (scheduled[node] || node_version != version[node]) continue;
+    scheduled[node] = true;
+    order.push_back(node);
+    for (int tensor : graph.input_tensors[node]) {
+      if (--num_references[tensor] != 1) continue;
+      for (int consumer : graph.consumers[tensor]) {
+        if (!scheduled[consumer] && missing_fanins[consumer] == 0) {
+          add_ready_node(consumer);
+        }
+      }
+    }
+    for (int fanout : graph.fanouts[node]) {
+      if (--missing_fanins[fanout] == 0) add_ready_node(fanout);
+    }
+  }
+  return order;
+}
+
+// Returns a depth first topological order of the graph, that completes a
+// branch of the graph before starting the next one.
+std::vector<int> DepthFirstOrder(const MemoryTrackingGraph& graph) {
+  const int num_nodes = graph.output_bytes.size();
+  std::vector<int> missing_fanins = graph.num_fanins;
+  auto by_decreasing_rank = [&graph](int a, int b) {
+    return graph.topo_rank[a] > graph.topo_rank[b];
+  };
+  std::vector<int> ready_nodes;
+  for (int i = 0; i < num_nodes; ++i) {
+    if (missing_fanins[i] == 0) ready_nodes.push_back(i);
+  }
+  std::sort(ready_nodes.begin(), ready_nodes.end(), by_decreasing_rank);
+
+  std::vector<int> order;
+  order.reserve(num_nodes);
+  std::vector<int> new_ready_nodes;
+  while (!ready_nodes.empty()) {
+    const int node = ready_nodes.back();
+    ready_nodes.pop_back();
+    order.push_back(node);
+    new_ready_nodes.clear();
+    for (int fanout : graph.fanouts[node]) {
+      if (--missing_fanins[fanout] == 0) new_ready_nodes.push_back(fanout);
+    }
+    std::sort(new_ready_nodes.begin(), new_ready_nodes.end(),
+              by_decreasing_rank);
+    ready_nodes.insert(ready_nodes.end(), new_ready_nodes.begin(),
+                       new_ready_nodes.end());
+  }
+  return order;
+}
+
+// Simulates the execution of the item on the devices of the cluster, and
+// returns the highest peak memory usage of the devices. The ready nodes are
+// scheduled by increasing priority if `node_priority` is not empty, and in the
+// order they become ready otherwise.
+Status EstimatePeakMemoryUsage(
+    Cluster* cluster, const GrapplerItem& item,
+    const std::unordered_map<string, int>& node_priority,
+    int64_t* peak_memory_usage) {
+  std::unique_ptr<ReadyNodeManager> ready_nodes;
+  if (node_priority.empty()) {
+    ready_nodes = std::make_unique<FirstReadyManager>();
+  } else {
+    auto priority_ready_nodes = std::make_unique<PriorityReadyManager>();
+    TF_RETURN_IF_ERROR(priority_ready_nodes->SetPriority(node_priority));
+    ready_nodes = std::move(priority_ready_nodes);
+  }
+  VirtualScheduler scheduler(/*use_static_shapes=*/true,
+                             /*use_aggressive_shape_inference=*/false, cluster,
+                             ready_nodes.get(),
+                             std::make_unique<VirtualPlacer>(
+                                 cluster->GetDevices()));
+  TF_RETURN_IF_ERROR(scheduler.Init(&item));
+  OpLevelCostEstimator node_estimator;
+  Costs node_costs;
+  do {
+    node_costs = node_estimator.PredictCosts(scheduler.GetCurrNode());
+  } while (scheduler.MarkCurrNodeExecuted(node_costs));
+
+  *peak_memory_usage = 0;
+  for (const auto& device : scheduler.GetPeakMemoryUsage()) {
+    *peak_memory_usage = std::max(*peak_memory_usage, device.second);
+  }
+  return absl::OkStatus();
+}
+
+// Adds control dependencies to the item, so that the nodes allocating large
+// tensors wait for the memory released before them in `order`. Returns the
+// number of control dependencies added.
+int EnforceMemoryOrder(const MemoryTrackingGraph& graph,
+                       const std::vector<int>& order, int64_t peak_memory,
+                       GrapplerItem* item) {
+  const std::unordered_set<string> nodes_to_preserve = item->NodesToPreserve();
+  std::unordered_set<string> feeds;
+  for (const auto& feed : item->feed) {
+    feeds.insert(NodeName(feed.first));
+  }
+  auto can_delay = [&](const NodeDef& node) {
+    return !IsPersistent(node) && !IsSend(node) && !IsRecv(node) &&
+           !IsArg(node) && feeds.find(node.name()) == feeds.end() &&
+           nodes_to_preserve.find(node.name()) == nodes_to_preserve.end();
+  };
+
+  std::vector<int> num_references = graph.num_references;
+  int last_release = -1;
+  int num_control_dependencies = 0;
+  for (int i : order) {
+    NodeDef* node = item->graph.mutable_node(i);
+    if (last_release >= 0 &&
+        graph.output_bytes[i] * kLargeAllocationFraction >= peak_memory &&
+        can_delay(*node)) {
+      const NodeDef& release = item->graph.node(last_release);
+      // Control dependencies between devices would add send/recv pairs.
+      bool is_fanin = release.device() != node->device() || IsSend(release);
+      for (const string& input : node->input()) {
+        is_fanin |= NodeName(input) == release.name();
+      }
+      if (!is_fanin) {
+        node->add_input(AsControlDependency(release.name()));
+        ++num_control_dependencies;
+      }
+    }
+    for (int tensor : graph.input_tensors[i]) {
+      if (--num_references[tensor] == 0 && graph.tensor_bytes[tensor] > 0) {
+        last_release = i;
+      }
+    }
+  }
+  return num_control_dependencies;
+}
+
+// Searches for an execution order of the graph that reduces its peak memory
+// usage, and adds control dependencies to enforce it. The peak memory usage of
+// the candidate orders is estimated by simulating their execution with the
+// VirtualScheduler, and the rewritten graph is only kept if its estimated peak
+// memory usage without any enforced priority is significantly lower.
+bool ReorderingPass(Cluster* cluster, GrapplerItem* item) {
+  for (const NodeDef& node : item->graph.node()) {
+    // Control dependencies can't cross frames, and would propagate dead
+    // tensors out of untaken branches.
+    if (IsControlFlow(node)) {
+      VLOG(1) << "Not reordering graph with control flow node " << node.name();
+      return false;
+    }
+  }
+
+  int64_t peak_memory = 0;
+  Status s = EstimatePeakMemoryUsage(cluster, *item, {}, &peak_memory);
+  if (!s.ok()) {
+    VLOG(1) << "Failed to estimate memory usage: " << s.message();
+    return false;
+  }
+  if (peak_memory <= 0) return false;
+
+  GraphProperties properties(*item);
+  s = properties.InferStatically(/*assume_valid_feeds=*/false,
+                                 /*aggressive_shape_inference=*/false,
+                                 /*include_tensor_values=*/false);
+  if (!s.ok()) {
+    VLOG(1) << "Failed to infer shapes: " << s.message();
+    return false;
+  }
+  MemoryTrackingGraph graph;
+  s = BuildMemoryTrackingGraph(*item, properties, &graph);
+  if (!s.ok()) {
+    VLOG(1) << "Failed to build memory tracking graph: " << s.message();
+    return false;
+  }
+
+  std::vector<std::vector<int>> candidate_orders;
+  candidate_orders.push_back(MinMemoryIncreaseOrder(graph));
+  candidate_orders.push_back(DepthFirstOrder(graph));
+  std::vector<int> best_order;
+  int64_t best_peak_memory = peak_memory;
+  for (std::vector<int>& order : candidate_orders) {
+    if (static_cast<int>(order.size()) != item->graph.node_size()) continue;
+    std::unordered_map<string, int> node_priority;
+    for (int i = 0; i < static_cast<int>(order.size()); ++i) {
+      node_priority[item->graph.node(order[i]).name()] = i;
+    }
+    int64_t order_peak_memory = 0;
+    s = EstimatePeakMemoryUsage(cluster, *item, node_priority,
+                                &order_peak_memory);
+    if (s.ok() && order_peak_memory < best_peak_memory) {
+      best_peak_memory = order_peak_memory;
+      best_order = std::move(order);
+    }
+  }
+  if (best_order.empty() ||
+      !SignificantMemorySavings(peak_memory, best_peak_memory)) {
+    return false;
+  }
+
+  GraphDef original_graph = item->graph;
+  const int num_control_dependencies =
+      EnforceMemoryOrder(graph, best_order, best_peak_memory, item);
+  int64_t new_peak_memory = 0;
+  s = EstimatePeakMemoryUsage(cluster, *item, {}, &new_peak_memory);
+  if (num_control_dependencies == 0 || !s.ok() ||
+      !SignificantMemorySavings(peak_memory, new_peak_memory)) {
+    item->graph.Swap(&original_graph);
+    return false;
+  }
+
+  VLOG(1) << "Added " << num_control_dependencies
+          << " control dependencies to " << item->id
+          << ": estimated peak memory usage "
+          << strings::HumanReadableNumBytes(peak_memory) << " -> "
+          << strings::HumanReadableNumBytes(new_peak_memory);
+  if (VLOG_IS_ON(1) && cluster->DetailedStatsEnabled()) {
+    const GrapplerItem original_item =
+        item->WithGraph(std::move(original_graph));
+    GraphMemory original_memory(original_item);
+    GraphMemory new_memory(*item);
+    if (original_memory.InferDynamically(cluster).ok() &&
+        new_memory.InferDynamically(cluster).ok()) {
+      VLOG(1) << "Measured peak memory usage of " << item->id << ": "
+              << strings::HumanReadableNumBytes(
+                     original_memory.GetWorstCaseMemoryUsage())
+              << " -> "
+              << strings::HumanReadableNumBytes(
+                     new_memory.GetWorstCaseMemoryUsage());
+    }
+  }
+  return true;
+}
+
 bool CrossesTaskOrCpuGpuBoundary(const NodeDef& node1, const NodeDef& node2) {
   string task1;
   string device1;
@@ -1436,6 +1822,11 @@ Status MemoryOptimizer::Optimize(Cluster* cluster, const GrapplerItem& item,
         }
       }
     }
+
+    GRAPPLER_RETURN_IF_DEADLINE_EXCEEDED();
+    if (optimization_level_ == RewriterConfig::REORDERING_HEURISTICS) {
+      ReorderingPass(cluster, &optimized_item);
+    }
   }
 
   optimized_graph->Swap(&optimized_item.graph);
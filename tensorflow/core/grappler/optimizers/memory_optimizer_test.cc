@@ -26,6 +26,7 @@ limitations under the License.
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/grappler/clusters/virtual_cluster.h"
+#include "tensorflow/core/grappler/costs/graph_memory.h"
 #include "tensorflow/core/grappler/grappler_item.h"
 #include "tensorflow/core/grappler/utils.h"
 #include "tensorflow/core/grappler/utils/grappler_test.h"
@@ -448,6 +449,75 @@ TEST_F(MemoryOptimizerTest, AccumulationRewrites) {
   }
 }
 
+TEST_F(MemoryOptimizerTest, ReorderingHeuristics) {
+  // Four independent branches, each producing a large tensor that is reduced
+  // to a scalar. Executing the branches one after the other keeps a single
+  // large tensor alive at a time.
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+  std::vector<Output> sums;
+  for (int i = 0; i < 4; ++i) {
+    Output a = ops::RandomNormal(
+        s.WithOpName(strings::StrCat("a", i)).WithDevice("/cpu:0"),
+        {128, 128, 8}, DT_FLOAT);
+    sums.push_back(
+        ops::Sum(s.WithOpName(strings::StrCat("r", i)).WithDevice("/cpu:0"),
+                 a, {0, 1, 2}));
+  }
+  Output out = ops::AddN(s.WithOpName("out").WithDevice("/cpu:0"), sums);
+
+  GrapplerItem item;
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  item.fetch = {"out"};
+
+  std::unique_ptr<VirtualCluster> cluster(CreateVirtualCluster());
+  MemoryOptimizer optimizer(RewriterConfig::REORDERING_HEURISTICS);
+  GraphDef output;
+  TF_EXPECT_OK(optimizer.Optimize(cluster.get(), item, &output));
+
+  // All but the first branch wait for the reduction of a previous branch.
+  int num_control_dependencies = 0;
+  for (const NodeDef& node : output.node()) {
+    for (const string& input : node.input()) {
+      if (!IsControlInput(input)) continue;
+      ++num_control_dependencies;
+      EXPECT_EQ("RandomStandardNormal", node.op()) << node.name();
+      EXPECT_EQ("r", NodeName(input).substr(0, 1)) << input;
+    }
+  }
+  EXPECT_EQ(3, num_control_dependencies);
+
+  // The rewritten graph has a lower estimated peak memory usage.
+  GraphMemory memory(item);
+  TF_EXPECT_OK(memory.InferStatically(cluster->GetDevices()));
+  GrapplerItem optimized = item.WithGraph(std::move(output));
+  GraphMemory optimized_memory(optimized);
+  TF_EXPECT_OK(optimized_memory.InferStatically(cluster->GetDevices()));
+  EXPECT_LT(optimized_memory.GetWorstCaseMemoryUsage(),
+            memory.GetWorstCaseMemoryUsage());
+
+  auto tensors = EvaluateFetchNodes(optimized);
+  ASSERT_EQ(1, tensors.size());
+  EXPECT_EQ(DT_FLOAT, tensors[0].dtype());
+}
+
+TEST_F(MemoryOptimizerTest, ReorderingHeuristicsWithoutSavings) {
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+  Output a = ops::RandomNormal(s.WithOpName("a").WithDevice("/cpu:0"),
+                               {128, 128, 8}, DT_FLOAT);
+  Output b = ops::Square(s.WithOpName("b").WithDevice("/cpu:0"), a);
+  Output c = ops::Square(s.WithOpName("c").WithDevice("/cpu:0"), b);
+
+  GrapplerItem item;
+  TF_CHECK_OK(s.ToGraphDef(&item.graph));
+  item.fetch = {"c"};
+
+  std::unique_ptr<VirtualCluster> cluster(CreateVirtualCluster());
+  MemoryOptimizer optimizer(RewriterConfig::REORDERING_HEURISTICS);
+  GraphDef output;
+  TF_EXPECT_OK(optimizer.Optimize(cluster.get(), item, &output));
+  CompareGraphs(item.graph, output);
+}
+
 class RelaxAllocatorConstraintsTest : public GrapplerTest {};
 
 TEST_F(RelaxAllocatorConstraintsTest, SameDevice) {
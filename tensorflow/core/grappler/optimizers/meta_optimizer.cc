@@ -16,11 +16,16 @@ limitations under the License.
 #include "tensorflow/core/grappler/optimizers/meta_optimizer.h"
 
 #include <algorithm>
+#include <atomic>
 #include <functional>
+#include <list>
+#include <map>
 #include <string>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/status/status.h"
 #include "absl/strings/match.h"
 #include "absl/strings/str_cat.h"
@@ -40,6 +45,7 @@ limitations under the License.
 #include "tensorflow/core/grappler/optimizers/auto_mixed_precision.h"
 #include "tensorflow/core/grappler/optimizers/auto_parallel.h"
 #include "tensorflow/core/grappler/optimizers/common_subgraph_elimination.h"
+#include "tensorflow/core/grappler/optimizers/cpu_op_splitter.h"
 #include "tensorflow/core/grappler/optimizers/constant_folding.h"
 #include "tensorflow/core/grappler/optimizers/custom_graph_optimizer_registry.h"
 #include "tensorflow/core/grappler/optimizers/debug_stripper.h"
@@ -62,7 +68,14 @@ limitations under the License.
 #include "tensorflow/core/grappler/verifiers/structure_verifier.h"
 #include "tensorflow/core/lib/core/status.h"
 #include "tensorflow/core/lib/gtl/map_util.h"
+#include "tensorflow/core/lib/strings/proto_serialization.h"
+#include "tensorflow/core/platform/blocking_counter.h"
+#include "tensorflow/core/platform/cpu_info.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/fingerprint.h"
 #include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/threadpool.h"
 #include "tensorflow/core/util/dump_graph.h"
 #include "tensorflow/core/util/util.h"
 #include "tensorflow/core/util/xla_config_registry.h"
@@ -174,8 +187,9 @@ bool MemoryOptimizerEnabled(RewriterConfig::MemOptType mem_opt_type,
   return mem_opt_type != RewriterConfig::NO_MEM_OPT;
 }
 
-Status GetGraphDevice(const GraphDef& g_def, std::set<std::string>* devices) {
-  for (auto& node : g_def.node()) {
+Status GetNodeDevices(const protobuf::RepeatedPtrField<NodeDef>& nodes,
+                      std::set<std::string>* devices) {
+  for (auto& node : nodes) {
     DeviceNameUtils::ParsedName parsed_name;
     if (!DeviceNameUtils::ParseFullName(node.device(), &parsed_name)) {
       return errors::InvalidArgument("Unable to parse ", node.device(),
@@ -186,6 +200,102 @@ Status GetGraphDevice(const GraphDef& g_def, std::set<std::string>* devices) {
   return absl::OkStatus();
 }
 
+Status GetGraphDevice(const GraphDef& g_def, std::set<std::string>* devices) {
+  return GetNodeDevices(g_def.node(), devices);
+}
+
+// An optimized function, with the specialized functions it calls that were
+// created while optimizing it.
+struct OptimizedFunction {
+  FunctionDef function;
+  FunctionDefLibrary new_functions;
+};
+
+// Returns the fingerprint of everything that optimizing `func` depends on.
+// `context` fingerprints the meta optimizer config and environment, and
+// `library` is the library reachable from `func`. `function_fingerprints`
+// holds the fingerprints of the functions of the meta optimizer's library, so
+// that they are not serialized again for every function that calls them.
+Fprint128 OptimizedFunctionFingerprint(
+    const string& context, const FunctionDef& func,
+    const FunctionDefLibrary& library,
+    const absl::flat_hash_map<string, uint64>& function_fingerprints,
+    const GrapplerItem::OptimizationOptions& options) {
+  std::vector<std::pair<string, uint64>> library_fingerprints;
+  library_fingerprints.reserve(library.function_size());
+  for (const FunctionDef& fdef : library.function()) {
+    const string& name = fdef.signature().name();
+    auto it = function_fingerprints.find(name);
+    library_fingerprints.emplace_back(name,
+                                      it != function_fingerprints.end()
+                                          ? it->second
+                                          : DeterministicProtoHash64(fdef));
+  }
+  // The order of the reachable library is unspecified.
+  std::sort(library_fingerprints.begin(), library_fingerprints.end());
+  string key = absl::StrCat(context, "|",
+                            options.allow_non_differentiable_rewrites,
+                            options.allow_pruning_stateful_and_dataset_ops,
+                            options.optimize_function_library,
+                            options.is_eager_mode, "|",
+                            DeterministicProtoHash64(func));
+  for (const auto& [name, fingerprint] : library_fingerprints) {
+    absl::StrAppend(&key, "|", name, ":", fingerprint);
+  }
+  return Fingerprint128(key);
+}
+
+// Returns the thread pool that the functions of a library are optimized on.
+// It is shared by all meta optimizers, which each use at most
+// `intra_op_parallelism_threads` of its threads.
+thread::ThreadPool* FunctionOptimizationThreadPool() {
+  static thread::ThreadPool* const thread_pool =
+      new thread::ThreadPool(Env::Default(), "meta_optimizer_functions",
+                             port::MaxParallelism());
+  return thread_pool;
+}
+
+// A process wide cache of optimized functions, so that functions shared by
+// several graphs, or by several instantiations of the same graph, are only
+// optimized once. The least recently used functions are evicted first.
+class OptimizedFunctionCache {
+ public:
+  static OptimizedFunctionCache* Global() {
+    static OptimizedFunctionCache* cache = new OptimizedFunctionCache;
+    return cache;
+  }
+
+  bool Lookup(const Fprint128& fingerprint, OptimizedFunction* function) {
+    mutex_lock lock(mu_);
+    auto it = entries_.find(fingerprint);
+    if (it == entries_.end()) return false;
+    lru_.splice(lru_.begin(), lru_, it->second);
+    *function = it->second->second;
+    return true;
+  }
+
+  void Insert(const Fprint128& fingerprint, const OptimizedFunction& function) {
+    mutex_lock lock(mu_);
+    if (entries_.contains(fingerprint)) return;
+    lru_.emplace_front(fingerprint, function);
+    entries_.emplace(fingerprint, lru_.begin());
+    if (lru_.size() > kCapacity) {
+      entries_.erase(lru_.back().first);
+      lru_.pop_back();
+    }
+  }
+
+ private:
+  static constexpr size_t kCapacity = 4096;
+
+  using Entry = std::pair<Fprint128, OptimizedFunction>;
+
+  mutex mu_;
+  std::list<Entry> lru_ TF_GUARDED_BY(mu_);
+  absl::flat_hash_map<Fprint128, std::list<Entry>::iterator, Fprint128Hasher>
+      entries_ TF_GUARDED_BY(mu_);
+};
+
 }  // namespace
 
 #define MK_OPT(NAME, CONFIG, VALUE)                                    \
@@ -218,11 +328,13 @@ std::unique_ptr<GraphOptimizer> MetaOptimizer::MakeNewOptimizer(
          new ConstantFolding(
              cpu_device_,
              cfg_.experimental_disable_compressed_tensor_optimization(),
-             !cfg_.experimental_disable_folding_quantization_emulation()));
+             !cfg_.experimental_disable_folding_quantization_emulation(),
+             cfg_.experimental_constant_folding_cache_dir()));
   MK_OPT("shape", "shape_optimization", new ShapeOptimizer());
   MK_OPT("remap", "remapping",
          new Remapper(cfg_.remapping(), cfg_.cpu_layout_conversion(),
-                      xla_auto_clustering_on_));
+                      xla_auto_clustering_on_,
+                      cfg_.experimental_enable_scaled_jpeg_decoding()));
   MK_OPT("layout", "layout_optimizer",
          new GenericLayoutOptimizer(
              /*optimization level*/ cfg_.layout_optimizer(),
@@ -260,6 +372,8 @@ std::unique_ptr<GraphOptimizer> MetaOptimizer::MakeNewOptimizer(
                                       cfg_.scoped_allocator_opts()));
   MK_OPT("pin_to_host", "pin_to_host_optimization",
          new PinToHostOptimizer(cfg_.pin_to_host_optimization()));
+  MK_OPT("cpu_op_splitting", "cpu_op_splitting",
+         new CpuOpSplitter(cfg_.cpu_op_splitting()));
 
   return std::unique_ptr<GraphOptimizer>();
 }
@@ -363,7 +477,8 @@ Status MetaOptimizer::InitializeOptimizers(
       optimizers->push_back(std::make_unique<ConstantFolding>(
           cfg_.constant_folding(), cpu_device_,
           cfg_.experimental_disable_compressed_tensor_optimization(),
-          !cfg_.experimental_disable_folding_quantization_emulation()));
+          !cfg_.experimental_disable_folding_quantization_emulation(),
+          cfg_.experimental_constant_folding_cache_dir()));
     }
   }
   if (BOTH_NOT_OFF(shape_optimization)) {
@@ -431,6 +546,12 @@ Status MetaOptimizer::InitializeOptimizers(
           /*CPU layout conversion*/ cfg_.cpu_layout_conversion()));
     }
   }
+  // Split ops after the layout optimizer has picked the Conv2D data format.
+  if (BOTH_ARE_ON(cpu_op_splitting))
+    optimizers->push_back(std::make_unique<CpuOpSplitter>());
+  else if (BOTH_ARE_EXPERIMENTAL_MLIR(cpu_op_splitting) ||
+           BOTH_ARE_EXPERIMENTAL_BOTH(cpu_op_splitting))
+    VLOG(2) << "cpu_op_splitting is not implemented in TFG yet";
   if (BOTH_NOT_OFF(remapping)) {
     bool enable_mlir_pass = USER_IS_EXPERIMENTAL_MLIR(remapping) ||
                             USER_IS_EXPERIMENTAL_BOTH(remapping);
@@ -575,6 +696,17 @@ Status MetaOptimizer::InitializeCustomGraphOptimizers(
   return InitializePluginGraphOptimizers(device_types, optimizers);
 }
 
+bool MetaOptimizer::CanReuseOptimizedFunctions() const {
+  if (!cfg_.experimental_optimize_functions_concurrently()) return false;
+  if (!cfg_.custom_optimizers().empty()) return false;
+  for (const string& optimizer_name : cfg_.optimizers()) {
+    if (MakeNewOptimizer(optimizer_name, /*device_types=*/{}) == nullptr) {
+      return false;
+    }
+  }
+  return true;
+}
+
 Status MetaOptimizer::InitializePluginGraphOptimizers(
     const std::set<string>& device_types,
     std::vector<std::unique_ptr<GraphOptimizer>>* optimizers) const {
@@ -641,6 +773,7 @@ void MetaOptimizer::PrintUserAndPluginConfigs(
     PRINT_CFG(loop_optimization)
     PRINT_CFG(dependency_optimization)
     PRINT_CFG(scoped_allocator_optimization)
+    PRINT_CFG(cpu_op_splitting)
 #undef PRINT_CFG
     user_cfg.toggle_config["auto_mixed_precision"] =
         AutoMixedPrecisionEnabled(cfg_.auto_mixed_precision())
@@ -696,6 +829,7 @@ void MetaOptimizer::PrintUserAndPluginConfigs(
       PRINT_CFG("memory", "memory_optimization")
       PRINT_CFG("autoparallel", "auto_parallel")
       PRINT_CFG("scoped_allocator", "scoped_allocator_optimization")
+      PRINT_CFG("cpu_op_splitting", "cpu_op_splitting")
 #undef PRINT_CFG
     }
   }
@@ -730,7 +864,8 @@ void MetaOptimizer::PrintUserAndPluginConfigs(
         pair.first == "auto_mixed_precision_mkl" ||
         pair.first == "auto_mixed_precision_cpu" ||
         pair.first == "pin_to_host_optimization" ||
-        pair.first == "scoped_allocator_optimization") {
+        pair.first == "scoped_allocator_optimization" ||
+        pair.first == "cpu_op_splitting") {
       // These optimizers are turned off by default.
       // TODO(penporn): Remove the hard-coded length and change it to max length
       // of all option strings.
@@ -756,7 +891,9 @@ void MetaOptimizer::PrintUserAndPluginConfigs(
 
 Status MetaOptimizer::OptimizeGraph(
     const std::vector<std::unique_ptr<GraphOptimizer>>& optimizers,
-    Cluster* cluster, GrapplerItem&& item, GraphDef* optimized_graph) {
+    Cluster* cluster, GrapplerItem&& item, GraphDef* optimized_graph,
+    bool* has_errors) {
+  if (has_errors != nullptr) *has_errors = false;
   int min_graph_nodes = cfg_.min_graph_nodes() == 0 ? kDefaultMinGraphNodes
                                                     : cfg_.min_graph_nodes();
   if (item.graph.node_size() < min_graph_nodes) {
@@ -886,9 +1023,19 @@ Status MetaOptimizer::OptimizeGraph(
                                    [](const OptimizerResult& result) {
                                      return result.status.ok();
                                    }) != optimization_result.results.end();
+  if (has_errors != nullptr) {
+    *has_errors = std::find_if(optimization_result.results.begin(),
+                               optimization_result.results.end(),
+                               [](const OptimizerResult& result) {
+                                 return !result.status.ok();
+                               }) != optimization_result.results.end();
+  }
 
   // Record graph optimization result.
-  optimization_results_.push_back(optimization_result);
+  {
+    mutex_lock lock(optimization_results_mu_);
+    optimization_results_.push_back(optimization_result);
+  }
 
   if (is_optimized) {
     TF_RETURN_IF_ERROR(TopologicalSort(optimized_graph));
@@ -901,7 +1048,8 @@ Status MetaOptimizer::OptimizeGraph(
 }
 
 Status MetaOptimizer::OptimizeGraph(Cluster* cluster, GrapplerItem&& item,
-                                    GraphDef* optimized_graph) {
+                                    GraphDef* optimized_graph,
+                                    bool* has_errors) {
   std::vector<std::unique_ptr<GraphOptimizer>> optimizers;
   std::set<std::string> device_types;
   TF_RETURN_IF_ERROR(GetGraphDevice(item.graph, &device_types));
@@ -913,7 +1061,7 @@ Status MetaOptimizer::OptimizeGraph(Cluster* cluster, GrapplerItem&& item,
   PrintUserAndPluginConfigs(device_types);
 
   return OptimizeGraph(std::move(optimizers), cluster, std::move(item),
-                       optimized_graph);
+                       optimized_graph, has_errors);
 }
 
 Status MetaOptimizer::RunOptimizer(
@@ -978,7 +1126,8 @@ Status MetaOptimizer::RunOptimizer(
         optimized_graph_function_library.release());
   }
 
-  OptimizerResult optimizer_result{optimizer->name(), message, status};
+  OptimizerResult optimizer_result{optimizer->name(), message, status,
+                                   duration_ms};
   optimization_result->results.push_back(optimizer_result);
 
   if (!status.ok()) {
@@ -1055,7 +1204,11 @@ Status MetaOptimizer::OptimizeConsumeItem(Cluster* cluster, GrapplerItem&& item,
       {kGrapplerCategory, "*"});
 
   VLOG(1) << "Starting optimization for grappler item: " << item.id;
-  optimization_results_.clear();
+  {
+    mutex_lock lock(optimization_results_mu_);
+    optimization_results_.clear();
+    total_duration_ms_ = 0.0f;
+  }
 
   // Constructs a FunctionLibraryDefinition with functions that are reachable
   // from the nodes of the graph.
@@ -1082,6 +1235,8 @@ Status MetaOptimizer::OptimizeConsumeItem(Cluster* cluster, GrapplerItem&& item,
   // Save a few small fields from item before we move it.
   bool optimize_function_library =
       item.optimization_options().optimize_function_library;
+  const int num_function_threads =
+      item.optimization_options().intra_op_parallelism_threads;
   const auto producer = item.graph.versions().producer();
 
   // 1. Optimize main graph
@@ -1164,15 +1319,36 @@ Status MetaOptimizer::OptimizeConsumeItem(Cluster* cluster, GrapplerItem&& item,
   // True if this is a TPU graph using the old bridge.
   bool is_tpu_graph = IsLegacyTPUBridgeGraphDef(*optimized_graph);
 
+  // Fingerprint of everything besides the function and its library that the
+  // optimized function depends on.
+  string optimization_context;
+  const bool reuse_optimized_functions = CanReuseOptimizedFunctions();
+  if (reuse_optimized_functions) {
+    SerializeToStringDeterministic(config_proto_, &optimization_context);
+    absl::StrAppend(&optimization_context, "|", xla_auto_clustering_on_, "|",
+                    is_tpu_graph, "|", producer);
+    if (cluster != nullptr) {
+      absl::StrAppend(&optimization_context, "|",
+                      absl::StrJoin(cluster->GetDeviceNames(), ","));
+    }
+  }
+  // Fingerprints of the functions in `flib`, kept up to date as optimized
+  // functions are merged into it.
+  absl::flat_hash_map<string, uint64> function_fingerprints;
+  if (reuse_optimized_functions) {
+    for (const string& name : flib.ListFunctionNames()) {
+      function_fingerprints[name] = DeterministicProtoHash64(*flib.Find(name));
+    }
+  }
+
   // Optimize each function only once.
   absl::flat_hash_set<string> optimized_funcs;
   while (optimize_function_library) {
     optimize_function_library = false;
 
+    std::vector<const FunctionDef*> funcs_to_optimize;
     int function_idx = 0;
     for (const FunctionDef& func : optimized_graph->library().function()) {
-      GRAPPLER_RETURN_IF_DEADLINE_EXCEEDED();
-
       const string& func_name = func.signature().name();
 
       // Skip functions that are not reachable from the optimized graph.
@@ -1200,6 +1376,33 @@ Status MetaOptimizer::OptimizeConsumeItem(Cluster* cluster, GrapplerItem&& item,
       // have to reset the flag and do at least one more pass over the library.
       optimize_function_library = true;
       optimized_funcs.insert(func_name);
+      funcs_to_optimize.push_back(&func);
+    }
+
+    // Functions are optimized concurrently only when requested in the config
+    // and all the optimizers are built in: custom and plugin optimizers need
+    // not be thread-safe. They are
+    // then all optimized against the library as it was at the beginning of the
+    // pass, and their results are merged into the library in order afterwards.
+    // Otherwise each function is merged before the next one is optimized.
+    const int num_funcs = funcs_to_optimize.size();
+    const int num_threads = std::min(num_function_threads, num_funcs);
+    bool optimize_concurrently = reuse_optimized_functions && num_threads > 1;
+    if (optimize_concurrently &&
+        cfg_.use_plugin_optimizers() != RewriterConfig::OFF) {
+      std::set<string> device_types;
+      for (const FunctionDef* func : funcs_to_optimize) {
+        TF_RETURN_IF_ERROR(GetNodeDevices(func->node_def(), &device_types));
+      }
+      optimize_concurrently =
+          PluginGraphOptimizerRegistry::CreateOptimizers(device_types).empty();
+    }
+
+    std::vector<OptimizedFunction> optimized_functions(num_funcs);
+    const auto optimize_function = [&](int i) -> Status {
+      GRAPPLER_RETURN_IF_DEADLINE_EXCEEDED();
+      const FunctionDef& func = *funcs_to_optimize[i];
+      const string& func_name = func.signature().name();
 
       // Make a GrapplerItem from a FunctionDef.
       GrapplerFunctionItem func_item;
@@ -1226,8 +1429,38 @@ Status MetaOptimizer::OptimizeConsumeItem(Cluster* cluster, GrapplerItem&& item,
       func_item.optimization_options().allow_pruning_stateful_and_dataset_ops =
           false;
 
+      // The same function, with the same library, might already have been
+      // optimized by another meta optimizer run.
+      bool reuse_optimized_function = reuse_optimized_functions;
+      if (reuse_optimized_function &&
+          cfg_.use_plugin_optimizers() != RewriterConfig::OFF) {
+        std::set<string> device_types;
+        TF_RETURN_IF_ERROR(GetGraphDevice(func_item.graph, &device_types));
+        reuse_optimized_function =
+            PluginGraphOptimizerRegistry::CreateOptimizers(device_types)
+                .empty();
+      }
+      Fprint128 fingerprint = {0, 0};
+      if (reuse_optimized_function) {
+        fingerprint = OptimizedFunctionFingerprint(
+            optimization_context, func, func_item.graph.library(),
+            function_fingerprints, func_item.optimization_options());
+        if (OptimizedFunctionCache::Global()->Lookup(fingerprint,
+                                                     &optimized_functions[i])) {
+          VLOG(3) << "Reusing optimized function: function=" << func_name;
+          GraphOptimizationResult optimization_result(func_name);
+          optimization_result.results.push_back(
+              {"meta_optimizer", "reused previously optimized function.",
+               absl::OkStatus()});
+          mutex_lock lock(optimization_results_mu_);
+          optimization_results_.push_back(std::move(optimization_result));
+          return absl::OkStatus();
+        }
+      }
+
       // Optimize function body graph.
       GraphDef optimized_func_graph;
+      bool has_errors = false;
       if (is_tpu_graph) {
         // Skip optimizing functions if this is a TPU graph. Currently, Grappler
         // passes do not handle TPU functions correctly in a variety of ways
@@ -1254,25 +1487,87 @@ Status MetaOptimizer::OptimizeConsumeItem(Cluster* cluster, GrapplerItem&& item,
       } else {
         GrapplerFunctionItem func_item_copy = func_item;
         TF_RETURN_IF_ERROR(OptimizeGraph(cluster, std::move(func_item_copy),
-                                         &optimized_func_graph));
+                                         &optimized_func_graph, &has_errors));
       }
 
       // Function body optimization might have created new specialized
-      // functions for each instantiation context. Add them to the library.
+      // functions for each instantiation context. They are added to the
+      // library with the optimized function.
+      OptimizedFunction& optimized_function = optimized_functions[i];
       for (const FunctionDef& func_def :
            optimized_func_graph.library().function()) {
         if (flib.Find(func_def.signature().name()) == nullptr) {
-          TF_RETURN_IF_ERROR(flib.AddFunctionDef(func_def));
+          *optimized_function.new_functions.add_function() = func_def;
         }
       }
 
       // Convert optimized graph back to FunctionDef.
-      FunctionDef optimized_func;
+      const FunctionLibraryDefinition func_flib(
+          &flib, optimized_function.new_functions);
       func_item.SwapFunctionBody(std::move(optimized_func_graph));
-      TF_RETURN_IF_ERROR(MakeFunctionDef(func_item, flib, &optimized_func));
+      TF_RETURN_IF_ERROR(
+          MakeFunctionDef(func_item, func_flib, &optimized_function.function));
 
+      // A function optimized past the deadline, or by optimizers that failed,
+      // might be only partially optimized.
+      if (reuse_optimized_function && !has_errors && !DeadlineExceeded()) {
+        OptimizedFunctionCache::Global()->Insert(fingerprint,
+                                                 optimized_function);
+      }
+      return absl::OkStatus();
+    };
+
+    const auto merge_function = [&](int i) -> Status {
+      const OptimizedFunction& optimized_function = optimized_functions[i];
+      for (const FunctionDef& func_def :
+           optimized_function.new_functions.function()) {
+        const string& name = func_def.signature().name();
+        if (flib.Find(name) == nullptr) {
+          TF_RETURN_IF_ERROR(flib.AddFunctionDef(func_def));
+          if (reuse_optimized_functions) {
+            function_fingerprints[name] = DeterministicProtoHash64(func_def);
+          }
+        }
+      }
       // Replace optimized function with a new FunctionDef.
-      TF_RETURN_IF_ERROR(flib.ReplaceFunction(func_name, optimized_func));
+      const string& func_name = funcs_to_optimize[i]->signature().name();
+      TF_RETURN_IF_ERROR(
+          flib.ReplaceFunction(func_name, optimized_function.function));
+      if (reuse_optimized_functions) {
+        function_fingerprints[func_name] =
+            DeterministicProtoHash64(optimized_function.function);
+      }
+      return absl::OkStatus();
+    };
+
+    if (optimize_concurrently) {
+      // The calling thread works through the functions along with
+      // `num_threads - 1` threads of the shared pool.
+      std::vector<Status> statuses(num_funcs);
+      std::atomic<int> next_func(0);
+      const auto optimize_functions = [&]() {
+        for (int i = next_func++; i < num_funcs; i = next_func++) {
+          statuses[i] = optimize_function(i);
+        }
+      };
+      BlockingCounter counter(num_threads - 1);
+      for (int t = 1; t < num_threads; ++t) {
+        FunctionOptimizationThreadPool()->Schedule([&]() {
+          optimize_functions();
+          counter.DecrementCount();
+        });
+      }
+      optimize_functions();
+      counter.Wait();
+      for (const Status& status : statuses) TF_RETURN_IF_ERROR(status);
+      for (int i = 0; i < num_funcs; ++i) {
+        TF_RETURN_IF_ERROR(merge_function(i));
+      }
+    } else {
+      for (int i = 0; i < num_funcs; ++i) {
+        TF_RETURN_IF_ERROR(optimize_function(i));
+        TF_RETURN_IF_ERROR(merge_function(i));
+      }
     }
 
     // If optimized at least one function, update the graph library.
@@ -1306,6 +1601,10 @@ Status MetaOptimizer::OptimizeConsumeItem(Cluster* cluster, GrapplerItem&& item,
   }
 #endif
 
+  {
+    mutex_lock lock(optimization_results_mu_);
+    total_duration_ms_ = timings.DurationMicroSec().value() / 1000.0f;
+  }
   VLOG(1) << "Optimized " << optimized_funcs.size()
           << " functions: " << absl::StrJoin(optimized_funcs, ", ");
   VLOG(3) << "Optimized graph =\n" << optimized_graph->DebugString();
@@ -1320,7 +1619,10 @@ Status MetaOptimizer::OptimizeConsumeItem(Cluster* cluster, GrapplerItem&& item,
 }
 
 string MetaOptimizer::GetResultString() const {
+  mutex_lock lock(optimization_results_mu_);
   std::string result_string;
+  // Total time spent in each optimizer, over all the grappler items.
+  std::map<string, std::pair<float, int>> optimizer_durations;
   for (const GraphOptimizationResult& graph_result : optimization_results_) {
     absl::StrAppend(&result_string,
                     "Optimization results for grappler item: ", graph_result.id,
@@ -1328,8 +1630,18 @@ string MetaOptimizer::GetResultString() const {
     for (const OptimizerResult& result : graph_result.results) {
       absl::StrAppend(&result_string, "  ", result.optimizer_name, ": ",
                       result.message, "\n");
+      auto& duration = optimizer_durations[result.optimizer_name];
+      duration.first += result.duration_ms;
+      ++duration.second;
     }
   }
+  absl::StrAppend(&result_string, "Total grappler time = ", total_duration_ms_,
+                  "ms, over ", optimization_results_.size(), " items.\n");
+  for (const auto& optimizer_duration : optimizer_durations) {
+    absl::StrAppend(&result_string, "  ", optimizer_duration.first, ": ",
+                    optimizer_duration.second.first, "ms in ",
+                    optimizer_duration.second.second, " runs.\n");
+  }
   return result_string;
 }
 
@@ -1357,6 +1669,7 @@ bool MetaOptimizerEnabled(const ConfigProto& cfg) {
          rewrite_cfg.scoped_allocator_optimization() == RewriterConfig::ON ||
 #endif
          rewrite_cfg.pin_to_host_optimization() == RewriterConfig::ON ||
+         rewrite_cfg.cpu_op_splitting() == RewriterConfig::ON ||
          AutoMixedPrecisionEnabled(rewrite_cfg.auto_mixed_precision()) ||
          AutoMixedPrecisionEnabled(
              rewrite_cfg.auto_mixed_precision_onednn_bfloat16()) ||
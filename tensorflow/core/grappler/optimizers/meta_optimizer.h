@@ -24,6 +24,8 @@ limitations under the License.
 #include "tensorflow/core/grappler/optimizers/graph_optimizer.h"
 #include "tensorflow/core/grappler/verifiers/graph_verifier.h"
 #include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
 #include "tensorflow/core/protobuf/config.pb.h"
 #include "tensorflow/core/protobuf/rewriter_config.pb.h"
 #include "tensorflow/core/protobuf/verifier_config.pb.h"
@@ -89,13 +91,21 @@ class MetaOptimizer : public GraphOptimizer {
 
   void PrintUserAndPluginConfigs(const std::set<string>& device_types) const;
 
+  // Returns true if optimized functions can be reused across meta optimizer
+  // runs, i.e. if this was requested in the config and the optimizers are all
+  // built in. Custom optimizers might depend on state that is neither in the
+  // graph nor in the config.
+  bool CanReuseOptimizedFunctions() const;
+
   // Run optimization pass over a single GrapplerItem. Meta optimizer might run
   // multiple such passes: 1) for the main graph 2) for the function library
+  // If `has_errors` is not null, it is set to whether any optimizer failed.
   Status OptimizeGraph(
       const std::vector<std::unique_ptr<GraphOptimizer>>& optimizers,
-      Cluster* cluster, GrapplerItem&& item, GraphDef* optimized_graph);
+      Cluster* cluster, GrapplerItem&& item, GraphDef* optimized_graph,
+      bool* has_errors = nullptr);
   Status OptimizeGraph(Cluster* cluster, GrapplerItem&& item,
-                       GraphDef* optimized_graph);
+                       GraphDef* optimized_graph, bool* has_errors = nullptr);
 
   DeviceBase* const cpu_device_;  // may be NULL
   ConfigProto config_proto_;
@@ -106,6 +116,7 @@ class MetaOptimizer : public GraphOptimizer {
     string optimizer_name;
     string message;
     Status status;
+    float duration_ms = 0.0f;
   };
 
   struct GraphOptimizationResult {
@@ -118,7 +129,13 @@ class MetaOptimizer : public GraphOptimizer {
                       GrapplerItem* optimized_item, GraphDef* optimized_graph,
                       GraphOptimizationResult* optimization_result);
 
-  std::vector<GraphOptimizationResult> optimization_results_;
+  // Functions of the library are optimized concurrently, each of them adds
+  // its results here.
+  mutable mutex optimization_results_mu_;
+  std::vector<GraphOptimizationResult> optimization_results_
+      TF_GUARDED_BY(optimization_results_mu_);
+  // Wall time of the last OptimizeConsumeItem call.
+  float total_duration_ms_ TF_GUARDED_BY(optimization_results_mu_) = 0.0f;
 };
 
 bool MetaOptimizerEnabled(const ConfigProto& cfg);
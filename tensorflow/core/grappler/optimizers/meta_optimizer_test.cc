@@ -703,6 +703,145 @@ TEST_F(MetaOptimizerTest, OptimizeFunctionLibraryWithRestrictions) {
       optimization_options_my_mul_2->allow_non_differentiable_rewrites);
 }
 
+// Returns a graph calling `num_functions` different functions, that are not
+// inlined and are optimized as part of the function library.
+GrapplerItem MakeItemWithManyFunctions(int num_functions) {
+  using test::function::NDef;
+
+  std::vector<FunctionDef> functions;
+  std::vector<NodeDef> nodes = {
+      NDef("x", "Placeholder", {}, {{"dtype", DT_FLOAT}}, kDevice)};
+  GrapplerItem item;
+  item.id = "main";
+  for (int i = 0; i < num_functions; ++i) {
+    const string func_name = absl::StrCat("MyFunc", i);
+    FunctionDef func = FunctionDefHelper::Create(
+        func_name, {"x:float"}, {"z:float"}, {},
+        {{{"a"}, "Add", {"x", "x"}, {{"T", DT_FLOAT}}},
+         {{"b"}, "Identity", {"a:z:0"}, {{"T", DT_FLOAT}}},
+         {{"c"}, "Mul", {"b:output:0", "x"}, {{"T", DT_FLOAT}}}},
+        /*ret_def=*/
+        {{"z", "c:z:0"}});
+    (*func.mutable_attr())["_noinline"].set_b(true);
+    functions.push_back(func);
+    const string call_name = absl::StrCat("call", i);
+    nodes.push_back(NDef(call_name, func_name, {"x"}, {}, kDevice));
+    item.fetch.push_back(call_name);
+  }
+  item.graph = test::function::GDef(nodes, functions);
+  return item;
+}
+
+ConfigProto MakeFunctionLibraryConfig() {
+  ConfigProto config_proto;
+  auto& rewriter_config =
+      *config_proto.mutable_graph_options()->mutable_rewrite_options();
+  rewriter_config.set_meta_optimizer_iterations(RewriterConfig::TWO);
+  rewriter_config.add_optimizers("function");
+  rewriter_config.add_optimizers("arithmetic");
+  rewriter_config.add_optimizers("dependency");
+  rewriter_config.set_min_graph_nodes(-1);
+  rewriter_config.set_experimental_optimize_functions_concurrently(true);
+  return config_proto;
+}
+
+TEST_F(MetaOptimizerTest, OptimizeFunctionLibraryConcurrently) {
+  const ConfigProto config_proto = MakeFunctionLibraryConfig();
+
+  GrapplerItem item = MakeItemWithManyFunctions(16);
+  item.optimization_options().intra_op_parallelism_threads = 1;
+  GraphDef serial_output;
+  MetaOptimizer serial_optimizer(nullptr, config_proto);
+  TF_EXPECT_OK(serial_optimizer.Optimize(nullptr, item, &serial_output));
+
+  item.optimization_options().intra_op_parallelism_threads = 8;
+  // A config that differs from the serial one, so that the functions are not
+  // reused from the serial run.
+  ConfigProto concurrent_config_proto = config_proto;
+  concurrent_config_proto.mutable_graph_options()
+      ->mutable_rewrite_options()
+      ->set_meta_optimizer_timeout_ms(600000);
+  GraphDef concurrent_output;
+  MetaOptimizer concurrent_optimizer(nullptr, concurrent_config_proto);
+  TF_EXPECT_OK(
+      concurrent_optimizer.Optimize(nullptr, item, &concurrent_output));
+
+  EXPECT_EQ(serial_output.library().function_size(), 16);
+  CompareGraphs(serial_output, concurrent_output);
+  ASSERT_EQ(serial_output.library().function_size(),
+            concurrent_output.library().function_size());
+  for (int i = 0; i < serial_output.library().function_size(); ++i) {
+    CompareFunctions(serial_output.library().function(i),
+                     concurrent_output.library().function(i));
+  }
+}
+
+TEST_F(MetaOptimizerTest, ReusesOptimizedFunctions) {
+  const ConfigProto config_proto = MakeFunctionLibraryConfig();
+  const GrapplerItem item = MakeItemWithManyFunctions(4);
+
+  GraphDef first_output;
+  MetaOptimizer first_optimizer(nullptr, config_proto);
+  TF_EXPECT_OK(first_optimizer.Optimize(nullptr, item, &first_output));
+
+  GraphDef second_output;
+  MetaOptimizer second_optimizer(nullptr, config_proto);
+  TF_EXPECT_OK(second_optimizer.Optimize(nullptr, item, &second_output));
+  CompareGraphs(first_output, second_output);
+
+  const string results = second_optimizer.GetResultString();
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(absl::StrContains(
+        results, absl::StrCat("grappler item: MyFunc", i,
+                              "\n  meta_optimizer: reused previously")))
+        << results;
+  }
+  EXPECT_TRUE(absl::StrContains(results, "Total grappler time = ")) << results;
+}
+
+TEST_F(MetaOptimizerTest, DoesNotReuseOptimizedFunctionsByDefault) {
+  ConfigProto config_proto = MakeFunctionLibraryConfig();
+  config_proto.mutable_graph_options()
+      ->mutable_rewrite_options()
+      ->set_experimental_optimize_functions_concurrently(false);
+  GrapplerItem item = MakeItemWithManyFunctions(4);
+  item.optimization_options().intra_op_parallelism_threads = 8;
+
+  GraphDef first_output;
+  MetaOptimizer first_optimizer(nullptr, config_proto);
+  TF_EXPECT_OK(first_optimizer.Optimize(nullptr, item, &first_output));
+
+  GraphDef second_output;
+  MetaOptimizer second_optimizer(nullptr, config_proto);
+  TF_EXPECT_OK(second_optimizer.Optimize(nullptr, item, &second_output));
+  CompareGraphs(first_output, second_output);
+
+  const string results = second_optimizer.GetResultString();
+  EXPECT_FALSE(absl::StrContains(results, "reused previously")) << results;
+}
+
+TEST_F(MetaOptimizerTest, DoesNotReuseFunctionsOptimizedByCustomOptimizers) {
+  gtl::FlatMap<string, GrapplerItem::OptimizationOptions> optimization_options;
+  GrapplerItemPropertiesAccumulator::SetOptimizationOptions(
+      &optimization_options);
+
+  ConfigProto config_proto = MakeFunctionLibraryConfig();
+  config_proto.mutable_graph_options()
+      ->mutable_rewrite_options()
+      ->add_optimizers("GrapplerItemPropertiesAccumulator");
+  const GrapplerItem item = MakeItemWithManyFunctions(2);
+
+  for (int run = 0; run < 2; ++run) {
+    optimization_options.clear();
+    GraphDef output;
+    MetaOptimizer optimizer(nullptr, config_proto);
+    TF_EXPECT_OK(optimizer.Optimize(nullptr, item, &output));
+    EXPECT_NE(gtl::FindOrNull(optimization_options, "MyFunc0"), nullptr);
+    EXPECT_NE(gtl::FindOrNull(optimization_options, "MyFunc1"), nullptr);
+  }
+  GrapplerItemPropertiesAccumulator::ResetOptimizationOptions();
+}
+
 class SleepingOptimizer : public CustomGraphOptimizer {
  public:
   SleepingOptimizer() {}
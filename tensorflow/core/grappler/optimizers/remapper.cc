@@ -74,6 +74,15 @@ namespace grappler {
 //
 // Sigmoid + Mul -> _MklSwish  // This fusion only works on Intel CPU.
 //
+// Gather/GatherV2 + SparseSegment{Sum,Mean,SqrtN}
+//   -> _FusedGatherSparseSegmentReduction  // CPU only.
+//
+// DecodeJpeg + [Cast] + ExpandDims + ResizeBilinear
+//   -> _DecodeAndResizeJpeg  // CPU only.
+//
+// BatchMatMul + [Mul/RealDiv] + [Add] + Softmax + BatchMatMul
+//   -> _FusedAttention  // CPU only.
+//
 //
 // In all cases, the supported activation functions are Relu, Relu6, and Elu.
 //
@@ -92,6 +101,10 @@ constexpr char kFusedDepthwiseConv2dNative[] = "_FusedDepthwiseConv2dNative";
 constexpr char kFusedBatchNormEx[] = "_FusedBatchNormEx";
 constexpr char kFusedBatchNormGradEx[] = "_FusedBatchNormGradEx";
 constexpr char kTensorToHashBucket[] = "_TensorToHashBucketFast";
+constexpr char kFusedGatherSparseSegmentReduction[] =
+    "_FusedGatherSparseSegmentReduction";
+constexpr char kDecodeAndResizeJpeg[] = "_DecodeAndResizeJpeg";
+constexpr char kFusedAttention[] = "_FusedAttention";
 constexpr char kLeakyRelu[] = "LeakyRelu";
 constexpr char kMklFusedMish[] = "_MklFusedMish";
 constexpr char kRelu[] = "Relu";
@@ -109,13 +122,15 @@ constexpr int kMissingIndex = -1;
 struct RemapperContext {
   explicit RemapperContext(GrapplerItem* item, Status* status,
                            RewriterConfig::CpuLayout cpu_layout_conversion,
-                           bool xla_auto_clustering_on)
+                           bool xla_auto_clustering_on,
+                           bool scaled_jpeg_decoding = false)
       : nodes_to_preserve(item->NodesToPreserve()),
         graph_view(&item->graph, status),
         graph_properties(*item),
         inferred_graph_properties(false),
         cpu_layout_conversion(cpu_layout_conversion),
-        xla_auto_clustering_on(xla_auto_clustering_on) {}
+        xla_auto_clustering_on(xla_auto_clustering_on),
+        scaled_jpeg_decoding(scaled_jpeg_decoding) {}
 
   std::unordered_set<string> nodes_to_preserve;
   utils::MutableGraphView graph_view;
@@ -123,6 +138,7 @@ struct RemapperContext {
   bool inferred_graph_properties;
   RewriterConfig::CpuLayout cpu_layout_conversion;
   bool xla_auto_clustering_on;
+  bool scaled_jpeg_decoding;
 };
 
 // FusedBatchNorm that can be replaced with a cheaper set of primitives.
@@ -167,6 +183,51 @@ struct TensorToHashBucket {
   int string_to_hash_bucket = kMissingIndex;
 };
 
+// Gather on axis 0 whose only consumer is a sparse segment reduction (the
+// usual embedding lookup with a combiner), which can be computed without
+// materializing the gathered rows.
+struct GatherWithSparseSegmentReduction {
+  GatherWithSparseSegmentReduction() = default;
+  GatherWithSparseSegmentReduction(int gather, int reduction)
+      : gather(gather), reduction(reduction) {}
+
+  int gather = kMissingIndex;
+  int reduction = kMissingIndex;
+};
+
+// DecodeJpeg whose image is only resized with ResizeBilinear, after being
+// expanded to a batch of one and optionally cast to float, which can decode a
+// smaller image to begin with.
+struct DecodeJpegWithResizeBilinear {
+  DecodeJpegWithResizeBilinear() = default;
+  DecodeJpegWithResizeBilinear(int decode, int cast, int expand_dims,
+                               int resize)
+      : decode(decode), cast(cast), expand_dims(expand_dims), resize(resize) {}
+
+  int decode = kMissingIndex;
+  int cast = kMissingIndex;  // Optional.
+  int expand_dims = kMissingIndex;
+  int resize = kMissingIndex;
+};
+
+// Scaled dot-product attention, i.e. the BatchMatMul of the Softmax of the
+// scores of a query and a key with a value, which can be computed without
+// materializing the scores. The scores are the BatchMatMul of the query with
+// the adjoint (or the Transpose) of the key, optionally scaled by a constant
+// and masked with an Add.
+struct ScaledDotProductAttention {
+  ScaledDotProductAttention() = default;
+
+  int scores = kMissingIndex;
+  int key_transpose = kMissingIndex;  // Optional.
+  int scale = kMissingIndex;          // Optional.
+  int mask_add = kMissingIndex;       // Optional.
+  int softmax = kMissingIndex;
+  int attention = kMissingIndex;
+  int mask_port = 1;
+  float scale_value = 1.0f;
+};
+
 // Pad followed by Conv3D/FusedConv3D
 struct PadWithConv3D {
   PadWithConv3D() = default;
@@ -2677,6 +2738,367 @@ bool FindTensorToHashBucket(const RemapperContext& ctx, int node_index,
   return true;
 }
 
+// Returns the `combiner` attribute of _FusedGatherSparseSegmentReduction that
+// computes `node`, or nullptr if `node` is not a sparse segment reduction.
+const char* SparseSegmentReductionCombiner(const NodeDef& node) {
+  if (node.op() == "SparseSegmentSum") return "sum";
+  if (node.op() == "SparseSegmentMean") return "mean";
+  if (node.op() == "SparseSegmentSqrtN") return "sqrtn";
+  return nullptr;
+}
+
+bool FindGatherWithSparseSegmentReduction(
+    const RemapperContext& ctx, int node_index,
+    GatherWithSparseSegmentReduction* matched) {
+  // Root of the pattern must be a SparseSegment{Sum,Mean,SqrtN} on CPU.
+  const auto* node_view = ctx.graph_view.GetNode(node_index);
+  const auto* node_def = node_view->node();
+  if (SparseSegmentReductionCombiner(*node_def) == nullptr ||
+      !NodeIsOnCpu(node_def) || HasControlFaninOrFanout(*node_view) ||
+      node_view->NumRegularFanins() < 3) {
+    return false;
+  }
+  if (!HasDataType(node_def, DT_FLOAT) && !HasDataType(node_def, DT_BFLOAT16)) {
+    return false;
+  }
+
+  // Input to the reduction must be a Gather whose output is not used anywhere
+  // else, otherwise the gathered rows have to be materialized anyway.
+  const auto* gather_node_view = node_view->GetRegularFanin(0).node_view();
+  const auto* gather_node_def = gather_node_view->node();
+  if ((gather_node_def->op() != "Gather" &&
+       gather_node_def->op() != "GatherV2") ||
+      !NodeIsOnCpu(gather_node_def) ||
+      HasControlFaninOrFanout(*gather_node_view) ||
+      !HasAtMostOneFanoutAtPort0(*gather_node_view) ||
+      IsInPreserveSet(ctx, gather_node_def)) {
+    return false;
+  }
+  if (GetDataTypeFromAttr(*gather_node_def, "Tparams") !=
+      GetDataTypeFromAttr(*node_def, "T")) {
+    return false;
+  }
+
+  // GatherV2 must gather along axis 0 without batch dimensions.
+  if (gather_node_def->op() == "GatherV2") {
+    int batch_dims = 0;
+    if (TryGetNodeAttr(*gather_node_def, "batch_dims", &batch_dims) &&
+        batch_dims != 0) {
+      return false;
+    }
+    if (gather_node_view->NumRegularFanins() < 3) return false;
+    const auto* axis_node_def =
+        gather_node_view->GetRegularFanin(2).node_view()->node();
+    Tensor axis;
+    if (!IsConstant(*axis_node_def) ||
+        !axis.FromProto(axis_node_def->attr().at("value").tensor()) ||
+        axis.NumElements() != 1) {
+      return false;
+    }
+    const int64_t axis_value = axis.dtype() == DT_INT32
+                                   ? axis.flat<int32>()(0)
+                                   : axis.flat<int64_t>()(0);
+    if (axis_value != 0) return false;
+  }
+
+  // The fused kernel only handles a vector of ids.
+  if (!ctx.inferred_graph_properties) return false;
+  const auto& gather_props =
+      ctx.graph_properties.GetInputProperties(gather_node_def->name());
+  if (gather_props.size() < 2 || gather_props[1].shape().unknown_rank() ||
+      gather_props[1].shape().dim_size() != 1) {
+    return false;
+  }
+
+  *matched = GatherWithSparseSegmentReduction(gather_node_view->node_index(),
+                                              node_index);
+  return true;
+}
+
+bool FindDecodeJpegWithResizeBilinear(const RemapperContext& ctx,
+                                      int node_index,
+                                      DecodeJpegWithResizeBilinear* matched) {
+  // Intermediate nodes of the pattern must only feed the next one.
+  const auto is_intermediate = [&](const utils::MutableNodeView& node_view) {
+    return NodeIsOnCpu(node_view.node()) &&
+           !HasControlFaninOrFanout(node_view) &&
+           HasAtMostOneFanoutAtPort0(node_view) &&
+           node_view.NumRegularFanins() >= 1 &&
+           !IsInPreserveSet(ctx, node_view.node());
+  };
+
+  // Root of the pattern must be a ResizeBilinear on CPU.
+  const auto* node_view = ctx.graph_view.GetNode(node_index);
+  const auto* node_def = node_view->node();
+  if (node_def->op() != "ResizeBilinear" || !NodeIsOnCpu(node_def) ||
+      HasControlFaninOrFanout(*node_view) ||
+      node_view->NumRegularFanins() < 2) {
+    return false;
+  }
+
+  // Resized images must come from ExpandDims on axis 0.
+  const auto* expand_dims_node_view = node_view->GetRegularFanin(0).node_view();
+  const auto* expand_dims_node_def = expand_dims_node_view->node();
+  if (expand_dims_node_def->op() != "ExpandDims" ||
+      !is_intermediate(*expand_dims_node_view) ||
+      expand_dims_node_view->NumRegularFanins() < 2) {
+    return false;
+  }
+  const auto* axis_node_def =
+      expand_dims_node_view->GetRegularFanin(1).node_view()->node();
+  Tensor axis;
+  if (!IsConstant(*axis_node_def) ||
+      !axis.FromProto(axis_node_def->attr().at("value").tensor()) ||
+      axis.NumElements() != 1) {
+    return false;
+  }
+  // The expanded image is 4-D, so -4 is also axis 0.
+  const int64_t axis_value = axis.dtype() == DT_INT32
+                                 ? axis.flat<int32>()(0)
+                                 : axis.flat<int64_t>()(0);
+  if (axis_value != 0 && axis_value != -4) return false;
+
+  // ResizeBilinear converts its input to float, so resizing a uint8 image that
+  // was cast to float is the same as resizing the uint8 image.
+  const auto* input_node_view =
+      expand_dims_node_view->GetRegularFanin(0).node_view();
+  int cast_index = kMissingIndex;
+  if (IsCast(*input_node_view->node())) {
+    const auto* cast_node_def = input_node_view->node();
+    if (!is_intermediate(*input_node_view) ||
+        GetDataTypeFromAttr(*cast_node_def, "SrcT") != DT_UINT8 ||
+        GetDataTypeFromAttr(*cast_node_def, "DstT") != DT_FLOAT) {
+      return false;
+    }
+    cast_index = input_node_view->node_index();
+    input_node_view = input_node_view->GetRegularFanin(0).node_view();
+  }
+
+  // The image must come from a full-size DecodeJpeg with a number of channels
+  // that the fused kernel supports.
+  const auto* decode_node_def = input_node_view->node();
+  if (decode_node_def->op() != "DecodeJpeg" ||
+      !is_intermediate(*input_node_view)) {
+    return false;
+  }
+  int ratio = 1;
+  int channels = 0;
+  if ((TryGetNodeAttr(*decode_node_def, "ratio", &ratio) && ratio != 1) ||
+      (TryGetNodeAttr(*decode_node_def, "channels", &channels) &&
+       channels != 0 && channels != 1 && channels != 3)) {
+    return false;
+  }
+
+  *matched = DecodeJpegWithResizeBilinear(input_node_view->node_index(),
+                                          cast_index,
+                                          expand_dims_node_view->node_index(),
+                                          node_index);
+  return true;
+}
+
+// Returns true if shape inference proved that `lhs` and `rhs` are the same
+// dimension, either because both are known and equal, or because both have the
+// same symbolic size.
+bool IsSameDimension(const TensorShapeProto::Dim& lhs,
+                     const TensorShapeProto::Dim& rhs) {
+  return (IsKnown(lhs) || IsKnownSymbolically(lhs)) &&
+         lhs.size() == rhs.size();
+}
+
+// Returns the value of `node` if it is a float scalar constant. Tensors of a
+// single element of higher rank are rejected, since they could broadcast the
+// result to a higher rank.
+bool GetScalarFloatConstant(const NodeDef& node, float* value) {
+  Tensor tensor;
+  if (!IsConstant(node) || !HasDataType(&node, DT_FLOAT, "dtype") ||
+      !tensor.FromProto(node.attr().at("value").tensor()) ||
+      tensor.dims() != 0) {
+    return false;
+  }
+  *value = tensor.flat<float>()(0);
+  return true;
+}
+
+bool FindScaledDotProductAttention(const RemapperContext& ctx, int node_index,
+                                   ScaledDotProductAttention* matched) {
+  // Intermediate nodes of the pattern must only feed the next one.
+  const auto is_intermediate = [&](const utils::MutableNodeView& node_view) {
+    return NodeIsOnCpu(node_view.node()) &&
+           !HasControlFaninOrFanout(node_view) &&
+           HasAtMostOneFanoutAtPort0(node_view) &&
+           !IsInPreserveSet(ctx, node_view.node());
+  };
+  const auto is_batch_matmul = [](const NodeDef& node, bool adj_y) -> bool {
+    if (!IsAnyBatchMatMul(node) || !HasDataType(&node, DT_FLOAT)) return false;
+    bool node_adj_x = false;
+    bool node_adj_y = false;
+    TryGetNodeAttr(node, "adj_x", &node_adj_x);
+    TryGetNodeAttr(node, "adj_y", &node_adj_y);
+    return !node_adj_x && node_adj_y == adj_y;
+  };
+
+  // Root of the pattern must be the BatchMatMul of the probabilities and the
+  // value, on CPU.
+  const auto* node_view = ctx.graph_view.GetNode(node_index);
+  const auto* node_def = node_view->node();
+  if (!is_batch_matmul(*node_def, /*adj_y=*/false) || !NodeIsOnCpu(node_def) ||
+      HasControlFaninOrFanout(*node_view) ||
+      node_view->NumRegularFanins() != 2) {
+    return false;
+  }
+  const auto* softmax_node_view = node_view->GetRegularFanin(0).node_view();
+  if (!IsSoftmax(*softmax_node_view->node()) ||
+      !is_intermediate(*softmax_node_view)) {
+    return false;
+  }
+
+  ScaledDotProductAttention pattern;
+  pattern.attention = node_index;
+  pattern.softmax = softmax_node_view->node_index();
+
+  // Matches the optionally scaled scores computed by `scores_node_view`.
+  const auto match_scores =
+      [&](const utils::MutableNodeView* scores_node_view) -> bool {
+    const NodeDef* scores_node_def = scores_node_view->node();
+    if (IsMul(*scores_node_def) || IsRealDiv(*scores_node_def)) {
+      if (!is_intermediate(*scores_node_view)) return false;
+      // Mul is commutative, RealDiv must divide by the scale.
+      const bool is_mul = IsMul(*scores_node_def);
+      const utils::MutableNodeView* unscaled_node_view = nullptr;
+      for (int port : {1, 0}) {
+        if (port == 0 && !is_mul) break;
+        float value;
+        if (GetScalarFloatConstant(
+                *scores_node_view->GetRegularFanin(port).node_view()->node(),
+                &value)) {
+          if (!is_mul && value == 0.0f) return false;
+          pattern.scale_value = is_mul ? value : 1.0f / value;
+          unscaled_node_view =
+              scores_node_view->GetRegularFanin(1 - port).node_view();
+          break;
+        }
+      }
+      if (unscaled_node_view == nullptr) return false;
+      pattern.scale = scores_node_view->node_index();
+      scores_node_view = unscaled_node_view;
+      scores_node_def = scores_node_view->node();
+    }
+
+    // The key is either adjoint in the BatchMatMul, or transposed by a
+    // Transpose of its two innermost dimensions that only feeds it.
+    const bool adj_y = is_batch_matmul(*scores_node_def, /*adj_y=*/true);
+    if ((!adj_y && !is_batch_matmul(*scores_node_def, /*adj_y=*/false)) ||
+        !is_intermediate(*scores_node_view) ||
+        scores_node_view->NumRegularFanins() != 2) {
+      return false;
+    }
+    pattern.scores = scores_node_view->node_index();
+    if (adj_y) return true;
+
+    const auto* transpose_node_view =
+        scores_node_view->GetRegularFanin(1).node_view();
+    const auto* transpose_node_def = transpose_node_view->node();
+    if (!IsTranspose(*transpose_node_def) ||
+        !is_intermediate(*transpose_node_view)) {
+      return false;
+    }
+    const auto* perm_node_def =
+        transpose_node_view->GetRegularFanin(1).node_view()->node();
+    Tensor perm;
+    if (!IsConstant(*perm_node_def) ||
+        !perm.FromProto(perm_node_def->attr().at("value").tensor()) ||
+        perm.dims() != 1 || perm.NumElements() < 2) {
+      return false;
+    }
+    const int64_t rank = perm.NumElements();
+    for (int64_t d = 0; d < rank; ++d) {
+      const int64_t expected = d < rank - 2 ? d : 2 * rank - 3 - d;
+      const int64_t value = perm.dtype() == DT_INT32 ? perm.flat<int32>()(d)
+                                                     : perm.flat<int64_t>()(d);
+      if (value != expected) return false;
+    }
+    pattern.key_transpose = transpose_node_view->node_index();
+    return true;
+  };
+
+  // The scores are optionally masked by adding either input of an Add.
+  const auto* masked_node_view =
+      softmax_node_view->GetRegularFanin(0).node_view();
+  if (IsAdd(*masked_node_view->node())) {
+    if (!is_intermediate(*masked_node_view)) return false;
+    pattern.mask_add = masked_node_view->node_index();
+    const ScaledDotProductAttention unmasked = pattern;
+    if (match_scores(masked_node_view->GetRegularFanin(0).node_view())) {
+      pattern.mask_port = 1;
+    } else {
+      pattern = unmasked;
+      if (!match_scores(masked_node_view->GetRegularFanin(1).node_view())) {
+        return false;
+      }
+      pattern.mask_port = 0;
+    }
+  } else if (!match_scores(masked_node_view)) {
+    return false;
+  }
+
+  // The fused kernel doesn't broadcast the batch dimensions of the query, key
+  // and value, and only broadcasts the mask to the shape of the scores.
+  if (!ctx.inferred_graph_properties) return false;
+  const auto& scores_props = ctx.graph_properties.GetInputProperties(
+      ctx.graph_view.graph()->node(pattern.scores).name());
+  const auto& key_props =
+      pattern.key_transpose == kMissingIndex
+          ? scores_props
+          : ctx.graph_properties.GetInputProperties(
+                ctx.graph_view.graph()->node(pattern.key_transpose).name());
+  const auto& attention_props =
+      ctx.graph_properties.GetInputProperties(node_def->name());
+  if (scores_props.size() != 2 || attention_props.size() != 2 ||
+      key_props.empty()) {
+    return false;
+  }
+  const TensorShapeProto& query_shape = scores_props[0].shape();
+  const TensorShapeProto& key_shape =
+      pattern.key_transpose == kMissingIndex ? scores_props[1].shape()
+                                             : key_props[0].shape();
+  const TensorShapeProto& value_shape = attention_props[1].shape();
+  const int rank = query_shape.dim_size();
+  if (query_shape.unknown_rank() || key_shape.unknown_rank() ||
+      value_shape.unknown_rank() || rank < 2 || key_shape.dim_size() != rank ||
+      value_shape.dim_size() != rank) {
+    return false;
+  }
+  for (int d = 0; d < rank - 2; ++d) {
+    if (!IsSameDimension(query_shape.dim(d), key_shape.dim(d)) ||
+        !IsSameDimension(query_shape.dim(d), value_shape.dim(d))) {
+      return false;
+    }
+  }
+
+  if (pattern.mask_add != kMissingIndex) {
+    const auto& mask_add_props = ctx.graph_properties.GetInputProperties(
+        ctx.graph_view.graph()->node(pattern.mask_add).name());
+    if (mask_add_props.size() != 2) return false;
+    const TensorShapeProto& mask_shape =
+        mask_add_props[pattern.mask_port].shape();
+    if (mask_shape.unknown_rank() || mask_shape.dim_size() > rank) {
+      return false;
+    }
+    for (int d = rank - 1, mask_d = mask_shape.dim_size() - 1; mask_d >= 0;
+         --d, --mask_d) {
+      const TensorShapeProto::Dim& score_dim =
+          d == rank - 1 ? key_shape.dim(rank - 2) : query_shape.dim(d);
+      if (mask_shape.dim(mask_d).size() != 1 &&
+          !IsSameDimension(mask_shape.dim(mask_d), score_dim)) {
+        return false;
+      }
+    }
+  }
+
+  *matched = pattern;
+  return true;
+}
+
 // clang-format off
 // HardSwish pattern
 //                        input     Const (value: 3)
@@ -4308,6 +4730,138 @@ Status AddTensorToHashBucketNode(RemapperContext* ctx,
   return absl::OkStatus();
 }
 
+Status AddFusedGatherSparseSegmentReductionNode(
+    RemapperContext* ctx, const GatherWithSparseSegmentReduction& matched,
+    std::vector<bool>* invalidated_nodes, std::vector<bool>* nodes_to_delete) {
+  const GraphDef* graph = ctx->graph_view.graph();
+  const NodeDef& gather = graph->node(matched.gather);
+  const NodeDef& reduction = graph->node(matched.reduction);
+  VLOG(2) << "Fuse " << gather.op() << " with " << reduction.op() << ":"
+          << " gather=" << gather.name() << " reduction=" << reduction.name();
+
+  NodeDef fused_op;
+  fused_op.set_name(reduction.name());
+  fused_op.set_op(kFusedGatherSparseSegmentReduction);
+  fused_op.set_device(reduction.device());
+  fused_op.add_input(gather.input(0));     // 0: params
+  fused_op.add_input(gather.input(1));     // 1: ids
+  fused_op.add_input(reduction.input(1));  // 2: indices
+  fused_op.add_input(reduction.input(2));  // 3: segment_ids
+
+  auto* attr = fused_op.mutable_attr();
+  const auto& gather_attr = gather.attr();
+  const auto& reduction_attr = reduction.attr();
+  (*attr)["T"] = reduction_attr.at("T");
+  (*attr)["Tindices"] = gather_attr.at("Tindices");
+  for (const char* name : {"Tidx", "Tsegmentids"}) {
+    auto it = reduction_attr.find(name);
+    if (it != reduction_attr.end()) (*attr)[name] = it->second;
+  }
+  SetAttrValue(SparseSegmentReductionCombiner(reduction),
+               &(*attr)["combiner"]);
+
+  utils::Mutation* mutation = ctx->graph_view.GetMutationBuilder();
+  Status status;
+  mutation->AddNode(std::move(fused_op), &status);
+  TF_RETURN_IF_ERROR(status);
+  TF_RETURN_IF_ERROR(mutation->Apply());
+
+  (*invalidated_nodes)[matched.reduction] = true;
+  (*nodes_to_delete)[matched.gather] = true;
+
+  return absl::OkStatus();
+}
+
+Status AddDecodeAndResizeJpegNode(RemapperContext* ctx,
+                                  const DecodeJpegWithResizeBilinear& matched,
+                                  std::vector<bool>* invalidated_nodes,
+                                  std::vector<bool>* nodes_to_delete) {
+  const GraphDef* graph = ctx->graph_view.graph();
+  const NodeDef& decode = graph->node(matched.decode);
+  const NodeDef& resize = graph->node(matched.resize);
+  VLOG(2) << "Fuse " << decode.op() << " with " << resize.op() << ":"
+          << " decode=" << decode.name() << " resize=" << resize.name();
+
+  NodeDef fused_op;
+  fused_op.set_name(resize.name());
+  fused_op.set_op(kDecodeAndResizeJpeg);
+  fused_op.set_device(resize.device());
+  fused_op.add_input(decode.input(0));  // 0: contents
+  fused_op.add_input(resize.input(1));  // 1: size
+
+  auto* attr = fused_op.mutable_attr();
+  for (const char* name : {"channels", "fancy_upscaling",
+                           "try_recover_truncated", "acceptable_fraction",
+                           "dct_method"}) {
+    auto it = decode.attr().find(name);
+    if (it != decode.attr().end()) (*attr)[name] = it->second;
+  }
+  for (const char* name : {"align_corners", "half_pixel_centers"}) {
+    auto it = resize.attr().find(name);
+    if (it != resize.attr().end()) (*attr)[name] = it->second;
+  }
+  // Decoding at a reduced resolution changes the result, so it is opt-in.
+  SetAttrValue(ctx->scaled_jpeg_decoding, &(*attr)["dct_scaling"]);
+
+  utils::Mutation* mutation = ctx->graph_view.GetMutationBuilder();
+  Status status;
+  mutation->AddNode(std::move(fused_op), &status);
+  TF_RETURN_IF_ERROR(status);
+  TF_RETURN_IF_ERROR(mutation->Apply());
+
+  (*invalidated_nodes)[matched.resize] = true;
+  (*nodes_to_delete)[matched.expand_dims] = true;
+  if (matched.cast != kMissingIndex) (*nodes_to_delete)[matched.cast] = true;
+  (*nodes_to_delete)[matched.decode] = true;
+
+  return absl::OkStatus();
+}
+
+Status AddFusedAttentionNode(RemapperContext* ctx,
+                             const ScaledDotProductAttention& matched,
+                             std::vector<bool>* invalidated_nodes,
+                             std::vector<bool>* nodes_to_delete) {
+  const GraphDef* graph = ctx->graph_view.graph();
+  const NodeDef& scores = graph->node(matched.scores);
+  const NodeDef& attention = graph->node(matched.attention);
+  VLOG(2) << "Fuse scaled dot-product attention:"
+          << " scores=" << scores.name() << " attention=" << attention.name();
+
+  NodeDef fused_op;
+  fused_op.set_name(attention.name());
+  fused_op.set_op(kFusedAttention);
+  fused_op.set_device(attention.device());
+  const string& key = matched.key_transpose == kMissingIndex
+                         ? scores.input(1)
+                         : graph->node(matched.key_transpose).input(0);
+  fused_op.add_input(scores.input(0));     // 0: query
+  fused_op.add_input(key);                 // 1: key
+  fused_op.add_input(attention.input(1));  // 2: value
+  if (matched.mask_add != kMissingIndex) {
+    const NodeDef& mask_add = graph->node(matched.mask_add);
+    fused_op.add_input(mask_add.input(matched.mask_port));  // 3: mask
+  }
+
+  auto* attr = fused_op.mutable_attr();
+  (*attr)["T"] = attention.attr().at("T");
+  SetAttrValue(matched.mask_add == kMissingIndex ? 0 : 1, &(*attr)["num_args"]);
+  SetAttrValue(matched.scale_value, &(*attr)["scale"]);
+
+  utils::Mutation* mutation = ctx->graph_view.GetMutationBuilder();
+  Status status;
+  mutation->AddNode(std::move(fused_op), &status);
+  TF_RETURN_IF_ERROR(status);
+  TF_RETURN_IF_ERROR(mutation->Apply());
+
+  (*invalidated_nodes)[matched.attention] = true;
+  for (int index : {matched.scores, matched.key_transpose, matched.scale,
+                    matched.mask_add, matched.softmax}) {
+    if (index != kMissingIndex) (*nodes_to_delete)[index] = true;
+  }
+
+  return absl::OkStatus();
+}
+
 Status AddFusedBatchMatMul(RemapperContext* ctx,
                            const std::map<string, int>& matched_nodes_map,
                            const std::set<int>& remove_node_indices,
@@ -4781,17 +5335,40 @@ bool RequiresInferredShapes(const RemapperContext& ctx, int node_index,
     return true;
   };
 
+  // Candidate for a Gather + SparseSegment{Sum,Mean,SqrtN} fusion, which needs
+  // the rank of the gathered ids.
+  const auto is_gather_sparse_segment_reduction_candidate = [&]() -> bool {
+    if (SparseSegmentReductionCombiner(*node_def) == nullptr) return false;
+    if (node_view->NumRegularFanins() < 1) return false;
+    const auto* gather_node_def =
+        node_view->GetRegularFanin(0).node_view()->node();
+    return gather_node_def->op() == "Gather" ||
+           gather_node_def->op() == "GatherV2";
+  };
+
+  // Candidate for a scaled dot-product attention fusion, which needs the
+  // shapes of the query, key, value and mask.
+  const auto is_attention_candidate = [&]() -> bool {
+    if (!IsAnyBatchMatMul(*node_def)) return false;
+    if (node_view->NumRegularFanins() < 1) return false;
+    return IsSoftmax(*node_view->GetRegularFanin(0).node_view()->node());
+  };
+
   if (IsMKLEnabled())
     return is_batch_norm_candidate() || is_batch_norm_fusion_candidate() ||
            IsContractionWithAdd(ctx, node_index) ||
            is_act_biasadd_conv_candidate() || IsBiasAdd(*node_def) ||
-           IsTranspose(*node_def);
+           IsTranspose(*node_def) ||
+           is_gather_sparse_segment_reduction_candidate() ||
+           is_attention_candidate();
 
   return is_act_biasadd_conv_candidate() || is_batch_norm_candidate() ||
          is_batch_norm_fusion_candidate() ||
          is_batch_norm_grad_fusion_candidate() ||
          is_matmul_gelu_exact_fusion_candidate() ||
-         is_act_biasadd_matmul_candidate();
+         is_act_biasadd_matmul_candidate() ||
+         is_gather_sparse_segment_reduction_candidate() ||
+         is_attention_candidate();
 }
 }  // namespace
 
@@ -4800,7 +5377,7 @@ Status Remapper::Optimize(Cluster* cluster, const GrapplerItem& item,
   GrapplerItem mutable_item = item;
   Status status;
   RemapperContext ctx(&mutable_item, &status, cpu_layout_conversion_,
-                      xla_auto_clustering_on_);
+                      xla_auto_clustering_on_, scaled_jpeg_decoding_);
   TF_RETURN_IF_ERROR(status);
   // Processing graph in reverse-topological sorted order allows to remap
   // longer chains of dependent ops in one pass.
@@ -5136,6 +5713,35 @@ Status Remapper::Optimize(Cluster* cluster, const GrapplerItem& item,
       continue;
     }
 
+    // Remap Gather+SparseSegment{Sum,Mean,SqrtN} into the
+    // _FusedGatherSparseSegmentReduction.
+    GatherWithSparseSegmentReduction gather_with_reduction;
+    if (allow_non_differentiable_rewrites &&
+        FindGatherWithSparseSegmentReduction(ctx, i, &gather_with_reduction)) {
+      TF_RETURN_IF_ERROR(AddFusedGatherSparseSegmentReductionNode(
+          &ctx, gather_with_reduction, &invalidated_nodes, &nodes_to_delete));
+      continue;
+    }
+
+    // Remap BatchMatMul+[Mul]+[Add]+Softmax+BatchMatMul into the
+    // _FusedAttention.
+    ScaledDotProductAttention attention;
+    if (allow_non_differentiable_rewrites &&
+        FindScaledDotProductAttention(ctx, i, &attention)) {
+      TF_RETURN_IF_ERROR(AddFusedAttentionNode(
+          &ctx, attention, &invalidated_nodes, &nodes_to_delete));
+      continue;
+    }
+
+    // Remap DecodeJpeg+[Cast]+ExpandDims+ResizeBilinear into the
+    // _DecodeAndResizeJpeg.
+    DecodeJpegWithResizeBilinear decode_with_resize;
+    if (FindDecodeJpegWithResizeBilinear(ctx, i, &decode_with_resize)) {
+      TF_RETURN_IF_ERROR(AddDecodeAndResizeJpegNode(
+          &ctx, decode_with_resize, &invalidated_nodes, &nodes_to_delete));
+      continue;
+    }
+
     // During inference, most of the inputs to FusedBatchNorm are constant, and
     // we can therefore replace the op with a much cheaper set of primitives.
     FusedBatchNorm fused_batch_norm;
@@ -29,10 +29,12 @@ class Remapper : public GraphOptimizer {
   explicit Remapper(RewriterConfig::Toggle opt_level,
                     RewriterConfig::CpuLayout cpu_layout_conversion =
                         RewriterConfig::NO_CONVERSION_ON_CPU,
-                    bool xla_auto_clustering_on = false)
+                    bool xla_auto_clustering_on = false,
+                    bool scaled_jpeg_decoding = false)
       : opt_level_(opt_level),
         cpu_layout_conversion_(cpu_layout_conversion),
-        xla_auto_clustering_on_(xla_auto_clustering_on) {}
+        xla_auto_clustering_on_(xla_auto_clustering_on),
+        scaled_jpeg_decoding_(scaled_jpeg_decoding) {}
 
   ~Remapper() override {}
 
@@ -47,6 +49,8 @@ class Remapper : public GraphOptimizer {
   RewriterConfig::Toggle opt_level_;
   RewriterConfig::CpuLayout cpu_layout_conversion_;
   bool xla_auto_clustering_on_;
+  // Whether fused JPEG decodes may use libjpeg DCT scaling.
+  bool scaled_jpeg_decoding_;
 };
 
 }  // end namespace grappler
@@ -683,7 +683,8 @@ class RemapperFuseConvWithBias : public RemapperTest {
       item.graph.mutable_node(i)->set_device("/device:CPU:0");
     }
 
-    Remapper optimizer(RewriterConfig::ON);
+    Remapper optimizer(RewriterConfig::ON, RewriterConfig::NO_CONVERSION_ON_CPU,
+                       /*xla_auto_clustering_on=*/false, scaled_jpeg_decoding);
     GraphDef output;
     TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
 
@@ -1767,6 +1768,278 @@ TEST_F(RemapperTensorToHashBucketTest, I32) { RunTest<DT_INT32>(); }
 
 TEST_F(RemapperTensorToHashBucketTest, I64) { RunTest<DT_INT64>(); }
 
+class RemapperGatherWithSparseSegmentReductionTest : public RemapperTest {
+ public:
+  // Builds GatherV2 + SparseSegmentMean. If `share_gather` is true, the
+  // gathered rows are also fetched, so they must not be fused away.
+  void RunTest(bool share_gather) {
+    using ::tensorflow::ops::Placeholder;
+
+    tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+
+    auto params = Placeholder(s.WithOpName("params"), DT_FLOAT,
+                              ops::Placeholder::Shape({100, 8}));
+    // Fed tensors have unknown shapes unless feeds are assumed to be valid,
+    // and the fusion needs to know that the ids are a vector.
+    auto ids =
+        ops::Const<int64_t>(s.WithOpName("ids"), {7, 0, 99, 42, 7, 13}, {6});
+    auto indices =
+        ops::Const(s.WithOpName("indices"), {0, 1, 2, 3, 4, 5, 1}, {7});
+    auto segment_ids =
+        ops::Const(s.WithOpName("segment_ids"), {0, 0, 0, 2, 2, 3, 3}, {7});
+    auto axis = ops::Const(s.WithOpName("axis"), 0);
+    auto gather = ops::GatherV2(s.WithOpName("gather"), params, ids, axis);
+    auto reduction = ops::SparseSegmentMean(s.WithOpName("reduction"), gather,
+                                            indices, segment_ids);
+    auto fetch = ops::Identity(s.WithOpName("fetch"), reduction);
+
+    GrapplerItem item;
+    item.fetch = {"fetch"};
+    if (share_gather) item.fetch.push_back("gather");
+    item.feed = {{"params", GenerateRandomTensor<DT_FLOAT>({100, 8})}};
+    TF_ASSERT_OK(s.ToGraphDef(&item.graph));
+
+    for (int i = 0; i < item.graph.node_size(); ++i) {
+      item.graph.mutable_node(i)->set_device("/device:CPU:0");
+    }
+
+    Remapper optimizer(RewriterConfig::ON);
+    GraphDef output;
+    TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+
+    int found = 0;
+    for (const NodeDef& node : output.node()) {
+      if (node.name() == "reduction") {
+        if (share_gather) {
+          EXPECT_EQ(node.op(), "SparseSegmentMean");
+        } else {
+          EXPECT_EQ(node.op(), "_FusedGatherSparseSegmentReduction");
+          ASSERT_EQ(node.input_size(), 4);
+          EXPECT_EQ(node.input(0), "params");
+          EXPECT_EQ(node.input(1), "ids");
+          EXPECT_EQ(node.input(2), "indices");
+          EXPECT_EQ(node.input(3), "segment_ids");
+          EXPECT_EQ(node.attr().at("combiner").s(), "mean");
+        }
+        found++;
+      }
+      if (node.name() == "gather") found++;
+    }
+    EXPECT_EQ(found, share_gather ? 2 : 1);
+
+    auto tensors_expected = EvaluateNodes(item.graph, item.fetch, item.feed);
+    auto tensors = EvaluateNodes(output, item.fetch, item.feed);
+    ASSERT_EQ(tensors.size(), tensors_expected.size());
+    test::ExpectTensorNear<float>(tensors[0], tensors_expected[0], 1e-6);
+  }
+};
+
+TEST_F(RemapperGatherWithSparseSegmentReductionTest, Fused) {
+  RunTest(/*share_gather=*/false);
+}
+
+TEST_F(RemapperGatherWithSparseSegmentReductionTest, SharedGatherNotFused) {
+  RunTest(/*share_gather=*/true);
+}
+
+class RemapperDecodeJpegWithResizeBilinearTest : public RemapperTest {
+ public:
+  // Builds DecodeJpeg + Cast + ExpandDims + ResizeBilinear, as resizing a
+  // decoded image with tf.image.resize does.
+  void RunTest(int channels, bool scaled_jpeg_decoding, bool expect_fused) {
+    using ::tensorflow::ops::Placeholder;
+
+    tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+
+    auto contents = Placeholder(s.WithOpName("contents"), DT_STRING);
+    auto decode = ops::DecodeJpeg(
+        s.WithOpName("decode"), contents,
+        ops::DecodeJpeg::Channels(channels).DctMethod("INTEGER_ACCURATE"));
+    auto cast = ops::Cast(s.WithOpName("cast"), decode, DT_FLOAT);
+    auto axis = ops::Const(s.WithOpName("axis"), 0);
+    auto expand_dims = ops::ExpandDims(s.WithOpName("expand_dims"), cast, axis);
+    auto size = ops::Const(s.WithOpName("size"), {224, 224}, {2});
+    auto resize =
+        ops::ResizeBilinear(s.WithOpName("resize"), expand_dims, size,
+                            ops::ResizeBilinear::HalfPixelCenters(true));
+    auto fetch = ops::Identity(s.WithOpName("fetch"), resize);
+
+    GrapplerItem item;
+    item.fetch = {"fetch"};
+    TF_ASSERT_OK(s.ToGraphDef(&item.graph));
+
+    for (int i = 0; i < item.graph.node_size(); ++i) {
+      item.graph.mutable_node(i)->set_device("/device:CPU:0");
+    }
+
+    Remapper optimizer(RewriterConfig::ON);
+    GraphDef output;
+    TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+
+    int found = 0;
+    for (const NodeDef& node : output.node()) {
+      if (node.name() == "resize") {
+        if (expect_fused) {
+          EXPECT_EQ(node.op(), "_DecodeAndResizeJpeg");
+          ASSERT_EQ(node.input_size(), 2);
+          EXPECT_EQ(node.input(0), "contents");
+          EXPECT_EQ(node.input(1), "size");
+          EXPECT_EQ(node.attr().at("channels").i(), channels);
+          EXPECT_EQ(node.attr().at("dct_method").s(), "INTEGER_ACCURATE");
+          EXPECT_EQ(node.attr().at("dct_scaling").b(), scaled_jpeg_decoding);
+          EXPECT_TRUE(node.attr().at("half_pixel_centers").b());
+        } else {
+          EXPECT_EQ(node.op(), "ResizeBilinear");
+        }
+        found++;
+      }
+      if (node.name() == "decode" || node.name() == "cast" ||
+          node.name() == "expand_dims") {
+        found++;
+      }
+    }
+    EXPECT_EQ(found, expect_fused ? 1 : 4);
+  }
+};
+
+TEST_F(RemapperDecodeJpegWithResizeBilinearTest, Fused) {
+  RunTest(/*channels=*/3, /*scaled_jpeg_decoding=*/false,
+          /*expect_fused=*/true);
+}
+
+TEST_F(RemapperDecodeJpegWithResizeBilinearTest, FusedWithScaledDecoding) {
+  RunTest(/*channels=*/1, /*scaled_jpeg_decoding=*/true,
+          /*expect_fused=*/true);
+}
+
+TEST_F(RemapperDecodeJpegWithResizeBilinearTest, UnsupportedChannelsNotFused) {
+  RunTest(/*channels=*/4, /*scaled_jpeg_decoding=*/false,
+          /*expect_fused=*/false);
+}
+
+class RemapperScaledDotProductAttentionTest : public RemapperTest {
+ public:
+  // Builds the attention of a [batch, heads, length, depth] query, key and
+  // value. If `transpose_key` is true, the key is transposed by a Transpose and
+  // the scores are divided by a constant, otherwise the key is adjoint in the
+  // BatchMatMul and the scores are multiplied by a constant, then masked. If
+  // `share_probabilities` is true, the probabilities are also fetched, so they
+  // must not be fused away. If `broadcast_scale` is true, the scale has a
+  // single element but a higher rank than the scores, so it can't be fused.
+  void RunTest(bool transpose_key, bool share_probabilities,
+               bool broadcast_scale = false) {
+    using ::tensorflow::ops::Placeholder;
+
+    tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+
+    const TensorShape shape({2, 4, 16, 8});
+    const TensorShape mask_shape({2, 1, 1, 16});
+    auto query = Placeholder(s.WithOpName("query"), DT_FLOAT,
+                             ops::Placeholder::Shape(shape));
+    auto key = Placeholder(s.WithOpName("key"), DT_FLOAT,
+                           ops::Placeholder::Shape(shape));
+    auto value = Placeholder(s.WithOpName("value"), DT_FLOAT,
+                             ops::Placeholder::Shape(shape));
+    auto mask = Placeholder(s.WithOpName("mask"), DT_FLOAT,
+                            ops::Placeholder::Shape(mask_shape));
+    Output probabilities;
+    if (transpose_key) {
+      auto key_t = ops::Transpose(s.WithOpName("key_t"), key, {0, 1, 3, 2});
+      auto scores = ops::BatchMatMulV2(s.WithOpName("scores"), query, key_t);
+      auto scaled = ops::RealDiv(s.WithOpName("scaled"), scores,
+                                 ops::Const(s.WithOpName("scale"), 4.0f));
+      probabilities = ops::Softmax(s.WithOpName("probabilities"), scaled);
+    } else {
+      auto scores = ops::BatchMatMulV2(s.WithOpName("scores"), query, key,
+                                       ops::BatchMatMulV2::AdjY(true));
+      auto scaled = ops::Mul(
+          s.WithOpName("scaled"), scores,
+          broadcast_scale
+              ? ops::Const(s.WithOpName("scale"), 0.25f,
+                           TensorShape({1, 1, 1, 1, 1}))
+              : ops::Const(s.WithOpName("scale"), 0.25f));
+      auto masked = ops::AddV2(s.WithOpName("masked"), scaled, mask);
+      probabilities = ops::Softmax(s.WithOpName("probabilities"), masked);
+    }
+    auto attention =
+        ops::BatchMatMulV2(s.WithOpName("attention"), probabilities, value);
+    auto fetch = ops::Identity(s.WithOpName("fetch"), attention);
+
+    GrapplerItem item;
+    item.fetch = {"fetch"};
+    if (share_probabilities) item.fetch.push_back("probabilities");
+    TF_ASSERT_OK(s.ToGraphDef(&item.graph));
+
+    for (int i = 0; i < item.graph.node_size(); ++i) {
+      item.graph.mutable_node(i)->set_device("/device:CPU:0");
+    }
+
+    Remapper optimizer(RewriterConfig::ON);
+    GraphDef output;
+    TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+
+    const bool fused = !share_probabilities && !broadcast_scale;
+    int found = 0;
+    int num_fused = 0;
+    for (const NodeDef& node : output.node()) {
+      if (node.op() == "_FusedAttention") num_fused++;
+      if (node.name() == "attention") {
+        if (!fused) {
+          EXPECT_EQ(node.op(), "BatchMatMulV2");
+        } else {
+          EXPECT_EQ(node.op(), "_FusedAttention");
+          ASSERT_EQ(node.input_size(), transpose_key ? 3 : 4);
+          EXPECT_EQ(node.input(0), "query");
+          EXPECT_EQ(node.input(1), "key");
+          EXPECT_EQ(node.input(2), "value");
+          if (!transpose_key) EXPECT_EQ(node.input(3), "mask");
+          EXPECT_EQ(node.attr().at("num_args").i(), transpose_key ? 0 : 1);
+          EXPECT_FLOAT_EQ(node.attr().at("scale").f(), 0.25f);
+        }
+        found++;
+      }
+      if (node.name() == "scores" || node.name() == "scaled" ||
+          node.name() == "masked" || node.name() == "key_t" ||
+          node.name() == "probabilities") {
+        found++;
+      }
+    }
+    EXPECT_EQ(found, fused ? 1 : 5);
+    ASSERT_EQ(num_fused, fused ? 1 : 0);
+
+    // Fed tensors have unknown shapes, so the inputs are only fed to evaluate
+    // the graphs.
+    auto mask_t = GenerateRandomTensor<DT_FLOAT>(mask_shape);
+    mask_t.flat<float>()(3) = -1e9f;
+    const std::vector<std::pair<string, Tensor>> feed = {
+        {"query", GenerateRandomTensor<DT_FLOAT>(shape)},
+        {"key", GenerateRandomTensor<DT_FLOAT>(shape)},
+        {"value", GenerateRandomTensor<DT_FLOAT>(shape)},
+        {"mask", mask_t}};
+    auto tensors_expected = EvaluateNodes(item.graph, item.fetch, feed);
+    auto tensors = EvaluateNodes(output, item.fetch, feed);
+    ASSERT_EQ(tensors.size(), tensors_expected.size());
+    test::ExpectTensorNear<float>(tensors[0], tensors_expected[0], 1e-5);
+  }
+};
+
+TEST_F(RemapperScaledDotProductAttentionTest, MaskedFused) {
+  RunTest(/*transpose_key=*/false, /*share_probabilities=*/false);
+}
+
+TEST_F(RemapperScaledDotProductAttentionTest, TransposedKeyFused) {
+  RunTest(/*transpose_key=*/true, /*share_probabilities=*/false);
+}
+
+TEST_F(RemapperScaledDotProductAttentionTest, SharedProbabilitiesNotFused) {
+  RunTest(/*transpose_key=*/false, /*share_probabilities=*/true);
+}
+
+TEST_F(RemapperScaledDotProductAttentionTest, BroadcastingScaleNotFused) {
+  RunTest(/*transpose_key=*/false, /*share_probabilities=*/false,
+          /*broadcast_scale=*/true);
+}
+
 class RemapperFuseMatMulWithBiasTest : public RemapperTest {
  public:
   template <DataType DTYPE>
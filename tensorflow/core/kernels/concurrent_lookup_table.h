@@ -0,0 +1,518 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_KERNELS_CONCURRENT_LOOKUP_TABLE_H_
+#define TENSORFLOW_CORE_KERNELS_CONCURRENT_LOOKUP_TABLE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>  // NOLINT(build/c++11)
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/core/framework/lookup_interface.h"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/graph/graph_def_builder.h"
+#include "tensorflow/core/kernels/lookup_table_op.h"
+#include "tensorflow/core/lib/core/bits.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+
+namespace tensorflow {
+namespace lookup {
+
+// A hash map from integral keys to scalar values that can be read without
+// taking any lock.
+//
+// Keys are split across `kNumShards` shards by hash, each with its own writer
+// mutex and its own open-addressed, linearly probed bucket array. Every bucket
+// is protected by a sequence lock: writers bump the bucket version around each
+// update, and readers retry if the version changed while they read the
+// bucket. Buckets are never moved within an array and removed keys leave a
+// tombstone behind, so a reader probing an array concurrently with writers
+// never skips over the key it is looking for.
+//
+// When a shard fills up, its writer rehashes the live entries into a new array
+// and publishes it atomically. The old array is freed after a grace period:
+// readers announce themselves in one of two sets of striped counters (selected
+// by the current epoch) for the duration of a `ReadScope`, and the writer
+// flips the epoch and waits for the counters of the previous epoch to drain.
+//
+// All lookups and iterations must happen within a `ReadScope`. A single scope
+// is meant to cover a whole batch of lookups; it costs two uncontended atomic
+// increments.
+template <class K, class V>
+class ConcurrentScalarMap {
+  static_assert(std::is_integral<K>::value, "Keys must be integers.");
+  static_assert(std::atomic<K>::is_always_lock_free &&
+                    std::atomic<V>::is_always_lock_free,
+                "Keys and values must be lock-free atomics.");
+
+ public:
+  ConcurrentScalarMap() {
+    for (Shard& shard : shards_) {
+      shard.array.store(new BucketArray(kMinCapacity),
+                        std::memory_order_relaxed);
+    }
+  }
+
+  ~ConcurrentScalarMap() {
+    for (Shard& shard : shards_) {
+      delete shard.array.load(std::memory_order_relaxed);
+    }
+  }
+
+  ConcurrentScalarMap(const ConcurrentScalarMap&) = delete;
+  ConcurrentScalarMap& operator=(const ConcurrentScalarMap&) = delete;
+
+  // Read-side critical section. The bucket arrays observed within the scope
+  // stay alive until the scope is destroyed.
+  class ReadScope {
+   public:
+    explicit ReadScope(const ConcurrentScalarMap& map)
+        : map_(map), slot_(ThreadSlot()) {
+      while (true) {
+        parity_ = map_.epoch_.load();
+        map_.readers_[parity_][slot_].count.fetch_add(1);
+        // A writer that flipped the epoch in between may already have checked
+        // this counter; announce the reader under the new epoch instead.
+        if (map_.epoch_.load() == parity_) break;
+        map_.readers_[parity_][slot_].count.fetch_sub(
+            1, std::memory_order_release);
+      }
+    }
+
+    ~ReadScope() {
+      map_.readers_[parity_][slot_].count.fetch_sub(1,
+                                                    std::memory_order_release);
+    }
+
+    ReadScope(const ReadScope&) = delete;
+    ReadScope& operator=(const ReadScope&) = delete;
+
+   private:
+    const ConcurrentScalarMap& map_;
+    const int slot_;
+    int parity_;
+  };
+
+  // Looks up `key`. Must be called within a ReadScope of this map.
+  bool Find(K key, V* value) const {
+    const uint64 hash = Hash(key);
+    const BucketArray* array =
+        shards_[ShardIndex(hash)].array.load(std::memory_order_acquire);
+    for (uint64 i = hash & array->mask, probes = 0; probes <= array->mask;
+         i = (i + 1) & array->mask, ++probes) {
+      uint32 state;
+      K bucket_key;
+      V bucket_value;
+      array->buckets[i].Read(&state, &bucket_key, &bucket_value);
+      if (state == kEmpty) return false;
+      if (bucket_key == key) {
+        if (state != kFull) return false;
+        *value = bucket_value;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Calls `fn(key, value)` for every entry. Entries inserted or removed
+  // concurrently may or may not be visited. Must be called within a ReadScope
+  // of this map.
+  template <typename Fn>
+  void ForEach(Fn fn) const {
+    for (const Shard& shard : shards_) {
+      const BucketArray* array = shard.array.load(std::memory_order_acquire);
+      for (uint64 i = 0; i <= array->mask; ++i) {
+        uint32 state;
+        K key;
+        V value;
+        array->buckets[i].Read(&state, &key, &value);
+        if (state == kFull) fn(key, value);
+      }
+    }
+  }
+
+  void InsertOrAssign(K key, V value) {
+    const uint64 hash = Hash(key);
+    Shard& shard = shards_[ShardIndex(hash)];
+    mutex_lock l(shard.mu);
+    BucketArray* array = shard.array.load(std::memory_order_relaxed);
+    uint64 i = FindSlotLocked(*array, hash, key);
+    Bucket& bucket = array->buckets[i];
+    const uint32 state = bucket.state.load(std::memory_order_relaxed);
+    if (state != kEmpty) {
+      // The key is present, possibly as a tombstone which is revived.
+      bucket.Write(kFull, key, value);
+      if (state == kDeleted) ++shard.num_full;
+      return;
+    }
+    if ((shard.num_used + 1) * kMaxLoadDenominator >
+        (array->mask + 1) * kMaxLoadNumerator) {
+      array = RehashLocked(&shard, shard.num_full + 1);
+      i = FindSlotLocked(*array, hash, key);
+    }
+    array->buckets[i].Write(kFull, key, value);
+    ++shard.num_used;
+    ++shard.num_full;
+  }
+
+  // Returns true if `key` was present.
+  bool Erase(K key) {
+    const uint64 hash = Hash(key);
+    Shard& shard = shards_[ShardIndex(hash)];
+    mutex_lock l(shard.mu);
+    BucketArray* array = shard.array.load(std::memory_order_relaxed);
+    Bucket& bucket = array->buckets[FindSlotLocked(*array, hash, key)];
+    if (bucket.state.load(std::memory_order_relaxed) != kFull) return false;
+    bucket.Write(kDeleted, key, bucket.value.load(std::memory_order_relaxed));
+    --shard.num_full;
+    return true;
+  }
+
+  // Removes all entries and reserves room for `expected_size` entries.
+  void Clear(int64_t expected_size = 0) {
+    const int64_t per_shard = expected_size / kNumShards + 1;
+    for (Shard& shard : shards_) {
+      mutex_lock l(shard.mu);
+      shard.num_used = 0;
+      shard.num_full = 0;
+      RehashLocked(&shard, per_shard, /*keep_entries=*/false);
+    }
+  }
+
+  int64_t size() const {
+    int64_t size = 0;
+    for (const Shard& shard : shards_) {
+      size += shard.num_full.load(std::memory_order_relaxed);
+    }
+    return size;
+  }
+
+  // Returns the number of bytes used by the bucket arrays.
+  int64_t MemoryUsed() const {
+    int64_t bytes = 0;
+    for (const Shard& shard : shards_) {
+      tf_shared_lock l(shard.mu);
+      bytes += (shard.array.load(std::memory_order_relaxed)->mask + 1) *
+               sizeof(Bucket);
+    }
+    return bytes;
+  }
+
+ private:
+  static constexpr int kNumShards = 64;
+  static constexpr int kNumReaderSlots = 64;
+  static constexpr int64_t kMinCapacity = 16;
+  // Arrays are rehashed past a load factor of 3/4, counting tombstones.
+  static constexpr int64_t kMaxLoadNumerator = 3;
+  static constexpr int64_t kMaxLoadDenominator = 4;
+
+  enum : uint32 { kEmpty = 0, kFull = 1, kDeleted = 2 };
+
+  struct Bucket {
+    Bucket() : version(0), state(kEmpty), key(K()), value(V()) {}
+
+    // Reads a consistent snapshot of the bucket.
+    void Read(uint32* out_state, K* out_key, V* out_value) const {
+      while (true) {
+        const uint32 before = version.load(std::memory_order_acquire);
+        if (before & 1) {
+          std::this_thread::yield();
+          continue;
+        }
+        *out_state = state.load(std::memory_order_relaxed);
+        *out_key = key.load(std::memory_order_relaxed);
+        *out_value = value.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (version.load(std::memory_order_relaxed) == before) return;
+      }
+    }
+
+    // Updates the bucket. Only called by the writer holding the shard mutex.
+    void Write(uint32 new_state, K new_key, V new_value) {
+      const uint32 before = version.load(std::memory_order_relaxed);
+      version.store(before + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      state.store(new_state, std::memory_order_relaxed);
+      key.store(new_key, std::memory_order_relaxed);
+      value.store(new_value, std::memory_order_relaxed);
+      version.store(before + 2, std::memory_order_release);
+    }
+
+    std::atomic<uint32> version;
+    std::atomic<uint32> state;
+    std::atomic<K> key;
+    std::atomic<V> value;
+  };
+
+  struct BucketArray {
+    explicit BucketArray(uint64 capacity)
+        : mask(capacity - 1), buckets(new Bucket[capacity]) {}
+
+    const uint64 mask;
+    const std::unique_ptr<Bucket[]> buckets;
+  };
+
+  struct alignas(64) Shard {
+    mutable mutex mu;
+    std::atomic<BucketArray*> array{nullptr};
+    // Number of non-empty buckets, including tombstones.
+    int64_t num_used TF_GUARDED_BY(mu) = 0;
+    // Written under `mu`, read without it by size().
+    std::atomic<int64_t> num_full{0};
+  };
+
+  struct alignas(64) ReaderCount {
+    std::atomic<int64_t> count{0};
+  };
+
+  static uint64 Hash(K key) {
+    // Finalizer of MurmurHash3; the bits of integer ids are rarely uniform.
+    uint64 h = static_cast<uint64>(key);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+  // Shards are selected by the high bits of the hash, buckets by the low bits.
+  static int ShardIndex(uint64 hash) { return hash >> 58; }
+  static_assert(kNumShards == 64, "ShardIndex assumes 64 shards.");
+
+  static int ThreadSlot() {
+    static std::atomic<int> next_slot{0};
+    thread_local const int slot =
+        next_slot.fetch_add(1, std::memory_order_relaxed) % kNumReaderSlots;
+    return slot;
+  }
+
+  // Returns the bucket holding `key` (live or as a tombstone), or the empty
+  // bucket where it would be inserted. `array` always has an empty bucket.
+  static uint64 FindSlotLocked(const BucketArray& array, uint64 hash, K key) {
+    uint64 i = hash & array.mask;
+    while (true) {
+      const Bucket& bucket = array.buckets[i];
+      if (bucket.state.load(std::memory_order_relaxed) == kEmpty ||
+          bucket.key.load(std::memory_order_relaxed) == key) {
+        return i;
+      }
+      i = (i + 1) & array.mask;
+    }
+  }
+
+  // Replaces the bucket array of `shard` with one that has room for
+  // `num_entries` entries, dropping tombstones, and frees the old array once
+  // no reader can observe it anymore.
+  BucketArray* RehashLocked(Shard* shard, int64_t num_entries,
+                            bool keep_entries = true)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(shard->mu) {
+    const uint64 capacity = std::max<uint64>(
+        kMinCapacity, NextPowerOfTwo64(static_cast<uint64>(num_entries) * 2));
+    BucketArray* old_array = shard->array.load(std::memory_order_relaxed);
+    BucketArray* new_array = new BucketArray(capacity);
+    if (keep_entries) {
+      // The new array is not visible to readers yet.
+      for (uint64 i = 0; i <= old_array->mask; ++i) {
+        const Bucket& bucket = old_array->buckets[i];
+        if (bucket.state.load(std::memory_order_relaxed) != kFull) continue;
+        const K key = bucket.key.load(std::memory_order_relaxed);
+        Bucket& target =
+            new_array->buckets[FindSlotLocked(*new_array, Hash(key), key)];
+        target.state.store(kFull, std::memory_order_relaxed);
+        target.key.store(key, std::memory_order_relaxed);
+        target.value.store(bucket.value.load(std::memory_order_relaxed),
+                           std::memory_order_relaxed);
+      }
+      shard->num_used = shard->num_full.load(std::memory_order_relaxed);
+    }
+    shard->array.store(new_array, std::memory_order_release);
+    WaitForReaders();
+    delete old_array;
+    return new_array;
+  }
+
+  // Waits until every ReadScope that may have observed an array unpublished
+  // before this call has been destroyed.
+  void WaitForReaders() TF_LOCKS_EXCLUDED(epoch_mu_) {
+    mutex_lock l(epoch_mu_);
+    const int parity = epoch_.load(std::memory_order_relaxed);
+    epoch_.store(parity ^ 1);
+    for (const ReaderCount& reader : readers_[parity]) {
+      while (reader.count.load() != 0) std::this_thread::yield();
+    }
+  }
+
+  Shard shards_[kNumShards];
+
+  // Serializes epoch flips; readers never take it.
+  mutex epoch_mu_;
+  std::atomic<int> epoch_{0};
+  mutable ReaderCount readers_[2][kNumReaderSlots];
+};
+
+// Mutable lookup table for scalar integer keys and scalar numeric values that
+// scales with the number of threads looking it up concurrently.
+//
+// Lookups never take a lock, and insertions and removals only lock one of
+// many shards. In exchange, the individual keys of a batched Insert, Remove or
+// Import become visible to concurrent lookups one at a time rather than
+// atomically.
+template <class K, class V>
+class MutableConcurrentHashTable final : public LookupInterface {
+ public:
+  MutableConcurrentHashTable(OpKernelContext* ctx, OpKernel* kernel) {}
+
+  size_t size() const override { return map_.size(); }
+
+  Status Find(OpKernelContext* ctx, const Tensor& key, Tensor* value,
+              const Tensor& default_value) override {
+    const auto key_values = key.flat<K>();
+    auto value_values = value->flat<V>();
+    const auto default_flat = default_value.flat<V>();
+    // As in MutableHashTableOfScalars, each key either has its own default
+    // value or they all share default_flat(0).
+    const bool is_full_size_default =
+        value_values.size() == default_flat.size();
+
+    typename Map::ReadScope scope(map_);
+    for (int64_t i = 0; i < key_values.size(); ++i) {
+      if (!map_.Find(SubtleMustCopyIfIntegral(key_values(i)),
+                     &value_values(i))) {
+        value_values(i) =
+            is_full_size_default ? default_flat(i) : default_flat(0);
+      }
+    }
+    return absl::OkStatus();
+  }
+
+  Status Insert(OpKernelContext* ctx, const Tensor& keys,
+                const Tensor& values) override {
+    const auto key_values = keys.flat<K>();
+    const auto value_values = values.flat<V>();
+    for (int64_t i = 0; i < key_values.size(); ++i) {
+      map_.InsertOrAssign(SubtleMustCopyIfIntegral(key_values(i)),
+                          SubtleMustCopyIfIntegral(value_values(i)));
+    }
+    return absl::OkStatus();
+  }
+
+  Status Remove(OpKernelContext* ctx, const Tensor& keys) override {
+    const auto key_values = keys.flat<K>();
+    for (int64_t i = 0; i < key_values.size(); ++i) {
+      map_.Erase(SubtleMustCopyIfIntegral(key_values(i)));
+    }
+    return absl::OkStatus();
+  }
+
+  Status ImportValues(OpKernelContext* ctx, const Tensor& keys,
+                      const Tensor& values) override {
+    map_.Clear(keys.NumElements());
+    return Insert(ctx, keys, values);
+  }
+
+  Status ExportValues(OpKernelContext* ctx) override {
+    std::vector<K> keys;
+    std::vector<V> values;
+    Export(&keys, &values);
+    const int64_t size = keys.size();
+    Tensor* keys_tensor;
+    Tensor* values_tensor;
+    TF_RETURN_IF_ERROR(
+        ctx->allocate_output("keys", TensorShape({size}), &keys_tensor));
+    TF_RETURN_IF_ERROR(
+        ctx->allocate_output("values", TensorShape({size}), &values_tensor));
+    std::copy(keys.begin(), keys.end(), keys_tensor->flat<K>().data());
+    std::copy(values.begin(), values.end(), values_tensor->flat<V>().data());
+    return absl::OkStatus();
+  }
+
+  DataType key_dtype() const override { return DataTypeToEnum<K>::v(); }
+
+  DataType value_dtype() const override { return DataTypeToEnum<V>::v(); }
+
+  TensorShape key_shape() const final { return TensorShape(); }
+
+  TensorShape value_shape() const override { return TensorShape(); }
+
+  int64_t MemoryUsed() const override {
+    return sizeof(MutableConcurrentHashTable) + map_.MemoryUsed();
+  }
+
+  Status AsGraphDef(GraphDefBuilder* builder, Node** out) const override {
+    std::vector<K> keys;
+    std::vector<V> values;
+    Export(&keys, &values);
+    const int64_t size = keys.size();
+    Tensor keys_tensor(key_dtype(), TensorShape({size}));
+    Tensor values_tensor(value_dtype(), TensorShape({size}));
+    std::copy(keys.begin(), keys.end(), keys_tensor.flat<K>().data());
+    std::copy(values.begin(), values.end(), values_tensor.flat<V>().data());
+
+    // See MutableHashTableOfScalars::AsGraphDef for why the node name is
+    // shared.
+    Node* table = ops::SourceOp(
+        "MutableConcurrentHashTable",
+        builder->opts()
+            .WithName(UniqueNodeName("MutableConcurrentHashTableFromGraphDef"))
+            .WithAttr("use_node_name_sharing", true)
+            .WithAttr("key_dtype", key_dtype())
+            .WithAttr("value_dtype", value_dtype()));
+    Node* keys_node =
+        ops::SourceOp("Const", builder->opts()
+                                   .WithAttr("dtype", key_dtype())
+                                   .WithAttr("value", keys_tensor));
+    Node* values_node =
+        ops::SourceOp("Const", builder->opts()
+                                   .WithAttr("dtype", value_dtype())
+                                   .WithAttr("value", values_tensor));
+    Node* import_table =
+        ops::TernaryOp("LookupTableImportV2", table, keys_node, values_node,
+                       builder->opts()
+                           .WithAttr("Tin", key_dtype())
+                           .WithAttr("Tout", value_dtype()));
+    *out = ops::UnaryOp("Identity", table,
+                        builder->opts().WithControlInput(import_table));
+    return absl::OkStatus();
+  }
+
+ private:
+  using Map = ConcurrentScalarMap<K, V>;
+
+  void Export(std::vector<K>* keys, std::vector<V>* values) const {
+    typename Map::ReadScope scope(map_);
+    keys->reserve(map_.size());
+    values->reserve(map_.size());
+    map_.ForEach([&](K key, V value) {
+      keys->push_back(key);
+      values->push_back(value);
+    });
+  }
+
+  Map map_;
+};
+
+}  // namespace lookup
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_KERNELS_CONCURRENT_LOOKUP_TABLE_H_
@@ -0,0 +1,252 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/kernels/concurrent_lookup_table.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/lib/random/simple_philox.h"
+#include "tensorflow/core/platform/blocking_counter.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace lookup {
+namespace {
+
+using Table = MutableConcurrentHashTable<int64_t, int64_t>;
+
+// None of the table methods exercised here touch the kernel context.
+constexpr OpKernelContext* kNoContext = nullptr;
+
+Tensor Range(int64_t begin, int64_t end, int64_t scale = 1) {
+  Tensor t(DT_INT64, TensorShape({end - begin}));
+  for (int64_t i = begin; i < end; ++i) {
+    t.vec<int64_t>()(i - begin) = i * scale;
+  }
+  return t;
+}
+
+TEST(MutableConcurrentHashTableTest, InsertFindRemove) {
+  core::RefCountPtr<Table> table(new Table(kNoContext, nullptr));
+  TF_ASSERT_OK(table->Insert(kNoContext, test::AsTensor<int64_t>({1, 2, 3}),
+                             test::AsTensor<int64_t>({10, 20, 30})));
+  EXPECT_EQ(table->size(), 3);
+
+  Tensor values(DT_INT64, TensorShape({4}));
+  TF_ASSERT_OK(table->Find(kNoContext, test::AsTensor<int64_t>({3, 4, 1, 2}),
+                           &values, test::AsTensor<int64_t>({-1})));
+  test::ExpectTensorEqual<int64_t>(values,
+                                   test::AsTensor<int64_t>({30, -1, 10, 20}));
+
+  // Removed keys fall back to the default, and can be inserted again.
+  TF_ASSERT_OK(table->Remove(kNoContext, test::AsTensor<int64_t>({2, 5})));
+  EXPECT_EQ(table->size(), 2);
+  TF_ASSERT_OK(table->Find(kNoContext, test::AsTensor<int64_t>({1, 2, 3, 4}),
+                           &values,
+                           test::AsTensor<int64_t>({-1, -2, -3, -4})));
+  test::ExpectTensorEqual<int64_t>(values,
+                                   test::AsTensor<int64_t>({10, -2, 30, -4}));
+  TF_ASSERT_OK(table->Insert(kNoContext, test::AsTensor<int64_t>({2, 3}),
+                             test::AsTensor<int64_t>({21, 31})));
+  EXPECT_EQ(table->size(), 3);
+  TF_ASSERT_OK(table->Find(kNoContext, test::AsTensor<int64_t>({1, 2, 3, 4}),
+                           &values, test::AsTensor<int64_t>({-1})));
+  test::ExpectTensorEqual<int64_t>(values,
+                                   test::AsTensor<int64_t>({10, 21, 31, -1}));
+}
+
+TEST(MutableConcurrentHashTableTest, GrowsAndShrinks) {
+  const int64_t kSize = 100000;
+  core::RefCountPtr<Table> table(new Table(kNoContext, nullptr));
+  TF_ASSERT_OK(
+      table->Insert(kNoContext, Range(0, kSize), Range(0, kSize, /*scale=*/3)));
+  EXPECT_EQ(table->size(), kSize);
+  const int64_t grown_bytes = table->MemoryUsed();
+
+  Tensor values(DT_INT64, TensorShape({kSize}));
+  TF_ASSERT_OK(table->Find(kNoContext, Range(0, kSize), &values,
+                           test::AsTensor<int64_t>({-1})));
+  test::ExpectTensorEqual<int64_t>(values, Range(0, kSize, /*scale=*/3));
+
+  // Importing replaces the contents and resizes the table to fit.
+  TF_ASSERT_OK(table->ImportValues(kNoContext, test::AsTensor<int64_t>({7}),
+                                   test::AsTensor<int64_t>({70})));
+  EXPECT_EQ(table->size(), 1);
+  EXPECT_LT(table->MemoryUsed(), grown_bytes);
+  Tensor value(DT_INT64, TensorShape({2}));
+  TF_ASSERT_OK(table->Find(kNoContext, test::AsTensor<int64_t>({7, 8}), &value,
+                           test::AsTensor<int64_t>({-1})));
+  test::ExpectTensorEqual<int64_t>(value, test::AsTensor<int64_t>({70, -1}));
+}
+
+TEST(MutableConcurrentHashTableTest, RemovedSlotsAreReclaimed) {
+  core::RefCountPtr<Table> table(new Table(kNoContext, nullptr));
+  TF_ASSERT_OK(table->Insert(kNoContext, Range(0, 1000), Range(0, 1000)));
+  const int64_t bytes = table->MemoryUsed();
+  // Churning through many short-lived keys leaves tombstones behind, which
+  // are dropped whenever a shard is rehashed.
+  for (int64_t begin = 1000; begin < 200000; begin += 1000) {
+    TF_ASSERT_OK(table->Insert(kNoContext, Range(begin, begin + 1000),
+                               Range(begin, begin + 1000)));
+    TF_ASSERT_OK(table->Remove(kNoContext, Range(begin, begin + 1000)));
+  }
+  EXPECT_EQ(table->size(), 1000);
+  EXPECT_LE(table->MemoryUsed(), 4 * bytes);
+
+  Tensor values(DT_INT64, TensorShape({1000}));
+  TF_ASSERT_OK(table->Find(kNoContext, Range(0, 1000), &values,
+                           test::AsTensor<int64_t>({-1})));
+  test::ExpectTensorEqual<int64_t>(values, Range(0, 1000));
+}
+
+TEST(ConcurrentScalarMapTest, ForEachVisitsLiveEntries) {
+  ConcurrentScalarMap<int32, float> map;
+  for (int32 i = 0; i < 100; ++i) map.InsertOrAssign(i, i * 0.5f);
+  for (int32 i = 0; i < 100; i += 3) EXPECT_TRUE(map.Erase(i));
+  EXPECT_FALSE(map.Erase(0));
+
+  std::vector<bool> seen(100, false);
+  ConcurrentScalarMap<int32, float>::ReadScope scope(map);
+  map.ForEach([&](int32 key, float value) {
+    EXPECT_FALSE(seen[key]);
+    EXPECT_EQ(value, key * 0.5f);
+    seen[key] = true;
+  });
+  for (int32 i = 0; i < 100; ++i) EXPECT_EQ(seen[i], i % 3 != 0) << i;
+}
+
+// Readers must always observe either the old or the new value of a key that
+// is being overwritten, while other writers grow, shrink and rehash the same
+// shards underneath them.
+TEST(MutableConcurrentHashTableTest, ConcurrentReadersAndWriters) {
+  const int64_t kStableKeys = 1000;
+  const int64_t kChurnKeys = 5000;
+  const int kReaders = 4, kWriters = 2, kRounds = 20;
+  core::RefCountPtr<Table> table(new Table(kNoContext, nullptr));
+  TF_ASSERT_OK(
+      table->Insert(kNoContext, Range(0, kStableKeys), Range(0, kStableKeys)));
+
+  std::atomic<bool> done(false);
+  std::atomic<int64_t> errors(0);
+  {
+    thread::ThreadPool pool(Env::Default(), "test", kReaders + kWriters);
+    for (int r = 0; r < kReaders; ++r) {
+      pool.Schedule([&] {
+        const Tensor keys = Range(0, kStableKeys);
+        Tensor values(DT_INT64, TensorShape({kStableKeys}));
+        while (!done.load()) {
+          TF_CHECK_OK(table->Find(kNoContext, keys, &values,
+                                  test::AsTensor<int64_t>({-1})));
+          for (int64_t i = 0; i < kStableKeys; ++i) {
+            const int64_t v = values.vec<int64_t>()(i);
+            if (v != i && v != -i) ++errors;
+          }
+        }
+      });
+    }
+    BlockingCounter writers(kWriters);
+    for (int w = 0; w < kWriters; ++w) {
+      pool.Schedule([&, w] {
+        const int64_t begin = kStableKeys + w * kChurnKeys;
+        const Tensor churn = Range(begin, begin + kChurnKeys);
+        for (int round = 0; round < kRounds; ++round) {
+          TF_CHECK_OK(table->Insert(kNoContext, churn, churn));
+          TF_CHECK_OK(table->Insert(
+              kNoContext, Range(0, kStableKeys),
+              Range(0, kStableKeys, /*scale=*/round % 2 ? -1 : 1)));
+          TF_CHECK_OK(table->Remove(kNoContext, churn));
+        }
+        writers.DecrementCount();
+      });
+    }
+    writers.Wait();
+    done = true;
+  }
+  EXPECT_EQ(errors.load(), 0);
+  EXPECT_EQ(table->size(), kStableKeys);
+}
+
+// Serves batches of `kBatchSize` lookups from `num_threads` threads at once.
+// A percentage of the batches insert fresh keys instead, so that readers race
+// with writers growing the table.
+void BM_ConcurrentLookup(::testing::benchmark::State& state) {
+  const int num_threads = state.range(0);
+  const int inserts_per_100 = state.range(1);
+  const int64_t kNumKeys = 1 << 20;
+  const int64_t kBatchSize = 1024;
+  const int kBatchesPerThread = 16;
+
+  core::RefCountPtr<Table> table(new Table(kNoContext, nullptr));
+  TF_CHECK_OK(
+      table->Insert(kNoContext, Range(0, kNumKeys), Range(0, kNumKeys)));
+  thread::ThreadPool pool(Env::Default(), "bench", num_threads);
+  std::atomic<int64_t> next_key(kNumKeys);
+  std::vector<std::unique_ptr<random::PhiloxRandom>> philox;
+  for (int t = 0; t < num_threads; ++t) {
+    philox.push_back(std::make_unique<random::PhiloxRandom>(t, 17));
+  }
+  const Tensor default_value = test::AsTensor<int64_t>({-1});
+
+  for (auto s : state) {
+    BlockingCounter counter(num_threads);
+    for (int t = 0; t < num_threads; ++t) {
+      pool.Schedule([&, t] {
+        random::SimplePhilox rnd(philox[t].get());
+        Tensor keys(DT_INT64, TensorShape({kBatchSize}));
+        Tensor values(DT_INT64, TensorShape({kBatchSize}));
+        for (int b = 0; b < kBatchesPerThread; ++b) {
+          if (rnd.Uniform(100) < inserts_per_100) {
+            const int64_t begin = next_key.fetch_add(kBatchSize);
+            TF_CHECK_OK(table->Insert(kNoContext,
+                                      Range(begin, begin + kBatchSize),
+                                      Range(begin, begin + kBatchSize)));
+          } else {
+            for (int64_t i = 0; i < kBatchSize; ++i) {
+              keys.vec<int64_t>()(i) = rnd.Uniform64(kNumKeys);
+            }
+            TF_CHECK_OK(
+                table->Find(kNoContext, keys, &values, default_value));
+          }
+        }
+        counter.DecrementCount();
+      });
+    }
+    counter.Wait();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          num_threads * kBatchesPerThread * kBatchSize);
+}
+
+// Arguments are the number of threads and the percentage of insert batches.
+BENCHMARK(BM_ConcurrentLookup)
+    ->UseRealTime()
+    ->ArgPair(1, 0)
+    ->ArgPair(4, 0)
+    ->ArgPair(16, 0)
+    ->ArgPair(1, 5)
+    ->ArgPair(4, 5)
+    ->ArgPair(16, 5);
+
+}  // namespace
+}  // namespace lookup
+}  // namespace tensorflow
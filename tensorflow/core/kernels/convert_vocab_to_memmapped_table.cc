@@ -0,0 +1,144 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Converts a text vocabulary file, as read by the InitializeTableFromTextFile
+// initializer, into an image served in place by the MemmappedHashTable op.
+//
+// Example, for a table from each line of `vocab.txt` to its line number:
+//
+//   convert_vocab_to_memmapped_table --vocab_file=vocab.txt \
+//       --output=vocab.table
+//
+// With --package_element, the image is instead written as the only region of
+// a MemmappedFileSystem package, to be opened through a MemmappedEnv as
+// "memmapped_package://<package_element>".
+
+#include <vector>
+
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/kernels/memmapped_lookup_table.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/init_main.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/util/command_line_flags.h"
+#include "tensorflow/core/util/memmapped_file_system.h"
+#include "tensorflow/core/util/memmapped_file_system_writer.h"
+
+namespace tensorflow {
+namespace {
+
+Status ParseDataType(const string& name, DataType* dtype) {
+  if (name == "int64") {
+    *dtype = DT_INT64;
+  } else if (name == "string") {
+    *dtype = DT_STRING;
+  } else {
+    return errors::InvalidArgument("Unsupported dtype ", name,
+                                   ", expected int64 or string");
+  }
+  return absl::OkStatus();
+}
+
+Status Convert(const string& vocab_file, const string& output,
+               const string& package_element, const string& key_dtype_name,
+               const string& value_dtype_name, int32_t key_index,
+               int32_t value_index, const string& delimiter,
+               int64_t vocab_size, int64_t offset) {
+  if (vocab_file.empty() || output.empty()) {
+    return errors::InvalidArgument("--vocab_file and --output are required");
+  }
+  if (delimiter.size() != 1) {
+    return errors::InvalidArgument("--delimiter must be a single character");
+  }
+  DataType key_dtype, value_dtype;
+  TF_RETURN_IF_ERROR(ParseDataType(key_dtype_name, &key_dtype));
+  TF_RETURN_IF_ERROR(ParseDataType(value_dtype_name, &value_dtype));
+
+  Env* env = Env::Default();
+  Tensor image;
+  TF_RETURN_IF_ERROR(lookup::ConvertTextFileToMemmappedHashTable(
+      vocab_file, vocab_size, delimiter[0], key_index, value_index, offset,
+      key_dtype, value_dtype, env, &image));
+
+  if (package_element.empty()) {
+    TF_RETURN_IF_ERROR(lookup::WriteMemmappedHashTable(image, output, env));
+  } else {
+    MemmappedFileSystemWriter writer;
+    TF_RETURN_IF_ERROR(writer.InitializeToFile(env, output));
+    TF_RETURN_IF_ERROR(writer.SaveTensor(
+        image, strings::StrCat(MemmappedFileSystem::kMemmappedPackagePrefix,
+                               package_element)));
+    TF_RETURN_IF_ERROR(writer.FlushAndClose());
+  }
+  LOG(INFO) << "Wrote a table of " << image.NumElements() << " bytes to "
+            << output;
+  return absl::OkStatus();
+}
+
+}  // namespace
+}  // namespace tensorflow
+
+int main(int argc, char* argv[]) {
+  tensorflow::string vocab_file;
+  tensorflow::string output;
+  tensorflow::string package_element;
+  tensorflow::string key_dtype = "string";
+  tensorflow::string value_dtype = "int64";
+  // As in InitializeTableFromTextFile, -2 is the whole line and -1 the line
+  // number.
+  tensorflow::int32 key_index = -2;
+  tensorflow::int32 value_index = -1;
+  tensorflow::string delimiter = "\t";
+  tensorflow::int64 vocab_size = -1;
+  tensorflow::int64 offset = 0;
+  std::vector<tensorflow::Flag> flag_list = {
+      tensorflow::Flag("vocab_file", &vocab_file, "text vocabulary to convert"),
+      tensorflow::Flag("output", &output, "file to write the table image to"),
+      tensorflow::Flag("package_element", &package_element,
+                       "if set, write a MemmappedFileSystem package holding "
+                       "the image under this name"),
+      tensorflow::Flag("key_dtype", &key_dtype, "int64 or string"),
+      tensorflow::Flag("value_dtype", &value_dtype, "int64 or string"),
+      tensorflow::Flag("key_index", &key_index,
+                       "column of the keys, -1 for the line number and -2 for "
+                       "the whole line"),
+      tensorflow::Flag("value_index", &value_index,
+                       "column of the values, -1 for the line number and -2 "
+                       "for the whole line"),
+      tensorflow::Flag("delimiter", &delimiter, "column delimiter"),
+      tensorflow::Flag("vocab_size", &vocab_size,
+                       "number of lines to read, or -1 for all of them"),
+      tensorflow::Flag("offset", &offset, "value added to line numbers"),
+  };
+  const tensorflow::string usage = tensorflow::Flags::Usage(argv[0], flag_list);
+  if (!tensorflow::Flags::Parse(&argc, argv, flag_list) || argc > 1) {
+    LOG(ERROR) << usage;
+    return 1;
+  }
+  tensorflow::port::InitMain(argv[0], &argc, &argv);
+
+  const tensorflow::Status status = tensorflow::Convert(
+      vocab_file, output, package_element, key_dtype, value_dtype, key_index,
+      value_index, delimiter, vocab_size, offset);
+  if (!status.ok()) {
+    LOG(ERROR) << "Conversion failed: " << status;
+    return 1;
+  }
+  return 0;
+}
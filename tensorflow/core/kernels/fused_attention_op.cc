@@ -0,0 +1,264 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// See docs in ../ops/nn_ops.cc.
+
+#define EIGEN_USE_THREADS
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "Eigen/Core"  // from @eigen_archive
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/util/work_sharder.h"
+
+namespace tensorflow {
+namespace {
+
+// Number of query rows attended to by one unit of work, and number of key rows
+// they are compared with at once. A block of scores (64 KiB) stays in the L2
+// cache between the two matrix products that produce and consume it.
+constexpr int64_t kQueryBlockSize = 64;
+constexpr int64_t kKeyBlockSize = 256;
+
+using Matrix =
+    Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+using ConstMatrixMap = Eigen::Map<const Matrix>;
+using MatrixMap = Eigen::Map<Matrix>;
+
+}  // namespace
+
+// Computes BatchMatMul(Softmax(BatchMatMul(query, key, adj_y=True) * scale +
+// mask), value) without materializing the [query length, key length] scores.
+//
+// The query rows of every batch are split into blocks, which are sharded
+// across the CPU worker threads. Each block walks over the keys and values in
+// blocks too, and keeps a running maximum and sum of the exponentiated scores
+// of each query row (the "online softmax"): the output rows accumulate the
+// values weighted by the unnormalized probabilities, and are rescaled whenever
+// the running maximum grows, then normalized once all keys were seen.
+class FusedAttentionOp : public OpKernel {
+ public:
+  explicit FusedAttentionOp(OpKernelConstruction* context)
+      : OpKernel(context) {
+    OP_REQUIRES_OK(context, context->GetAttr("scale", &scale_));
+    int num_args;
+    OP_REQUIRES_OK(context, context->GetAttr("num_args", &num_args));
+    OP_REQUIRES(context, num_args <= 1,
+                errors::InvalidArgument(
+                    "_FusedAttention takes at most one mask, got num_args=",
+                    num_args));
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& query = context->input(0);
+    const Tensor& key = context->input(1);
+    const Tensor& value = context->input(2);
+
+    const int rank = query.dims();
+    OP_REQUIRES(context, rank >= 2,
+                errors::InvalidArgument(
+                    "query must be at least 2 dimensional, got shape ",
+                    query.shape().DebugString()));
+    OP_REQUIRES(
+        context, key.dims() == rank && value.dims() == rank,
+        errors::InvalidArgument(
+            "query, key and value must have the same rank, got shapes ",
+            query.shape().DebugString(), ", ", key.shape().DebugString(),
+            " and ", value.shape().DebugString()));
+    TensorShape output_shape;
+    for (int d = 0; d < rank - 2; ++d) {
+      OP_REQUIRES(
+          context,
+          key.dim_size(d) == query.dim_size(d) &&
+              value.dim_size(d) == query.dim_size(d),
+          errors::InvalidArgument(
+              "query, key and value must have the same batch dimensions, got "
+              "shapes ",
+              query.shape().DebugString(), ", ", key.shape().DebugString(),
+              " and ", value.shape().DebugString()));
+      OP_REQUIRES_OK(context, output_shape.AddDimWithStatus(query.dim_size(d)));
+    }
+    const int64_t query_length = query.dim_size(rank - 2);
+    const int64_t depth = query.dim_size(rank - 1);
+    const int64_t key_length = key.dim_size(rank - 2);
+    const int64_t value_depth = value.dim_size(rank - 1);
+    OP_REQUIRES(context, key.dim_size(rank - 1) == depth,
+                errors::InvalidArgument(
+                    "query and key must have the same depth, got shapes ",
+                    query.shape().DebugString(), " and ",
+                    key.shape().DebugString()));
+    OP_REQUIRES(context, value.dim_size(rank - 2) == key_length,
+                errors::InvalidArgument(
+                    "key and value must have the same length, got shapes ",
+                    key.shape().DebugString(), " and ",
+                    value.shape().DebugString()));
+    const int64_t batch_size = output_shape.num_elements();
+    OP_REQUIRES_OK(context, output_shape.AddDimWithStatus(query_length));
+    OP_REQUIRES_OK(context, output_shape.AddDimWithStatus(value_depth));
+
+    // The mask is broadcast to the shape of the scores, [batch dimensions...,
+    // query length, key length], like the Add it replaces. It is addressed
+    // through strides, which are 0 along the broadcast dimensions.
+    const float* mask_data = nullptr;
+    std::vector<int64_t> mask_batch_offsets;
+    int64_t mask_row_stride = 0;
+    int64_t mask_column_stride = 0;
+    if (context->num_inputs() > 3) {
+      const Tensor& mask = context->input(3);
+      OP_REQUIRES(context, mask.dims() <= rank,
+                  errors::InvalidArgument(
+                      "mask must be broadcastable to the attention scores, "
+                      "got shape ",
+                      mask.shape().DebugString()));
+      std::vector<int64_t> strides(rank, 0);
+      int64_t stride = 1;
+      for (int d = rank - 1, mask_d = mask.dims() - 1; mask_d >= 0;
+           --d, --mask_d) {
+        const int64_t score_size = d == rank - 1   ? key_length
+                                   : d == rank - 2 ? query_length
+                                                   : query.dim_size(d);
+        const int64_t mask_size = mask.dim_size(mask_d);
+        OP_REQUIRES(
+            context, mask_size == 1 || mask_size == score_size,
+            errors::InvalidArgument(
+                "mask must be broadcastable to the attention scores, got "
+                "shape ",
+                mask.shape().DebugString(), " for scores of length ",
+                query_length, " x ", key_length));
+        if (mask_size != 1) strides[d] = stride;
+        stride *= mask_size;
+      }
+      mask_data = mask.flat<float>().data();
+      mask_row_stride = strides[rank - 2];
+      mask_column_stride = strides[rank - 1];
+      mask_batch_offsets.resize(batch_size);
+      for (int64_t b = 0; b < batch_size; ++b) {
+        int64_t offset = 0;
+        int64_t index = b;
+        for (int d = rank - 3; d >= 0; --d) {
+          offset += (index % query.dim_size(d)) * strides[d];
+          index /= query.dim_size(d);
+        }
+        mask_batch_offsets[b] = offset;
+      }
+    }
+
+    Tensor* output = nullptr;
+    OP_REQUIRES_OK(context, context->allocate_output(0, output_shape, &output));
+    if (output->NumElements() == 0) return;
+    if (key_length == 0) {
+      output->flat<float>().setZero();
+      return;
+    }
+
+    const float* query_data = query.flat<float>().data();
+    const float* key_data = key.flat<float>().data();
+    const float* value_data = value.flat<float>().data();
+    float* output_data = output->flat<float>().data();
+    const int64_t num_query_blocks =
+        (query_length + kQueryBlockSize - 1) / kQueryBlockSize;
+    const float scale = scale_;
+
+    auto attend = [&](int64_t begin, int64_t end) {
+      Matrix scores(kQueryBlockSize, kKeyBlockSize);
+      Eigen::VectorXf row_max(kQueryBlockSize);
+      Eigen::VectorXf row_sum(kQueryBlockSize);
+
+      for (int64_t block = begin; block < end; ++block) {
+        const int64_t b = block / num_query_blocks;
+        const int64_t query_begin =
+            (block % num_query_blocks) * kQueryBlockSize;
+        const int64_t query_size =
+            std::min(kQueryBlockSize, query_length - query_begin);
+        ConstMatrixMap q(query_data + (b * query_length + query_begin) * depth,
+                         query_size, depth);
+        // The output rows accumulate the weighted values.
+        MatrixMap out(
+            output_data + (b * query_length + query_begin) * value_depth,
+            query_size, value_depth);
+        out.setZero();
+        row_max.head(query_size)
+            .setConstant(-std::numeric_limits<float>::infinity());
+        row_sum.head(query_size).setZero();
+
+        for (int64_t key_begin = 0; key_begin < key_length;
+             key_begin += kKeyBlockSize) {
+          const int64_t key_size =
+              std::min(kKeyBlockSize, key_length - key_begin);
+          ConstMatrixMap k(key_data + (b * key_length + key_begin) * depth,
+                           key_size, depth);
+          ConstMatrixMap v(
+              value_data + (b * key_length + key_begin) * value_depth,
+              key_size, value_depth);
+          auto s = scores.topLeftCorner(query_size, key_size);
+          s.noalias() = q * k.transpose();
+          if (scale != 1.0f) s *= scale;
+
+          if (mask_data != nullptr) {
+            const float* mask_block = mask_data + mask_batch_offsets[b] +
+                                      query_begin * mask_row_stride +
+                                      key_begin * mask_column_stride;
+            for (int64_t i = 0; i < query_size; ++i) {
+              const float* mask_row = mask_block + i * mask_row_stride;
+              if (mask_column_stride == 0) {
+                s.row(i).array() += *mask_row;
+              } else {
+                s.row(i) += Eigen::Map<const Eigen::RowVectorXf>(mask_row,
+                                                                 key_size);
+              }
+            }
+          }
+
+          for (int64_t i = 0; i < query_size; ++i) {
+            const float new_max = std::max(row_max(i), s.row(i).maxCoeff());
+            if (new_max == -std::numeric_limits<float>::infinity()) {
+              // Every score seen so far is masked out.
+              s.row(i).setZero();
+              continue;
+            }
+            s.row(i) = (s.row(i).array() - new_max).exp().matrix();
+            const float correction = std::exp(row_max(i) - new_max);
+            row_sum(i) = row_sum(i) * correction + s.row(i).sum();
+            if (correction != 1.0f) out.row(i) *= correction;
+            row_max(i) = new_max;
+          }
+          out.noalias() += s * v;
+        }
+
+        for (int64_t i = 0; i < query_size; ++i) out.row(i) /= row_sum(i);
+      }
+    };
+
+    const int64_t cost_per_block =
+        kQueryBlockSize * key_length * (depth + value_depth + 8);
+    auto worker_threads = context->device()->tensorflow_cpu_worker_threads();
+    Shard(worker_threads->num_threads, worker_threads->workers,
+          batch_size * num_query_blocks, cost_per_block, attend);
+  }
+
+ private:
+  float scale_;
+};
+
+REGISTER_KERNEL_BUILDER(
+    Name("_FusedAttention").Device(DEVICE_CPU).TypeConstraint<float>("T"),
+    FusedAttentionOp);
+
+}  // namespace tensorflow
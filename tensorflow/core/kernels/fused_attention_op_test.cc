@@ -0,0 +1,262 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/framework/types.pb.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/graph/testlib.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/kernels/ops_util.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace {
+
+// Returns the mask value added to the score of query `i` and key `j` of batch
+// `b`.
+using MaskFn = std::function<float(int64_t b, int64_t i, int64_t j)>;
+
+// Computes the attention of [batch, length, depth] inputs one score at a time.
+Tensor ReferenceAttention(const Tensor& query, const Tensor& key,
+                          const Tensor& value, float scale,
+                          const MaskFn& mask) {
+  const int64_t batch_size = query.dim_size(0);
+  const int64_t query_length = query.dim_size(1);
+  const int64_t depth = query.dim_size(2);
+  const int64_t key_length = key.dim_size(1);
+  const int64_t value_depth = value.dim_size(2);
+  auto q = query.tensor<float, 3>();
+  auto k = key.tensor<float, 3>();
+  auto v = value.tensor<float, 3>();
+
+  Tensor output(DT_FLOAT, TensorShape({batch_size, query_length, value_depth}));
+  auto out = output.tensor<float, 3>();
+  for (int64_t b = 0; b < batch_size; ++b) {
+    for (int64_t i = 0; i < query_length; ++i) {
+      std::vector<double> scores(key_length);
+      double max_score = -INFINITY;
+      for (int64_t j = 0; j < key_length; ++j) {
+        double score = 0;
+        for (int64_t d = 0; d < depth; ++d) score += q(b, i, d) * k(b, j, d);
+        scores[j] = score * scale + (mask ? mask(b, i, j) : 0.0f);
+        max_score = std::max(max_score, scores[j]);
+      }
+      double sum = 0;
+      for (double& score : scores) {
+        score = std::exp(score - max_score);
+        sum += score;
+      }
+      for (int64_t d = 0; d < value_depth; ++d) {
+        double weighted = 0;
+        for (int64_t j = 0; j < key_length; ++j) {
+          weighted += scores[j] * v(b, j, d);
+        }
+        out(b, i, d) = weighted / sum;
+      }
+    }
+  }
+  return output;
+}
+
+class FusedAttentionOpTest : public OpsTestBase {
+ protected:
+  void MakeOp(int num_args, float scale) {
+    TF_ASSERT_OK(NodeDefBuilder("attention", "_FusedAttention")
+                     .Input(FakeInput(DT_FLOAT))
+                     .Input(FakeInput(DT_FLOAT))
+                     .Input(FakeInput(DT_FLOAT))
+                     .Input(FakeInput(num_args, DT_FLOAT))
+                     .Attr("num_args", num_args)
+                     .Attr("scale", scale)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+  }
+
+  Tensor AddRandomInput(const TensorShape& shape) {
+    Tensor* input = AddInput(DT_FLOAT, shape);
+    input->flat<float>().setRandom();
+    return *input;
+  }
+};
+
+TEST_F(FusedAttentionOpTest, Small) {
+  MakeOp(/*num_args=*/0, /*scale=*/1.0f);
+  AddInputFromArray<float>(TensorShape({1, 2, 1}), {0, 1});
+  AddInputFromArray<float>(TensorShape({1, 2, 1}), {0, std::log(3.0f)});
+  AddInputFromArray<float>(TensorShape({1, 2, 2}), {4, 0, 0, 8});
+  TF_ASSERT_OK(RunOpKernel());
+
+  // The first query attends equally to both keys, the second one three times
+  // more to the second key.
+  Tensor expected(allocator(), DT_FLOAT, TensorShape({1, 2, 2}));
+  test::FillValues<float>(&expected, {2, 4, 1, 6});
+  test::ExpectTensorNear<float>(expected, *GetOutput(0), 1e-5);
+}
+
+TEST_F(FusedAttentionOpTest, MultipleBlocks) {
+  // Lengths that are not multiples of the query and key block sizes.
+  const int64_t kBatch = 3, kQueryLength = 70, kKeyLength = 300;
+  const int64_t kDepth = 16, kValueDepth = 8;
+  const float kScale = 0.25f;
+  MakeOp(/*num_args=*/0, kScale);
+  Tensor query = AddRandomInput({kBatch, kQueryLength, kDepth});
+  Tensor key = AddRandomInput({kBatch, kKeyLength, kDepth});
+  Tensor value = AddRandomInput({kBatch, kKeyLength, kValueDepth});
+  TF_ASSERT_OK(RunOpKernel());
+
+  test::ExpectTensorNear<float>(
+      ReferenceAttention(query, key, value, kScale, nullptr), *GetOutput(0),
+      1e-5);
+}
+
+TEST_F(FusedAttentionOpTest, BroadcastMask) {
+  // [batch, heads, length, depth] inputs with a padding mask of shape
+  // [batch, 1, 1, key length], as Keras builds it.
+  const int64_t kBatch = 2, kHeads = 3, kQueryLength = 5, kKeyLength = 270;
+  const int64_t kDepth = 4;
+  MakeOp(/*num_args=*/1, /*scale=*/0.5f);
+  Tensor query = AddRandomInput({kBatch, kHeads, kQueryLength, kDepth});
+  Tensor key = AddRandomInput({kBatch, kHeads, kKeyLength, kDepth});
+  Tensor value = AddRandomInput({kBatch, kHeads, kKeyLength, kDepth});
+  Tensor* mask = AddInput(DT_FLOAT, TensorShape({kBatch, 1, 1, kKeyLength}));
+  auto mask_flat = mask->flat<float>();
+  for (int64_t b = 0; b < kBatch; ++b) {
+    for (int64_t j = 0; j < kKeyLength; ++j) {
+      // The second batch has fewer valid keys.
+      mask_flat(b * kKeyLength + j) = j < kKeyLength - 100 * b ? 0.0f : -1e9f;
+    }
+  }
+  TF_ASSERT_OK(RunOpKernel());
+
+  // Reference on [batch * heads, length, depth] views of the inputs.
+  const auto reshape = [](const Tensor& t) {
+    Tensor reshaped;
+    CHECK(reshaped.CopyFrom(
+        t, TensorShape({kBatch * kHeads, t.dim_size(2), t.dim_size(3)})));
+    return reshaped;
+  };
+  Tensor expected_3d = ReferenceAttention(
+      reshape(query), reshape(key), reshape(value), 0.5f,
+      [&](int64_t b, int64_t i, int64_t j) {
+        return mask_flat(b / kHeads * kKeyLength + j);
+      });
+  Tensor expected;
+  CHECK(expected.CopyFrom(expected_3d, GetOutput(0)->shape()));
+  test::ExpectTensorNear<float>(expected, *GetOutput(0), 1e-5);
+}
+
+TEST_F(FusedAttentionOpTest, MismatchedDepth) {
+  MakeOp(/*num_args=*/0, /*scale=*/1.0f);
+  AddInputFromArray<float>(TensorShape({1, 2, 3}), {0, 0, 0, 0, 0, 0});
+  AddInputFromArray<float>(TensorShape({1, 3, 2}), {0, 0, 0, 0, 0, 0});
+  AddInputFromArray<float>(TensorShape({1, 3, 1}), {0, 0, 0});
+  Status status = RunOpKernel();
+  EXPECT_TRUE(absl::StrContains(status.message(),
+                                "query and key must have the same depth"))
+      << status;
+}
+
+TEST_F(FusedAttentionOpTest, MaskNotBroadcastable) {
+  MakeOp(/*num_args=*/1, /*scale=*/1.0f);
+  AddInputFromArray<float>(TensorShape({1, 2, 1}), {0, 0});
+  AddInputFromArray<float>(TensorShape({1, 3, 1}), {0, 0, 0});
+  AddInputFromArray<float>(TensorShape({1, 3, 1}), {0, 0, 0});
+  AddInputFromArray<float>(TensorShape({2}), {0, 0});
+  Status status = RunOpKernel();
+  EXPECT_TRUE(absl::StrContains(status.message(),
+                                "mask must be broadcastable"))
+      << status;
+}
+
+// Self-attention of `heads` heads of depth 64 over `length` tokens. Compares
+// the fused op with the BatchMatMulV2 + Mul + Softmax + BatchMatMulV2 graph
+// it replaces, which materializes the [length, length] scores of every head.
+static Graph* SelfAttention(int heads, int length, bool fused) {
+  Graph* g = new Graph(OpRegistry::Global());
+  const int kDepth = 64;
+  const float scale = 1.0f / std::sqrt(static_cast<float>(kDepth));
+
+  Tensor qkv(DT_FLOAT, TensorShape({1, heads, length, kDepth}));
+  qkv.flat<float>().setRandom();
+  Node* query = test::graph::Constant(g, qkv);
+  Node* key = test::graph::Constant(g, qkv);
+  Node* value = test::graph::Constant(g, qkv);
+  Node* node;
+  if (fused) {
+    TF_CHECK_OK(NodeBuilder(g->NewName("n"), "_FusedAttention")
+                    .Input(query)
+                    .Input(key)
+                    .Input(value)
+                    .Input(std::vector<NodeBuilder::NodeOut>())
+                    .Attr("num_args", 0)
+                    .Attr("scale", scale)
+                    .Finalize(g, &node));
+  } else {
+    Node* scores;
+    TF_CHECK_OK(NodeBuilder(g->NewName("n"), "BatchMatMulV2")
+                    .Input(query)
+                    .Input(key)
+                    .Attr("adj_y", true)
+                    .Finalize(g, &scores));
+    Tensor scale_tensor(DT_FLOAT, TensorShape({}));
+    scale_tensor.scalar<float>()() = scale;
+    Node* scaled = test::graph::Binary(
+        g, "Mul", scores, test::graph::Constant(g, scale_tensor));
+    Node* probabilities = test::graph::Unary(g, "Softmax", scaled);
+    TF_CHECK_OK(NodeBuilder(g->NewName("n"), "BatchMatMulV2")
+                    .Input(probabilities)
+                    .Input(value)
+                    .Finalize(g, &node));
+  }
+  return g;
+}
+
+#define BM_SELF_ATTENTION(HEADS, LENGTH)                                      \
+  static void BM_SelfAttention_##HEADS##_##LENGTH(                            \
+      ::testing::benchmark::State& state) {                                   \
+    const bool fused = state.range(0);                                        \
+    test::Benchmark("cpu", SelfAttention(HEADS, LENGTH, fused),               \
+                    /*old_benchmark_api=*/false)                              \
+        .Run(state);                                                          \
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *        \
+                            HEADS * LENGTH * LENGTH);                         \
+  }                                                                           \
+  BENCHMARK(BM_SelfAttention_##HEADS##_##LENGTH)                              \
+      ->UseRealTime()                                                         \
+      ->Arg(0)                                                                \
+      ->Arg(1);
+
+BM_SELF_ATTENTION(8, 128);
+BM_SELF_ATTENTION(8, 512);
+BM_SELF_ATTENTION(8, 1024);
+BM_SELF_ATTENTION(4, 2048);
+BM_SELF_ATTENTION(4, 4096);
+BM_SELF_ATTENTION(4, 8192);
+
+}  // namespace
+}  // namespace tensorflow
@@ -0,0 +1,240 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// See docs in ../ops/math_ops.cc.
+
+#define EIGEN_USE_THREADS
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <vector>
+
+#include "Eigen/Core"  // from @eigen_archive
+#include "tensorflow/core/framework/bounds_check.h"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/register_types.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/platform/prefetch.h"
+#include "tensorflow/core/util/work_sharder.h"
+
+namespace tensorflow {
+namespace {
+
+// How many (index, segment id) pairs ahead of the accumulation to prefetch the
+// embedding rows. Rows are usually scattered across a table much larger than
+// the caches, so the reduction is bound by the latency of these loads.
+constexpr int64_t kPrefetchDistance = 8;
+constexpr int64_t kCacheLineSize = 64;
+// Only the head of very wide rows is prefetched; the hardware prefetcher picks
+// up the sequential remainder.
+constexpr int64_t kMaxPrefetchBytes = 16 * kCacheLineSize;
+
+template <typename T>
+EIGEN_ALWAYS_INLINE void PrefetchRow(const T* row, int64_t row_bytes) {
+  const char* bytes = reinterpret_cast<const char*>(row);
+  const int64_t limit = std::min(row_bytes, kMaxPrefetchBytes);
+  for (int64_t offset = 0; offset < limit; offset += kCacheLineSize) {
+    port::prefetch<port::PREFETCH_HINT_T0>(bytes + offset);
+  }
+}
+
+}  // namespace
+
+// Computes SparseSegment{Sum,Mean,SqrtN}(Gather(params, ids), indices,
+// segment_ids) without materializing the gathered rows.
+//
+// The rows of `params` referenced by each (index, segment id) pair are resolved
+// and validated up front, after which every output row is reduced
+// independently: the output rows are sharded across the CPU worker threads,
+// and each shard accumulates its rows in float with vectorized adds while
+// prefetching the embedding rows it is about to read.
+template <typename T, typename Tindices, typename Tidx, typename Tsegmentids>
+class FusedGatherSparseSegmentReductionOp : public OpKernel {
+ public:
+  explicit FusedGatherSparseSegmentReductionOp(OpKernelConstruction* context)
+      : OpKernel(context) {
+    string combiner;
+    OP_REQUIRES_OK(context, context->GetAttr("combiner", &combiner));
+    is_mean_ = combiner == "mean";
+    is_sqrtn_ = combiner == "sqrtn";
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& params = context->input(0);
+    const Tensor& ids = context->input(1);
+    const Tensor& indices = context->input(2);
+    const Tensor& segment_ids = context->input(3);
+
+    OP_REQUIRES(context, TensorShapeUtils::IsVectorOrHigher(params.shape()),
+                errors::InvalidArgument(
+                    "params must be at least 1 dimensional, got shape ",
+                    params.shape().DebugString()));
+    OP_REQUIRES(context, TensorShapeUtils::IsVector(ids.shape()),
+                errors::InvalidArgument("ids should be a vector, got shape ",
+                                        ids.shape().DebugString()));
+    OP_REQUIRES(context, TensorShapeUtils::IsVector(indices.shape()),
+                errors::InvalidArgument(
+                    "indices should be a vector, got shape ",
+                    indices.shape().DebugString()));
+    OP_REQUIRES(context, TensorShapeUtils::IsVector(segment_ids.shape()),
+                errors::InvalidArgument(
+                    "segment_ids should be a vector, got shape ",
+                    segment_ids.shape().DebugString()));
+    const int64_t num_indices = indices.NumElements();
+    OP_REQUIRES(context, num_indices == segment_ids.NumElements(),
+                errors::InvalidArgument(
+                    "segment_ids and indices should have same size, got ",
+                    segment_ids.NumElements(), " vs ", num_indices));
+
+    auto params_flat = params.flat_outer_dims<T>();
+    const int64_t num_rows = params_flat.dimension(0);
+    const int64_t num_col = params_flat.dimension(1);
+    const auto ids_vec = ids.vec<Tindices>();
+    const int64_t num_ids = ids_vec.dimension(0);
+    const auto indices_vec = indices.vec<Tidx>();
+    const auto segment_vec = segment_ids.vec<Tsegmentids>();
+
+    // Gather rejects every out of range id, whether or not the segment
+    // reduction reads it, so the fused op does too.
+    for (int64_t i = 0; i < num_ids; ++i) {
+      const Tindices id = internal::SubtleMustCopy(ids_vec(i));
+      OP_REQUIRES(context, FastBoundsCheck(id, num_rows),
+                  errors::InvalidArgument("ids[", i, "] = ", id,
+                                          " is not in [0, ", num_rows, ")"));
+    }
+
+    // Resolve the row of `params` read by each (index, segment id) pair, so
+    // that the reduction below neither branches nor chases two indirections.
+    std::vector<int64_t> rows(num_indices);
+    Tsegmentids previous_segment_id = 0;
+    for (int64_t i = 0; i < num_indices; ++i) {
+      const Tidx index = internal::SubtleMustCopy(indices_vec(i));
+      OP_REQUIRES(context, FastBoundsCheck(index, num_ids),
+                  errors::InvalidArgument("Bad: indices[", i, "] == ", index,
+                                          " out of range [0, ", num_ids, ")"));
+      const Tsegmentids segment_id = internal::SubtleMustCopy(segment_vec(i));
+      OP_REQUIRES(context, segment_id >= previous_segment_id,
+                  errors::InvalidArgument(
+                      i == 0 ? "segment ids must be >= 0"
+                             : "segment ids are not increasing"));
+      previous_segment_id = segment_id;
+      rows[i] = internal::SubtleMustCopy(ids_vec(index));
+    }
+
+    const int64_t output_rows =
+        num_indices > 0 ? static_cast<int64_t>(segment_vec(num_indices - 1)) + 1
+                        : 0;
+    TensorShape output_shape = params.shape();
+    OP_REQUIRES_OK(context, output_shape.SetDimWithStatus(0, output_rows));
+    Tensor* output = nullptr;
+    OP_REQUIRES_OK(context, context->allocate_output(0, output_shape, &output));
+    if (output_rows == 0 || num_col == 0) return;
+    auto output_flat = output->flat_outer_dims<T>();
+
+    const T* params_data = params_flat.data();
+    const Tsegmentids* segment_data = segment_vec.data();
+    const int64_t row_bytes = num_col * sizeof(T);
+
+    auto reduce_rows = [&](int64_t begin, int64_t end) {
+      using Row = Eigen::Map<const Eigen::Array<T, Eigen::Dynamic, 1>>;
+      using Accumulator = Eigen::Map<Eigen::Array<float, Eigen::Dynamic, 1>>;
+      // float rows are accumulated in place, bfloat16 rows in a scratch buffer
+      // that is rounded once per output row.
+      std::vector<float> scratch(std::is_same<T, float>::value ? 0 : num_col);
+
+      int64_t i = std::lower_bound(segment_data, segment_data + num_indices,
+                                   static_cast<Tsegmentids>(begin)) -
+                  segment_data;
+      for (int64_t out_row = begin; out_row < end; ++out_row) {
+        float* acc_data;
+        if constexpr (std::is_same<T, float>::value) {
+          acc_data = &output_flat(out_row, 0);
+        } else {
+          acc_data = scratch.data();
+        }
+        Accumulator acc(acc_data, num_col);
+        acc.setZero();
+
+        int64_t count = 0;
+        for (; i < num_indices && segment_data[i] == out_row; ++i, ++count) {
+          if (i + kPrefetchDistance < num_indices) {
+            PrefetchRow(params_data + rows[i + kPrefetchDistance] * num_col,
+                        row_bytes);
+          }
+          acc += Row(params_data + rows[i] * num_col, num_col)
+                     .template cast<float>();
+        }
+
+        if (count > 1) {
+          if (is_mean_) {
+            acc /= static_cast<float>(count);
+          } else if (is_sqrtn_) {
+            acc /= std::sqrt(static_cast<float>(count));
+          }
+        }
+        if constexpr (!std::is_same<T, float>::value) {
+          Eigen::Map<Eigen::Array<T, Eigen::Dynamic, 1>>(
+              &output_flat(out_row, 0), num_col) = acc.template cast<T>();
+        }
+      }
+    };
+
+    const int64_t cost_per_row =
+        (num_indices / output_rows + 1) * num_col * sizeof(T);
+    auto worker_threads = context->device()->tensorflow_cpu_worker_threads();
+    Shard(worker_threads->num_threads, worker_threads->workers, output_rows,
+          cost_per_row, reduce_rows);
+  }
+
+ private:
+  bool is_mean_;
+  bool is_sqrtn_;
+};
+
+#define REGISTER_CPU_KERNEL(type, index_type, segment_ids_type)         \
+  REGISTER_KERNEL_BUILDER(                                              \
+      Name("_FusedGatherSparseSegmentReduction")                        \
+          .Device(DEVICE_CPU)                                           \
+          .TypeConstraint<type>("T")                                    \
+          .TypeConstraint<int32>("Tindices")                            \
+          .TypeConstraint<index_type>("Tidx")                           \
+          .TypeConstraint<segment_ids_type>("Tsegmentids"),             \
+      FusedGatherSparseSegmentReductionOp<type, int32, index_type,      \
+                                          segment_ids_type>);           \
+  REGISTER_KERNEL_BUILDER(                                              \
+      Name("_FusedGatherSparseSegmentReduction")                        \
+          .Device(DEVICE_CPU)                                           \
+          .TypeConstraint<type>("T")                                    \
+          .TypeConstraint<int64_t>("Tindices")                          \
+          .TypeConstraint<index_type>("Tidx")                           \
+          .TypeConstraint<segment_ids_type>("Tsegmentids"),             \
+      FusedGatherSparseSegmentReductionOp<type, int64_t, index_type,    \
+                                          segment_ids_type>);
+
+#define REGISTER_CPU_KERNEL_ALL_INDICES(type) \
+  REGISTER_CPU_KERNEL(type, int32, int32);    \
+  REGISTER_CPU_KERNEL(type, int32, int64_t);  \
+  REGISTER_CPU_KERNEL(type, int64_t, int32);  \
+  REGISTER_CPU_KERNEL(type, int64_t, int64_t);
+
+TF_CALL_float(REGISTER_CPU_KERNEL_ALL_INDICES);
+TF_CALL_bfloat16(REGISTER_CPU_KERNEL_ALL_INDICES);
+
+#undef REGISTER_CPU_KERNEL_ALL_INDICES
+#undef REGISTER_CPU_KERNEL
+
+}  // namespace tensorflow
@@ -0,0 +1,243 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/framework/types.pb.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/graph/testlib.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/kernels/ops_util.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/random/simple_philox.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace {
+
+class FusedGatherSparseSegmentReductionOpTest : public OpsTestBase {
+ protected:
+  void MakeOp(DataType dtype, const string& combiner) {
+    TF_ASSERT_OK(NodeDefBuilder("fused", "_FusedGatherSparseSegmentReduction")
+                     .Input(FakeInput(dtype))
+                     .Input(FakeInput(DT_INT64))
+                     .Input(FakeInput(DT_INT32))
+                     .Input(FakeInput(DT_INT32))
+                     .Attr("combiner", combiner)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+  }
+};
+
+TEST_F(FusedGatherSparseSegmentReductionOpTest, Sum) {
+  MakeOp(DT_FLOAT, "sum");
+  AddInputFromArray<float>(TensorShape({4, 2}), {1, 2, 3, 4, 5, 6, 7, 8});
+  AddInputFromArray<int64_t>(TensorShape({3}), {3, 0, 2});
+  AddInputFromArray<int32>(TensorShape({4}), {0, 1, 2, 2});
+  AddInputFromArray<int32>(TensorShape({4}), {0, 0, 1, 3});
+  TF_ASSERT_OK(RunOpKernel());
+
+  // Gathered rows are {7, 8}, {1, 2}, {5, 6}; segment 2 is empty.
+  Tensor expected(allocator(), DT_FLOAT, TensorShape({4, 2}));
+  test::FillValues<float>(&expected, {8, 10, 5, 6, 0, 0, 5, 6});
+  test::ExpectTensorEqual<float>(expected, *GetOutput(0));
+}
+
+TEST_F(FusedGatherSparseSegmentReductionOpTest, Mean) {
+  MakeOp(DT_FLOAT, "mean");
+  AddInputFromArray<float>(TensorShape({3, 1}), {2, 4, 9});
+  AddInputFromArray<int64_t>(TensorShape({3}), {0, 1, 2});
+  AddInputFromArray<int32>(TensorShape({4}), {0, 1, 1, 2});
+  AddInputFromArray<int32>(TensorShape({4}), {0, 0, 0, 1});
+  TF_ASSERT_OK(RunOpKernel());
+
+  Tensor expected(allocator(), DT_FLOAT, TensorShape({2, 1}));
+  test::FillValues<float>(&expected, {10.0f / 3, 9});
+  test::ExpectTensorNear<float>(expected, *GetOutput(0), 1e-6);
+}
+
+TEST_F(FusedGatherSparseSegmentReductionOpTest, SqrtNBfloat16) {
+  MakeOp(DT_BFLOAT16, "sqrtn");
+  AddInputFromArray<bfloat16>(
+      TensorShape({2, 2}),
+      {bfloat16(1.0f), bfloat16(2.0f), bfloat16(3.0f), bfloat16(4.0f)});
+  AddInputFromArray<int64_t>(TensorShape({2}), {1, 0});
+  AddInputFromArray<int32>(TensorShape({4}), {0, 0, 0, 0});
+  AddInputFromArray<int32>(TensorShape({4}), {0, 0, 0, 0});
+  TF_ASSERT_OK(RunOpKernel());
+
+  Tensor expected(allocator(), DT_BFLOAT16, TensorShape({1, 2}));
+  test::FillValues<bfloat16>(&expected, {bfloat16(6.0f), bfloat16(8.0f)});
+  test::ExpectTensorEqual<bfloat16>(expected, *GetOutput(0));
+}
+
+TEST_F(FusedGatherSparseSegmentReductionOpTest, OutOfRangeId) {
+  MakeOp(DT_FLOAT, "sum");
+  AddInputFromArray<float>(TensorShape({2, 1}), {1, 2});
+  // The bad id is not referenced by `indices`, but Gather would reject it.
+  AddInputFromArray<int64_t>(TensorShape({2}), {0, 2});
+  AddInputFromArray<int32>(TensorShape({1}), {0});
+  AddInputFromArray<int32>(TensorShape({1}), {0});
+  Status s = RunOpKernel();
+  EXPECT_TRUE(absl::StrContains(s.message(), "ids[1] = 2 is not in [0, 2)"))
+      << s;
+}
+
+TEST_F(FusedGatherSparseSegmentReductionOpTest, OutOfRangeIndex) {
+  MakeOp(DT_FLOAT, "sum");
+  AddInputFromArray<float>(TensorShape({2, 1}), {1, 2});
+  AddInputFromArray<int64_t>(TensorShape({2}), {0, 1});
+  AddInputFromArray<int32>(TensorShape({2}), {0, 2});
+  AddInputFromArray<int32>(TensorShape({2}), {0, 0});
+  Status s = RunOpKernel();
+  EXPECT_TRUE(absl::StrContains(s.message(), "indices[1] == 2 out of range"))
+      << s;
+}
+
+TEST_F(FusedGatherSparseSegmentReductionOpTest, UnsortedSegmentIds) {
+  MakeOp(DT_FLOAT, "sum");
+  AddInputFromArray<float>(TensorShape({2, 1}), {1, 2});
+  AddInputFromArray<int64_t>(TensorShape({2}), {0, 1});
+  AddInputFromArray<int32>(TensorShape({2}), {0, 1});
+  AddInputFromArray<int32>(TensorShape({2}), {1, 0});
+  Status s = RunOpKernel();
+  EXPECT_TRUE(absl::StrContains(s.message(), "segment ids are not increasing"))
+      << s;
+}
+
+// Large inputs are reduced on multiple threads; the result must match the
+// unfused Gather + SparseSegmentSum reference regardless of the sharding.
+TEST_F(FusedGatherSparseSegmentReductionOpTest, LargeInputMatchesReference) {
+  MakeOp(DT_FLOAT, "sum");
+  const int kRows = 1000, kDim = 16, kIds = 500, kIndices = 20000;
+  random::PhiloxRandom philox(17, 42);
+  random::SimplePhilox rnd(&philox);
+
+  std::vector<float> params(kRows * kDim);
+  for (float& x : params) x = rnd.RandFloat();
+  std::vector<int64_t> ids(kIds);
+  for (int64_t& id : ids) id = rnd.Uniform(kRows);
+  std::vector<int32> indices(kIndices), segment_ids(kIndices);
+  int32 segment = 0;
+  for (int i = 0; i < kIndices; ++i) {
+    indices[i] = rnd.Uniform(kIds);
+    segment += rnd.Uniform(3) == 0;
+    segment_ids[i] = segment;
+  }
+  const int num_segments = segment + 1;
+
+  std::vector<float> expected(num_segments * kDim, 0.0f);
+  for (int i = 0; i < kIndices; ++i) {
+    for (int j = 0; j < kDim; ++j) {
+      expected[segment_ids[i] * kDim + j] +=
+          params[ids[indices[i]] * kDim + j];
+    }
+  }
+
+  AddInputFromArray<float>(TensorShape({kRows, kDim}), params);
+  AddInputFromArray<int64_t>(TensorShape({kIds}), ids);
+  AddInputFromArray<int32>(TensorShape({kIndices}), indices);
+  AddInputFromArray<int32>(TensorShape({kIndices}), segment_ids);
+  TF_ASSERT_OK(RunOpKernel());
+  test::ExpectTensorNear<float>(
+      test::AsTensor<float>(expected, TensorShape({num_segments, kDim})),
+      *GetOutput(0), 1e-4);
+}
+
+// Embedding lookup with `num_ids` unique ids into a `num_rows` x `dim` table,
+// reduced into bags of 16 ids. Compares the fused op with the GatherV2 +
+// SparseSegmentSum pair it replaces.
+static Graph* EmbeddingLookup(int num_rows, int dim, int num_ids, bool fused) {
+  Graph* g = new Graph(OpRegistry::Global());
+  random::PhiloxRandom philox(301, 17);
+  random::SimplePhilox rnd(&philox);
+
+  Tensor params(DT_FLOAT, TensorShape({num_rows, dim}));
+  params.flat<float>().setRandom();
+  Tensor ids(DT_INT64, TensorShape({num_ids}));
+  for (int i = 0; i < num_ids; ++i) {
+    ids.vec<int64_t>()(i) = rnd.Uniform(num_rows);
+  }
+  const int kBagSize = 16;
+  const int num_indices = num_ids * 4;
+  Tensor indices(DT_INT32, TensorShape({num_indices}));
+  Tensor segment_ids(DT_INT32, TensorShape({num_indices}));
+  for (int i = 0; i < num_indices; ++i) {
+    indices.vec<int32>()(i) = rnd.Uniform(num_ids);
+    segment_ids.vec<int32>()(i) = i / kBagSize;
+  }
+
+  Node* params_node = test::graph::Constant(g, params);
+  Node* ids_node = test::graph::Constant(g, ids);
+  Node* indices_node = test::graph::Constant(g, indices);
+  Node* segment_ids_node = test::graph::Constant(g, segment_ids);
+  Node* node;
+  if (fused) {
+    TF_CHECK_OK(
+        NodeBuilder(g->NewName("n"), "_FusedGatherSparseSegmentReduction")
+            .Input(params_node)
+            .Input(ids_node)
+            .Input(indices_node)
+            .Input(segment_ids_node)
+            .Attr("combiner", "sum")
+            .Finalize(g, &node));
+  } else {
+    Tensor axis(DT_INT32, TensorShape({}));
+    axis.scalar<int32>()() = 0;
+    Node* gather;
+    TF_CHECK_OK(NodeBuilder(g->NewName("n"), "GatherV2")
+                    .Input(params_node)
+                    .Input(ids_node)
+                    .Input(test::graph::Constant(g, axis))
+                    .Finalize(g, &gather));
+    TF_CHECK_OK(NodeBuilder(g->NewName("n"), "SparseSegmentSum")
+                    .Input(gather)
+                    .Input(indices_node)
+                    .Input(segment_ids_node)
+                    .Finalize(g, &node));
+  }
+  return g;
+}
+
+#define BM_EMBEDDING_LOOKUP(ROWS, DIM, IDS)                                   \
+  static void BM_EmbeddingLookup_##ROWS##_##DIM##_##IDS(                      \
+      ::testing::benchmark::State& state) {                                   \
+    const bool fused = state.range(0);                                        \
+    test::Benchmark("cpu", EmbeddingLookup(ROWS, DIM, IDS, fused),            \
+                    /*old_benchmark_api=*/false)                              \
+        .Run(state);                                                          \
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * IDS * \
+                            4);                                               \
+  }                                                                           \
+  BENCHMARK(BM_EmbeddingLookup_##ROWS##_##DIM##_##IDS)                        \
+      ->UseRealTime()                                                         \
+      ->Arg(0)                                                                \
+      ->Arg(1);
+
+BM_EMBEDDING_LOOKUP(100000, 32, 4096);
+BM_EMBEDDING_LOOKUP(100000, 128, 4096);
+BM_EMBEDDING_LOOKUP(1000000, 64, 16384);
+BM_EMBEDDING_LOOKUP(1000000, 256, 16384);
+
+}  // namespace
+}  // namespace tensorflow
@@ -0,0 +1,418 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// See docs in ../ops/image_ops.cc
+
+#define EIGEN_USE_THREADS
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "tensorflow/core/framework/bounds_check.h"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/op_requires.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/tensor_types.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/lib/gif/gif_io.h"
+#include "tensorflow/core/lib/gtl/cleanup.h"
+#include "tensorflow/core/lib/jpeg/jpeg_mem.h"
+#include "tensorflow/core/lib/png/png_io.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/stringpiece.h"
+#include "tensorflow/core/platform/tstring.h"
+#include "tensorflow/core/util/image_resizer_state.h"
+#include "tensorflow/core/util/work_sharder.h"
+
+namespace tensorflow {
+namespace {
+
+// Magic bytes of the formats DecodeJpeg accepts, see decode_image_op.cc.
+static const char kPngMagicBytes[] = "\x89\x50\x4E\x47\x0D\x0A\x1A\x0A";
+static const char kGifMagicBytes[] = "\x47\x49\x46\x38";
+static const char kJpegMagicBytes[] = "\xff\xd8\xff";
+
+// Returns the largest denominator of the libjpeg DCT scaling, among 8, 4, 2
+// and 1, that decodes a `width` x `height` image to at least `out_width` x
+// `out_height` pixels. The resize that follows then only ever downsamples,
+// from at most twice the output size along the most reduced dimension.
+int ChooseJpegRatio(int width, int height, int64_t out_width,
+                    int64_t out_height) {
+  for (int ratio = 8; ratio > 1; ratio /= 2) {
+    // libjpeg rounds the scaled dimensions up.
+    if ((width + ratio - 1) / ratio >= out_width &&
+        (height + ratio - 1) / ratio >= out_height) {
+      return ratio;
+    }
+  }
+  return 1;
+}
+
+// Same as in resize_bilinear_op.cc.
+struct CachedInterpolation {
+  int64_t lower;
+  int64_t upper;
+  float lerp;
+};
+
+template <typename Scaler>
+void ComputeInterpolationWeights(const Scaler scaler, const int64_t out_size,
+                                 const int64_t in_size, const float scale,
+                                 CachedInterpolation* interpolation) {
+  for (int64_t i = 0; i < out_size; ++i) {
+    const float in = scaler(i, scale);
+    const float in_f = std::floor(in);
+    interpolation[i].lower =
+        std::max(static_cast<int64_t>(in_f), static_cast<int64_t>(0));
+    interpolation[i].upper =
+        std::min(static_cast<int64_t>(std::ceil(in)), in_size - 1);
+    interpolation[i].lerp = in - in_f;
+  }
+}
+
+// Interpolates the input row `in` horizontally into the `xs.size()` output
+// columns of `out`. The lower and upper indices in `xs` are premultiplied by
+// the number of channels.
+template <int kChannels>
+void InterpolateRow(const uint8* in, const std::vector<CachedInterpolation>& xs,
+                    float* out) {
+  for (const CachedInterpolation& x : xs) {
+    const uint8* left = in + x.lower;
+    const uint8* right = in + x.upper;
+    for (int c = 0; c < kChannels; ++c) {
+      const float l(left[c]);
+      const float r(right[c]);
+      *out++ = l + (r - l) * x.lerp;
+    }
+  }
+}
+
+void InterpolateRow(const uint8* in, const std::vector<CachedInterpolation>& xs,
+                    int channels, float* out) {
+  switch (channels) {
+    case 1:
+      return InterpolateRow<1>(in, xs, out);
+    case 3:
+      return InterpolateRow<3>(in, xs, out);
+    case 4:
+      return InterpolateRow<4>(in, xs, out);
+    default:
+      for (const CachedInterpolation& x : xs) {
+        for (int c = 0; c < channels; ++c) {
+          const float l(in[x.lower + c]);
+          const float r(in[x.upper + c]);
+          *out++ = l + (r - l) * x.lerp;
+        }
+      }
+  }
+}
+
+// Resizes `image` into the [1, out_height, out_width, channels] `output`
+// with bilinear interpolation, computing the same values as ResizeBilinear.
+//
+// The interpolation is separable: each output row is the vertical lerp of two
+// input rows that have been interpolated horizontally first, which is the
+// order of operations of ResizeBilinear. Output rows are split into bands
+// across the CPU worker threads. Each band keeps its two most recent
+// horizontally interpolated rows, since consecutive output rows often read
+// the same input rows, and computes the vertical lerp over whole rows with
+// packet (SIMD) instructions.
+void ResizeImage(OpKernelContext* context,
+                 TTypes<uint8, 3>::ConstTensor image, bool align_corners,
+                 bool half_pixel_centers, TTypes<float, 4>::Tensor output) {
+  const int64_t in_height = image.dimension(0);
+  const int64_t in_width = image.dimension(1);
+  const int channels = image.dimension(2);
+  const int64_t out_height = output.dimension(1);
+  const int64_t out_width = output.dimension(2);
+  const int64_t in_row_size = in_width * channels;
+  const int64_t out_row_size = out_width * channels;
+
+  const float height_scale =
+      CalculateResizeScale(in_height, out_height, align_corners);
+  const float width_scale =
+      CalculateResizeScale(in_width, out_width, align_corners);
+  std::vector<CachedInterpolation> ys(out_height);
+  std::vector<CachedInterpolation> xs(out_width);
+  if (half_pixel_centers) {
+    ComputeInterpolationWeights(HalfPixelScaler(), out_height, in_height,
+                                height_scale, ys.data());
+    ComputeInterpolationWeights(HalfPixelScaler(), out_width, in_width,
+                                width_scale, xs.data());
+  } else {
+    ComputeInterpolationWeights(LegacyScaler(), out_height, in_height,
+                                height_scale, ys.data());
+    ComputeInterpolationWeights(LegacyScaler(), out_width, in_width,
+                                width_scale, xs.data());
+  }
+  for (CachedInterpolation& x : xs) {
+    x.lower *= channels;
+    x.upper *= channels;
+  }
+
+  const uint8* input = image.data();
+  float* output_data = output.data();
+  auto resize_rows = [&](int64_t start, int64_t limit) {
+    std::vector<float> rows(2 * out_row_size);
+    float* top = rows.data();
+    float* bottom = top + out_row_size;
+    int64_t top_index = -1;
+    int64_t bottom_index = -1;
+    for (int64_t y = start; y < limit; ++y) {
+      const int64_t lower = ys[y].lower;
+      const int64_t upper = ys[y].upper;
+      if (lower != top_index) {
+        if (lower == bottom_index) {
+          std::swap(top, bottom);
+          std::swap(top_index, bottom_index);
+        } else {
+          InterpolateRow(input + lower * in_row_size, xs, channels, top);
+          top_index = lower;
+        }
+      }
+      if (upper != bottom_index) {
+        InterpolateRow(input + upper * in_row_size, xs, channels, bottom);
+        bottom_index = upper;
+      }
+      TTypes<float>::UnalignedConstFlat top_row(top, out_row_size);
+      TTypes<float>::UnalignedConstFlat bottom_row(bottom, out_row_size);
+      TTypes<float>::UnalignedFlat out_row(output_data + y * out_row_size,
+                                           out_row_size);
+      out_row = top_row + (bottom_row - top_row) * ys[y].lerp;
+    }
+  };
+
+  // Two horizontal lerps of a row, and a vertical lerp, per output value.
+  const int64_t cost_per_row = 9 * out_row_size;
+  const auto& worker_threads =
+      *context->device()->tensorflow_cpu_worker_threads();
+  Shard(worker_threads.num_threads, worker_threads.workers, out_height,
+        cost_per_row, resize_rows);
+}
+
+// Decodes a JPEG image and resizes it with bilinear interpolation, as
+// DecodeJpeg followed by ResizeBilinear would. See _DecodeAndResizeJpeg in
+// ../ops/image_ops.cc.
+//
+// If `dct_scaling` is set, JPEG images are decoded with the largest libjpeg
+// DCT scaling that still yields at least the output size, which skips most of
+// the inverse DCT and color conversion work when a large image is resized to
+// a small one, but only approximates the full-size result. Otherwise, and for
+// PNG and GIF images, which DecodeJpeg also accepts, images are decoded at
+// full size and the output matches DecodeJpeg followed by ResizeBilinear.
+class DecodeAndResizeJpegOp : public OpKernel {
+ public:
+  explicit DecodeAndResizeJpegOp(OpKernelConstruction* context)
+      : OpKernel(context) {
+    OP_REQUIRES_OK(context, context->GetAttr("channels", &channels_));
+    OP_REQUIRES(context, channels_ == 0 || channels_ == 1 || channels_ == 3,
+                errors::InvalidArgument("channels must be 0, 1 or 3, got ",
+                                        channels_));
+    OP_REQUIRES_OK(context, context->GetAttr("fancy_upscaling",
+                                             &flags_.fancy_upscaling));
+    OP_REQUIRES_OK(context,
+                   context->GetAttr("try_recover_truncated",
+                                    &flags_.try_recover_truncated_jpeg));
+    OP_REQUIRES_OK(context, context->GetAttr("acceptable_fraction",
+                                             &flags_.min_acceptable_fraction));
+    string dct_method;
+    OP_REQUIRES_OK(context, context->GetAttr("dct_method", &dct_method));
+    OP_REQUIRES(
+        context,
+        (dct_method.empty() || dct_method == "INTEGER_FAST" ||
+         dct_method == "INTEGER_ACCURATE"),
+        errors::InvalidArgument("dct_method must be one of "
+                                "{'', 'INTEGER_FAST', 'INTEGER_ACCURATE'}"));
+    flags_.dct_method =
+        dct_method == "INTEGER_ACCURATE" ? JDCT_ISLOW : JDCT_IFAST;
+    flags_.components = channels_;
+    OP_REQUIRES_OK(context, context->GetAttr("dct_scaling", &dct_scaling_));
+    OP_REQUIRES_OK(context, context->GetAttr("align_corners", &align_corners_));
+    OP_REQUIRES_OK(
+        context, context->GetAttr("half_pixel_centers", &half_pixel_centers_));
+    OP_REQUIRES(context, !(align_corners_ && half_pixel_centers_),
+                errors::InvalidArgument("If half_pixel_centers is True, "
+                                        "align_corners must be False."));
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& contents = context->input(0);
+    OP_REQUIRES(
+        context, TensorShapeUtils::IsScalar(contents.shape()),
+        errors::InvalidArgument("`contents` must be scalar but got shape",
+                                contents.shape().DebugString()));
+    const StringPiece input = contents.scalar<tstring>()();
+    OP_REQUIRES(context, !input.empty(),
+                errors::InvalidArgument("Input is empty."));
+    OP_REQUIRES(context, input.size() <= std::numeric_limits<int>::max(),
+                errors::InvalidArgument(
+                    "Input contents are too large for int: ", input.size()));
+
+    const Tensor& size = context->input(1);
+    OP_REQUIRES(context, size.dims() == 1,
+                errors::InvalidArgument("shape_t must be 1-D",
+                                        size.shape().DebugString()));
+    OP_REQUIRES(context, size.NumElements() == 2,
+                errors::InvalidArgument("shape_t must have two elements",
+                                        size.shape().DebugString()));
+    auto size_vec = size.vec<int32>();
+    const int64_t out_height = internal::SubtleMustCopy(size_vec(0));
+    const int64_t out_width = internal::SubtleMustCopy(size_vec(1));
+    OP_REQUIRES(context, out_height > 0 && out_width > 0,
+                errors::InvalidArgument("output dimensions must be positive"));
+
+    Tensor image;
+    if (absl::StartsWith(input, kJpegMagicBytes)) {
+      OP_REQUIRES_OK(context,
+                     DecodeJpeg(context, input, out_width, out_height, &image));
+    } else if (absl::StartsWith(input, kPngMagicBytes)) {
+      OP_REQUIRES_OK(context, DecodePng(context, input, &image));
+    } else if (absl::StartsWith(input, kGifMagicBytes)) {
+      OP_REQUIRES_OK(context, DecodeGif(context, input, &image));
+    } else {
+      OP_REQUIRES(context, false,
+                  errors::InvalidArgument("Unknown image file format. One of "
+                                          "JPEG, PNG, GIF required."));
+    }
+
+    Tensor* output = nullptr;
+    OP_REQUIRES_OK(context, context->allocate_output(
+                                0,
+                                TensorShape({1, out_height, out_width,
+                                             image.dim_size(2)}),
+                                &output));
+    if (output->NumElements() == 0) return;
+    ResizeImage(context, const_cast<const Tensor&>(image).tensor<uint8, 3>(),
+                align_corners_, half_pixel_centers_,
+                output->tensor<float, 4>());
+  }
+
+ private:
+  Status DecodeJpeg(OpKernelContext* context, StringPiece input,
+                    int64_t out_width, int64_t out_height, Tensor* image) {
+    int width, height, components;
+    if (!jpeg::GetImageInfo(input.data(), input.size(), &width, &height,
+                            &components)) {
+      return errors::InvalidArgument("Invalid JPEG data, size ", input.size());
+    }
+    // Use local copy of flags to avoid race condition as the class member is
+    // shared among different invocations.
+    jpeg::UncompressFlags flags = flags_;
+    flags.ratio = dct_scaling_
+                      ? ChooseJpegRatio(width, height, out_width, out_height)
+                      : 1;
+
+    Status status;
+    uint8* buffer = jpeg::Uncompress(
+        input.data(), input.size(), flags, nullptr /* nwarn */,
+        [&](int scaled_width, int scaled_height, int channels) -> uint8* {
+          status = context->allocate_temp(
+              DT_UINT8, TensorShape({scaled_height, scaled_width, channels}),
+              image);
+          if (!status.ok()) {
+            VLOG(1) << status;
+            return nullptr;
+          }
+          return image->flat<uint8>().data();
+        });
+    TF_RETURN_IF_ERROR(status);
+    if (buffer == nullptr) {
+      return errors::InvalidArgument(
+          "jpeg::Uncompress failed. Invalid JPEG data.");
+    }
+    return absl::OkStatus();
+  }
+
+  Status DecodePng(OpKernelContext* context, StringPiece input,
+                   Tensor* image) {
+    png::DecodeContext decode;
+    if (!png::CommonInitDecode(input, channels_, 8, &decode)) {
+      return errors::InvalidArgument(
+          "Invalid PNG. Failed to initialize decoder.");
+    }
+    auto cleanup =
+        gtl::MakeCleanup([&decode]() { png::CommonFreeDecode(&decode); });
+
+    // Same limits as DecodePng.
+    const int width = static_cast<int>(decode.width);
+    const int height = static_cast<int>(decode.height);
+    const int64_t total_size =
+        static_cast<int64_t>(width) * static_cast<int64_t>(height);
+    if (width != static_cast<int64_t>(decode.width) || width <= 0 ||
+        width >= (1LL << 27) || height != static_cast<int64_t>(decode.height) ||
+        height <= 0 || height >= (1LL << 27) || total_size >= (1LL << 29)) {
+      return errors::InvalidArgument("PNG size too large for int: ",
+                                     decode.width, " by ", decode.height);
+    }
+    TF_RETURN_IF_ERROR(context->allocate_temp(
+        DT_UINT8, TensorShape({height, width, decode.channels}), image));
+    if (!png::CommonFinishDecode(
+            reinterpret_cast<png_bytep>(image->flat<uint8>().data()),
+            decode.channels * width, &decode)) {
+      return errors::InvalidArgument("Invalid PNG data, size ", input.size());
+    }
+    return absl::OkStatus();
+  }
+
+  Status DecodeGif(OpKernelContext* context, StringPiece input,
+                   Tensor* image) {
+    if (channels_ != 0 && channels_ != 3) {
+      return errors::InvalidArgument("channels must be 0 or 3 for GIF, got ",
+                                     channels_);
+    }
+    Status status;
+    string error_string;
+    uint8* buffer = gif::Decode(
+        input.data(), input.size(),
+        [&](int num_frames, int width, int height, int channels) -> uint8* {
+          if (num_frames != 1) {
+            status = errors::InvalidArgument(
+                "Got ", num_frames, " frames, but animated gifs ",
+                "can only be decoded by tf.io.decode_gif or ",
+                "tf.io.decode_image");
+            return nullptr;
+          }
+          status = context->allocate_temp(
+              DT_UINT8, TensorShape({height, width, channels}), image);
+          if (!status.ok()) return nullptr;
+          return image->flat<uint8>().data();
+        },
+        &error_string);
+    TF_RETURN_IF_ERROR(status);
+    if (buffer == nullptr) {
+      return errors::InvalidArgument("Invalid GIF data (size ", input.size(),
+                                     "), ", error_string);
+    }
+    return absl::OkStatus();
+  }
+
+  int channels_;
+  jpeg::UncompressFlags flags_;
+  bool dct_scaling_;
+  bool align_corners_;
+  bool half_pixel_centers_;
+};
+
+REGISTER_KERNEL_BUILDER(Name("_DecodeAndResizeJpeg").Device(DEVICE_CPU),
+                        DecodeAndResizeJpegOp);
+
+}  // namespace
+}  // namespace tensorflow
@@ -0,0 +1,261 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/jpeg/jpeg_mem.h"
+#include "tensorflow/core/lib/png/png_io.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/core/util/image_resizer_state.h"
+
+namespace tensorflow {
+namespace {
+
+// Returns a `width` x `height` RGB image with smooth gradients and some
+// higher frequency content, so that the DCT scaling is actually exercised.
+std::vector<uint8> MakeImage(int width, int height) {
+  std::vector<uint8> image(width * height * 3);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      uint8* pixel = &image[(y * width + x) * 3];
+      pixel[0] = (x * 255) / width;
+      pixel[1] = (y * 255) / height;
+      pixel[2] = ((x / 4 + y / 4) % 2) * 200;
+    }
+  }
+  return image;
+}
+
+tstring MakeJpeg(int width, int height) {
+  const std::vector<uint8> image = MakeImage(width, height);
+  jpeg::CompressFlags flags;
+  flags.format = jpeg::FORMAT_RGB;
+  return jpeg::Compress(image.data(), width, height, flags);
+}
+
+// Decodes `jpeg` as DecodeJpeg with `ratio` would.
+Tensor DecodeJpeg(const tstring& jpeg, int ratio) {
+  jpeg::UncompressFlags flags;
+  flags.ratio = ratio;
+  flags.dct_method = JDCT_IFAST;
+  int width, height, channels;
+  std::unique_ptr<uint8[]> buffer(jpeg::Uncompress(
+      jpeg.data(), jpeg.size(), flags, &width, &height, &channels, nullptr));
+  CHECK(buffer != nullptr);
+  Tensor image(DT_UINT8, TensorShape({height, width, channels}));
+  std::copy_n(buffer.get(), image.NumElements(), image.flat<uint8>().data());
+  return image;
+}
+
+// Straightforward ResizeBilinear with half pixel centers.
+Tensor ResizeBilinear(const Tensor& image, int out_height, int out_width) {
+  const int in_height = image.dim_size(0);
+  const int in_width = image.dim_size(1);
+  const int channels = image.dim_size(2);
+  const float height_scale = CalculateResizeScale(in_height, out_height, false);
+  const float width_scale = CalculateResizeScale(in_width, out_width, false);
+  auto in = image.tensor<uint8, 3>();
+  Tensor resized(DT_FLOAT, TensorShape({1, out_height, out_width, channels}));
+  auto out = resized.tensor<float, 4>();
+  for (int y = 0; y < out_height; ++y) {
+    const float in_y = HalfPixelScaler()(y, height_scale);
+    const int top = std::max(static_cast<int>(std::floor(in_y)), 0);
+    const int bottom =
+        std::min(static_cast<int>(std::ceil(in_y)), in_height - 1);
+    const float y_lerp = in_y - std::floor(in_y);
+    for (int x = 0; x < out_width; ++x) {
+      const float in_x = HalfPixelScaler()(x, width_scale);
+      const int left = std::max(static_cast<int>(std::floor(in_x)), 0);
+      const int right =
+          std::min(static_cast<int>(std::ceil(in_x)), in_width - 1);
+      const float x_lerp = in_x - std::floor(in_x);
+      for (int c = 0; c < channels; ++c) {
+        const float top_value =
+            in(top, left, c) + (in(top, right, c) - in(top, left, c)) * x_lerp;
+        const float bottom_value =
+            in(bottom, left, c) +
+            (in(bottom, right, c) - in(bottom, left, c)) * x_lerp;
+        out(0, y, x, c) = top_value + (bottom_value - top_value) * y_lerp;
+      }
+    }
+  }
+  return resized;
+}
+
+class DecodeAndResizeJpegOpTest : public OpsTestBase {
+ protected:
+  void MakeOp(int channels, bool dct_scaling = true) {
+    TF_ASSERT_OK(NodeDefBuilder("decode_and_resize", "_DecodeAndResizeJpeg")
+                     .Input(FakeInput(DT_STRING))
+                     .Input(FakeInput(DT_INT32))
+                     .Attr("channels", channels)
+                     .Attr("dct_scaling", dct_scaling)
+                     .Attr("half_pixel_centers", true)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+  }
+};
+
+TEST_F(DecodeAndResizeJpegOpTest, ResizesTheDctScaledImage) {
+  MakeOp(3);
+  const tstring jpeg = MakeJpeg(257, 193);
+  AddInputFromArray<tstring>(TensorShape({}), {jpeg});
+  // 193 / 4 rounds up to 49 rows, fewer than requested, so the image is
+  // decoded at half size.
+  AddInputFromArray<int32>(TensorShape({2}), {50, 60});
+  TF_ASSERT_OK(RunOpKernel());
+
+  const Tensor expected = ResizeBilinear(DecodeJpeg(jpeg, 2), 50, 60);
+  test::ExpectClose(expected, *GetOutput(0), /*atol=*/1e-4);
+}
+
+TEST_F(DecodeAndResizeJpegOpTest, DecodesAtFullSizeWithoutDctScaling) {
+  MakeOp(3, /*dct_scaling=*/false);
+  const tstring jpeg = MakeJpeg(257, 193);
+  AddInputFromArray<tstring>(TensorShape({}), {jpeg});
+  AddInputFromArray<int32>(TensorShape({2}), {50, 60});
+  TF_ASSERT_OK(RunOpKernel());
+
+  const Tensor expected = ResizeBilinear(DecodeJpeg(jpeg, 1), 50, 60);
+  test::ExpectClose(expected, *GetOutput(0), /*atol=*/1e-4);
+}
+
+TEST_F(DecodeAndResizeJpegOpTest, ScaledSizeIsNotResized) {
+  MakeOp(0);
+  const tstring jpeg = MakeJpeg(257, 193);
+  AddInputFromArray<tstring>(TensorShape({}), {jpeg});
+  AddInputFromArray<int32>(TensorShape({2}), {25, 33});
+  TF_ASSERT_OK(RunOpKernel());
+
+  const Tensor decoded = DecodeJpeg(jpeg, 8);
+  ASSERT_EQ(decoded.shape(), TensorShape({25, 33, 3}));
+  Tensor expected(DT_FLOAT, TensorShape({1, 25, 33, 3}));
+  expected.flat<float>() = decoded.flat<uint8>().cast<float>();
+  test::ExpectTensorEqual<float>(expected, *GetOutput(0));
+}
+
+TEST_F(DecodeAndResizeJpegOpTest, UpsamplesFromFullSize) {
+  MakeOp(3);
+  const tstring jpeg = MakeJpeg(40, 30);
+  AddInputFromArray<tstring>(TensorShape({}), {jpeg});
+  AddInputFromArray<int32>(TensorShape({2}), {45, 71});
+  TF_ASSERT_OK(RunOpKernel());
+
+  const Tensor expected = ResizeBilinear(DecodeJpeg(jpeg, 1), 45, 71);
+  test::ExpectClose(expected, *GetOutput(0), /*atol=*/1e-4);
+}
+
+TEST_F(DecodeAndResizeJpegOpTest, DecodesPngAtFullSize) {
+  MakeOp(3);
+  const int width = 64, height = 48;
+  const std::vector<uint8> image = MakeImage(width, height);
+  tstring png;
+  ASSERT_TRUE(png::WriteImageToBuffer(image.data(), width, height, width * 3,
+                                      3, 8, -1, &png, nullptr));
+  AddInputFromArray<tstring>(TensorShape({}), {png});
+  AddInputFromArray<int32>(TensorShape({2}), {12, 16});
+  TF_ASSERT_OK(RunOpKernel());
+
+  Tensor decoded(DT_UINT8, TensorShape({height, width, 3}));
+  std::copy(image.begin(), image.end(), decoded.flat<uint8>().data());
+  const Tensor expected = ResizeBilinear(decoded, 12, 16);
+  test::ExpectClose(expected, *GetOutput(0), /*atol=*/1e-4);
+}
+
+TEST_F(DecodeAndResizeJpegOpTest, RejectsUnknownFormat) {
+  MakeOp(3);
+  AddInputFromArray<tstring>(TensorShape({}), {"not an image"});
+  AddInputFromArray<int32>(TensorShape({2}), {12, 16});
+  const Status status = RunOpKernel();
+  EXPECT_TRUE(errors::IsInvalidArgument(status)) << status;
+}
+
+TEST_F(DecodeAndResizeJpegOpTest, RejectsEmptySize) {
+  MakeOp(3);
+  AddInputFromArray<tstring>(TensorShape({}), {MakeJpeg(16, 16)});
+  AddInputFromArray<int32>(TensorShape({2}), {0, 16});
+  const Status status = RunOpKernel();
+  EXPECT_TRUE(errors::IsInvalidArgument(status)) << status;
+}
+
+// Decodes a `width` x `height` JPEG image and resizes it to 224 x 224, either
+// with a DCT-scaled _DecodeAndResizeJpeg or with DecodeJpeg, ExpandDims and
+// ResizeBilinear.
+Graph* DecodeAndResize(bool fused, int width, int height) {
+  Graph* g = new Graph(OpRegistry::Global());
+  Tensor contents(DT_STRING, TensorShape({}));
+  contents.scalar<tstring>()() = MakeJpeg(width, height);
+  Tensor size(DT_INT32, TensorShape({2}));
+  size.flat<int32>().setConstant(224);
+
+  Node* ret;
+  if (fused) {
+    TF_CHECK_OK(NodeBuilder(g->NewName("n"), "_DecodeAndResizeJpeg")
+                    .Input(test::graph::Constant(g, contents))
+                    .Input(test::graph::Constant(g, size))
+                    .Attr("channels", 3)
+                    .Attr("dct_scaling", true)
+                    .Attr("half_pixel_centers", true)
+                    .Finalize(g, &ret));
+  } else {
+    Node* decoded;
+    TF_CHECK_OK(NodeBuilder(g->NewName("n"), "DecodeJpeg")
+                    .Input(test::graph::Constant(g, contents))
+                    .Attr("channels", 3)
+                    .Finalize(g, &decoded));
+    Node* expanded;
+    TF_CHECK_OK(NodeBuilder(g->NewName("n"), "ExpandDims")
+                    .Input(decoded)
+                    .Input(test::graph::Constant(g, test::AsScalar<int32>(0)))
+                    .Finalize(g, &expanded));
+    TF_CHECK_OK(NodeBuilder(g->NewName("n"), "ResizeBilinear")
+                    .Input(expanded)
+                    .Input(test::graph::Constant(g, size))
+                    .Attr("half_pixel_centers", true)
+                    .Finalize(g, &ret));
+  }
+  return g;
+}
+
+#define BM_DecodeAndResize(FUSED, W, H)                                    \
+  static void BM_DecodeAndResize_##FUSED##_##W##_##H(                      \
+      ::testing::benchmark::State& state) {                                \
+    test::Benchmark("cpu", DecodeAndResize(FUSED, W, H),                   \
+                    /*old_benchmark_api*/ false)                           \
+        .Run(state);                                                       \
+    state.SetItemsProcessed(state.iterations());                           \
+  }                                                                        \
+  BENCHMARK(BM_DecodeAndResize_##FUSED##_##W##_##H)->UseRealTime();
+
+BM_DecodeAndResize(false, 640, 480);
+BM_DecodeAndResize(true, 640, 480);
+BM_DecodeAndResize(false, 3840, 2160);
+BM_DecodeAndResize(true, 3840, 2160);
+
+}  // namespace
+}  // namespace tensorflow
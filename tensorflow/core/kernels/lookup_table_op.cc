@@ -23,6 +23,7 @@ limitations under the License.
 #include "tensorflow/core/framework/register_types.h"
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/framework/variant.h"
+#include "tensorflow/core/kernels/concurrent_lookup_table.h"
 #include "tensorflow/core/kernels/initializable_lookup_table.h"
 #include "tensorflow/core/lib/gtl/inlined_vector.h"
 #include "tensorflow/core/lib/hash/hash.h"
@@ -1160,6 +1161,28 @@ REGISTER_KERNEL(tstring, int64_t);
 
 #undef REGISTER_KERNEL
 
+// Register the MutableConcurrentHashTable op.
+#define REGISTER_KERNEL(key_dtype, value_dtype)                          \
+  REGISTER_KERNEL_BUILDER(                                               \
+      Name("MutableConcurrentHashTable")                                 \
+          .Device(DEVICE_CPU)                                            \
+          .TypeConstraint<key_dtype>("key_dtype")                        \
+          .TypeConstraint<value_dtype>("value_dtype"),                   \
+      LookupTableOp<                                                     \
+          lookup::MutableConcurrentHashTable<key_dtype, value_dtype>,    \
+          key_dtype, value_dtype>)
+
+REGISTER_KERNEL(int32, double);
+REGISTER_KERNEL(int32, float);
+REGISTER_KERNEL(int32, int32);
+REGISTER_KERNEL(int32, int64_t);
+REGISTER_KERNEL(int64_t, double);
+REGISTER_KERNEL(int64_t, float);
+REGISTER_KERNEL(int64_t, int32);
+REGISTER_KERNEL(int64_t, int64_t);
+
+#undef REGISTER_KERNEL
+
 // Register the MutableHashTableOfTensors op.
 #define REGISTER_KERNEL(key_dtype, value_dtype)                                \
   REGISTER_KERNEL_BUILDER(                                                     \
@@ -0,0 +1,549 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/kernels/memmapped_lookup_table.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/graph/graph_def_builder.h"
+#include "tensorflow/core/kernels/initializable_lookup_table.h"
+#include "tensorflow/core/kernels/lookup_table_op.h"
+#include "tensorflow/core/kernels/lookup_util.h"
+#include "tensorflow/core/lib/core/bits.h"
+#include "tensorflow/core/platform/byte_order.h"
+#include "tensorflow/core/platform/prefetch.h"
+#include "tensorflow/core/util/work_sharder.h"
+
+namespace tensorflow {
+namespace lookup {
+namespace {
+
+constexpr uint64 kMinBuckets = 16;
+// Images are built with a load factor of at most 3/4, which keeps the probe
+// sequences of linear probing short.
+constexpr uint64 kMaxLoadNumerator = 3;
+constexpr uint64 kMaxLoadDenominator = 4;
+
+// Number of lookups whose buckets are prefetched before they are probed.
+constexpr int64_t kLookupBlockSize = 16;
+// Rough cost of a lookup in cycles, dominated by a cache miss.
+constexpr int64_t kLookupCost = 250;
+
+uint64 NumBucketsFor(uint64 num_entries) {
+  const uint64 min_buckets =
+      (num_entries * kMaxLoadDenominator + kMaxLoadNumerator - 1) /
+      kMaxLoadNumerator;
+  return std::max(kMinBuckets, NextPowerOfTwo64(min_buckets));
+}
+
+bool IsSupportedDataType(DataType dtype) {
+  return dtype == DT_INT64 || dtype == DT_STRING;
+}
+
+uint64 HashOf(int64_t key) { return MemmappedHashTableHash(key); }
+
+uint64 HashOf(const tstring& key) {
+  return MemmappedHashTableHash(StringPiece(key));
+}
+
+// Returns the string of `size` bytes at `offset` of `pool`, or false if it
+// is out of bounds.
+bool PoolString(StringPiece pool, uint64 offset, uint32 size,
+                StringPiece* s) {
+  if (offset > pool.size() || size > pool.size() - offset) return false;
+  *s = StringPiece(pool.data() + offset, size);
+  return true;
+}
+
+bool KeyEquals(const MemmappedHashTableBucket& bucket, int64_t key,
+               StringPiece pool) {
+  return bucket.key == static_cast<uint64>(key);
+}
+
+bool KeyEquals(const MemmappedHashTableBucket& bucket, const tstring& key,
+               StringPiece pool) {
+  StringPiece bucket_key;
+  return bucket.key_size == key.size() &&
+         PoolString(pool, bucket.key, bucket.key_size, &bucket_key) &&
+         bucket_key == StringPiece(key);
+}
+
+bool ReadKey(const MemmappedHashTableBucket& bucket, StringPiece pool,
+             int64_t* key) {
+  *key = static_cast<int64_t>(bucket.key);
+  return true;
+}
+
+bool ReadKey(const MemmappedHashTableBucket& bucket, StringPiece pool,
+             tstring* key) {
+  StringPiece s;
+  if (!PoolString(pool, bucket.key, bucket.key_size, &s)) return false;
+  key->assign(s.data(), s.size());
+  return true;
+}
+
+bool ReadValue(const MemmappedHashTableBucket& bucket, StringPiece pool,
+               int64_t* value) {
+  *value = static_cast<int64_t>(bucket.value);
+  return true;
+}
+
+bool ReadValue(const MemmappedHashTableBucket& bucket, StringPiece pool,
+               tstring* value) {
+  StringPiece s;
+  if (!PoolString(pool, bucket.value, bucket.value_size, &s)) return false;
+  value->assign(s.data(), s.size());
+  return true;
+}
+
+// Collects the entries read by InitializeTableFromTextFile into a builder.
+class TextFileTableCollector : public InitializableLookupTable {
+ public:
+  explicit TextFileTableCollector(MemmappedHashTableBuilder* builder)
+      : builder_(builder) {}
+
+  size_t size() const override { return builder_->size(); }
+
+  DataType key_dtype() const override { return builder_->key_dtype(); }
+
+  DataType value_dtype() const override { return builder_->value_dtype(); }
+
+ protected:
+  Status DoPrepare(size_t size) override {
+    builder_->Reserve(size);
+    return absl::OkStatus();
+  }
+
+  Status DoLazyPrepare(std::function<int64(void)> size_fn) override {
+    const int64_t size = size_fn();
+    return DoPrepare(size > 0 ? size : 0);
+  }
+
+  Status DoInsert(const Tensor& keys, const Tensor& values) override {
+    return builder_->Insert(keys, values);
+  }
+
+  Status DoFind(const Tensor& keys, Tensor* values,
+                const Tensor& default_value) override {
+    return errors::Unimplemented("TextFileTableCollector does not serve");
+  }
+
+ private:
+  MemmappedHashTableBuilder* const builder_;
+};
+
+}  // namespace
+
+MemmappedHashTableBuilder::MemmappedHashTableBuilder(DataType key_dtype,
+                                                     DataType value_dtype)
+    : key_dtype_(key_dtype), value_dtype_(value_dtype), buckets_(kMinBuckets) {}
+
+void MemmappedHashTableBuilder::Reserve(int64_t num_entries) {
+  const uint64 num_buckets = NumBucketsFor(num_entries);
+  if (num_buckets > buckets_.size()) Rehash(num_buckets);
+}
+
+Status MemmappedHashTableBuilder::Insert(const Tensor& keys,
+                                         const Tensor& values) {
+  if (keys.dtype() != key_dtype_ || values.dtype() != value_dtype_) {
+    return errors::InvalidArgument(
+        "Expected keys of type ", DataTypeString(key_dtype_),
+        " and values of type ", DataTypeString(value_dtype_), ", got ",
+        DataTypeString(keys.dtype()), " and ", DataTypeString(values.dtype()));
+  }
+  if (keys.NumElements() != values.NumElements()) {
+    return errors::InvalidArgument("Expected as many values as keys, got ",
+                                   values.NumElements(), " values and ",
+                                   keys.NumElements(), " keys");
+  }
+  if (key_dtype_ == DT_INT64 && value_dtype_ == DT_INT64) {
+    return InsertTyped<int64_t, int64_t>(keys, values);
+  } else if (key_dtype_ == DT_INT64 && value_dtype_ == DT_STRING) {
+    return InsertTyped<int64_t, tstring>(keys, values);
+  } else if (key_dtype_ == DT_STRING && value_dtype_ == DT_INT64) {
+    return InsertTyped<tstring, int64_t>(keys, values);
+  } else if (key_dtype_ == DT_STRING && value_dtype_ == DT_STRING) {
+    return InsertTyped<tstring, tstring>(keys, values);
+  }
+  return errors::InvalidArgument(
+      "MemmappedHashTable only supports int64 and string keys and values, "
+      "got ",
+      DataTypeString(key_dtype_), " keys and ", DataTypeString(value_dtype_),
+      " values");
+}
+
+template <typename K>
+MemmappedHashTableBucket* MemmappedHashTableBuilder::FindBucket(K key,
+                                                                uint64 hash) {
+  const uint64 mask = buckets_.size() - 1;
+  for (uint64 i = hash & mask;; i = (i + 1) & mask) {
+    MemmappedHashTableBucket& bucket = buckets_[i];
+    if (bucket.hash == 0 ||
+        (bucket.hash == hash && KeyEquals(bucket, key, string_pool_))) {
+      return &bucket;
+    }
+  }
+}
+
+template <typename K, typename V>
+Status MemmappedHashTableBuilder::InsertTyped(const Tensor& keys,
+                                              const Tensor& values) {
+  const auto key_values = keys.flat<K>();
+  const auto value_values = values.flat<V>();
+  for (int64_t i = 0; i < key_values.size(); ++i) {
+    const K& key = key_values(i);
+    const V& value = value_values(i);
+    if constexpr (std::is_same<K, tstring>::value) {
+      if (key.size() > std::numeric_limits<uint32>::max()) {
+        return errors::InvalidArgument("Key ", i, " is too long");
+      }
+    }
+    if constexpr (std::is_same<V, tstring>::value) {
+      if (value.size() > std::numeric_limits<uint32>::max()) {
+        return errors::InvalidArgument("Value ", i, " is too long");
+      }
+    }
+
+    const uint64 hash = HashOf(key);
+    MemmappedHashTableBucket* bucket = FindBucket<const K&>(key, hash);
+    if (bucket->hash != 0) {
+      V existing;
+      ReadValue(*bucket, string_pool_, &existing);
+      if (existing != value) {
+        return errors::FailedPrecondition(
+            "HashTable has different value for same key. Key ", key, " has ",
+            existing, " and trying to add value ", value);
+      }
+      continue;
+    }
+    if ((num_entries_ + 1) * kMaxLoadDenominator >
+        buckets_.size() * kMaxLoadNumerator) {
+      Rehash(buckets_.size() * 2);
+      bucket = FindBucket<const K&>(key, hash);
+    }
+
+    bucket->hash = hash;
+    if constexpr (std::is_same<K, tstring>::value) {
+      bucket->key = AppendString(key, &bucket->key_size);
+    } else {
+      bucket->key = static_cast<uint64>(key);
+    }
+    if constexpr (std::is_same<V, tstring>::value) {
+      bucket->value = AppendString(value, &bucket->value_size);
+    } else {
+      bucket->value = static_cast<uint64>(value);
+    }
+    ++num_entries_;
+  }
+  return absl::OkStatus();
+}
+
+uint64 MemmappedHashTableBuilder::AppendString(StringPiece s, uint32* size) {
+  const uint64 offset = string_pool_.size();
+  string_pool_.append(s.data(), s.size());
+  *size = static_cast<uint32>(s.size());
+  return offset;
+}
+
+void MemmappedHashTableBuilder::Rehash(uint64 num_buckets) {
+  std::vector<MemmappedHashTableBucket> buckets(num_buckets);
+  const uint64 mask = num_buckets - 1;
+  for (const MemmappedHashTableBucket& bucket : buckets_) {
+    if (bucket.hash == 0) continue;
+    uint64 i = bucket.hash & mask;
+    while (buckets[i].hash != 0) i = (i + 1) & mask;
+    buckets[i] = bucket;
+  }
+  buckets_.swap(buckets);
+}
+
+Status MemmappedHashTableBuilder::Finish(Tensor* image) const {
+  if (!IsSupportedDataType(key_dtype_) || !IsSupportedDataType(value_dtype_)) {
+    return errors::InvalidArgument(
+        "MemmappedHashTable only supports int64 and string keys and values");
+  }
+  if (!port::kLittleEndian) {
+    return errors::Unimplemented(
+        "MemmappedHashTable images are only supported on little-endian "
+        "platforms");
+  }
+  MemmappedHashTableHeader header = {};
+  header.magic = kMemmappedHashTableMagic;
+  header.version = kMemmappedHashTableVersion;
+  header.key_dtype = key_dtype_;
+  header.value_dtype = value_dtype_;
+  header.num_buckets = buckets_.size();
+  header.num_entries = num_entries_;
+  header.string_pool_size = string_pool_.size();
+
+  const int64_t buckets_size =
+      buckets_.size() * sizeof(MemmappedHashTableBucket);
+  *image = Tensor(DT_UINT8, TensorShape({static_cast<int64_t>(
+                                sizeof(header) + buckets_size +
+                                string_pool_.size())}));
+  char* data = reinterpret_cast<char*>(image->flat<uint8>().data());
+  std::memcpy(data, &header, sizeof(header));
+  std::memcpy(data + sizeof(header), buckets_.data(), buckets_size);
+  std::memcpy(data + sizeof(header) + buckets_size, string_pool_.data(),
+              string_pool_.size());
+  return absl::OkStatus();
+}
+
+Status ConvertTextFileToMemmappedHashTable(
+    const string& filename, int64_t vocab_size, char delimiter,
+    int32_t key_index, int32_t value_index, int64_t offset,
+    DataType key_dtype, DataType value_dtype, Env* env, Tensor* image) {
+  MemmappedHashTableBuilder builder(key_dtype, value_dtype);
+  core::RefCountPtr<TextFileTableCollector> collector(
+      new TextFileTableCollector(&builder));
+  TF_RETURN_IF_ERROR(InitializeTableFromTextFile(filename, vocab_size,
+                                                 delimiter, key_index,
+                                                 value_index, offset, env,
+                                                 collector.get()));
+  return builder.Finish(image);
+}
+
+Status WriteMemmappedHashTable(const Tensor& image, const string& filename,
+                               Env* env) {
+  return WriteStringToFile(env, filename, image.tensor_data());
+}
+
+template <class K, class V>
+MemmappedHashTable<K, V>::MemmappedHashTable(OpKernelContext* ctx,
+                                             OpKernel* kernel) {
+  const Tensor* filename;
+  OP_REQUIRES_OK(ctx, ctx->input("filename", &filename));
+  OP_REQUIRES(ctx, TensorShapeUtils::IsScalar(filename->shape()),
+              errors::InvalidArgument("filename should be a scalar, got shape ",
+                                      filename->shape().DebugString()));
+  OP_REQUIRES_OK(ctx, Load(ctx->env(), filename->scalar<tstring>()()));
+}
+
+template <class K, class V>
+Status MemmappedHashTable<K, V>::Load(Env* env, const string& filename) {
+  if (!port::kLittleEndian) {
+    return errors::Unimplemented(
+        "MemmappedHashTable images are only supported on little-endian "
+        "platforms");
+  }
+  std::unique_ptr<ReadOnlyMemoryRegion> region;
+  TF_RETURN_IF_ERROR(env->NewReadOnlyMemoryRegionFromFile(filename, &region));
+  const char* data = static_cast<const char*>(region->data());
+  const uint64 length = region->length();
+  if (length < sizeof(MemmappedHashTableHeader)) {
+    return errors::DataLoss(filename, " is too short to be a hash table image");
+  }
+  if (reinterpret_cast<uintptr_t>(data) % alignof(MemmappedHashTableBucket)) {
+    return errors::InvalidArgument(filename, " is not mapped at an address ",
+                                   "suitably aligned for a hash table image");
+  }
+
+  const auto* header = reinterpret_cast<const MemmappedHashTableHeader*>(data);
+  if (header->magic != kMemmappedHashTableMagic) {
+    return errors::DataLoss(filename, " is not a hash table image");
+  }
+  if (header->version != kMemmappedHashTableVersion) {
+    return errors::Unimplemented(filename, " has unsupported version ",
+                                 header->version);
+  }
+  if (static_cast<DataType>(header->key_dtype) != key_dtype() ||
+      static_cast<DataType>(header->value_dtype) != value_dtype()) {
+    return errors::InvalidArgument(
+        filename, " maps ",
+        DataTypeString(static_cast<DataType>(header->key_dtype)), " to ",
+        DataTypeString(static_cast<DataType>(header->value_dtype)),
+        ", but the table maps ", DataTypeString(key_dtype()), " to ",
+        DataTypeString(value_dtype()));
+  }
+  const uint64 max_buckets = (length - sizeof(MemmappedHashTableHeader)) /
+                             sizeof(MemmappedHashTableBucket);
+  if (header->num_buckets == 0 ||
+      (header->num_buckets & (header->num_buckets - 1)) != 0 ||
+      header->num_buckets > max_buckets ||
+      header->num_entries >= header->num_buckets ||
+      header->string_pool_size !=
+          length - sizeof(MemmappedHashTableHeader) -
+              header->num_buckets * sizeof(MemmappedHashTableBucket)) {
+    return errors::DataLoss(filename, " has an inconsistent header");
+  }
+
+  filename_ = filename;
+  region_ = std::move(region);
+  header_ = header;
+  buckets_ = reinterpret_cast<const MemmappedHashTableBucket*>(
+      data + sizeof(MemmappedHashTableHeader));
+  string_pool_ = reinterpret_cast<const char*>(buckets_ + header->num_buckets);
+  return absl::OkStatus();
+}
+
+template <class K, class V>
+Status MemmappedHashTable<K, V>::Find(OpKernelContext* ctx, const Tensor& keys,
+                                      Tensor* values,
+                                      const Tensor& default_value) {
+  if (header_ == nullptr) {
+    return errors::FailedPrecondition("MemmappedHashTable is not loaded");
+  }
+  const int64_t num_keys = keys.NumElements();
+  std::atomic<bool> corrupted(false);
+  auto find_range = [&](int64_t begin, int64_t end) {
+    if (!FindRange(keys, values, default_value, begin, end)) {
+      corrupted.store(true, std::memory_order_relaxed);
+    }
+  };
+  if (ctx == nullptr) {
+    find_range(0, num_keys);
+  } else {
+    auto worker_threads = ctx->device()->tensorflow_cpu_worker_threads();
+    Shard(worker_threads->num_threads, worker_threads->workers, num_keys,
+          kLookupCost, find_range);
+  }
+  if (corrupted.load()) {
+    return errors::DataLoss(filename_, " is corrupted");
+  }
+  return absl::OkStatus();
+}
+
+template <class K, class V>
+bool MemmappedHashTable<K, V>::FindRange(const Tensor& keys, Tensor* values,
+                                         const Tensor& default_value,
+                                         int64_t begin, int64_t end) const {
+  const auto key_values = keys.flat<K>();
+  auto value_values = values->flat<V>();
+  const auto default_flat = default_value.flat<V>();
+  // As in MutableHashTableOfScalars, each key either has its own default
+  // value or they all share default_flat(0).
+  const bool is_full_size_default = value_values.size() == default_flat.size();
+  const StringPiece pool(string_pool_, header_->string_pool_size);
+  const uint64 mask = header_->num_buckets - 1;
+
+  uint64 hashes[kLookupBlockSize];
+  for (int64_t block = begin; block < end; block += kLookupBlockSize) {
+    const int64_t block_size = std::min(kLookupBlockSize, end - block);
+    for (int64_t i = 0; i < block_size; ++i) {
+      hashes[i] = HashOf(key_values(block + i));
+      port::prefetch<port::PREFETCH_HINT_T0>(&buckets_[hashes[i] & mask]);
+    }
+    for (int64_t i = 0; i < block_size; ++i) {
+      const int64_t j = block + i;
+      const MemmappedHashTableBucket* bucket =
+          Probe(key_values(j), hashes[i]);
+      if (bucket == nullptr) {
+        value_values(j) =
+            is_full_size_default ? default_flat(j) : default_flat(0);
+      } else if (!ReadValue(*bucket, pool, &value_values(j))) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+template <class K, class V>
+const MemmappedHashTableBucket* MemmappedHashTable<K, V>::Probe(
+    const K& key, uint64 hash) const {
+  const StringPiece pool(string_pool_, header_->string_pool_size);
+  const uint64 mask = header_->num_buckets - 1;
+  // Images always have empty buckets, but do not loop forever on corrupted
+  // ones.
+  for (uint64 i = hash & mask, probes = 0; probes <= mask;
+       i = (i + 1) & mask, ++probes) {
+    const MemmappedHashTableBucket& bucket = buckets_[i];
+    if (bucket.hash == 0) return nullptr;
+    if (bucket.hash == hash && KeyEquals(bucket, key, pool)) return &bucket;
+  }
+  return nullptr;
+}
+
+template <class K, class V>
+Status MemmappedHashTable<K, V>::ExportValues(OpKernelContext* ctx) {
+  if (header_ == nullptr) {
+    return errors::FailedPrecondition("MemmappedHashTable is not loaded");
+  }
+  const int64_t size = header_->num_entries;
+  Tensor* keys;
+  Tensor* values;
+  TF_RETURN_IF_ERROR(
+      ctx->allocate_output("keys", TensorShape({size}), &keys));
+  TF_RETURN_IF_ERROR(
+      ctx->allocate_output("values", TensorShape({size}), &values));
+  auto keys_data = keys->flat<K>();
+  auto values_data = values->flat<V>();
+  const StringPiece pool(string_pool_, header_->string_pool_size);
+  int64_t i = 0;
+  for (uint64 b = 0; b < header_->num_buckets; ++b) {
+    const MemmappedHashTableBucket& bucket = buckets_[b];
+    if (bucket.hash == 0) continue;
+    if (i == size || !ReadKey(bucket, pool, &keys_data(i)) ||
+        !ReadValue(bucket, pool, &values_data(i))) {
+      return errors::DataLoss(filename_, " is corrupted");
+    }
+    ++i;
+  }
+  if (i != size) {
+    return errors::DataLoss(filename_, " is corrupted");
+  }
+  return absl::OkStatus();
+}
+
+template <class K, class V>
+Status MemmappedHashTable<K, V>::AsGraphDef(GraphDefBuilder* builder,
+                                            Node** out) const {
+  Tensor filename(DT_STRING, TensorShape({}));
+  filename.scalar<tstring>()() = filename_;
+  Node* filename_node =
+      ops::SourceOp("Const", builder->opts()
+                                 .WithAttr("dtype", DT_STRING)
+                                 .WithAttr("value", filename));
+  // See MutableHashTableOfScalars::AsGraphDef for why the node name is shared.
+  *out = ops::UnaryOp(
+      "MemmappedHashTable", filename_node,
+      builder->opts()
+          .WithName(UniqueNodeName("MemmappedHashTableFromGraphDef"))
+          .WithAttr("use_node_name_sharing", true)
+          .WithAttr("key_dtype", key_dtype())
+          .WithAttr("value_dtype", value_dtype()));
+  return absl::OkStatus();
+}
+
+template class MemmappedHashTable<int64_t, int64_t>;
+template class MemmappedHashTable<int64_t, tstring>;
+template class MemmappedHashTable<tstring, int64_t>;
+template class MemmappedHashTable<tstring, tstring>;
+
+}  // namespace lookup
+
+#define REGISTER_KERNEL(key_dtype, value_dtype)                           \
+  REGISTER_KERNEL_BUILDER(                                                \
+      Name("MemmappedHashTable")                                          \
+          .Device(DEVICE_CPU)                                             \
+          .TypeConstraint<key_dtype>("key_dtype")                         \
+          .TypeConstraint<value_dtype>("value_dtype"),                    \
+      LookupTableOp<lookup::MemmappedHashTable<key_dtype, value_dtype>,   \
+                    key_dtype, value_dtype>)
+
+REGISTER_KERNEL(int64_t, int64_t);
+REGISTER_KERNEL(int64_t, tstring);
+REGISTER_KERNEL(tstring, int64_t);
+REGISTER_KERNEL(tstring, tstring);
+
+#undef REGISTER_KERNEL
+
+}  // namespace tensorflow
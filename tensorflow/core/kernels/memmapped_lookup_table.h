@@ -0,0 +1,230 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_KERNELS_MEMMAPPED_LOOKUP_TABLE_H_
+#define TENSORFLOW_CORE_KERNELS_MEMMAPPED_LOOKUP_TABLE_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tensorflow/core/framework/lookup_interface.h"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/fingerprint.h"
+#include "tensorflow/core/platform/status.h"
+#include "tensorflow/core/platform/stringpiece.h"
+
+namespace tensorflow {
+namespace lookup {
+
+// A read-only hash table image that can be memory mapped and used in place.
+//
+// The image is a little-endian file made of a header, an open-addressed array
+// of buckets with linear probing, and a pool holding the bytes of string keys
+// and values:
+//
+//   MemmappedHashTableHeader
+//   MemmappedHashTableBucket[num_buckets]
+//   char string_pool[string_pool_size]
+//
+// Loading an image only validates its header, so that tables of any size are
+// ready to serve in constant time, and the pages of an image mapped by several
+// processes are shared through the page cache. Images are written by
+// MemmappedHashTableBuilder, and may either be standalone files or regions of
+// a MemmappedFileSystem package.
+struct MemmappedHashTableHeader {
+  uint64 magic;
+  uint32 version;
+  // DataType of the keys and of the values.
+  uint32 key_dtype;
+  uint32 value_dtype;
+  uint32 reserved;
+  // A power of two.
+  uint64 num_buckets;
+  uint64 num_entries;
+  uint64 string_pool_size;
+  uint64 reserved2[2];
+};
+
+struct MemmappedHashTableBucket {
+  // Hash of the key, or 0 if the bucket is empty.
+  uint64 hash;
+  // The bits of an int64 key, or the offset of a string key in the pool.
+  uint64 key;
+  // The bits of an int64 value, or the offset of a string value in the pool.
+  uint64 value;
+  // Lengths of string keys and values, 0 otherwise.
+  uint32 key_size;
+  uint32 value_size;
+};
+
+static_assert(sizeof(MemmappedHashTableHeader) == 64, "Unexpected padding.");
+static_assert(sizeof(MemmappedHashTableBucket) == 32, "Unexpected padding.");
+
+constexpr uint64 kMemmappedHashTableMagic = 0x314c42544853464dULL;  // MFSHTBL1
+constexpr uint32 kMemmappedHashTableVersion = 1;
+
+// Hashes of keys as stored in the image. These are part of the file format
+// and must never change.
+inline uint64 MemmappedHashTableHash(int64_t key) {
+  // Finalizer of MurmurHash3.
+  uint64 h = static_cast<uint64>(key);
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h == 0 ? 1 : h;
+}
+
+inline uint64 MemmappedHashTableHash(StringPiece key) {
+  const uint64 h = Fingerprint64(key);
+  return h == 0 ? 1 : h;
+}
+
+// Builds the image of a MemmappedHashTable from batches of keys and values.
+//
+// Keys can be int64 or string, and so can values. As with HashTable, a key
+// may be inserted several times as long as it always maps to the same value.
+class MemmappedHashTableBuilder {
+ public:
+  MemmappedHashTableBuilder(DataType key_dtype, DataType value_dtype);
+
+  DataType key_dtype() const { return key_dtype_; }
+  DataType value_dtype() const { return value_dtype_; }
+  int64_t size() const { return num_entries_; }
+
+  // Makes room for `num_entries` entries, to avoid rehashing while inserting.
+  void Reserve(int64_t num_entries);
+
+  // Inserts the key-value pairs of the 1-D tensors `keys` and `values`.
+  Status Insert(const Tensor& keys, const Tensor& values);
+
+  // Returns the image of the table built so far, as a DT_UINT8 vector.
+  Status Finish(Tensor* image) const;
+
+ private:
+  // Returns the bucket holding `key`, or the empty bucket where it belongs.
+  template <typename K>
+  MemmappedHashTableBucket* FindBucket(K key, uint64 hash);
+  template <typename K, typename V>
+  Status InsertTyped(const Tensor& keys, const Tensor& values);
+  uint64 AppendString(StringPiece s, uint32* size);
+  void Rehash(uint64 num_buckets);
+
+  const DataType key_dtype_;
+  const DataType value_dtype_;
+  int64_t num_entries_ = 0;
+  std::vector<MemmappedHashTableBucket> buckets_;
+  std::string string_pool_;
+};
+
+// Reads keys and values from the text file `filename` as the
+// InitializeTableFromTextFile initializer would, and returns them as a
+// MemmappedHashTable image in `image`.
+Status ConvertTextFileToMemmappedHashTable(
+    const string& filename, int64_t vocab_size, char delimiter,
+    int32_t key_index, int32_t value_index, int64_t offset,
+    DataType key_dtype, DataType value_dtype, Env* env, Tensor* image);
+
+// Writes `image` to the standalone file `filename`. To add it to a
+// MemmappedFileSystem package instead, save it with
+// MemmappedFileSystemWriter::SaveTensor.
+Status WriteMemmappedHashTable(const Tensor& image, const string& filename,
+                               Env* env);
+
+// Lookup table serving directly from an image mapped read-only with
+// Env::NewReadOnlyMemoryRegionFromFile. Files are mapped by the file system
+// backing their name, which includes files of a MemmappedFileSystem package
+// when the session runs in a MemmappedEnv.
+//
+// Lookups are processed in blocks: the hashes of all the keys of a block are
+// computed and their buckets prefetched before any of them is probed, which
+// hides most of the latency of the random accesses to a table much larger than
+// the caches. Large batches are also split across the CPU worker threads.
+template <class K, class V>
+class MemmappedHashTable final : public LookupInterface {
+ public:
+  // Maps the file named by the "filename" input of the kernel.
+  MemmappedHashTable(OpKernelContext* ctx, OpKernel* kernel);
+
+  // Creates a table that needs to be loaded before it can be used.
+  MemmappedHashTable() = default;
+
+  // Maps the image stored in `filename` and validates its header.
+  Status Load(Env* env, const string& filename);
+
+  size_t size() const override {
+    return header_ == nullptr ? 0 : header_->num_entries;
+  }
+
+  // `ctx` is only used to shard large batches and may be null.
+  Status Find(OpKernelContext* ctx, const Tensor& keys, Tensor* values,
+              const Tensor& default_value) override;
+
+  Status Insert(OpKernelContext* ctx, const Tensor& keys,
+                const Tensor& values) override {
+    return errors::Unimplemented("MemmappedHashTable is read-only");
+  }
+
+  Status Remove(OpKernelContext* ctx, const Tensor& keys) override {
+    return errors::Unimplemented("MemmappedHashTable is read-only");
+  }
+
+  Status ExportValues(OpKernelContext* ctx) override;
+
+  Status ImportValues(OpKernelContext* ctx, const Tensor& keys,
+                      const Tensor& values) override {
+    return errors::Unimplemented("MemmappedHashTable is read-only");
+  }
+
+  DataType key_dtype() const override { return DataTypeToEnum<K>::v(); }
+
+  DataType value_dtype() const override { return DataTypeToEnum<V>::v(); }
+
+  TensorShape key_shape() const override { return TensorShape(); }
+
+  TensorShape value_shape() const override { return TensorShape(); }
+
+  // The mapped image is backed by the page cache rather than by allocations
+  // of this process.
+  int64_t MemoryUsed() const override { return sizeof(MemmappedHashTable); }
+
+  Status AsGraphDef(GraphDefBuilder* builder, Node** out) const override;
+
+ private:
+  // Looks up the keys in [begin, end). Returns false if the image turned out
+  // to be corrupted.
+  bool FindRange(const Tensor& keys, Tensor* values,
+                 const Tensor& default_value, int64_t begin, int64_t end) const;
+  // Returns the bucket holding `key`, or null if it is missing.
+  const MemmappedHashTableBucket* Probe(const K& key, uint64 hash) const;
+
+  string filename_;
+  std::unique_ptr<ReadOnlyMemoryRegion> region_;
+  const MemmappedHashTableHeader* header_ = nullptr;
+  const MemmappedHashTableBucket* buckets_ = nullptr;
+  const char* string_pool_ = nullptr;
+};
+
+}  // namespace lookup
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_KERNELS_MEMMAPPED_LOOKUP_TABLE_H_
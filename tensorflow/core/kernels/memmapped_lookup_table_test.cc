@@ -0,0 +1,296 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/kernels/memmapped_lookup_table.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/resource_mgr.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/kernels/initializable_lookup_table.h"
+#include "tensorflow/core/kernels/lookup_table_op.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/lib/random/simple_philox.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/core/util/memmapped_file_system.h"
+#include "tensorflow/core/util/memmapped_file_system_writer.h"
+
+namespace tensorflow {
+namespace lookup {
+namespace {
+
+string TempPath(const string& name) {
+  return io::JoinPath(testing::TmpDir(), name);
+}
+
+// Builds a table from `keys` and `values` and writes it to a temporary file
+// named `name`.
+string WriteTable(const string& name, const Tensor& keys,
+                  const Tensor& values) {
+  MemmappedHashTableBuilder builder(keys.dtype(), values.dtype());
+  TF_CHECK_OK(builder.Insert(keys, values));
+  Tensor image;
+  TF_CHECK_OK(builder.Finish(&image));
+  const string path = TempPath(name);
+  TF_CHECK_OK(WriteMemmappedHashTable(image, path, Env::Default()));
+  return path;
+}
+
+TEST(MemmappedHashTableTest, Int64Keys) {
+  const int64_t kSize = 10000;
+  Tensor keys(DT_INT64, TensorShape({kSize}));
+  Tensor values(DT_INT64, TensorShape({kSize}));
+  for (int64_t i = 0; i < kSize; ++i) {
+    keys.vec<int64_t>()(i) = i * 7919 - 5000;
+    values.vec<int64_t>()(i) = i;
+  }
+  core::RefCountPtr<MemmappedHashTable<int64_t, int64_t>> table(
+      new MemmappedHashTable<int64_t, int64_t>());
+  TF_ASSERT_OK(
+      table->Load(Env::Default(), WriteTable("int64_keys", keys, values)));
+  EXPECT_EQ(table->size(), kSize);
+
+  Tensor found(DT_INT64, TensorShape({kSize}));
+  TF_ASSERT_OK(
+      table->Find(nullptr, keys, &found, test::AsTensor<int64_t>({-1})));
+  test::ExpectTensorEqual<int64_t>(found, values);
+
+  Tensor missing(DT_INT64, TensorShape({3}));
+  TF_ASSERT_OK(table->Find(nullptr, test::AsTensor<int64_t>({1, -4999, 2}),
+                           &missing, test::AsTensor<int64_t>({-1, -2, -3})));
+  test::ExpectTensorEqual<int64_t>(missing,
+                                   test::AsTensor<int64_t>({-1, -2, -3}));
+}
+
+TEST(MemmappedHashTableTest, StringValues) {
+  core::RefCountPtr<MemmappedHashTable<int64_t, tstring>> table(
+      new MemmappedHashTable<int64_t, tstring>());
+  TF_ASSERT_OK(table->Load(
+      Env::Default(),
+      WriteTable("string_values", test::AsTensor<int64_t>({3, 1, 2}),
+                 test::AsTensor<tstring>({"three", "one", ""}))));
+
+  Tensor found(DT_STRING, TensorShape({4}));
+  TF_ASSERT_OK(table->Find(nullptr, test::AsTensor<int64_t>({1, 2, 3, 4}),
+                           &found, test::AsTensor<tstring>({"UNK"})));
+  test::ExpectTensorEqual<tstring>(
+      found, test::AsTensor<tstring>({"one", "", "three", "UNK"}));
+}
+
+TEST(MemmappedHashTableTest, ConvertsTextFile) {
+  const string vocab = TempPath("vocab.txt");
+  TF_ASSERT_OK(WriteStringToFile(Env::Default(), vocab,
+                                 "brain\tN\nsalad\tN\nsurgery\tV\n"));
+
+  // Whole lines to line numbers, as index_table_from_file does.
+  Tensor image;
+  TF_ASSERT_OK(ConvertTextFileToMemmappedHashTable(
+      vocab, /*vocab_size=*/-1, /*delimiter=*/' ', /*key_index=*/-2,
+      /*value_index=*/-1, /*offset=*/0, DT_STRING, DT_INT64, Env::Default(),
+      &image));
+  const string path = TempPath("vocab.table");
+  TF_ASSERT_OK(WriteMemmappedHashTable(image, path, Env::Default()));
+  core::RefCountPtr<MemmappedHashTable<tstring, int64_t>> table(
+      new MemmappedHashTable<tstring, int64_t>());
+  TF_ASSERT_OK(table->Load(Env::Default(), path));
+  EXPECT_EQ(table->size(), 3);
+  Tensor found(DT_INT64, TensorShape({4}));
+  TF_ASSERT_OK(table->Find(
+      nullptr, test::AsTensor<tstring>({"salad\tN", "brain", "surgery\tV", ""}),
+      &found, test::AsTensor<int64_t>({-1})));
+  test::ExpectTensorEqual<int64_t>(found,
+                                   test::AsTensor<int64_t>({1, -1, 2, -1}));
+
+  // First column to second column.
+  TF_ASSERT_OK(ConvertTextFileToMemmappedHashTable(
+      vocab, /*vocab_size=*/2, /*delimiter=*/'\t', /*key_index=*/0,
+      /*value_index=*/1, /*offset=*/0, DT_STRING, DT_STRING, Env::Default(),
+      &image));
+  TF_ASSERT_OK(WriteMemmappedHashTable(image, path, Env::Default()));
+  core::RefCountPtr<MemmappedHashTable<tstring, tstring>> columns(
+      new MemmappedHashTable<tstring, tstring>());
+  TF_ASSERT_OK(columns->Load(Env::Default(), path));
+  EXPECT_EQ(columns->size(), 2);
+  Tensor tags(DT_STRING, TensorShape({3}));
+  TF_ASSERT_OK(columns->Find(nullptr,
+                             test::AsTensor<tstring>({"salad", "surgery",
+                                                      "brain"}),
+                             &tags, test::AsTensor<tstring>({"?"})));
+  test::ExpectTensorEqual<tstring>(tags,
+                                   test::AsTensor<tstring>({"N", "?", "N"}));
+}
+
+TEST(MemmappedHashTableTest, LoadsFromMemmappedPackage) {
+  MemmappedHashTableBuilder builder(DT_STRING, DT_INT64);
+  TF_ASSERT_OK(builder.Insert(test::AsTensor<tstring>({"a", "b"}),
+                              test::AsTensor<int64_t>({10, 20})));
+  Tensor image;
+  TF_ASSERT_OK(builder.Finish(&image));
+
+  const string package = TempPath("package");
+  const string element =
+      strings::StrCat(MemmappedFileSystem::kMemmappedPackagePrefix, "vocab");
+  MemmappedFileSystemWriter writer;
+  TF_ASSERT_OK(writer.InitializeToFile(Env::Default(), package));
+  TF_ASSERT_OK(writer.SaveTensor(image, element));
+  TF_ASSERT_OK(writer.FlushAndClose());
+
+  MemmappedEnv env(Env::Default());
+  TF_ASSERT_OK(env.InitializeFromFile(package));
+  core::RefCountPtr<MemmappedHashTable<tstring, int64_t>> table(
+      new MemmappedHashTable<tstring, int64_t>());
+  TF_ASSERT_OK(table->Load(&env, element));
+  Tensor found(DT_INT64, TensorShape({3}));
+  TF_ASSERT_OK(table->Find(nullptr, test::AsTensor<tstring>({"b", "c", "a"}),
+                           &found, test::AsTensor<int64_t>({0})));
+  test::ExpectTensorEqual<int64_t>(found, test::AsTensor<int64_t>({20, 0, 10}));
+}
+
+TEST(MemmappedHashTableTest, DuplicateKeys) {
+  MemmappedHashTableBuilder builder(DT_INT64, DT_INT64);
+  TF_ASSERT_OK(builder.Insert(test::AsTensor<int64_t>({1, 2, 1}),
+                              test::AsTensor<int64_t>({5, 6, 5})));
+  EXPECT_EQ(builder.size(), 2);
+  Status s = builder.Insert(test::AsTensor<int64_t>({2}),
+                            test::AsTensor<int64_t>({7}));
+  EXPECT_TRUE(absl::StrContains(s.message(), "different value for same key"))
+      << s;
+}
+
+TEST(MemmappedHashTableTest, RejectsInvalidImages) {
+  const string path = WriteTable("invalid", test::AsTensor<int64_t>({1}),
+                                 test::AsTensor<int64_t>({2}));
+  core::RefCountPtr<MemmappedHashTable<tstring, int64_t>> wrong_type(
+      new MemmappedHashTable<tstring, int64_t>());
+  Status s = wrong_type->Load(Env::Default(), path);
+  EXPECT_TRUE(absl::StrContains(s.message(), "maps int64 to int64")) << s;
+
+  string contents;
+  TF_ASSERT_OK(ReadFileToString(Env::Default(), path, &contents));
+  TF_ASSERT_OK(WriteStringToFile(Env::Default(), path,
+                                 contents.substr(0, contents.size() - 8)));
+  core::RefCountPtr<MemmappedHashTable<int64_t, int64_t>> truncated(
+      new MemmappedHashTable<int64_t, int64_t>());
+  s = truncated->Load(Env::Default(), path);
+  EXPECT_TRUE(errors::IsDataLoss(s)) << s;
+
+  TF_ASSERT_OK(WriteStringToFile(Env::Default(), path, "not a table"));
+  s = truncated->Load(Env::Default(), path);
+  EXPECT_TRUE(errors::IsDataLoss(s)) << s;
+}
+
+class MemmappedHashTableOpTest : public OpsTestBase {};
+
+TEST_F(MemmappedHashTableOpTest, ServesLookups) {
+  const int64_t kSize = 100000;
+  Tensor keys(DT_INT64, TensorShape({kSize}));
+  Tensor values(DT_INT64, TensorShape({kSize}));
+  for (int64_t i = 0; i < kSize; ++i) {
+    keys.vec<int64_t>()(i) = i;
+    values.vec<int64_t>()(i) = kSize - i;
+  }
+  const string path = WriteTable("op", keys, values);
+
+  TF_ASSERT_OK(NodeDefBuilder("table", "MemmappedHashTable")
+                   .Input(FakeInput(DT_STRING))
+                   .Attr("key_dtype", DT_INT64)
+                   .Attr("value_dtype", DT_INT64)
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  AddInputFromArray<tstring>(TensorShape({}), {path});
+  TF_ASSERT_OK(RunOpKernel());
+
+  LookupInterface* table;
+  TF_ASSERT_OK(LookupResource(context_.get(),
+                              GetOutput(0)->scalar<ResourceHandle>()(),
+                              &table));
+  core::ScopedUnref unref(table);
+  EXPECT_EQ(table->size(), kSize);
+  // Large enough to be split across the worker threads.
+  Tensor found(DT_INT64, TensorShape({kSize}));
+  TF_ASSERT_OK(table->Find(context_.get(), keys, &found,
+                           test::AsTensor<int64_t>({-1})));
+  test::ExpectTensorEqual<int64_t>(found, values);
+}
+
+// Looks up batches of `kBatchSize` random keys, a quarter of them missing,
+// in a string table of `num_keys` entries.
+template <class Table>
+void BM_StringTableFind(::testing::benchmark::State& state, Table* table,
+                        int64_t num_keys) {
+  const int64_t kBatchSize = 4096;
+  random::PhiloxRandom philox(301, 17);
+  random::SimplePhilox rnd(&philox);
+  Tensor keys(DT_STRING, TensorShape({kBatchSize}));
+  for (int64_t i = 0; i < kBatchSize; ++i) {
+    keys.vec<tstring>()(i) =
+        strings::StrCat("token_", rnd.Uniform64(num_keys * 4 / 3));
+  }
+  Tensor found(DT_INT64, TensorShape({kBatchSize}));
+  const Tensor default_value = test::AsTensor<int64_t>({-1});
+  for (auto s : state) {
+    TF_CHECK_OK(table->Find(nullptr, keys, &found, default_value));
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          kBatchSize);
+}
+
+Tensor Vocabulary(int64_t num_keys, Tensor* ids) {
+  Tensor tokens(DT_STRING, TensorShape({num_keys}));
+  *ids = Tensor(DT_INT64, TensorShape({num_keys}));
+  for (int64_t i = 0; i < num_keys; ++i) {
+    tokens.vec<tstring>()(i) = strings::StrCat("token_", i);
+    ids->vec<int64_t>()(i) = i;
+  }
+  return tokens;
+}
+
+void BM_MemmappedHashTable(::testing::benchmark::State& state) {
+  const int64_t num_keys = state.range(0);
+  Tensor ids;
+  const Tensor tokens = Vocabulary(num_keys, &ids);
+  core::RefCountPtr<MemmappedHashTable<tstring, int64_t>> table(
+      new MemmappedHashTable<tstring, int64_t>());
+  TF_CHECK_OK(table->Load(Env::Default(), WriteTable("bench", tokens, ids)));
+  BM_StringTableFind(state, table.get(), num_keys);
+}
+
+void BM_HashTable(::testing::benchmark::State& state) {
+  const int64_t num_keys = state.range(0);
+  Tensor ids;
+  const Tensor tokens = Vocabulary(num_keys, &ids);
+  core::RefCountPtr<HashTable<tstring, int64_t>> table(
+      new HashTable<tstring, int64_t>(nullptr, nullptr));
+  KeyValueTensorIterator iter(&tokens, &ids);
+  TF_CHECK_OK(table->Initialize(iter));
+  BM_StringTableFind(state, table.get(), num_keys);
+}
+
+BENCHMARK(BM_MemmappedHashTable)->Arg(1 << 10)->Arg(1 << 20)->Arg(1 << 23);
+BENCHMARK(BM_HashTable)->Arg(1 << 10)->Arg(1 << 20)->Arg(1 << 23);
+
+}  // namespace
+}  // namespace lookup
+}  // namespace tensorflow
@@ -1547,4 +1547,16 @@ BM_TopKCPU(128, 70000, 70000, 16, "topk_nmt_r_128_c_70000_k_70000_th_16");
 BM_TopKCPU(128, 175000, 175000, 16, "topk_nmt_r_128_c_175000_k_175000_th_16");
 BM_TopKCPU(128, 350000, 350000, 16, "topk_nmt_r_128_c_350000_k_350000_th_16");
 
+// Retrieval: a few queries scoring a large candidate set, where rows are split
+// into blocks of columns.
+BM_TopKCPU(1, 1000000, 10, 16, "topk_retrieval_r_1_c_1000000_k_10_th_16");
+BM_TopKCPU(1, 1000000, 100, 16, "topk_retrieval_r_1_c_1000000_k_100_th_16");
+BM_TopKCPU(1, 1000000, 1000, 16, "topk_retrieval_r_1_c_1000000_k_1000_th_16");
+BM_TopKCPU(1, 5000000, 10, 16, "topk_retrieval_r_1_c_5000000_k_10_th_16");
+BM_TopKCPU(1, 5000000, 100, 16, "topk_retrieval_r_1_c_5000000_k_100_th_16");
+BM_TopKCPU(1, 5000000, 1000, 16, "topk_retrieval_r_1_c_5000000_k_1000_th_16");
+BM_TopKCPU(1, 5000000, 100, 1, "topk_retrieval_r_1_c_5000000_k_100_th_1");
+BM_TopKCPU(4, 5000000, 100, 16, "topk_retrieval_r_4_c_5000000_k_100_th_16");
+BM_TopKCPU(16, 5000000, 100, 16, "topk_retrieval_r_16_c_5000000_k_100_th_16");
+
 }  // namespace tensorflow
@@ -20,7 +20,9 @@ limitations under the License.
 
 #define EIGEN_USE_THREADS
 
+#include <algorithm>
 #include <atomic>
+#include <vector>
 
 #include "unsupported/Eigen/CXX11/Tensor"  // from @eigen_archive
 
@@ -127,6 +129,13 @@ struct ScatterNdFunctor<CPUDevice, T, Index, OP, IXDIM> {
           batch_strides[dim + 1] * output_shape_prefix[dim + 1];
     }
 
+    if (d.numThreads() > 1 && Toutput.dimension(0) > 1 &&
+        batch_size * slice_size >= kMinParallelWork &&
+        slice_size <= kMaxParallelSliceSize) {
+      return ParallelUpdate(d, slice_size, output_shape_prefix, batch_strides,
+                            Tindices, Tupdates, Toutput);
+    }
+
     for (Eigen::DenseIndex loc = 0; loc < batch_size; ++loc) {
       Index i = 0;
       bool out_of_bounds = false;
@@ -151,6 +160,108 @@ struct ScatterNdFunctor<CPUDevice, T, Index, OP, IXDIM> {
 
     return error_loc;
   }
+
+ private:
+  // Below this many updated elements, the updates are applied serially.
+  static constexpr int64_t kMinParallelWork = 32 * 1024;
+  // Above this slice size, each update is already split over the threads.
+  static constexpr int64_t kMaxParallelSliceSize = 64 * 1024;
+
+  // Applies the updates on all the threads of `d`. The output slices are
+  // partitioned into contiguous ranges, each owned by a single shard, and
+  // each shard applies its updates in their original order. Every slice thus
+  // sees the same sequence of updates as with the serial loop, even when
+  // indices are duplicated.
+  //
+  // All the indices are checked before any update is applied, so nothing is
+  // updated if one of them is out of bounds.
+  static Index ParallelUpdate(
+      const CPUDevice& d, const Index slice_size,
+      const Eigen::array<Eigen::DenseIndex, IXDIM>& output_shape_prefix,
+      const Index* batch_strides,
+      typename TTypes<Index, 2>::ConstTensor Tindices,
+      typename TTypes<T, 2>::ConstTensor Tupdates,
+      typename TTypes<T, 2>::Tensor Toutput) {
+    const Eigen::DenseIndex batch_size = Tindices.dimension(0);
+    const Eigen::DenseIndex num_slices = Toutput.dimension(0);
+
+    // Flat output slice of every update.
+    std::vector<Index> slices(batch_size);
+    std::atomic<Eigen::DenseIndex> error_loc(batch_size);
+    auto compute_slices = [&](Eigen::DenseIndex begin, Eigen::DenseIndex end) {
+      for (Eigen::DenseIndex loc = begin; loc < end; ++loc) {
+        Index i = 0;
+        bool out_of_bounds = false;
+        for (int dim = 0; dim < IXDIM; ++dim) {
+          const Index ix_d = internal::SubtleMustCopy(Tindices(loc, dim));
+          out_of_bounds |= !FastBoundsCheck(ix_d, output_shape_prefix[dim]);
+          i += ix_d * batch_strides[dim];
+        }
+        if (TF_PREDICT_FALSE(out_of_bounds)) {
+          Eigen::DenseIndex current = error_loc.load();
+          while (loc < current &&
+                 !error_loc.compare_exchange_weak(current, loc)) {
+          }
+          return;
+        }
+        slices[loc] = i;
+      }
+    };
+    d.parallelFor(batch_size,
+                  Eigen::TensorOpCost(IXDIM * sizeof(Index), sizeof(Index),
+                                      3 * IXDIM),
+                  compute_slices);
+    if (TF_PREDICT_FALSE(error_loc.load() < batch_size)) {
+      return error_loc.load();
+    }
+
+    // Stable partition of the updates by the shard owning their slice, in a
+    // single counting sort pass. Several shards per thread keep the threads
+    // busy when the indices are skewed.
+    const int64_t num_shards =
+        std::min<int64_t>(4 * d.numThreads(), num_slices);
+    auto shard_of = [num_shards, num_slices](Index slice) {
+      return static_cast<int64_t>(slice) * num_shards / num_slices;
+    };
+    std::vector<Eigen::DenseIndex> shard_starts(num_shards + 1, 0);
+    for (Eigen::DenseIndex loc = 0; loc < batch_size; ++loc) {
+      ++shard_starts[shard_of(slices[loc]) + 1];
+    }
+    for (int64_t shard = 0; shard < num_shards; ++shard) {
+      shard_starts[shard + 1] += shard_starts[shard];
+    }
+    std::vector<Eigen::DenseIndex> order(batch_size);
+    {
+      std::vector<Eigen::DenseIndex> next(shard_starts.begin(),
+                                          shard_starts.end() - 1);
+      for (Eigen::DenseIndex loc = 0; loc < batch_size; ++loc) {
+        order[next[shard_of(slices[loc])]++] = loc;
+      }
+    }
+
+    auto apply_updates = [&](int64_t begin_shard, int64_t end_shard) {
+      const Eigen::DefaultDevice device;
+      for (Eigen::DenseIndex k = shard_starts[begin_shard];
+           k < shard_starts[end_shard]; ++k) {
+        const Eigen::DenseIndex loc = order[k];
+        auto input_chip = Toutput.template chip<0>(slices[loc]);
+        auto output_chip = input_chip;
+        auto update_chip = Tupdates.template chip<0>(loc);
+        update_executor::UpdateExecutor<
+            Eigen::DefaultDevice, decltype(input_chip), decltype(update_chip),
+            decltype(output_chip), OP>::Execute(device, input_chip,
+                                                update_chip, output_chip);
+      }
+    };
+    const double elements_per_shard =
+        static_cast<double>(batch_size) * slice_size / num_shards;
+    d.parallelFor(num_shards,
+                  Eigen::TensorOpCost(elements_per_shard * sizeof(T),
+                                      elements_per_shard * sizeof(T),
+                                      elements_per_shard),
+                  apply_updates);
+    return -1;
+  }
 };
 
 #define REGISTER_SCATTER_ND_FULL(T, Index, op)                               \
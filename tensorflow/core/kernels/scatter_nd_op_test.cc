@@ -174,6 +174,54 @@ TEST_F(ScatterNdUpdateOpTest, HigherRank) {
   test::ExpectTensorEqual<float>(expected, params_tensor);
 }
 
+// Enough updates for the rows to be updated in parallel, with every row
+// updated many times. The last update of each row must win.
+TEST_F(ScatterNdUpdateOpTest, ManyRepeatedIndices) {
+  MakeOp(DT_FLOAT_REF, DT_INT32);
+
+  const int kRows = 1000;
+  const int kNumUpdates = 50000;
+  const int kSliceSize = 4;
+  std::vector<int32> indices(kNumUpdates);
+  std::vector<float> updates(kNumUpdates * kSliceSize);
+  std::vector<float> expected_values(kRows * kSliceSize, 0);
+  for (int i = 0; i < kNumUpdates; ++i) {
+    indices[i] = (i * 7919) % kRows;
+    for (int j = 0; j < kSliceSize; ++j) {
+      updates[i * kSliceSize + j] = i * kSliceSize + j;
+      expected_values[indices[i] * kSliceSize + j] = i * kSliceSize + j;
+    }
+  }
+  AddInputFromArray<float>(TensorShape({kRows, kSliceSize}),
+                           std::vector<float>(kRows * kSliceSize, 0));
+  AddInputFromArray<int32>(TensorShape({kNumUpdates, 1}), indices);
+  AddInputFromArray<float>(TensorShape({kNumUpdates, kSliceSize}), updates);
+  TF_ASSERT_OK(RunOpKernel());
+
+  Tensor params_tensor = *mutable_input(0).tensor;
+  Tensor expected(allocator(), DT_FLOAT, TensorShape({kRows, kSliceSize}));
+  test::FillValues<float>(&expected, expected_values);
+  test::ExpectTensorEqual<float>(expected, params_tensor);
+}
+
+TEST_F(ScatterNdUpdateOpTest, ManyIndicesOneOutOfRange) {
+  MakeOp(DT_FLOAT_REF, DT_INT32);
+
+  const int kRows = 1000;
+  const int kNumUpdates = 50000;
+  std::vector<int32> indices(kNumUpdates);
+  for (int i = 0; i < kNumUpdates; ++i) indices[i] = i % kRows;
+  indices[30000] = kRows;
+  AddInputFromArray<float>(TensorShape({kRows}), std::vector<float>(kRows));
+  AddInputFromArray<int32>(TensorShape({kNumUpdates, 1}), indices);
+  AddInputFromArray<float>(TensorShape({kNumUpdates}),
+                           std::vector<float>(kNumUpdates, 1));
+  Status s = RunOpKernel();
+  EXPECT_TRUE(absl::StrContains(
+      s.ToString(), "indices[30000] = [1000] does not index into shape [1000]"))
+      << s;
+}
+
 TEST_F(ScatterNdUpdateOpTest, Error_IndexOutOfRange) {
   MakeOp(DT_FLOAT_REF, DT_INT32);
 
@@ -255,14 +303,14 @@ class ScatterNdUpdateBM : public ScatterNdUpdateOpTest {
 
 template <typename Index>
 void BM_ScatterNdHelper(::testing::benchmark::State& state, int embedding_size,
-                        const char* op) {
+                        const char* op, int num_updates = 1000) {
   const int kRows = 10000000 / embedding_size;
   std::vector<float> values;
   values.reserve(kRows);
   for (int i = 0; i < kRows * embedding_size; i++) {
     values.push_back(i);
   }
-  const int kNumUpdates = 1000;
+  const int kNumUpdates = num_updates;
   random::PhiloxRandom philox(301, 17);
   random::SimplePhilox rnd(&philox);
   std::vector<Index> indices;
@@ -325,5 +373,33 @@ BENCHMARK(BM_ScatterNdUpdateInt64)
 BENCHMARK(BM_ScatterNdAddInt32)->Arg(1)->Arg(10)->Arg(64)->Arg(256)->Arg(1024);
 BENCHMARK(BM_ScatterNdAddInt64)->Arg(1)->Arg(10)->Arg(64)->Arg(256)->Arg(1024);
 
+// Large sparse updates, as in embedding training steps, which are applied on
+// all the threads.
+void BM_ScatterNdUpdateManyInt64(::testing::benchmark::State& state) {
+  const int embedding_size = state.range(0);
+  const int num_updates = state.range(1);
+
+  BM_ScatterNdHelper<int64_t>(state, embedding_size, "ScatterNdUpdate",
+                              num_updates);
+}
+void BM_ScatterNdAddManyInt64(::testing::benchmark::State& state) {
+  const int embedding_size = state.range(0);
+  const int num_updates = state.range(1);
+
+  BM_ScatterNdHelper<int64_t>(state, embedding_size, "ScatterNdAdd",
+                              num_updates);
+}
+
+BENCHMARK(BM_ScatterNdUpdateManyInt64)
+    ->ArgPair(1, 1 << 20)
+    ->ArgPair(10, 1 << 18)
+    ->ArgPair(64, 1 << 16)
+    ->ArgPair(256, 1 << 14);
+BENCHMARK(BM_ScatterNdAddManyInt64)
+    ->ArgPair(1, 1 << 20)
+    ->ArgPair(10, 1 << 18)
+    ->ArgPair(64, 1 << 16)
+    ->ArgPair(256, 1 << 14);
+
 }  // namespace
 }  // namespace tensorflow
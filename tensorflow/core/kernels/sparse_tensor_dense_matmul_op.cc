@@ -19,11 +19,15 @@ limitations under the License.
 
 #include "tensorflow/core/kernels/sparse_tensor_dense_matmul_op.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "tensorflow/core/framework/bounds_check.h"
 #include "tensorflow/core/framework/op.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/kernels/fill_functor.h"
 #include "tensorflow/core/platform/bfloat16.h"
+#include "tensorflow/core/util/work_sharder.h"
 
 namespace tensorflow {
 
@@ -250,14 +254,22 @@ Status MOutOfBoundsError(int64_t m, std::size_t i, int lhs_index_a,
                                  "] out of bounds (>=", out_dim0, ")");
 }
 
+// Vectorize certain operations above this size.
+constexpr std::size_t kNumVectorize = 32;
+
+// Below this number of multiply-adds, grouping the nonzeros of `a` by output
+// row costs more than computing the output rows in parallel saves.
+constexpr int64_t kMinWorkForRowSharding = 64 * 1024;
+
+// Output columns computed by each task when there are fewer output rows than
+// threads.
+constexpr int64_t kMinColumnsPerBlock = 128;
+
 template <typename T, typename Tsum, typename Tindices, bool ADJ_A, bool ADJ_B>
 Status SparseTensorDenseMatMulImpl(
     typename TTypes<Tsum>::Matrix out,
     typename TTypes<Tindices>::ConstMatrix a_indices,
     typename TTypes<T>::ConstVec a_values, typename TTypes<T>::ConstMatrix b) {
-  // Vectorize certain operations above this size.
-  static constexpr std::size_t kNumVectorize = 32;
-
   const std::size_t nnz = a_values.size();
   const std::size_t rhs_right = (ADJ_B ? b.dimension(0) : b.dimension(1));
   const std::size_t lhs_right = (ADJ_B ? b.dimension(1) : b.dimension(0));
@@ -321,6 +333,134 @@ Status SparseTensorDenseMatMulImpl(
   }
   return absl::OkStatus();
 }
+
+// Computes the same product as SparseTensorDenseMatMulImpl, with the output
+// rows split across the CPU worker threads.
+//
+// The nonzeros of `a` are first grouped by the output row they contribute to,
+// which is their row of `a`, or their column when ADJ_A. This converts `a` to
+// CSR (or `a^H` to CSR, without transposing it) on the fly. The grouping is
+// stable, so each output row accumulates its terms in the same order as the
+// nnz loop of SparseTensorDenseMatMulImpl. When ADJ_B, `b^H` is materialized
+// once so that the rows of `b` read for each nonzero are contiguous and
+// accumulated with packet (SIMD) instructions.
+template <typename T, typename Tsum, typename Tindices, bool ADJ_A, bool ADJ_B>
+Status SparseTensorDenseMatMulByRows(
+    OpKernelContext* ctx, typename TTypes<Tsum>::Matrix out,
+    typename TTypes<Tindices>::ConstMatrix a_indices,
+    typename TTypes<T>::ConstVec a_values, typename TTypes<T>::ConstMatrix b) {
+  const std::size_t nnz = a_values.size();
+  const int64_t rhs_right = (ADJ_B ? b.dimension(0) : b.dimension(1));
+  const std::size_t lhs_right = (ADJ_B ? b.dimension(1) : b.dimension(0));
+  const int lhs_index_a = ADJ_A ? 1 : 0;
+  const int rhs_index_a = ADJ_A ? 0 : 1;
+  const int64_t num_rows = out.dimension(0);
+
+  // Validate the indices, in the same order as the nnz loop, and count the
+  // nonzeros of each output row. The validated indices are copied, so that
+  // later changes to `a_indices` cannot cause out of bounds accesses.
+  std::vector<Tindices> nnz_rows(nnz);
+  std::vector<Tindices> nnz_cols(nnz);
+  std::vector<int64_t> row_starts(num_rows + 1, 0);
+  for (std::size_t i = 0; i < nnz; ++i) {
+    const Tindices m = internal::SubtleMustCopy(a_indices(i, lhs_index_a));
+    const Tindices k = internal::SubtleMustCopy(a_indices(i, rhs_index_a));
+    if (!FastBoundsCheck(k, lhs_right)) {
+      return KOutOfBoundsError(k, i, rhs_index_a, lhs_right);
+    }
+    if (!FastBoundsCheck(m, num_rows)) {
+      return MOutOfBoundsError(m, i, lhs_index_a, num_rows);
+    }
+    nnz_rows[i] = m;
+    nnz_cols[i] = k;
+    ++row_starts[m + 1];
+  }
+  for (int64_t m = 0; m < num_rows; ++m) {
+    row_starts[m + 1] += row_starts[m];
+  }
+
+  // Stable counting sort of the nonzeros by output row.
+  std::vector<Tindices> csr_cols(nnz);
+  std::vector<T> csr_values(nnz);
+  {
+    std::vector<int64_t> next(row_starts.begin(), row_starts.end() - 1);
+    for (std::size_t i = 0; i < nnz; ++i) {
+      const int64_t pos = next[nnz_rows[i]]++;
+      csr_cols[pos] = nnz_cols[i];
+      csr_values[pos] = ADJ_A ? MaybeConj(a_values(i)) : a_values(i);
+    }
+  }
+
+  Tensor b_adjoint_t;
+  const T* b_rows = b.data();
+  if (ADJ_B) {
+    TF_RETURN_IF_ERROR(ctx->allocate_temp(
+        DataTypeToEnum<T>::value,
+        TensorShape({static_cast<int64_t>(lhs_right), rhs_right}),
+        &b_adjoint_t));
+    Eigen::array<int, 2> shuffle{1, 0};
+    b_adjoint_t.matrix<T>().device(ctx->eigen_device<CPUDevice>()) =
+        b.shuffle(shuffle).conjugate();
+    b_rows = b_adjoint_t.flat<T>().data();
+  }
+
+  // Few output rows, as with ADJ_A and a short `a`, are also split into
+  // blocks of columns to keep all threads busy.
+  const auto& worker_threads = *ctx->device()->tensorflow_cpu_worker_threads();
+  int64_t block_cols = rhs_right;
+  if (num_rows < worker_threads.num_threads) {
+    const int64_t blocks_per_row =
+        Eigen::divup<int64_t>(worker_threads.num_threads, num_rows);
+    block_cols = std::max(kMinColumnsPerBlock,
+                          Eigen::divup<int64_t>(rhs_right, blocks_per_row));
+  }
+  const int64_t blocks_per_row = Eigen::divup(rhs_right, block_cols);
+
+  auto work = [&](int64_t start_block, int64_t limit_block) {
+    for (int64_t block = start_block; block < limit_block; ++block) {
+      const int64_t m = block / blocks_per_row;
+      const int64_t begin = (block % blocks_per_row) * block_cols;
+      const int64_t size = std::min(rhs_right, begin + block_cols) - begin;
+      Tsum* out_row = &out(m, begin);
+      for (int64_t j = row_starts[m]; j < row_starts[m + 1]; ++j) {
+        const Tsum a_value = static_cast<Tsum>(csr_values[j]);
+        const T* b_row = b_rows + csr_cols[j] * rhs_right + begin;
+        if (size < static_cast<int64_t>(kNumVectorize)) {
+          for (int64_t n = 0; n < size; ++n) {
+            out_row[n] += a_value * static_cast<Tsum>(b_row[n]);
+          }
+        } else {
+          typename TTypes<Tsum>::UnalignedVec out_vec(out_row, size);
+          typename TTypes<T>::UnalignedConstVec b_vec(b_row, size);
+          out_vec += b_vec.template cast<Tsum>() * a_value;
+        }
+      }
+    }
+  };
+  const int64_t nnz_per_row = Eigen::divup<int64_t>(nnz, num_rows);
+  const int64_t cost_per_block =
+      (nnz_per_row + 1) * block_cols *
+      (Eigen::TensorOpCost::AddCost<Tsum>() +
+       Eigen::TensorOpCost::MulCost<Tsum>());
+  Shard(worker_threads.num_threads, worker_threads.workers,
+        num_rows * blocks_per_row, cost_per_block, work);
+  return absl::OkStatus();
+}
+
+template <typename T, typename Tsum, typename Tindices, bool ADJ_A, bool ADJ_B>
+Status SparseTensorDenseMatMulCpu(
+    OpKernelContext* ctx, typename TTypes<Tsum>::Matrix out,
+    typename TTypes<Tindices>::ConstMatrix a_indices,
+    typename TTypes<T>::ConstVec a_values, typename TTypes<T>::ConstMatrix b) {
+  const int64_t work = static_cast<int64_t>(a_values.size()) * out.dimension(1);
+  if (ctx->device()->tensorflow_cpu_worker_threads()->num_threads > 1 &&
+      work >= kMinWorkForRowSharding) {
+    return SparseTensorDenseMatMulByRows<T, Tsum, Tindices, ADJ_A, ADJ_B>(
+        ctx, out, a_indices, a_values, b);
+  }
+  return SparseTensorDenseMatMulImpl<T, Tsum, Tindices, ADJ_A, ADJ_B>(
+      out, a_indices, a_values, b);
+}
 }  // namespace
 
 template <typename T, typename Tindices, bool ADJ_A, bool ADJ_B>
@@ -338,8 +478,8 @@ struct SparseTensorDenseMatMulFunctor<CPUDevice, T, Tindices, ADJ_A, ADJ_B> {
       auto temp_out = temp_out_t.matrix<Tsum>();
       temp_out.setZero();
       TF_RETURN_IF_ERROR(
-          SparseTensorDenseMatMulImpl<T, Tsum, Tindices, ADJ_A, ADJ_B>(
-              temp_out, a_indices, a_values, b));
+          SparseTensorDenseMatMulCpu<T, Tsum, Tindices, ADJ_A, ADJ_B>(
+              ctx, temp_out, a_indices, a_values, b));
       out = temp_out.template cast<T>();
     } else {
       out.setZero();
@@ -348,8 +488,8 @@ struct SparseTensorDenseMatMulFunctor<CPUDevice, T, Tindices, ADJ_A, ADJ_B> {
       auto out_workaround =
           *reinterpret_cast<typename TTypes<Tsum>::Matrix*>(&out);
       TF_RETURN_IF_ERROR(
-          SparseTensorDenseMatMulImpl<T, Tsum, Tindices, ADJ_A, ADJ_B>(
-              out_workaround, a_indices, a_values, b));
+          SparseTensorDenseMatMulCpu<T, Tsum, Tindices, ADJ_A, ADJ_B>(
+              ctx, out_workaround, a_indices, a_values, b));
     }
     return OkStatus();
   }
@@ -120,4 +120,10 @@ BM_SparseTensorDenseMatmul(16384, 4096, 4096, 4096, false, true);
 BM_SparseTensorDenseMatmul(16384, 4096, 4096, 4096, true, false);
 BM_SparseTensorDenseMatmul(16384, 4096, 4096, 4096, true, true);
 
+// Few output rows, as in the batch of a wide embedding layer.
+BM_SparseTensorDenseMatmul(65536, 8, 65536, 64, false, false);
+BM_SparseTensorDenseMatmul(65536, 8, 65536, 256, false, false);
+BM_SparseTensorDenseMatmul(65536, 65536, 8, 256, true, false);
+BM_SparseTensorDenseMatmul(65536, 8, 65536, 256, false, true);
+
 }  // end namespace tensorflow
@@ -15,7 +15,10 @@ limitations under the License.
 
 // See docs in ../ops/string_ops.cc.
 
+#include <algorithm>
+#include <iterator>
 #include <string>
+#include <vector>
 
 #include "tensorflow/core/framework/kernel_def_builder.h"
 #include "tensorflow/core/framework/op_kernel.h"
@@ -24,83 +27,101 @@ limitations under the License.
 #include "tensorflow/core/lib/core/status.h"
 #include "tensorflow/core/lib/core/stringpiece.h"
 #include "tensorflow/core/lib/strings/str_util.h"
+#include "tensorflow/core/util/work_sharder.h"
 
 namespace tensorflow {
 namespace {
-// Split input string `str` based on a character delimiter.
-// Returns a vector of StringPieces which are valid as long as input `str`
-// is valid.
+
+// Rough number of cycles needed to scan one byte of input and to emit one
+// token.
+constexpr int64_t kCostPerByte = 2;
+constexpr int64_t kCostPerToken = 50;
+
+// Set of single character delimiters, tested with one table lookup per input
+// character.
+class DelimiterSet {
+ public:
+  explicit DelimiterSet(StringPiece delimiters) {
+    std::fill(std::begin(is_delimiter_), std::end(is_delimiter_), false);
+    for (const char c : delimiters) {
+      is_delimiter_[static_cast<unsigned char>(c)] = true;
+    }
+  }
+
+  bool Contains(char c) const {
+    return is_delimiter_[static_cast<unsigned char>(c)];
+  }
+
+ private:
+  bool is_delimiter_[256];
+};
+
+// Split input string `str` based on a character delimiter, and call `emit`
+// with each resulting token. Tokens are StringPieces which are valid as long
+// as input `str` is valid.
 // Note: The single character delimiter is a common case and is implemented as
 // a series of finds in the input string, making it much more efficient than
 // SplitOnCharSet.
-template <typename Predicate>
-std::vector<StringPiece> SplitOnChar(const tstring& str, const char delim,
-                                     Predicate p) {
-  std::vector<StringPiece> result;
+template <typename Predicate, typename Emit>
+void SplitOnChar(const tstring& str, const char delim, Predicate p,
+                 Emit emit) {
   StringPiece text(str);
   auto f = text.find(delim);
   while (f != StringPiece::npos) {
     StringPiece token = text.substr(0, f);
     if (p(token)) {
-      result.emplace_back(token);
+      emit(token);
     }
     text.remove_prefix(f + 1);
     f = text.find(delim);
   }
   if (p(text)) {
-    result.push_back(text);
+    emit(text);
   }
-  return result;
 }
 
-// Split input string `str` based on a set of character delimiters.
-// Returns a vector of StringPieces which are valid as long as input `str`
-// is valid.
+// Split input string `str` based on a set of character delimiters, and call
+// `emit` with each resulting token.
 // Based on str_util::Split.
-template <typename Predicate>
-std::vector<StringPiece> SplitOnCharSet(const tstring& str,
-                                        const tstring& delim_set, Predicate p) {
-  std::vector<StringPiece> result;
+template <typename Predicate, typename Emit>
+void SplitOnCharSet(const tstring& str, const DelimiterSet& delims,
+                    Predicate p, Emit emit) {
   StringPiece text(str);
-  StringPiece delims(delim_set);
   size_t token_start = 0;
   for (size_t i = 0; i < text.size() + 1; i++) {
-    if ((i == text.size()) || (delims.find(text[i]) != StringPiece::npos)) {
+    if ((i == text.size()) || delims.Contains(text[i])) {
       StringPiece token(text.data() + token_start, i - token_start);
       if (p(token)) {
-        result.emplace_back(token);
+        emit(token);
       }
       token_start = i + 1;
     }
   }
-  return result;
 }
 
-// Split input string `str` based on given delimiter.
-// Returns a vector of StringPieces which are valid as long as input `str`
-// is valid.
-template <typename Predicate>
-std::vector<StringPiece> Split(const tstring& str, const tstring& delimiter,
-                               Predicate predicate) {
+// Split input string `str` based on given delimiter, and call `emit` with each
+// resulting token.
+template <typename Predicate, typename Emit>
+void Split(const tstring& str, const tstring& delimiter,
+           const DelimiterSet& delims, Predicate predicate, Emit emit) {
   if (str.empty()) {
-    return std::vector<StringPiece>();
+    return;
   }
   if (delimiter.empty()) {
-    std::vector<StringPiece> result;
-    result.resize(str.size());
     for (size_t i = 0; i < str.size(); ++i) {
-      result[i] = StringPiece(str.data() + i, 1);
+      emit(StringPiece(str.data() + i, 1));
     }
-    return result;
+    return;
   }
   if (delimiter.size() == 1) {
-    return SplitOnChar(str, delimiter[0], predicate);
+    SplitOnChar(str, delimiter[0], predicate, emit);
+    return;
   }
-  return SplitOnCharSet(str, delimiter, predicate);
+  SplitOnCharSet(str, delims, predicate, emit);
 }
 
-std::vector<StringPiece> SplitV2(const tstring& str, StringPiece sep,
-                                 int maxsplit) {
+template <typename Emit>
+void SplitV2(const tstring& str, StringPiece sep, int maxsplit, Emit emit) {
   // This SplitV2 method matches the behavior of python's str.split:
   //   If sep is given, consecutive delimiters are not grouped together
   //   and are deemed to delimit empty strings (for example, '1,,2'.split(',')
@@ -115,12 +136,10 @@ std::vector<StringPiece> SplitV2(const tstring& str, StringPiece sep,
   //   splitting an empty string or a string consisting of just whitespace
   //   with a None separator returns [].
 
-  std::vector<StringPiece> result;
-
   StringPiece text(str);
   if (maxsplit == 0) {
-    result.emplace_back(text);
-    return result;
+    emit(text);
+    return;
   }
 
   if (sep.empty()) {
@@ -129,32 +148,98 @@ std::vector<StringPiece> SplitV2(const tstring& str, StringPiece sep,
     str_util::RemoveLeadingWhitespace(&text);
     int split = 0;
     while (str_util::ConsumeNonWhitespace(&text, &token)) {
-      result.push_back(token);
+      emit(token);
       str_util::RemoveLeadingWhitespace(&text);
       ++split;
       if (maxsplit > 0 && split == maxsplit) {
-        result.push_back(text);
-        return result;
+        emit(text);
+        return;
       }
     }
-    return result;
+    return;
   }
   auto p = std::search(text.begin(), text.end(), sep.begin(), sep.end());
   int split = 0;
   while (p != text.end()) {
     StringPiece token = text.substr(0, p - text.begin());
-    result.push_back(token);
+    emit(token);
     text.remove_prefix(token.size());
     text.remove_prefix(sep.size());
     ++split;
     if (maxsplit > 0 && split == maxsplit) {
-      result.push_back(StringPiece(text));
-      return result;
+      emit(text);
+      return;
     }
     p = std::search(text.begin(), text.end(), sep.begin(), sep.end());
   }
-  result.push_back(text);
-  return result;
+  emit(text);
+}
+
+// Writes the tokens of each string in `input` to the outputs of a sparse
+// tensor. `split(i, emit)` must call `emit` with each token of the `i`-th
+// string.
+//
+// Strings are split twice, first to count their tokens and then to copy them
+// to their final positions. This avoids materializing the tokens of the whole
+// batch, and lets both passes be sharded across the CPU worker threads.
+template <typename SplitFn>
+void SplitBatch(OpKernelContext* ctx, const TTypes<tstring>::ConstVec& input,
+                SplitFn split) {
+  const int64_t batch_size = input.dimension(0);
+  int64_t input_bytes = 0;
+  for (int64_t i = 0; i < batch_size; ++i) {
+    input_bytes += input(i).size();
+  }
+  const int64_t cost_per_string =
+      kCostPerToken +
+      kCostPerByte * (batch_size > 0 ? input_bytes / batch_size : 0);
+  const auto& worker_threads = *ctx->device()->tensorflow_cpu_worker_threads();
+
+  std::vector<int64_t> row_starts(batch_size + 1, 0);
+  Shard(worker_threads.num_threads, worker_threads.workers, batch_size,
+        cost_per_string, [&split, &row_starts](int64_t start, int64_t limit) {
+          for (int64_t i = start; i < limit; ++i) {
+            int64_t n_entries = 0;
+            split(i, [&n_entries](StringPiece) { ++n_entries; });
+            row_starts[i + 1] = n_entries;
+          }
+        });
+  int64_t max_num_entries = 0;
+  for (int64_t i = 0; i < batch_size; ++i) {
+    max_num_entries = std::max(max_num_entries, row_starts[i + 1]);
+    row_starts[i + 1] += row_starts[i];
+  }
+  const int64_t output_size = row_starts[batch_size];
+
+  Tensor* sp_indices_t;
+  OP_REQUIRES_OK(ctx, ctx->allocate_output(0, TensorShape({output_size, 2}),
+                                           &sp_indices_t));
+  Tensor* sp_tokens_t;
+  OP_REQUIRES_OK(
+      ctx, ctx->allocate_output(1, TensorShape({output_size}), &sp_tokens_t));
+  Tensor* sp_shape_t;
+  OP_REQUIRES_OK(ctx, ctx->allocate_output(2, TensorShape({2}), &sp_shape_t));
+
+  auto sp_indices = sp_indices_t->matrix<int64_t>();
+  auto sp_tokens = sp_tokens_t->vec<tstring>();
+  auto sp_shape = sp_shape_t->vec<int64_t>();
+  sp_shape(0) = batch_size;
+  sp_shape(1) = max_num_entries;
+  Shard(worker_threads.num_threads, worker_threads.workers, batch_size,
+        cost_per_string,
+        [&split, &row_starts, &sp_indices, &sp_tokens](int64_t start,
+                                                       int64_t limit) {
+          for (int64_t i = start; i < limit; ++i) {
+            int64_t c = row_starts[i];
+            int64_t j = 0;
+            split(i, [&](StringPiece token) {
+              sp_indices(c, 0) = i;
+              sp_indices(c, 1) = j++;
+              sp_tokens(c++).assign(token.data(), token.size());
+            });
+            DCHECK_EQ(c, row_starts[i + 1]);
+          }
+        });
 }
 
 }  // namespace
@@ -179,7 +264,6 @@ class StringSplitOp : public OpKernel {
                                         input_tensor->shape().DebugString()));
 
     const auto input_vec = input_tensor->vec<tstring>();
-    const int64_t batch_size = input_vec.dimension(0);
 
     const Tensor* delimiter_tensor;
     OP_REQUIRES_OK(ctx, ctx->input("delimiter", &delimiter_tensor));
@@ -190,48 +274,15 @@ class StringSplitOp : public OpKernel {
     const auto delimiter_vec = delimiter_tensor->flat<tstring>();
     const tstring& delimiter = delimiter_vec(0);
     // Empty delimiter means split the input character by character.
-    std::vector<StringPiece> tokens;
-    // Guess that we'll be unpacking a handful of tokens per example.
-    static constexpr int kReserveSize = 4;
-    tokens.reserve(batch_size * kReserveSize);
-
-    int64_t output_size = 0;
-    int64_t max_num_entries = 0;
-    std::vector<int64_t> num_indices(batch_size);
-    for (int64_t i = 0; i < batch_size; ++i) {
-      std::vector<StringPiece> parts =
-          skip_empty_ ? Split(input_vec(i), delimiter, str_util::SkipEmpty())
-                      : Split(input_vec(i), delimiter, str_util::AllowEmpty());
-      int64_t n_entries = parts.size();
-      num_indices[i] = n_entries;
-      output_size += n_entries;
-      max_num_entries = std::max(max_num_entries, n_entries);
-      tokens.insert(tokens.end(), std::make_move_iterator(parts.begin()),
-                    std::make_move_iterator(parts.end()));
-    }
-
-    Tensor* sp_indices_t;
-    OP_REQUIRES_OK(ctx, ctx->allocate_output(0, TensorShape({output_size, 2}),
-                                             &sp_indices_t));
-    Tensor* sp_tokens_t;
-    OP_REQUIRES_OK(
-        ctx, ctx->allocate_output(1, TensorShape({output_size}), &sp_tokens_t));
-    Tensor* sp_shape_t;
-    OP_REQUIRES_OK(ctx, ctx->allocate_output(2, TensorShape({2}), &sp_shape_t));
-
-    auto sp_indices = sp_indices_t->matrix<int64_t>();
-    auto sp_tokens = sp_tokens_t->vec<tstring>();
-    auto sp_shape = sp_shape_t->vec<int64_t>();
-    sp_shape(0) = batch_size;
-    sp_shape(1) = max_num_entries;
-    size_t c = 0;
-    for (size_t i = 0; i < batch_size; ++i) {
-      for (size_t j = 0; j < num_indices[i]; ++j) {
-        sp_indices(c, 0) = i;
-        sp_indices(c, 1) = j;
-        sp_tokens(c).assign(tokens[c].data(), tokens[c].size());
-        ++c;
-      }
+    const DelimiterSet delims(delimiter);
+    if (skip_empty_) {
+      SplitBatch(ctx, input_vec, [&](int64_t i, auto emit) {
+        Split(input_vec(i), delimiter, delims, str_util::SkipEmpty(), emit);
+      });
+    } else {
+      SplitBatch(ctx, input_vec, [&](int64_t i, auto emit) {
+        Split(input_vec(i), delimiter, delims, str_util::AllowEmpty(), emit);
+      });
     }
   }
 
@@ -254,7 +305,6 @@ class StringSplitV2Op : public OpKernel {
                                         input_tensor->shape().DebugString()));
 
     const auto input_vec = input_tensor->vec<tstring>();
-    const int64_t batch_size = input_vec.dimension(0);
 
     const Tensor* sep_tensor;
     OP_REQUIRES_OK(ctx, ctx->input("sep", &sep_tensor));
@@ -263,46 +313,9 @@ class StringSplitV2Op : public OpKernel {
                                         sep_tensor->shape().DebugString()));
     const auto sep_vec = sep_tensor->flat<tstring>();
     StringPiece sep(sep_vec(0));
-    std::vector<StringPiece> tokens;
-    // Guess that we'll be unpacking a handful of tokens per example.
-    static constexpr int kReserveSize = 4;
-    tokens.reserve(batch_size * kReserveSize);
-
-    int64_t output_size = 0;
-    int64_t max_num_entries = 0;
-    std::vector<int64_t> num_indices(batch_size);
-    for (int64_t i = 0; i < batch_size; ++i) {
-      std::vector<StringPiece> parts = SplitV2(input_vec(i), sep, maxsplit_);
-      int64_t n_entries = parts.size();
-      num_indices[i] = n_entries;
-      output_size += n_entries;
-      max_num_entries = std::max(max_num_entries, n_entries);
-      tokens.insert(tokens.end(), parts.begin(), parts.end());
-    }
-
-    Tensor* sp_indices_t;
-    OP_REQUIRES_OK(ctx, ctx->allocate_output(0, TensorShape({output_size, 2}),
-                                             &sp_indices_t));
-    Tensor* sp_tokens_t;
-    OP_REQUIRES_OK(
-        ctx, ctx->allocate_output(1, TensorShape({output_size}), &sp_tokens_t));
-    Tensor* sp_shape_t;
-    OP_REQUIRES_OK(ctx, ctx->allocate_output(2, TensorShape({2}), &sp_shape_t));
-
-    auto sp_indices = sp_indices_t->matrix<int64_t>();
-    auto sp_tokens = sp_tokens_t->vec<tstring>();
-    auto sp_shape = sp_shape_t->vec<int64_t>();
-    sp_shape(0) = batch_size;
-    sp_shape(1) = max_num_entries;
-    size_t c = 0;
-    for (size_t i = 0; i < batch_size; ++i) {
-      for (size_t j = 0; j < num_indices[i]; ++j) {
-        sp_indices(c, 0) = i;
-        sp_indices(c, 1) = j;
-        sp_tokens(c).assign(tokens[c].data(), tokens[c].size());
-        ++c;
-      }
-    }
+    SplitBatch(ctx, input_vec, [&](int64_t i, auto emit) {
+      SplitV2(input_vec(i), sep, maxsplit_, emit);
+    });
   }
 
  private:
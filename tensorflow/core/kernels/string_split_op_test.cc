@@ -13,6 +13,10 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_join.h"
 #include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
 #include "tensorflow/core/framework/allocator.h"
 #include "tensorflow/core/framework/fake_input.h"
@@ -26,6 +30,7 @@ limitations under the License.
 #include "tensorflow/core/kernels/ops_testutil.h"
 #include "tensorflow/core/kernels/ops_util.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/platform/test_benchmark.h"
 
@@ -64,6 +69,118 @@ Tensor GetTestTensor(int batch) {
   return t;
 }
 
+class StringSplitOpTest : public OpsTestBase {
+ protected:
+  // Runs the op on `inputs` and checks that row `i` of its sparse output holds
+  // the tokens `expected[i]`.
+  void RunAndExpectTokens(const std::vector<tstring>& inputs,
+                          const std::vector<std::vector<string>>& expected) {
+    AddInputFromArray<tstring>(
+        TensorShape({static_cast<int64_t>(inputs.size())}), inputs);
+    AddInputFromArray<tstring>(TensorShape({}), {delimiter_});
+    TF_ASSERT_OK(RunOpKernel());
+    const auto indices = GetOutput(0)->matrix<int64_t>();
+    const auto values = GetOutput(1)->vec<tstring>();
+    const auto shape = GetOutput(2)->vec<int64_t>();
+    const int64_t num_rows = expected.size();
+    int64_t c = 0;
+    int64_t max_tokens = 0;
+    for (int64_t i = 0; i < num_rows; ++i) {
+      const int64_t num_tokens = expected[i].size();
+      for (int64_t j = 0; j < num_tokens; ++j, ++c) {
+        ASSERT_LT(c, values.size());
+        EXPECT_EQ(indices(c, 0), i);
+        EXPECT_EQ(indices(c, 1), j);
+        EXPECT_EQ(values(c), expected[i][j]) << "row " << i;
+      }
+      max_tokens = std::max(max_tokens, num_tokens);
+    }
+    EXPECT_EQ(c, values.size());
+    EXPECT_EQ(shape(0), num_rows);
+    EXPECT_EQ(shape(1), max_tokens);
+  }
+
+  tstring delimiter_;
+};
+
+// Large enough for the input to be split across threads.
+constexpr int kShardedBatchSize = 20000;
+
+// Returns the tokens of row `i`: a varying number of them, including none.
+std::vector<string> RowTokens(int i) {
+  std::vector<string> tokens;
+  for (int j = 0; j < i % 5; ++j) {
+    tokens.push_back(strings::StrCat("t", i, "_", j));
+  }
+  return tokens;
+}
+
+TEST_F(StringSplitOpTest, ShardedBatchSkipsEmptyTokens) {
+  TF_ASSERT_OK(NodeDefBuilder("string_split_op", "StringSplit")
+                   .Input(FakeInput(DT_STRING))
+                   .Input(FakeInput(DT_STRING))
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  // Any character of the delimiter splits, and runs of them only produce
+  // empty tokens.
+  delimiter_ = " ,";
+  std::vector<tstring> inputs;
+  std::vector<std::vector<string>> expected;
+  for (int i = 0; i < kShardedBatchSize; ++i) {
+    expected.push_back(RowTokens(i));
+    inputs.push_back(strings::StrCat(
+        i % 2 ? " ," : "", absl::StrJoin(expected.back(), i % 3 ? "," : " ,")));
+  }
+  RunAndExpectTokens(inputs, expected);
+}
+
+TEST_F(StringSplitOpTest, ShardedBatchKeepsEmptyTokens) {
+  TF_ASSERT_OK(NodeDefBuilder("string_split_op", "StringSplit")
+                   .Input(FakeInput(DT_STRING))
+                   .Input(FakeInput(DT_STRING))
+                   .Attr("skip_empty", false)
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  delimiter_ = " ";
+  std::vector<tstring> inputs;
+  std::vector<std::vector<string>> expected;
+  for (int i = 0; i < kShardedBatchSize; ++i) {
+    // Leading and, for rows without tokens, trailing empty tokens are kept.
+    std::vector<string> tokens = RowTokens(i);
+    tokens.insert(tokens.begin(), "");
+    if (tokens.size() == 1) tokens.push_back("");
+    inputs.push_back(absl::StrJoin(tokens, " "));
+    expected.push_back(std::move(tokens));
+  }
+  RunAndExpectTokens(inputs, expected);
+}
+
+TEST_F(StringSplitOpTest, ShardedBatchV2) {
+  TF_ASSERT_OK(NodeDefBuilder("string_split_op", "StringSplitV2")
+                   .Input(FakeInput(DT_STRING))
+                   .Input(FakeInput(DT_STRING))
+                   .Attr("maxsplit", 2)
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  delimiter_ = "<>";
+  std::vector<tstring> inputs;
+  std::vector<std::vector<string>> expected;
+  for (int i = 0; i < kShardedBatchSize; ++i) {
+    const std::vector<string> tokens = RowTokens(i);
+    inputs.push_back(absl::StrJoin(tokens, "<>"));
+    // At most two splits, and an empty string is a single empty token.
+    std::vector<string> row(tokens.begin(),
+                            tokens.begin() + std::min<int>(2, tokens.size()));
+    if (tokens.size() > 2) {
+      row.push_back(absl::StrJoin(tokens.begin() + 2, tokens.end(), "<>"));
+    } else if (tokens.empty()) {
+      row.push_back("");
+    }
+    expected.push_back(std::move(row));
+  }
+  RunAndExpectTokens(inputs, expected);
+}
+
 Graph* SetupStringSplitGraph(const Tensor& input) {
   Graph* g = new Graph(OpRegistry::Global());
   Tensor delim(DT_STRING, TensorShape({}));
@@ -93,7 +210,9 @@ BENCHMARK(BM_StringSplit)
     ->Arg(32)
     ->Arg(64)
     ->Arg(128)
-    ->Arg(256);
+    ->Arg(256)
+    ->Arg(4096)
+    ->Arg(65536);
 
 Graph* SetupStringSplitV2Graph(const Tensor& input) {
   Graph* g = new Graph(OpRegistry::Global());
@@ -124,6 +243,8 @@ BENCHMARK(BM_StringSplitV2)
     ->Arg(32)
     ->Arg(64)
     ->Arg(128)
-    ->Arg(256);
+    ->Arg(256)
+    ->Arg(4096)
+    ->Arg(65536);
 
 }  // end namespace tensorflow
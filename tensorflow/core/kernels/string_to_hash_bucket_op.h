@@ -23,6 +23,7 @@ limitations under the License.
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/status.h"
 #include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/util/work_sharder.h"
 
 namespace tensorflow {
 
@@ -51,18 +52,27 @@ class StringToKeyedHashBucketOp : public OpKernel {
                                             &output_tensor));
     auto output_flat = output_tensor->flat<int64_t>();
 
-    typedef decltype(input_flat.size()) Index;
-    for (Index i = 0; i < input_flat.size(); ++i) {
-      const uint64 input_hash = hash(key_, input_flat(i));
-      const uint64 bucket_id = input_hash % num_buckets_;
-      // The number of buckets is always in the positive range of int64 so is
-      // the resulting bucket_id. Casting the bucket_id from uint64 to int64 is
-      // safe.
-      output_flat(i) = static_cast<int64_t>(bucket_id);
-    }
+    auto work = [this, &input_flat, &output_flat](int64_t start,
+                                                  int64_t limit) {
+      for (int64_t i = start; i < limit; ++i) {
+        const uint64 input_hash = hash(key_, input_flat(i));
+        const uint64 bucket_id = input_hash % num_buckets_;
+        // The number of buckets is always in the positive range of int64 so is
+        // the resulting bucket_id. Casting the bucket_id from uint64 to int64
+        // is safe.
+        output_flat(i) = static_cast<int64_t>(bucket_id);
+      }
+    };
+    const auto& worker_threads =
+        *context->device()->tensorflow_cpu_worker_threads();
+    Shard(worker_threads.num_threads, worker_threads.workers,
+          input_flat.size(), kCostPerString, work);
   }
 
  private:
+  // Rough number of cycles needed to hash a short string with a keyed hash.
+  static constexpr int64_t kCostPerString = 250;
+
   int64_t num_buckets_;
   uint64 key_[2];
 
@@ -0,0 +1,136 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <string>
+#include <vector>
+
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/fingerprint.h"
+#include "tensorflow/core/platform/strong_hash.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace {
+
+constexpr int64_t kNumBuckets = 1000003;
+
+std::vector<tstring> GetTestStrings(int batch) {
+  std::vector<tstring> values(batch);
+  for (int i = 0; i < batch; ++i) {
+    values[i] = strings::StrCat("feature_value_", i, string(i % 37, 'x'));
+  }
+  return values;
+}
+
+Tensor GetTestTensor(int batch) {
+  return test::AsTensor<tstring>(GetTestStrings(batch));
+}
+
+class StringToHashBucketOpTest : public OpsTestBase {};
+
+TEST_F(StringToHashBucketOpTest, FastMatchesFingerprint64) {
+  TF_ASSERT_OK(NodeDefBuilder("hash", "StringToHashBucketFast")
+                   .Input(FakeInput(DT_STRING))
+                   .Attr("num_buckets", kNumBuckets)
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  // Large enough for the input to be split across threads.
+  const std::vector<tstring> input = GetTestStrings(100000);
+  AddInputFromArray<tstring>(TensorShape({100000}), input);
+  TF_ASSERT_OK(RunOpKernel());
+
+  const auto output = GetOutput(0)->flat<int64_t>();
+  for (size_t i = 0; i < input.size(); ++i) {
+    const uint64 hash = Fingerprint64(input[i]);
+    ASSERT_EQ(output(i), static_cast<int64_t>(hash % kNumBuckets)) << i;
+  }
+}
+
+TEST_F(StringToHashBucketOpTest, StrongMatchesStrongKeyedHash) {
+  TF_ASSERT_OK(NodeDefBuilder("hash", "StringToHashBucketStrong")
+                   .Input(FakeInput(DT_STRING))
+                   .Attr("num_buckets", kNumBuckets)
+                   .Attr("key", std::vector<int64_t>{123, 456})
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  // Large enough for the input to be split across threads.
+  const std::vector<tstring> input = GetTestStrings(100000);
+  AddInputFromArray<tstring>(TensorShape({100000}), input);
+  TF_ASSERT_OK(RunOpKernel());
+
+  const uint64 key[2] = {123, 456};
+  const auto output = GetOutput(0)->flat<int64_t>();
+  for (size_t i = 0; i < input.size(); ++i) {
+    const uint64 hash = StrongKeyedHash(key, input[i]);
+    ASSERT_EQ(output(i), static_cast<int64_t>(hash % kNumBuckets)) << i;
+  }
+}
+
+Graph* SetupStringToHashBucketGraph(const Tensor& input, const string& op) {
+  Graph* g = new Graph(OpRegistry::Global());
+  NodeBuilder builder("hash", op);
+  builder.Input(test::graph::Constant(g, input))
+      .Attr("num_buckets", kNumBuckets);
+  if (op == "StringToHashBucketStrong") {
+    builder.Attr("key", std::vector<int64_t>{123, 456});
+  }
+  TF_CHECK_OK(builder.Finalize(g, nullptr /* node */));
+  return g;
+}
+
+static void BM_StringToHashBucketFast(::testing::benchmark::State& state) {
+  const int batch_size = state.range(0);
+
+  Tensor input = GetTestTensor(batch_size);
+  Graph* g = SetupStringToHashBucketGraph(input, "StringToHashBucketFast");
+  test::Benchmark("cpu", g, /*old_benchmark_api*/ false).Run(state);
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          batch_size);
+}
+
+static void BM_StringToHashBucketStrong(::testing::benchmark::State& state) {
+  const int batch_size = state.range(0);
+
+  Tensor input = GetTestTensor(batch_size);
+  Graph* g = SetupStringToHashBucketGraph(input, "StringToHashBucketStrong");
+  test::Benchmark("cpu", g, /*old_benchmark_api*/ false).Run(state);
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          batch_size);
+}
+
+BENCHMARK(BM_StringToHashBucketFast)
+    ->UseRealTime()
+    ->Arg(1)
+    ->Arg(256)
+    ->Arg(4096)
+    ->Arg(65536);
+BENCHMARK(BM_StringToHashBucketStrong)
+    ->UseRealTime()
+    ->Arg(1)
+    ->Arg(256)
+    ->Arg(4096)
+    ->Arg(65536);
+
+}  // namespace
+}  // namespace tensorflow
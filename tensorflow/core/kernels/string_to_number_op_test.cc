@@ -0,0 +1,169 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/strings/numbers.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace {
+
+class StringToNumberOpTest : public OpsTestBase {
+ protected:
+  void MakeOp(DataType out_type) {
+    TF_ASSERT_OK(NodeDefBuilder("string_to_number", "StringToNumber")
+                     .Input(FakeInput(DT_STRING))
+                     .Attr("out_type", out_type)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+  }
+
+  // Checks that the kernel agrees with strings::SafeStringToNumeric on each
+  // of `inputs`, all of which are expected to be valid.
+  template <typename T>
+  void ExpectSameAsSafeStringToNumeric(const std::vector<tstring>& inputs) {
+    MakeOp(DataTypeToEnum<T>::v());
+    AddInputFromArray<tstring>(
+        TensorShape({static_cast<int64_t>(inputs.size())}), inputs);
+    TF_ASSERT_OK(RunOpKernel());
+    const auto output = GetOutput(0)->flat<T>();
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      T expected;
+      ASSERT_TRUE(strings::SafeStringToNumeric<T>(inputs[i], &expected))
+          << inputs[i];
+      EXPECT_EQ(output(i), expected) << inputs[i];
+    }
+  }
+};
+
+// Covers both the fast path for short plain integers and the strings it
+// leaves to SafeStringToNumeric.
+std::vector<tstring> IntegerInputs(int max_digits) {
+  std::vector<tstring> inputs = {"0",  "-0", "7",   "-7",   "00012",
+                                 " 3", "4 ", "-08", "\t42"};
+  string digits;
+  for (int n = 1; n <= max_digits; ++n) {
+    digits.push_back('0' + n % 10);
+    inputs.push_back(digits);
+    inputs.push_back(strings::StrCat("-", digits));
+  }
+  return inputs;
+}
+
+TEST_F(StringToNumberOpTest, Int32) {
+  std::vector<tstring> inputs = IntegerInputs(10);
+  inputs.push_back("2147483647");
+  inputs.push_back("-2147483648");
+  ExpectSameAsSafeStringToNumeric<int32>(inputs);
+}
+
+TEST_F(StringToNumberOpTest, Int64) {
+  std::vector<tstring> inputs = IntegerInputs(19);
+  inputs.push_back("9223372036854775807");
+  inputs.push_back("-9223372036854775808");
+  inputs.push_back("000000000000000000000001");
+  ExpectSameAsSafeStringToNumeric<int64_t>(inputs);
+}
+
+TEST_F(StringToNumberOpTest, Float) {
+  ExpectSameAsSafeStringToNumeric<float>(
+      {"0", "-0", "1.5", "-2.25e3", "16777217", " 3.0"});
+}
+
+TEST_F(StringToNumberOpTest, ReportsFirstInvalidString) {
+  MakeOp(DT_INT64);
+  // Large enough for the input to be split across threads.
+  const int kSize = 100000;
+  std::vector<tstring> inputs(kSize, "12345678");
+  inputs[kSize / 2] = "9223372036854775808";
+  inputs[kSize - 1] = "12x";
+  AddInputFromArray<tstring>(TensorShape({kSize}), inputs);
+  Status status = RunOpKernel();
+  EXPECT_TRUE(errors::IsInvalidArgument(status));
+  EXPECT_TRUE(absl::StrContains(status.message(), "9223372036854775808"))
+      << status;
+}
+
+Graph* SetupStringToNumberGraph(const Tensor& input, DataType out_type) {
+  Graph* g = new Graph(OpRegistry::Global());
+  TF_CHECK_OK(NodeBuilder("string_to_number", "StringToNumber")
+                  .Input(test::graph::Constant(g, input))
+                  .Attr("out_type", out_type)
+                  .Finalize(g, nullptr /* node */));
+  return g;
+}
+
+// Parses `batch_size` identifier-like integers.
+static void RunStringToNumberBenchmark(::testing::benchmark::State& state,
+                                       DataType out_type) {
+  const int batch_size = state.range(0);
+
+  Tensor input(DT_STRING, TensorShape({batch_size}));
+  auto input_flat = input.flat<tstring>();
+  for (int i = 0; i < batch_size; ++i) {
+    input_flat(i) = strings::StrCat(i * 7919);
+  }
+  Graph* g = SetupStringToNumberGraph(input, out_type);
+  test::Benchmark("cpu", g, /*old_benchmark_api*/ false).Run(state);
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          batch_size);
+}
+
+static void BM_StringToNumberInt32(::testing::benchmark::State& state) {
+  RunStringToNumberBenchmark(state, DT_INT32);
+}
+
+static void BM_StringToNumberInt64(::testing::benchmark::State& state) {
+  RunStringToNumberBenchmark(state, DT_INT64);
+}
+
+static void BM_StringToNumberFloat(::testing::benchmark::State& state) {
+  RunStringToNumberBenchmark(state, DT_FLOAT);
+}
+
+BENCHMARK(BM_StringToNumberInt32)
+    ->UseRealTime()
+    ->Arg(1)
+    ->Arg(256)
+    ->Arg(4096)
+    ->Arg(65536);
+BENCHMARK(BM_StringToNumberInt64)
+    ->UseRealTime()
+    ->Arg(1)
+    ->Arg(256)
+    ->Arg(4096)
+    ->Arg(65536);
+BENCHMARK(BM_StringToNumberFloat)
+    ->UseRealTime()
+    ->Arg(1)
+    ->Arg(256)
+    ->Arg(4096)
+    ->Arg(65536);
+
+}  // namespace
+}  // namespace tensorflow
@@ -13,6 +13,7 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#include <atomic>
 #include <cstddef>
 #include <cstdlib>
 #include <string>
@@ -31,6 +32,7 @@ limitations under the License.
 #include "tensorflow/core/lib/core/stringpiece.h"
 #include "tensorflow/core/platform/types.h"
 #include "tensorflow/core/util/bcast.h"
+#include "tensorflow/core/util/work_sharder.h"
 
 namespace tensorflow {
 
@@ -71,59 +73,48 @@ class SubstrOp : public OpKernel {
                      context->allocate_output("output", input_tensor.shape(),
                                               &output_tensor));
       auto output = output_tensor->flat<tstring>();
-      if (is_scalar) {
-        // Perform Op with scalar pos/len
-        const T pos =
-            tensorflow::internal::SubtleMustCopy(pos_tensor.scalar<T>()());
-        const T len =
-            tensorflow::internal::SubtleMustCopy(len_tensor.scalar<T>()());
-        for (size_t i = 0; i < input_tensor.NumElements(); ++i) {
-          StringPiece in(input(i));
-          T byte_pos = pos;
-          T byte_len = len;
-          switch (unit_) {
-            case CharUnit::UTF8_CHAR:
-              OP_REQUIRES(
-                  context, UpdatePosAndLenForUtf8(in, &byte_pos, &byte_len),
-                  errors::InvalidArgument("pos ", pos, " out of range for ",
-                                          "string at index ", i));
-              break;
-            case CharUnit::BYTE:
-              byte_pos = AdjustedPosIndex(byte_pos, in);
-              OP_REQUIRES(
-                  context, FastBoundsCheck(byte_pos, in.size() + 1),
-                  errors::InvalidArgument("pos ", pos, " out of range for ",
-                                          "string b'", in, "' at index ", i));
+      // Perform Op with scalar pos/len, or element-wise with tensor pos/len.
+      // Strings are independent, so large inputs are split across the CPU
+      // worker threads. Like a serial loop, errors report the first string
+      // for which pos is out of range.
+      auto pos_flat = pos_tensor.flat<T>();
+      auto len_flat = len_tensor.flat<T>();
+      const int64_t stride = is_scalar ? 0 : 1;
+      const int64_t size = input_tensor.NumElements();
+      std::atomic<int64_t> first_error(size);
+      auto work = [&](int64_t start, int64_t limit) {
+        for (int64_t i = start; i < limit; ++i) {
+          const T pos =
+              tensorflow::internal::SubtleMustCopy(pos_flat(i * stride));
+          const T len =
+              tensorflow::internal::SubtleMustCopy(len_flat(i * stride));
+          if (!Substr(input(i), pos, len, &output(i))) {
+            int64_t error = first_error.load(std::memory_order_relaxed);
+            while (i < error && !first_error.compare_exchange_weak(error, i)) {
+            }
+            return;
           }
-          StringPiece sub_in = in.substr(byte_pos, byte_len);
-          output(i).assign(sub_in.data(), sub_in.size());
         }
-      } else {
-        // Perform Op element-wise with tensor pos/len
-        auto pos_flat = pos_tensor.flat<T>();
-        auto len_flat = len_tensor.flat<T>();
-        for (size_t i = 0; i < input_tensor.NumElements(); ++i) {
-          StringPiece in(input(i));
-          const T pos = tensorflow::internal::SubtleMustCopy(pos_flat(i));
-          const T len = tensorflow::internal::SubtleMustCopy(len_flat(i));
-          T byte_pos = pos;
-          T byte_len = len;
-          switch (unit_) {
-            case CharUnit::UTF8_CHAR:
-              OP_REQUIRES(
-                  context, UpdatePosAndLenForUtf8(in, &byte_pos, &byte_len),
-                  errors::InvalidArgument("pos ", pos, " out of range for ",
-                                          "string at index ", i));
-              break;
-            case CharUnit::BYTE:
-              byte_pos = AdjustedPosIndex(byte_pos, in);
-              OP_REQUIRES(
-                  context, FastBoundsCheck(byte_pos, in.size() + 1),
-                  errors::InvalidArgument("pos ", pos, " out of range for ",
-                                          "string b'", in, "' at index ", i));
-          }
-          StringPiece sub_in = in.substr(byte_pos, byte_len);
-          output(i).assign(sub_in.data(), sub_in.size());
+      };
+      const auto& worker_threads =
+          *context->device()->tensorflow_cpu_worker_threads();
+      Shard(worker_threads.num_threads, worker_threads.workers, size,
+            kCostPerString, work);
+
+      const int64_t i = first_error.load();
+      if (i < size) {
+        StringPiece in(input(i));
+        const T pos =
+            tensorflow::internal::SubtleMustCopy(pos_flat(i * stride));
+        switch (unit_) {
+          case CharUnit::UTF8_CHAR:
+            context->SetStatus(errors::InvalidArgument(
+                "pos ", pos, " out of range for ", "string at index ", i));
+            break;
+          case CharUnit::BYTE:
+            context->SetStatus(errors::InvalidArgument(
+                "pos ", pos, " out of range for ", "string b'", in,
+                "' at index ", i));
         }
       }
     } else {
@@ -266,6 +257,25 @@ class SubstrOp : public OpKernel {
   }
 
  private:
+  // Rough number of cycles needed to take the substring of a short string.
+  static constexpr int64_t kCostPerString = 100;
+
+  // Stores the substring of `in` starting at `pos` with length `len` in `out`,
+  // with both counted in `unit_`. Returns false if `pos` is out of range.
+  bool Substr(StringPiece in, T pos, T len, tstring* out) const {
+    switch (unit_) {
+      case CharUnit::UTF8_CHAR:
+        if (!UpdatePosAndLenForUtf8(in, &pos, &len)) return false;
+        break;
+      case CharUnit::BYTE:
+        pos = AdjustedPosIndex(pos, in);
+        if (!FastBoundsCheck(pos, in.size() + 1)) return false;
+    }
+    StringPiece sub_in = in.substr(pos, len);
+    out->assign(sub_in.data(), sub_in.size());
+    return true;
+  }
+
   // This adjusts the requested position. Note it does not perform any bound
   // checks.
   static inline T AdjustedPosIndex(const T pos_requested, const StringPiece s) {
@@ -14,6 +14,9 @@ limitations under the License.
 ==============================================================================*/
 
 #include <string>
+#include <vector>
+
+#include "absl/strings/match.h"
 
 #include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
 #include "tensorflow/core/framework/allocator.h"
@@ -34,6 +37,7 @@ limitations under the License.
 #include "tensorflow/core/kernels/ops_util.h"
 #include "tensorflow/core/lib/core/status.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/platform/macros.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/platform/test_benchmark.h"
@@ -132,6 +136,80 @@ Tensor GetTestUTF8Tensor(int batch) {
   return t;
 }
 
+class SubstrOpTest : public OpsTestBase {
+ protected:
+  void MakeOp(const char* const unit) {
+    TF_ASSERT_OK(NodeDefBuilder("substr_op", "Substr")
+                     .Input(FakeInput(DT_STRING))
+                     .Input(FakeInput(DT_INT32))
+                     .Input(FakeInput(DT_INT32))
+                     .Attr("unit", unit)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+  }
+};
+
+// Large enough for the input to be split across threads.
+constexpr int kShardedBatchSize = 100000;
+
+TEST_F(SubstrOpTest, ShardedBatchWithElementwisePos) {
+  MakeOp(kByteUnit);
+  std::vector<tstring> inputs(kShardedBatchSize);
+  std::vector<int32> pos(kShardedBatchSize);
+  std::vector<int32> len(kShardedBatchSize);
+  for (int i = 0; i < kShardedBatchSize; ++i) {
+    inputs[i] = strings::StrCat("s", i);
+    // Positions counted from the start and from the end of the string.
+    pos[i] = i % 2 ? 1 : -2;
+    len[i] = i % 3;
+  }
+  AddInputFromArray<tstring>(TensorShape({kShardedBatchSize}), inputs);
+  AddInputFromArray<int32>(TensorShape({kShardedBatchSize}), pos);
+  AddInputFromArray<int32>(TensorShape({kShardedBatchSize}), len);
+  TF_ASSERT_OK(RunOpKernel());
+  const auto output = GetOutput(0)->flat<tstring>();
+  for (int i = 0; i < kShardedBatchSize; ++i) {
+    const string in(inputs[i]);
+    const int start = pos[i] >= 0 ? pos[i] : static_cast<int>(in.size()) + pos[i];
+    EXPECT_EQ(output(i), in.substr(start, len[i])) << "index " << i;
+  }
+}
+
+TEST_F(SubstrOpTest, ShardedBatchWithScalarPos) {
+  MakeOp(kByteUnit);
+  Tensor input = GetTestTensor(kShardedBatchSize);
+  const auto input_flat = input.flat<tstring>();
+  AddInputFromArray<tstring>(
+      input.shape(),
+      gtl::ArraySlice<tstring>(input_flat.data(), input_flat.size()));
+  AddInputFromArray<int32>(TensorShape({}), {3});
+  AddInputFromArray<int32>(TensorShape({}), {30});
+  TF_ASSERT_OK(RunOpKernel());
+  const auto output = GetOutput(0)->flat<tstring>();
+  for (int i = 0; i < kShardedBatchSize; ++i) {
+    EXPECT_EQ(output(i), string(input_flat(i)).substr(3, 30)) << "index " << i;
+  }
+}
+
+TEST_F(SubstrOpTest, ReportsFirstOutOfRangePos) {
+  MakeOp(kByteUnit);
+  std::vector<tstring> inputs(kShardedBatchSize, "abc");
+  std::vector<int32> pos(kShardedBatchSize, 1);
+  std::vector<int32> len(kShardedBatchSize, 1);
+  pos[kShardedBatchSize / 2] = 4;
+  pos[kShardedBatchSize - 1] = -5;
+  AddInputFromArray<tstring>(TensorShape({kShardedBatchSize}), inputs);
+  AddInputFromArray<int32>(TensorShape({kShardedBatchSize}), pos);
+  AddInputFromArray<int32>(TensorShape({kShardedBatchSize}), len);
+  Status status = RunOpKernel();
+  EXPECT_TRUE(errors::IsInvalidArgument(status));
+  EXPECT_TRUE(absl::StrContains(
+      status.message(),
+      strings::StrCat("pos 4 out of range for string b'abc' at index ",
+                      kShardedBatchSize / 2)))
+      << status;
+}
+
 Graph* SetupSubstrGraph(const Tensor& input, const int32_t pos,
                         const int32_t len, const char* const unit) {
   Graph* g = new Graph(OpRegistry::Global());
@@ -175,7 +253,9 @@ BENCHMARK(BM_SubstrByte)
     ->Arg(32)
     ->Arg(64)
     ->Arg(128)
-    ->Arg(256);
+    ->Arg(256)
+    ->Arg(4096)
+    ->Arg(65536);
 BENCHMARK(BM_SubstrUTF8)
     ->UseRealTime()
     ->Arg(1)
@@ -184,6 +264,8 @@ BENCHMARK(BM_SubstrUTF8)
     ->Arg(32)
     ->Arg(64)
     ->Arg(128)
-    ->Arg(256);
+    ->Arg(256)
+    ->Arg(4096)
+    ->Arg(65536);
 
 }  // end namespace tensorflow
@@ -20,6 +20,7 @@ limitations under the License.
 #include "tensorflow/core/kernels/topk_op.h"
 
 #include <algorithm>
+#include <memory>
 #include <numeric>
 #include <vector>
 
@@ -161,19 +162,24 @@ struct TopKFunctor<CPUDevice, T, Tidx> {
       return OkStatus();
     }
 
+    auto worker_threads = *(context->device()->tensorflow_cpu_worker_threads());
+    const double cmp_cost = 3 * Eigen::TensorOpCost::AddCost<Tidx>() +
+                            Eigen::TensorOpCost::AddCost<T>();
+
+    // A few rows with many columns, as when retrieving the top candidates of
+    // a single query, would leave most threads idle. Their columns are split
+    // into blocks instead, whose top k candidates are selected in parallel
+    // and then merged.
+    const int64_t block_cols = std::max<int64_t>(kMinColumnsPerBlock, 4 * k);
+    if (k < num_cols && num_rows < worker_threads.num_threads &&
+        num_cols >= 2 * block_cols) {
+      return ComputeInBlocks(context, sorted, k, input, num_rows, num_cols,
+                             block_cols, cmp_cost, values, indices);
+    }
+
     auto SortIndices = [&](int64_t start_batch, int64_t limit_batch) {
       for (int32_t b = start_batch; b < limit_batch; ++b) {
         const T* input_data = &input(b, 0);
-        const auto stable_comp = [input_data](const int32_t a,
-                                              const int32_t b) {
-          if (input_data[b] < input_data[a]) {
-            return true;
-          } else if (input_data[b] > input_data[a]) {
-            return false;
-          } else {
-            return a < b;
-          }
-        };
         const auto comp = [input_data](const int32_t a, const int32_t b) {
           return input_data[b] < input_data[a];
         };
@@ -206,25 +212,10 @@ struct TopKFunctor<CPUDevice, T, Tidx> {
           }
         } else {
           // Use the TopN heap object to sort.
-          gtl::TopN<Tidx, decltype(stable_comp)> filter(k, stable_comp);
+          TopNColumns filter(k, StableGreater(input_data));
           filter.reserve(num_cols);
-          for (Tidx c = 0; c < num_cols; ++c) {
-            filter.push(c);
-          }
-
-          int32_t i = 0;
-          if (sorted) {
-            std::unique_ptr<std::vector<Tidx>> top_k(filter.Extract());
-            for (auto top_k_it = top_k->begin(); top_k_it != top_k->end();
-                 ++top_k_it, ++i) {
-              indices(b, i) = *top_k_it;
-            }
-          } else {
-            for (auto top_k_it = filter.unsorted_begin();
-                 top_k_it != filter.unsorted_end(); ++top_k_it, ++i) {
-              indices(b, i) = *top_k_it;
-            }
-          }
+          PushColumns(input_data, 0, num_cols, k, &filter);
+          ExtractIndices(sorted, &filter, &indices(b, 0));
         }
         // Now that the indices are sorted, copy the values over in
         // sorted order.
@@ -235,8 +226,6 @@ struct TopKFunctor<CPUDevice, T, Tidx> {
 
     // Guesstimate of cost; 4*N*log(K) where N == num_cols.
     // If K == N, assume the cost is N*log(K + 1).
-    const double cmp_cost = 3 * Eigen::TensorOpCost::AddCost<Tidx>() +
-                            Eigen::TensorOpCost::AddCost<T>();
     const double base_cost =
         cmp_cost *
         static_cast<double>(num_cols *
@@ -244,12 +233,159 @@ struct TopKFunctor<CPUDevice, T, Tidx> {
     const double sort_cost = (k == num_cols) ? base_cost : 4 * base_cost;
     const double copy_cost = 2 * k * Eigen::TensorOpCost::AddCost<T>();
     const double total_cost = sort_cost + copy_cost;
-    const int64_t final_cost = (total_cost >= static_cast<double>(kint64max))
-                                   ? kint64max
-                                   : static_cast<int64_t>(total_cost);
+    Shard(worker_threads.num_threads, worker_threads.workers, num_rows,
+          ClampCost(total_cost), SortIndices);
+
+    return OkStatus();
+  }
+
+ private:
+  // Columns handled by each task when the rows are split into blocks. Blocks
+  // of 16K float scores stay within the L2 cache while they are scanned, and
+  // are large enough for their k candidates to be a small fraction of the
+  // columns.
+  static constexpr int64_t kMinColumnsPerBlock = 16 * 1024;
+
+  // Orders the columns of a row by decreasing value, and ties by increasing
+  // column.
+  struct StableGreater {
+    explicit StableGreater(const T* input_data) : input_data(input_data) {}
+    bool operator()(const Tidx a, const Tidx b) const {
+      if (input_data[b] < input_data[a]) {
+        return true;
+      } else if (input_data[b] > input_data[a]) {
+        return false;
+      } else {
+        return a < b;
+      }
+    }
+    const T* input_data;
+  };
+
+  typedef gtl::TopN<Tidx, StableGreater> TopNColumns;
+
+  static int64_t ClampCost(double cost) {
+    return cost >= static_cast<double>(kint64max) ? kint64max
+                                                  : static_cast<int64_t>(cost);
+  }
+
+  // Pushes the columns [begin, end) of the row `input_data` into `filter`.
+  //
+  // Once `filter` holds k columns, a column can only enter it if its value is
+  // not below the smallest value held. Columns are thus first compared with
+  // that threshold in a branch-free pass over chunks of the row, which the
+  // compiler vectorizes, and only the surviving candidates are pushed into
+  // the heap. For random scores, the fraction of candidates quickly drops to
+  // about k / (number of columns scanned so far).
+  static void PushColumns(const T* input_data, int64_t begin, int64_t end,
+                          int k, TopNColumns* filter) {
+    constexpr int64_t kChunkSize = 256;
+    // Filling the filter with k + 1 columns turns it into a heap, whose root
+    // is the smallest value held.
+    int64_t c = begin;
+    for (; c < end && c <= begin + k; ++c) {
+      filter->push(static_cast<Tidx>(c));
+    }
+    Tidx candidates[kChunkSize];
+    while (c < end) {
+      const T threshold = input_data[filter->peek_bottom()];
+      const int64_t chunk_end = std::min(end, c + kChunkSize);
+      int64_t num_candidates = 0;
+      for (; c < chunk_end; ++c) {
+        candidates[num_candidates] = static_cast<Tidx>(c);
+        // Also keeps NaNs, which the heap orders by column.
+        num_candidates += !(input_data[c] < threshold);
+      }
+      for (int64_t i = 0; i < num_candidates; ++i) {
+        filter->push(candidates[i]);
+      }
+    }
+  }
+
+  // Writes the columns held by `filter` to `out`, sorted if requested.
+  static void ExtractIndices(bool sorted, TopNColumns* filter, Tidx* out) {
+    if (sorted) {
+      std::unique_ptr<std::vector<Tidx>> top_k(filter->Extract());
+      std::copy(top_k->begin(), top_k->end(), out);
+    } else {
+      std::copy(filter->unsorted_begin(), filter->unsorted_end(), out);
+    }
+  }
+
+  // Splits each row into blocks of `block_cols` columns, selects the top k
+  // columns of each block in parallel, and then merges the candidates of the
+  // blocks of each row. Since columns are totally ordered by StableGreater,
+  // the result is the same as selecting from the whole row at once.
+  static Status ComputeInBlocks(
+      OpKernelContext* context, bool sorted, int k,
+      const typename TTypes<T, 2>::ConstTensor& input, const int64_t num_rows,
+      const int64_t num_cols, const int64_t block_cols, const double cmp_cost,
+      typename TTypes<T, 2>::Tensor values,
+      typename TTypes<Tidx, 2>::Tensor indices) {
     auto worker_threads = *(context->device()->tensorflow_cpu_worker_threads());
+    const int64_t blocks_per_row = (num_cols + block_cols - 1) / block_cols;
+    // Up to k candidates for each block. Blocks hold k candidates, unless the
+    // last block of a row has fewer columns.
+    std::vector<Tidx> candidates(num_rows * blocks_per_row * k);
+    std::vector<int64_t> num_candidates(num_rows * blocks_per_row);
+    // NaNs are unordered, so the top k of a row holding NaNs depends on the
+    // order in which its columns are pushed. Such rows are selected from as a
+    // whole, like rows that are not split.
+    std::vector<char> block_has_nan(num_rows * blocks_per_row, false);
+
+    auto SelectInBlocks = [&](int64_t start_block, int64_t limit_block) {
+      for (int64_t block = start_block; block < limit_block; ++block) {
+        const int64_t row = block / blocks_per_row;
+        const int64_t begin = (block % blocks_per_row) * block_cols;
+        const int64_t end = std::min(num_cols, begin + block_cols);
+        const T* input_data = &input(row, 0);
+        TopNColumns filter(k, StableGreater(input_data));
+        filter.reserve(end - begin);
+        PushColumns(input_data, begin, end, k, &filter);
+        num_candidates[block] = filter.size();
+        if (!Eigen::NumTraits<T>::IsInteger) {
+          block_has_nan[block] =
+              std::any_of(input_data + begin, input_data + end,
+                          [](const T x) { return Eigen::numext::isnan(x); });
+        }
+        std::copy(filter.unsorted_begin(), filter.unsorted_end(),
+                  &candidates[block * k]);
+      }
+    };
+    const double log_k = Eigen::numext::log2(static_cast<float>(k + 1));
+    const double block_cost =
+        cmp_cost * (2 * block_cols + 4 * k * log_k) +
+        k * Eigen::TensorOpCost::AddCost<Tidx>();
+    Shard(worker_threads.num_threads, worker_threads.workers,
+          num_rows * blocks_per_row, ClampCost(block_cost), SelectInBlocks);
+
+    auto MergeBlocks = [&](int64_t start_row, int64_t limit_row) {
+      for (int64_t row = start_row; row < limit_row; ++row) {
+        const T* input_data = &input(row, 0);
+        const int64_t begin_block = row * blocks_per_row;
+        const int64_t end_block = begin_block + blocks_per_row;
+        TopNColumns filter(k, StableGreater(input_data));
+        if (std::any_of(&block_has_nan[begin_block], &block_has_nan[end_block],
+                        [](const char has_nan) { return has_nan; })) {
+          filter.reserve(num_cols);
+          PushColumns(input_data, 0, num_cols, k, &filter);
+        } else {
+          filter.reserve(blocks_per_row * k);
+          for (int64_t block = begin_block; block < end_block; ++block) {
+            for (int64_t i = 0; i < num_candidates[block]; ++i) {
+              filter.push(candidates[block * k + i]);
+            }
+          }
+        }
+        ExtractIndices(sorted, &filter, &indices(row, 0));
+        std::transform(
+            &indices(row, 0), &indices(row, k), &values(row, 0),
+            [row, &input](const Tidx loc) { return input(row, loc); });
+      }
+    };
+    const double merge_cost = 4 * cmp_cost * blocks_per_row * k * log_k;
     Shard(worker_threads.num_threads, worker_threads.workers, num_rows,
-          final_cost, SortIndices);
+          ClampCost(merge_cost), MergeBlocks);
 
     return OkStatus();
   }
@@ -16,6 +16,7 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_KERNELS_TRANSPOSE_FUNCTOR_H_
 #define TENSORFLOW_CORE_KERNELS_TRANSPOSE_FUNCTOR_H_
 
+#include <memory>
 #include <numeric>
 #include <string>
 #include <vector>
@@ -143,6 +144,52 @@ inline bool NonSingletonDimensionsAlign(const TensorShape& input_shape,
   return true;
 }
 
+// How the CPU transposes an array of `elem_size` byte elements.
+//
+// Size 1 dimensions are dropped and the dimensions which stay adjacent are
+// merged, after which the transpose is either a copy, a copy of contiguous
+// rows to strided locations, or a 2-D transpose of `num_rows` x `num_cols`
+// tiles repeated over the remaining outer dimensions.
+struct CpuTransposePlan {
+  CpuTransposePlan(int64_t elem_size, const TensorShape& shape,
+                   gtl::ArraySlice<int32> perm);
+
+  // Number of iterations over the outer dimensions.
+  int64_t NumOuterIterations() const;
+
+  // Sets `in_offset` and `out_offset` to the offsets, in elements, of the
+  // `index`-th iteration over the outer dimensions.
+  void OuterOffsets(int64_t index, int64_t* in_offset,
+                    int64_t* out_offset) const;
+
+  enum Kind { kCopy, kCopyRows, kTiled };
+
+  int64_t elem_size;
+  int64_t num_elements;
+  Kind kind = kCopy;
+
+  // kCopyRows: number of contiguous elements in each row.
+  int64_t row_size = 0;
+
+  // kTiled: element (r, c) of a tile is read at `r * in_row_stride + c` and
+  // written at `c * out_col_stride + r`.
+  int64_t num_rows = 0;
+  int64_t num_cols = 0;
+  int64_t in_row_stride = 0;
+  int64_t out_col_stride = 0;
+
+  // Outer dimensions in output order, with their strides in the input and in
+  // the output.
+  TransposeDimsVec outer_dims;
+  TransposeDimsVec outer_in_strides;
+  TransposeDimsVec outer_out_strides;
+};
+
+// Returns the plan to transpose `shape` by `perm`, from a process wide cache
+// of the most recently used plans.
+std::shared_ptr<const CpuTransposePlan> GetCpuTransposePlan(
+    int64_t elem_size, const TensorShape& shape, gtl::ArraySlice<int32> perm);
+
 // Uses Eigen to transpose.
 template <typename Device, typename T, int NDIMS>
 void TransposeUsingEigen(const Device& d, const Tensor& in,
@@ -15,8 +15,16 @@ limitations under the License.
 
 #define EIGEN_USE_THREADS
 
+#include <algorithm>
 #include <complex>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "unsupported/Eigen/CXX11/Tensor"  // from @eigen_archive
 #include "tensorflow/core/framework/attr_value.pb.h"
 #include "tensorflow/core/framework/tensor.h"
@@ -25,10 +33,163 @@ limitations under the License.
 #include "tensorflow/core/lib/core/status.h"
 #include "tensorflow/core/lib/gtl/array_slice.h"
 #include "tensorflow/core/lib/gtl/inlined_vector.h"
+#include "tensorflow/core/platform/mutex.h"
 
 typedef Eigen::ThreadPoolDevice CPUDevice;
 
 namespace tensorflow {
+namespace internal {
+
+CpuTransposePlan::CpuTransposePlan(int64_t elem_size, const TensorShape& shape,
+                                   const gtl::ArraySlice<int32> perm)
+    : elem_size(elem_size), num_elements(shape.num_elements()) {
+  // Dimensions of size 1 do not move any data, drop them.
+  TensorShape squeezed_shape;
+  TransposePermsVec squeezed_perm;
+  TransposePermsVec new_index(shape.dims(), -1);
+  for (int i = 0; i < shape.dims(); ++i) {
+    if (shape.dim_size(i) != 1) {
+      new_index[i] = squeezed_shape.dims();
+      squeezed_shape.AddDim(shape.dim_size(i));
+    }
+  }
+  for (int32_t p : perm) {
+    if (new_index[p] >= 0) squeezed_perm.push_back(new_index[p]);
+  }
+  if (num_elements == 0 || squeezed_shape.dims() <= 1) {
+    kind = kCopy;
+    return;
+  }
+
+  // Merge the dimensions that stay adjacent, so that nothing but the tiled
+  // dimensions and the loops around them remain.
+  TransposePermsVec output_positions;
+  TransposeDimsVec dims(squeezed_shape.dims());
+  ReduceTransposeDimensions(squeezed_shape, squeezed_perm, &output_positions,
+                            &dims);
+  // ReduceTransposeDimensions returns the output position of each merged input
+  // dimension, which is the inverse of the merged permutation.
+  const int ndims = output_positions.size();
+  TransposePermsVec reduced_perm(ndims);
+  for (int i = 0; i < ndims; ++i) reduced_perm[output_positions[i]] = i;
+  if (ndims == 1) {
+    kind = kCopy;
+    return;
+  }
+  TransposeDimsVec in_strides(ndims);
+  TransposeDimsVec out_strides(ndims);
+  in_strides[ndims - 1] = 1;
+  out_strides[ndims - 1] = 1;
+  for (int i = ndims - 2; i >= 0; --i) {
+    in_strides[i] = in_strides[i + 1] * dims[i + 1];
+    out_strides[i] = out_strides[i + 1] * dims[reduced_perm[i + 1]];
+  }
+
+  // After merging, the innermost input and output dimensions are either the
+  // same, so whole rows are copied, or two different dimensions transposed as
+  // 2-D tiles.
+  int tiled_out_dim = -1;
+  if (reduced_perm[ndims - 1] == ndims - 1) {
+    kind = kCopyRows;
+    row_size = dims[ndims - 1];
+  } else {
+    kind = kTiled;
+    const int row_dim = reduced_perm[ndims - 1];
+    num_rows = dims[row_dim];
+    num_cols = dims[ndims - 1];
+    in_row_stride = in_strides[row_dim];
+    tiled_out_dim = std::find(reduced_perm.begin(), reduced_perm.end(),
+                              ndims - 1) -
+                    reduced_perm.begin();
+    out_col_stride = out_strides[tiled_out_dim];
+  }
+  for (int i = 0; i < ndims - 1; ++i) {
+    if (i == tiled_out_dim) continue;
+    outer_dims.push_back(dims[reduced_perm[i]]);
+    outer_in_strides.push_back(in_strides[reduced_perm[i]]);
+    outer_out_strides.push_back(out_strides[i]);
+  }
+}
+
+int64_t CpuTransposePlan::NumOuterIterations() const {
+  int64_t count = 1;
+  for (int64_t dim : outer_dims) count *= dim;
+  return count;
+}
+
+void CpuTransposePlan::OuterOffsets(int64_t index, int64_t* in_offset,
+                                    int64_t* out_offset) const {
+  *in_offset = 0;
+  *out_offset = 0;
+  for (int i = outer_dims.size() - 1; i >= 0; --i) {
+    const int64_t coordinate = index % outer_dims[i];
+    index /= outer_dims[i];
+    *in_offset += coordinate * outer_in_strides[i];
+    *out_offset += coordinate * outer_out_strides[i];
+  }
+}
+
+namespace {
+
+// An LRU cache of transpose plans, shared by all the CPU transposes of the
+// process. Building a plan is cheaper than transposing all but the smallest
+// tensors, but the same few shapes and permutations are transposed at every
+// step, so that the lookup is the only per-call overhead.
+class CpuTransposePlanCache {
+ public:
+  static CpuTransposePlanCache* Global() {
+    static CpuTransposePlanCache* cache = new CpuTransposePlanCache;
+    return cache;
+  }
+
+  std::shared_ptr<const CpuTransposePlan> GetOrCreate(
+      int64_t elem_size, const TensorShape& shape,
+      const gtl::ArraySlice<int32> perm) {
+    std::vector<int64_t> key;
+    key.reserve(2 * shape.dims() + 1);
+    key.push_back(elem_size);
+    for (int i = 0; i < shape.dims(); ++i) key.push_back(shape.dim_size(i));
+    key.insert(key.end(), perm.begin(), perm.end());
+
+    mutex_lock l(mu_);
+    auto it = plans_.find(key);
+    if (it != plans_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second);
+      return it->second->second;
+    }
+    auto plan = std::make_shared<const CpuTransposePlan>(elem_size, shape,
+                                                         perm);
+    lru_.emplace_front(key, plan);
+    plans_.emplace(std::move(key), lru_.begin());
+    if (lru_.size() > kCapacity) {
+      plans_.erase(lru_.back().first);
+      lru_.pop_back();
+    }
+    return plan;
+  }
+
+ private:
+  static constexpr size_t kCapacity = 256;
+
+  using Entry =
+      std::pair<std::vector<int64_t>, std::shared_ptr<const CpuTransposePlan>>;
+
+  mutex mu_;
+  std::list<Entry> lru_ TF_GUARDED_BY(mu_);
+  absl::flat_hash_map<std::vector<int64_t>, std::list<Entry>::iterator> plans_
+      TF_GUARDED_BY(mu_);
+};
+
+}  // namespace
+
+std::shared_ptr<const CpuTransposePlan> GetCpuTransposePlan(
+    int64_t elem_size, const TensorShape& shape,
+    const gtl::ArraySlice<int32> perm) {
+  return CpuTransposePlanCache::Global()->GetOrCreate(elem_size, shape, perm);
+}
+
+}  // namespace internal
+
 namespace {
 
 template <typename T, bool conjugate>
@@ -68,12 +229,203 @@ void TransposeSimple(const CPUDevice& device, const Tensor& in,
   device.parallelFor(in.NumElements(), cost, std::move(transpose_fn));
 }
 
+template <typename T, bool conjugate>
+inline T MaybeConj(const T& v) {
+  if (conjugate) return Eigen::numext::conj(v);
+  return v;
+}
+
+// Packet type used to transpose square tiles of T in registers, as packets of
+// floating point numbers of the same size, which are only moved around and
+// never computed on. `kSize` is 1 if tiles are transposed one element at a
+// time.
+template <typename T, bool conjugate>
+struct TilePacket {
+  using Scalar = T;
+  using Packet = T;
+  static constexpr int kSize = 1;
+};
+
+template <>
+struct TilePacket<uint32, false> {
+  using Scalar = float;
+  using Packet = Eigen::internal::packet_traits<float>::type;
+  static constexpr int kSize = Eigen::internal::unpacket_traits<Packet>::size;
+};
+
+template <>
+struct TilePacket<uint64, false> {
+  using Scalar = double;
+  using Packet = Eigen::internal::packet_traits<double>::type;
+  static constexpr int kSize = Eigen::internal::unpacket_traits<Packet>::size;
+};
+
+// Transposes the rows [row_begin, row_end) and columns [col_begin, col_end)
+// of the tile at `in`, where rows are `in_row_stride` apart, into `out`,
+// where columns are `out_col_stride` apart, one element at a time.
+template <typename T, bool conjugate>
+void TransposeTileScalar(const T* in, int64_t in_row_stride, T* out,
+                         int64_t out_col_stride, int64_t row_begin,
+                         int64_t row_end, int64_t col_begin, int64_t col_end) {
+  for (int64_t c = col_begin; c < col_end; ++c) {
+    const T* src = in + c;
+    T* dst = out + c * out_col_stride;
+    for (int64_t r = row_begin; r < row_end; ++r) {
+      dst[r] = MaybeConj<T, conjugate>(src[r * in_row_stride]);
+    }
+  }
+}
+
+// Same as above, but full kSize x kSize blocks are loaded as kSize packets,
+// transposed with shuffles and stored as kSize packets.
+template <typename T, bool conjugate>
+void TransposeTile(const T* in, int64_t in_row_stride, T* out,
+                   int64_t out_col_stride, int64_t row_begin, int64_t row_end,
+                   int64_t col_begin, int64_t col_end) {
+  using Traits = TilePacket<T, conjugate>;
+  constexpr int kSize = Traits::kSize;
+  if constexpr (kSize == 1) {
+    TransposeTileScalar<T, conjugate>(in, in_row_stride, out, out_col_stride,
+                                      row_begin, row_end, col_begin, col_end);
+  } else {
+    using Scalar = typename Traits::Scalar;
+    using Packet = typename Traits::Packet;
+    const int64_t row_limit = row_begin + (row_end - row_begin) / kSize * kSize;
+    const int64_t col_limit = col_begin + (col_end - col_begin) / kSize * kSize;
+    for (int64_t c = col_begin; c < col_limit; c += kSize) {
+      for (int64_t r = row_begin; r < row_limit; r += kSize) {
+        const Scalar* src =
+            reinterpret_cast<const Scalar*>(in + r * in_row_stride + c);
+        Scalar* dst = reinterpret_cast<Scalar*>(out + c * out_col_stride + r);
+        Eigen::internal::PacketBlock<Packet, kSize> block;
+        for (int i = 0; i < kSize; ++i) {
+          block.packet[i] =
+              Eigen::internal::ploadu<Packet>(src + i * in_row_stride);
+        }
+        Eigen::internal::ptranspose(block);
+        for (int i = 0; i < kSize; ++i) {
+          Eigen::internal::pstoreu(dst + i * out_col_stride, block.packet[i]);
+        }
+      }
+    }
+    // Left over rows and columns.
+    TransposeTileScalar<T, conjugate>(in, in_row_stride, out, out_col_stride,
+                                      row_limit, row_end, col_begin,
+                                      col_limit);
+    TransposeTileScalar<T, conjugate>(in, in_row_stride, out, out_col_stride,
+                                      row_begin, row_end, col_limit, col_end);
+  }
+}
+
+// Transposes `in` into `out` following `plan`, on the threads of `device`.
+//
+// Tiled transposes are split into blocks of kBlockBytes x kBlockBytes bytes,
+// so that both the rows read from `in` and the ones written to `out` stay in
+// L1 while a block is transposed, and blocks are distributed over the threads.
+template <typename T, bool conjugate>
+void ExecuteTransposePlan(const CPUDevice& device,
+                          const internal::CpuTransposePlan& plan, const T* in,
+                          T* out) {
+  using Plan = internal::CpuTransposePlan;
+  if (plan.kind == Plan::kCopy) {
+    auto copy = [in, out](int64_t begin, int64_t end) {
+      if (conjugate) {
+        for (int64_t i = begin; i < end; ++i) {
+          out[i] = MaybeConj<T, conjugate>(in[i]);
+        }
+      } else {
+        std::memcpy(out + begin, in + begin, (end - begin) * sizeof(T));
+      }
+    };
+    device.parallelFor(plan.num_elements,
+                       Eigen::TensorOpCost(sizeof(T), sizeof(T), 1), copy);
+    return;
+  }
+
+  const int64_t num_outer = plan.NumOuterIterations();
+  if (plan.kind == Plan::kCopyRows) {
+    const int64_t row_size = plan.row_size;
+    auto copy_rows = [&plan, in, out, row_size](int64_t begin, int64_t end) {
+      // Consecutive rows only differ by their innermost outer coordinate
+      // until it wraps around.
+      const int64_t inner_dim = plan.outer_dims.back();
+      const int64_t inner_in_stride = plan.outer_in_strides.back();
+      const int64_t inner_out_stride = plan.outer_out_strides.back();
+      int64_t in_offset = 0, out_offset = 0;
+      for (int64_t i = begin; i < end; ++i) {
+        if (i == begin || i % inner_dim == 0) {
+          plan.OuterOffsets(i, &in_offset, &out_offset);
+        } else {
+          in_offset += inner_in_stride;
+          out_offset += inner_out_stride;
+        }
+        const T* src = in + in_offset;
+        T* dst = out + out_offset;
+        if (conjugate) {
+          for (int64_t j = 0; j < row_size; ++j) {
+            dst[j] = MaybeConj<T, conjugate>(src[j]);
+          }
+        } else {
+          std::memcpy(dst, src, row_size * sizeof(T));
+        }
+      }
+    };
+    device.parallelFor(
+        num_outer,
+        Eigen::TensorOpCost(row_size * sizeof(T), row_size * sizeof(T),
+                            row_size + 2 * plan.outer_dims.size()),
+        copy_rows);
+    return;
+  }
+
+  constexpr int64_t kBlockBytes = 256;
+  constexpr int64_t kBlock =
+      std::max<int64_t>(TilePacket<T, conjugate>::kSize,
+                        std::min<int64_t>(64, kBlockBytes / sizeof(T)));
+  const int64_t row_blocks = (plan.num_rows + kBlock - 1) / kBlock;
+  const int64_t col_blocks = (plan.num_cols + kBlock - 1) / kBlock;
+  const int64_t blocks_per_outer = row_blocks * col_blocks;
+  auto transpose_blocks = [&](int64_t begin, int64_t end) {
+    int64_t outer = -1;
+    int64_t in_offset = 0, out_offset = 0;
+    for (int64_t i = begin; i < end; ++i) {
+      if (i / blocks_per_outer != outer) {
+        outer = i / blocks_per_outer;
+        plan.OuterOffsets(outer, &in_offset, &out_offset);
+      }
+      const int64_t block = i % blocks_per_outer;
+      const int64_t row_begin = (block % row_blocks) * kBlock;
+      const int64_t col_begin = (block / row_blocks) * kBlock;
+      TransposeTile<T, conjugate>(
+          in + in_offset, plan.in_row_stride, out + out_offset,
+          plan.out_col_stride, row_begin,
+          std::min(row_begin + kBlock, plan.num_rows), col_begin,
+          std::min(col_begin + kBlock, plan.num_cols));
+    }
+  };
+  device.parallelFor(num_outer * blocks_per_outer,
+                     Eigen::TensorOpCost(kBlock * kBlock * sizeof(T),
+                                         kBlock * kBlock * sizeof(T),
+                                         kBlock * kBlock),
+                     transpose_blocks);
+}
+
 }  // namespace
 
 template <typename T, bool conjugate>
 struct Transpose<CPUDevice, T, conjugate> {
   static void run(const CPUDevice& d, const Tensor& in,
                   const gtl::ArraySlice<int32> perm, Tensor* out) {
+    // The plan moves raw bytes, so it is only instantiated for types that can
+    // be copied that way.
+    if constexpr (std::is_trivially_copyable<T>::value) {
+      const auto plan = internal::GetCpuTransposePlan(sizeof(T), in.shape(),
+                                                      perm);
+      ExecuteTransposePlan<T, conjugate>(
+          d, *plan, reinterpret_cast<const T*>(in.tensor_data().data()),
+          reinterpret_cast<T*>(const_cast<char*>(out->tensor_data().data())));
+      return;
+    }
     switch (in.dims()) {
       case 2:
         internal::TransposeUsingEigen<CPUDevice, T, 2>(d, in, perm, conjugate,
@@ -0,0 +1,217 @@
+/* Copyright 2023 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#define EIGEN_USE_THREADS
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+#include "unsupported/Eigen/CXX11/Tensor"  // from @eigen_archive
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/kernels/transpose_functor.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/random/simple_philox.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/core/platform/threadpool.h"
+
+namespace tensorflow {
+namespace {
+
+typedef Eigen::ThreadPoolDevice CPUDevice;
+
+// Transposes `in` one element at a time.
+template <typename T>
+Tensor ReferenceTranspose(const Tensor& in, const std::vector<int32>& perm,
+                          bool conjugate) {
+  TensorShape out_shape;
+  for (int32_t p : perm) out_shape.AddDim(in.dim_size(p));
+  Tensor out(in.dtype(), out_shape);
+  const int ndims = in.dims();
+  std::vector<int64_t> in_strides(ndims, 1);
+  for (int i = ndims - 2; i >= 0; --i) {
+    in_strides[i] = in_strides[i + 1] * in.dim_size(i + 1);
+  }
+  auto in_flat = in.flat<T>();
+  auto out_flat = out.flat<T>();
+  for (int64_t o = 0; o < out.NumElements(); ++o) {
+    int64_t remaining = o;
+    int64_t i = 0;
+    for (int d = ndims - 1; d >= 0; --d) {
+      i += (remaining % out_shape.dim_size(d)) * in_strides[perm[d]];
+      remaining /= out_shape.dim_size(d);
+    }
+    out_flat(o) = conjugate ? Eigen::numext::conj(in_flat(i)) : in_flat(i);
+  }
+  return out;
+}
+
+class TransposeFunctorCpuTest : public ::testing::Test {
+ protected:
+  TransposeFunctorCpuTest()
+      : threadpool_(Env::Default(), "test", 4),
+        device_(threadpool_.AsEigenThreadPool(), 4),
+        philox_(123, 17),
+        rnd_(&philox_) {}
+
+  template <typename T>
+  void TestTranspose(const TensorShape& shape, const std::vector<int32>& perm,
+                     bool conjugate) {
+    Tensor in(DataTypeToEnum<T>::value, shape);
+    auto in_flat = in.flat<T>();
+    for (int64_t i = 0; i < in.NumElements(); ++i) {
+      in_flat(i) = T(static_cast<float>(rnd_.Uniform(100)));
+    }
+    const Tensor expected = ReferenceTranspose<T>(in, perm, conjugate);
+    Tensor out(in.dtype(), expected.shape());
+    if (conjugate) {
+      TF_ASSERT_OK(DoConjugateTranspose(device_, in, perm, &out));
+    } else {
+      TF_ASSERT_OK(DoTranspose(device_, in, perm, &out));
+    }
+    test::ExpectTensorEqual<T>(expected, out);
+  }
+
+  // Transposes tensors of random shapes by random permutations.
+  template <typename T>
+  void TestRandomTransposes(bool conjugate) {
+    for (int iteration = 0; iteration < 200; ++iteration) {
+      const int ndims = 2 + rnd_.Uniform(5);
+      TensorShape shape;
+      for (int i = 0; i < ndims; ++i) {
+        shape.AddDim(rnd_.OneIn(5) ? 1 : 1 + rnd_.Uniform(ndims <= 3 ? 70 : 9));
+      }
+      std::vector<int32> perm(ndims);
+      std::iota(perm.begin(), perm.end(), 0);
+      for (int i = ndims - 1; i > 0; --i) {
+        std::swap(perm[i], perm[rnd_.Uniform(i + 1)]);
+      }
+      TestTranspose<T>(shape, perm, conjugate);
+    }
+  }
+
+  thread::ThreadPool threadpool_;
+  CPUDevice device_;
+  random::PhiloxRandom philox_;
+  random::SimplePhilox rnd_;
+};
+
+TEST_F(TransposeFunctorCpuTest, RandomUint8) {
+  TestRandomTransposes<uint8>(false);
+}
+
+TEST_F(TransposeFunctorCpuTest, RandomInt16) {
+  TestRandomTransposes<int16>(false);
+}
+
+TEST_F(TransposeFunctorCpuTest, RandomFloat) {
+  TestRandomTransposes<float>(false);
+}
+
+TEST_F(TransposeFunctorCpuTest, RandomDouble) {
+  TestRandomTransposes<double>(false);
+}
+
+TEST_F(TransposeFunctorCpuTest, RandomComplex64) {
+  TestRandomTransposes<complex64>(false);
+  TestRandomTransposes<complex64>(true);
+}
+
+TEST_F(TransposeFunctorCpuTest, RandomComplex128) {
+  TestRandomTransposes<complex128>(true);
+}
+
+TEST_F(TransposeFunctorCpuTest, LayoutAndAttentionPermutations) {
+  TestTranspose<float>({3, 17, 19, 35}, {0, 3, 1, 2}, false);
+  TestTranspose<float>({3, 35, 17, 19}, {0, 2, 3, 1}, false);
+  TestTranspose<float>({2, 37, 5, 24}, {0, 2, 1, 3}, false);
+  TestTranspose<float>({2, 5, 37, 24}, {0, 1, 3, 2}, false);
+  TestTranspose<bfloat16>({2, 5, 37, 24}, {0, 1, 3, 2}, false);
+}
+
+TEST_F(TransposeFunctorCpuTest, EmptyAndSingletonDimensions) {
+  TestTranspose<float>({4, 0, 3}, {2, 0, 1}, false);
+  TestTranspose<float>({1, 1, 1}, {2, 0, 1}, false);
+  TestTranspose<float>({1, 30, 1, 20}, {3, 2, 0, 1}, false);
+}
+
+TEST(CpuTransposePlanTest, MergesAndDropsDimensions) {
+  // NHWC -> NCHW transposes HW x C tiles, once per batch.
+  auto plan = internal::GetCpuTransposePlan(4, {8, 5, 6, 3}, {0, 3, 1, 2});
+  EXPECT_EQ(plan->kind, internal::CpuTransposePlan::kTiled);
+  EXPECT_EQ(plan->num_rows, 30);
+  EXPECT_EQ(plan->num_cols, 3);
+  EXPECT_EQ(plan->in_row_stride, 3);
+  EXPECT_EQ(plan->out_col_stride, 30);
+  EXPECT_EQ(plan->NumOuterIterations(), 8);
+
+  // Swapping the heads and sequence dimensions copies rows of the depth.
+  plan = internal::GetCpuTransposePlan(4, {2, 7, 4, 16}, {0, 2, 1, 3});
+  EXPECT_EQ(plan->kind, internal::CpuTransposePlan::kCopyRows);
+  EXPECT_EQ(plan->row_size, 16);
+  EXPECT_EQ(plan->NumOuterIterations(), 2 * 7 * 4);
+
+  // Only size 1 dimensions move.
+  plan = internal::GetCpuTransposePlan(2, {1, 6, 1, 5}, {2, 1, 3, 0});
+  EXPECT_EQ(plan->kind, internal::CpuTransposePlan::kCopy);
+}
+
+TEST(CpuTransposePlanTest, CachesPlans) {
+  auto plan = internal::GetCpuTransposePlan(4, {8, 5, 6, 3}, {0, 3, 1, 2});
+  EXPECT_EQ(plan, internal::GetCpuTransposePlan(4, {8, 5, 6, 3}, {0, 3, 1, 2}));
+  EXPECT_NE(plan, internal::GetCpuTransposePlan(2, {8, 5, 6, 3}, {0, 3, 1, 2}));
+  EXPECT_NE(plan, internal::GetCpuTransposePlan(4, {8, 5, 6, 3}, {0, 3, 2, 1}));
+}
+
+Graph* TransposeGraph(const TensorShape& shape,
+                      const std::vector<int32>& perm) {
+  Graph* g = new Graph(OpRegistry::Global());
+  Tensor in(DT_FLOAT, shape);
+  in.flat<float>().setRandom();
+  Node* ret;
+  TF_CHECK_OK(NodeBuilder(g->NewName("n"), "Transpose")
+                  .Input(test::graph::Constant(g, in))
+                  .Input(test::graph::Constant(g, test::AsTensor<int32>(perm)))
+                  .Finalize(g, &ret));
+  return g;
+}
+
+// NHWC <-> NCHW conversions, as inserted by the layout optimizer, and the
+// transposes of multi-head attention.
+#define BM_Transpose(NAME, SHAPE, PERM)                                        \
+  static void BM_Transpose_##NAME(::testing::benchmark::State& state) {        \
+    const TensorShape shape SHAPE;                                             \
+    test::Benchmark("cpu", TransposeGraph(shape, std::vector<int32> PERM),     \
+                    /*old_benchmark_api*/ false)                               \
+        .Run(state);                                                           \
+    state.SetBytesProcessed(state.iterations() * shape.num_elements() *        \
+                            sizeof(float) * 2);                                \
+  }                                                                            \
+  BENCHMARK(BM_Transpose_##NAME)->UseRealTime();
+
+BM_Transpose(NhwcToNchw, ({32, 56, 56, 64}), ({0, 3, 1, 2}));
+BM_Transpose(NchwToNhwc, ({32, 64, 56, 56}), ({0, 2, 3, 1}));
+BM_Transpose(SplitHeads, ({8, 512, 16, 64}), ({0, 2, 1, 3}));
+BM_Transpose(TransposeKeys, ({8, 16, 512, 64}), ({0, 1, 3, 2}));
+BM_Transpose(NdhwcToNcdhw, ({4, 16, 32, 32, 32}), ({0, 4, 1, 2, 3}));
+
+}  // namespace
+}  // namespace tensorflow
@@ -13,9 +13,12 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#include <algorithm>
 #include <functional>
+#include <type_traits>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
 #include "tensorflow/core/framework/bounds_check.h"
@@ -23,9 +26,11 @@ limitations under the License.
 #include "tensorflow/core/framework/register_types.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/lib/core/bits.h"
 #include "tensorflow/core/lib/core/status.h"
 #include "tensorflow/core/lib/hash/hash.h"
 #include "tensorflow/core/platform/bfloat16.h"
+#include "tensorflow/core/util/work_sharder.h"
 
 namespace tensorflow {
 namespace {
@@ -68,6 +73,185 @@ struct UniqueOpHashMap<bfloat16, TIndex> {
   using map_type = std::unordered_map<bfloat16, TIndex>;
 };
 
+// Inputs with at least this many elements are uniquified on multiple threads
+// when their element type supports it.
+constexpr int64_t kParallelUniqueMinElements = 128 * 1024;
+
+// The multi-threaded implementation is used for integer keys, which are cheap
+// to hash into partitions.
+template <typename T>
+constexpr bool SupportsParallelUnique() {
+  return std::is_integral<T>::value && !std::is_same<T, bool>::value;
+}
+
+// Uniquifies the 1-D tensor `Tin` on the CPU worker threads, with the same
+// results as the sequential implementation: unique elements are numbered in
+// order of first occurrence.
+//
+// 1. The input is split into blocks, and each block scatters the positions of
+//    its elements into one of `num_partitions` partitions chosen by a hash of
+//    the element. Positions within a partition stay in input order.
+// 2. Each partition is uniquified independently with its own hash map, which
+//    assigns partition-local ids and marks the first occurrence of each
+//    unique element.
+// 3. A prefix sum over the first-occurrence marks gives each unique element
+//    its global id, which is written to `y`, and is then used to translate
+//    the local ids in `idx`.
+//
+// Allocates `y`, with the shape of `input_shape` except for `axis`, and, if
+// `count_output_index` is non-negative, the counts output.
+template <typename T, typename TIndex>
+Status ParallelUnique(OpKernelContext* context,
+                      typename TTypes<T>::ConstFlat Tin,
+                      const TensorShape& input_shape, int64_t axis,
+                      typename TTypes<TIndex>::Vec idx_vec,
+                      int count_output_index, int64_t* uniq_size) {
+  const DeviceBase::CpuWorkerThreads& worker_threads =
+      *context->device()->tensorflow_cpu_worker_threads();
+  const int64_t N = Tin.size();
+
+  const int log2_partitions =
+      std::min(8, Log2Ceiling(4 * worker_threads.num_threads));
+  const int num_partitions = 1 << log2_partitions;
+  const auto partition_of_key = [log2_partitions](const T& key) -> uint8 {
+    // Fibonacci hashing; the top bits are well mixed even for dense ids.
+    return static_cast<uint8>((static_cast<uint64>(key) *
+                               uint64{0x9E3779B97F4A7C15}) >>
+                              (64 - log2_partitions));
+  };
+
+  const int64_t target_num_blocks =
+      std::min<int64_t>(4 * worker_threads.num_threads,
+                        std::max<int64_t>(1, N / (16 * 1024)));
+  const int64_t block_size = (N + target_num_blocks - 1) / target_num_blocks;
+  const int64_t num_blocks = (N + block_size - 1) / block_size;
+  const auto block_range = [N, block_size](int64_t block) {
+    return std::make_pair(block * block_size,
+                          std::min(N, (block + 1) * block_size));
+  };
+  const auto shard_blocks = [&](int64_t cost_per_element,
+                                const std::function<void(int64_t)>& fn) {
+    Shard(worker_threads.num_threads, worker_threads.workers, num_blocks,
+          block_size * cost_per_element, [&fn](int64_t start, int64_t limit) {
+            for (int64_t block = start; block < limit; ++block) fn(block);
+          });
+  };
+
+  // Step 1: scatter positions into partitions.
+  std::vector<uint8> partition_of(N);
+  std::vector<int64_t> offsets(num_blocks * num_partitions, 0);
+  shard_blocks(/*cost_per_element=*/5, [&](int64_t block) {
+    int64_t* counts = &offsets[block * num_partitions];
+    const auto range = block_range(block);
+    for (int64_t i = range.first; i < range.second; ++i) {
+      const uint8 partition = partition_of_key(Tin(i));
+      partition_of[i] = partition;
+      ++counts[partition];
+    }
+  });
+  // Partition-major exclusive scan, so that each partition's positions are
+  // laid out block by block.
+  std::vector<int64_t> partition_start(num_partitions + 1);
+  int64_t total = 0;
+  for (int partition = 0; partition < num_partitions; ++partition) {
+    partition_start[partition] = total;
+    for (int64_t block = 0; block < num_blocks; ++block) {
+      int64_t& offset = offsets[block * num_partitions + partition];
+      const int64_t count = offset;
+      offset = total;
+      total += count;
+    }
+  }
+  partition_start[num_partitions] = total;
+  // `N` fits in int32, see `UniqueOp::Compute()`.
+  std::vector<int32> positions(N);
+  shard_blocks(/*cost_per_element=*/5, [&](int64_t block) {
+    int64_t* next = &offsets[block * num_partitions];
+    const auto range = block_range(block);
+    for (int64_t i = range.first; i < range.second; ++i) {
+      positions[next[partition_of[i]]++] = static_cast<int32>(i);
+    }
+  });
+
+  // Step 2: uniquify each partition, leaving partition-local ids in `idx_vec`.
+  std::vector<uint8> is_first(N, 0);
+  std::vector<std::vector<TIndex>> local_counts(num_partitions);
+  std::vector<std::vector<TIndex>> local_to_global(num_partitions);
+  const bool with_counts = count_output_index >= 0;
+  Shard(worker_threads.num_threads, worker_threads.workers, num_partitions,
+        /*cost_per_unit=*/50 * N / num_partitions,
+        [&](int64_t start, int64_t limit) {
+          for (int64_t partition = start; partition < limit; ++partition) {
+            const int64_t begin = partition_start[partition];
+            const int64_t end = partition_start[partition + 1];
+            typename UniqueOpHashMap<T, TIndex>::map_type uniq;
+            uniq.reserve(end - begin);
+            std::vector<TIndex>& counts = local_counts[partition];
+            TIndex j = 0;
+            for (int64_t k = begin; k < end; ++k) {
+              const int32 i = positions[k];
+              auto it = uniq.emplace(Tin(i), j);
+              idx_vec(i) = it.first->second;
+              if (it.second) {
+                is_first[i] = 1;
+                ++j;
+                if (with_counts) counts.push_back(0);
+              }
+              if (with_counts) ++counts[it.first->second];
+            }
+            local_to_global[partition].resize(j);
+          }
+        });
+
+  // Step 3: number the unique elements in order of first occurrence.
+  std::vector<int64_t> block_first(num_blocks);
+  shard_blocks(/*cost_per_element=*/1, [&](int64_t block) {
+    const auto range = block_range(block);
+    block_first[block] = std::count(is_first.begin() + range.first,
+                                    is_first.begin() + range.second, 1);
+  });
+  *uniq_size = 0;
+  for (int64_t block = 0; block < num_blocks; ++block) {
+    const int64_t count = block_first[block];
+    block_first[block] = *uniq_size;
+    *uniq_size += count;
+  }
+
+  TensorShape output_shape(input_shape);
+  output_shape.set_dim(axis, *uniq_size);
+  Tensor* output = nullptr;
+  TF_RETURN_IF_ERROR(context->allocate_output(0, output_shape, &output));
+  auto Tout = output->flat<T>();
+  TIndex* count_data = nullptr;
+  if (with_counts) {
+    Tensor* count_output = nullptr;
+    TF_RETURN_IF_ERROR(context->allocate_output(
+        count_output_index, TensorShape({*uniq_size}), &count_output));
+    count_data = count_output->vec<TIndex>().data();
+  }
+  shard_blocks(/*cost_per_element=*/2, [&](int64_t block) {
+    TIndex global_id = block_first[block];
+    const auto range = block_range(block);
+    for (int64_t i = range.first; i < range.second; ++i) {
+      if (!is_first[i]) continue;
+      const uint8 partition = partition_of[i];
+      local_to_global[partition][idx_vec(i)] = global_id;
+      Tout(global_id) = Tin(i);
+      if (with_counts) {
+        count_data[global_id] = local_counts[partition][idx_vec(i)];
+      }
+      ++global_id;
+    }
+  });
+  shard_blocks(/*cost_per_element=*/2, [&](int64_t block) {
+    const auto range = block_range(block);
+    for (int64_t i = range.first; i < range.second; ++i) {
+      idx_vec(i) = local_to_global[partition_of[i]][idx_vec(i)];
+    }
+  });
+  return absl::OkStatus();
+}
+
 // `UniqueOp` computes the unique elements in the input tensor.
 //
 // * `T` is the element type.
@@ -150,6 +334,18 @@ class UniqueOp : public OpKernel {
       auto Tin = input.flat<T>();
       const int64_t N = static_cast<int64_t>(Tin.size());
 
+      if constexpr (SupportsParallelUnique<T>()) {
+        if (N >= kParallelUniqueMinElements &&
+            context->device()->tensorflow_cpu_worker_threads()->num_threads >
+                1) {
+          OP_REQUIRES_OK(
+              context, ParallelUnique<T, TIndex>(
+                           context, Tin, input.shape(), axis, idx_vec,
+                           num_outputs() > 2 ? 2 : -1, &uniq_size));
+          return;
+        }
+      }
+
       typename UniqueOpHashMap<T, TIndex>::map_type uniq;
       uniq.reserve(2 * N);
       for (Eigen::Index i = 0, j = 0; i < N; ++i) {
@@ -15,10 +15,15 @@ limitations under the License.
 
 #include <functional>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 #include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor.pb.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/framework/tensor_shape.pb.h"
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/framework/types.pb.h"
@@ -28,8 +33,10 @@ limitations under the License.
 #include "tensorflow/core/kernels/ops_testutil.h"
 #include "tensorflow/core/kernels/ops_util.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/random/simple_philox.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/core/platform/threadpool.h"
 
 namespace tensorflow {
 
@@ -37,6 +44,108 @@ namespace {
 
 const int kMaxStrLen = 40;
 
+class UniqueOpTest : public OpsTestBase {
+ protected:
+  void MakeOp(const string& op_name) {
+    TF_ASSERT_OK(NodeDefBuilder("unique", op_name)
+                     .Input(FakeInput(DT_INT64))
+                     .Attr("out_idx", DT_INT32)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+  }
+
+  // Runs the op on `input` with `num_threads` CPU worker threads, and returns
+  // its outputs.
+  std::vector<Tensor> RunWithThreads(const std::vector<int64_t>& input,
+                                     int num_threads) {
+    pool_ = std::make_unique<thread::ThreadPool>(
+        Env::Default(), "unique_op_test", num_threads);
+    worker_threads_.num_threads = num_threads;
+    worker_threads_.workers = pool_.get();
+    device_->set_tensorflow_cpu_worker_threads(&worker_threads_);
+
+    const int64_t n = input.size();
+    inputs_.clear();
+    AddInputFromArray<int64_t>(TensorShape({n}), input);
+    std::vector<Tensor> outputs;
+    TF_CHECK_OK(RunOpKernel());
+    for (int i = 0; i < context_->num_outputs(); ++i) {
+      outputs.push_back(*GetOutput(i));
+    }
+    return outputs;
+  }
+
+  // Checks the outputs of the op against a sequential reference for `input`.
+  void RunAndCheck(const std::vector<int64_t>& input, bool with_counts) {
+    std::unordered_map<int64_t, int32> first_index;
+    std::vector<int64_t> expected_y;
+    std::vector<int32> expected_idx;
+    std::vector<int32> expected_count;
+    for (const int64_t x : input) {
+      auto it = first_index.emplace(x, expected_y.size());
+      if (it.second) {
+        expected_y.push_back(x);
+        expected_count.push_back(0);
+      }
+      expected_idx.push_back(it.first->second);
+      ++expected_count[it.first->second];
+    }
+
+    const std::vector<Tensor> outputs =
+        RunWithThreads(input, /*num_threads=*/4);
+    test::ExpectTensorEqual<int64_t>(outputs[0],
+                                     test::AsTensor<int64_t>(expected_y));
+    test::ExpectTensorEqual<int32>(outputs[1],
+                                   test::AsTensor<int32>(expected_idx));
+    if (with_counts) {
+      test::ExpectTensorEqual<int32>(outputs[2],
+                                     test::AsTensor<int32>(expected_count));
+    }
+  }
+
+ private:
+  std::unique_ptr<thread::ThreadPool> pool_;
+  DeviceBase::CpuWorkerThreads worker_threads_;
+};
+
+// Large enough inputs are uniquified on multiple threads; the outputs must be
+// identical to the sequential implementation.
+TEST_F(UniqueOpTest, LargeInputKeepsFirstOccurrenceOrder) {
+  MakeOp("Unique");
+  random::PhiloxRandom philox(17, 42);
+  random::SimplePhilox rnd(&philox);
+  std::vector<int64_t> input(1 << 20);
+  for (int64_t& x : input) x = rnd.Uniform64(1 << 16) - (1 << 15);
+  RunAndCheck(input, /*with_counts=*/false);
+}
+
+TEST_F(UniqueOpTest, LargeInputWithCounts) {
+  MakeOp("UniqueWithCounts");
+  random::PhiloxRandom philox(17, 42);
+  random::SimplePhilox rnd(&philox);
+  std::vector<int64_t> input(1 << 20);
+  for (int64_t& x : input) x = rnd.Uniform64(1 << 22);
+  RunAndCheck(input, /*with_counts=*/true);
+}
+
+// Runs the same input above the parallel threshold through the serial path,
+// with a single worker thread, and the parallel one.
+TEST_F(UniqueOpTest, ParallelMatchesSerial) {
+  MakeOp("UniqueWithCounts");
+  random::PhiloxRandom philox(3, 7);
+  random::SimplePhilox rnd(&philox);
+  std::vector<int64_t> input(300 * 1024);
+  for (int64_t& x : input) x = rnd.Uniform64(1 << 14) * 0x100000001;
+
+  const std::vector<Tensor> serial = RunWithThreads(input, /*num_threads=*/1);
+  const std::vector<Tensor> parallel = RunWithThreads(input, /*num_threads=*/4);
+  ASSERT_EQ(3, serial.size());
+  ASSERT_EQ(3, parallel.size());
+  test::ExpectTensorEqual<int64_t>(parallel[0], serial[0]);
+  test::ExpectTensorEqual<int32>(parallel[1], serial[1]);
+  test::ExpectTensorEqual<int32>(parallel[2], serial[2]);
+}
+
 TensorProto GetRandomInt32TensorProto(int dim, int max_int) {
   TensorProto tensor_proto;
   tensor_proto.set_dtype(DT_INT32);
@@ -149,6 +258,48 @@ void BM_Unique_STRING(::testing::benchmark::State& state) {
                           sizeof(tstring));
 }
 
+// Uniquifies `dim` random int64 ids drawn from `cardinality` distinct values,
+// as done on embedding ids before a lookup.
+void BM_Unique_INT64(::testing::benchmark::State& state) {
+  const int dim = state.range(0);
+  const int cardinality = state.range(1);
+
+  Graph* g = new Graph(OpRegistry::Global());
+
+  Tensor input(DT_INT64, TensorShape({dim}));
+  random::PhiloxRandom philox(301, 17);
+  random::SimplePhilox rnd(&philox);
+  auto input_flat = input.flat<int64_t>();
+  for (int i = 0; i < dim; ++i) {
+    input_flat(i) = rnd.Uniform64(cardinality);
+  }
+
+  Node* node;
+  TF_CHECK_OK(NodeBuilder(g->NewName("n"), "Unique")
+                  .Input(test::graph::Constant(g, input))
+                  .Attr("T", DT_INT64)
+                  .Finalize(g, &node));
+  FixupSourceAndSinkEdges(g);
+
+  test::Benchmark("cpu", g, nullptr, nullptr, nullptr,
+                  "SINGLE_THREADED_EXECUTOR", /*old_benchmark_api*/ false)
+      .Run(state);
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * dim);
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * dim *
+                          sizeof(int64_t));
+}
+
+BENCHMARK(BM_Unique_INT64)
+    ->UseRealTime()
+    ->ArgPair(64 * 1024, 1024)
+    ->ArgPair(64 * 1024, 64 * 1024)
+    ->ArgPair(1024 * 1024, 1024)
+    ->ArgPair(1024 * 1024, 64 * 1024)
+    ->ArgPair(1024 * 1024, 1024 * 1024)
+    ->ArgPair(10 * 1024 * 1024, 1024)
+    ->ArgPair(10 * 1024 * 1024, 1024 * 1024)
+    ->ArgPair(10 * 1024 * 1024, 10 * 1024 * 1024);
+
 BENCHMARK(BM_Unique_INT32)
     ->UseRealTime()
     ->ArgPair(32, 1024 * 1024)
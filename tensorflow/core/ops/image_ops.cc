@@ -526,6 +526,44 @@ REGISTER_OP("DecodeAndCropJpeg")
       return absl::OkStatus();
     });
 
+// --------------------------------------------------------------------------
+// Internal operation computing DecodeJpeg, followed by ExpandDims on axis 0 and
+// ResizeBilinear to `size`. By default the result matches the one of the
+// unfused ops. With `dct_scaling`, JPEG images are instead decoded with the
+// libjpeg DCT scaling to the smallest size at least as large as `size`, which
+// is faster but only approximates the unfused result.
+//
+// Do not invoke this operator directly in Python. The remapper is expected to
+// create these operators.
+REGISTER_OP("_DecodeAndResizeJpeg")
+    .Input("contents: string")
+    .Input("size: int32")
+    .Attr("channels: int = 0")
+    .Attr("fancy_upscaling: bool = true")
+    .Attr("try_recover_truncated: bool = false")
+    .Attr("acceptable_fraction: float = 1.0")
+    .Attr("dct_method: string = ''")
+    .Attr("dct_scaling: bool = false")
+    .Attr("align_corners: bool = false")
+    .Attr("half_pixel_centers: bool = false")
+    .Output("resized_images: float")
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeHandle unused;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 0, &unused));
+      DimensionHandle channels_dim = c->UnknownDim();
+      int32_t channels;
+      TF_RETURN_IF_ERROR(c->GetAttr("channels", &channels));
+      if (channels != 0) {
+        if (channels < 0) {
+          return errors::InvalidArgument("channels must be non-negative, got ",
+                                         channels);
+        }
+        channels_dim = c->MakeDim(channels);
+      }
+      return SetOutputToSizedImage(c, c->MakeDim(1), 1 /* size_input_idx */,
+                                   channels_dim);
+    });
+
 // --------------------------------------------------------------------------
 REGISTER_OP("EncodeJpeg")
     .Input("image: uint8")
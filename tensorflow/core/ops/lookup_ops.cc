@@ -384,6 +384,22 @@ REGISTER_OP("AnonymousHashTable")
     .SetIsStateful()
     .SetShapeFn(ScalarOutput);
 
+REGISTER_OP("MemmappedHashTable")
+    .Input("filename: string")
+    .Output("table_handle: resource")
+    .Attr("container: string = ''")
+    .Attr("shared_name: string = ''")
+    .Attr("use_node_name_sharing: bool = false")
+    .Attr("key_dtype: {int64, string}")
+    .Attr("value_dtype: {int64, string}")
+    .SetIsStateful()
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeHandle filename;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 0, &filename));
+      c->set_output(0, c->Scalar());
+      return absl::OkStatus();
+    });
+
 REGISTER_OP("MutableHashTable")
     .Output("table_handle: Ref(string)")
     .Attr("container: string = ''")
@@ -411,6 +427,16 @@ REGISTER_OP("AnonymousMutableHashTable")
     .SetIsStateful()
     .SetShapeFn(MutableHashTableShapeFn);
 
+REGISTER_OP("MutableConcurrentHashTable")
+    .Output("table_handle: resource")
+    .Attr("container: string = ''")
+    .Attr("shared_name: string = ''")
+    .Attr("use_node_name_sharing: bool = false")
+    .Attr("key_dtype: {int32, int64}")
+    .Attr("value_dtype: {int32, int64, float, double}")
+    .SetIsStateful()
+    .SetShapeFn(MutableHashTableShapeFn);
+
 REGISTER_OP("MutableHashTableOfTensors")
     .Output("table_handle: Ref(string)")
     .Attr("container: string = ''")
@@ -81,6 +81,13 @@ TEST(LookupOpsTest, LookupTableExportV2_ShapeFn) {
   INFER_OK(op, "[]", "?;?");
 }
 
+TEST(LookupOpsTest, MemmappedHashTable_ShapeFn) {
+  ShapeInferenceTestOp op("MemmappedHashTable");
+  INFER_OK(op, "?", "[]");
+  INFER_OK(op, "[]", "[]");
+  INFER_ERROR("Shape must be rank 0 but is rank 1", op, "[2]");
+}
+
 // TODO(b/169969017): add shape fn tests for rest of the ops.
 
 }  // namespace
@@ -1569,6 +1569,47 @@ REGISTER_OP("SparseSegmentSqrtNGradV2")
     .Attr("Tsegmentids: {int32, int64} = DT_INT32")
     .SetShapeFn(SparseSegmentReductionGradV2ShapeFn);
 
+REGISTER_OP("_FusedGatherSparseSegmentReduction")
+    .Input("params: T")
+    .Input("ids: Tindices")
+    .Input("indices: Tidx")
+    .Input("segment_ids: Tsegmentids")
+    .Output("output: T")
+    .Attr("T: {bfloat16, float}")
+    .Attr("Tindices: {int32, int64}")
+    .Attr("Tidx: {int32, int64} = DT_INT32")
+    .Attr("Tsegmentids: {int32, int64} = DT_INT32")
+    .Attr("combiner: {'sum', 'mean', 'sqrtn'}")
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeHandle data_shape;
+      TF_RETURN_IF_ERROR(c->WithRankAtLeast(c->input(0), 1, &data_shape));
+      ShapeHandle unused;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(1), 1, &unused));
+
+      ShapeHandle indices_shape;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(2), 1, &indices_shape));
+      ShapeHandle segment_ids_shape;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(3), 1, &segment_ids_shape));
+      TF_RETURN_IF_ERROR(c->Merge(indices_shape, segment_ids_shape, &unused));
+
+      ShapeHandle subshape;
+      TF_RETURN_IF_ERROR(c->Subshape(data_shape, 1, &subshape));
+      ShapeHandle out;
+      TF_RETURN_IF_ERROR(c->Concatenate(
+          c->Vector(InferenceContext::kUnknownDim), subshape, &out));
+      c->set_output(0, out);
+      return absl::OkStatus();
+    })
+    .Doc(R"doc(
+Internal operation which is a composition of gathering rows of `params` at
+`ids` (Gather/GatherV2 on axis 0) and reducing the gathered rows with
+SparseSegmentSum, SparseSegmentMean or SparseSegmentSqrtN, as selected by
+`combiner`. The gathered rows are never materialized.
+
+Do not invoke this operator directly in Python. A fusion optimization is
+expected to create these operators.
+)doc");
+
 REGISTER_OP("All")
     .Input("input: bool")
     .Input("reduction_indices: Tidx")
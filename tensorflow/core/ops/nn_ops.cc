@@ -1301,6 +1301,57 @@ REGISTER_OP("LogSoftmax")
 
 // --------------------------------------------------------------------------
 
+REGISTER_OP("_FusedAttention")
+    .Input("query: T")
+    .Input("key: T")
+    .Input("value: T")
+    .Input("args: num_args * T")
+    .Output("output: T")
+    .Attr("T: {float}")
+    .Attr("num_args: int >= 0")
+    .Attr("scale: float = 1.0")
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeHandle query;
+      TF_RETURN_IF_ERROR(c->WithRankAtLeast(c->input(0), 2, &query));
+      ShapeHandle key;
+      TF_RETURN_IF_ERROR(c->WithRankAtLeast(c->input(1), 2, &key));
+      ShapeHandle value;
+      TF_RETURN_IF_ERROR(c->WithRankAtLeast(c->input(2), 2, &value));
+
+      // Query, key and value share their batch dimensions.
+      ShapeHandle batch_shape;
+      TF_RETURN_IF_ERROR(c->Subshape(query, 0, -2, &batch_shape));
+      ShapeHandle other_batch_shape;
+      TF_RETURN_IF_ERROR(c->Subshape(key, 0, -2, &other_batch_shape));
+      TF_RETURN_IF_ERROR(
+          c->Merge(batch_shape, other_batch_shape, &batch_shape));
+      TF_RETURN_IF_ERROR(c->Subshape(value, 0, -2, &other_batch_shape));
+      TF_RETURN_IF_ERROR(
+          c->Merge(batch_shape, other_batch_shape, &batch_shape));
+
+      // Query and key have the same depth, key and value the same length.
+      DimensionHandle unused;
+      TF_RETURN_IF_ERROR(c->Merge(c->Dim(query, -1), c->Dim(key, -1), &unused));
+      TF_RETURN_IF_ERROR(c->Merge(c->Dim(key, -2), c->Dim(value, -2), &unused));
+
+      ShapeHandle out;
+      TF_RETURN_IF_ERROR(c->Concatenate(
+          batch_shape, c->Matrix(c->Dim(query, -2), c->Dim(value, -1)), &out));
+      c->set_output(0, out);
+      return absl::OkStatus();
+    })
+    .Doc(R"doc(
+Internal operation which computes scaled dot-product attention,
+`BatchMatMul(Softmax(BatchMatMul(query, key, adj_y=True) * scale + mask),
+value)`, where the optional `mask` in `args` is broadcast to the shape of the
+attention scores. The scores are never materialized.
+
+Do not invoke this operator directly in Python. A fusion optimization is
+expected to create these operators.
+)doc");
+
+// --------------------------------------------------------------------------
+
 REGISTER_OP("SoftmaxCrossEntropyWithLogits")
     .Input("features: T")
     .Input("labels: T")
@@ -397,6 +397,14 @@ class OptimizationOptions(options_lib.OptionsBase):
       "Whether to parallelize stateless map transformations. If None, defaults "
       "to True.")
 
+  map_vectorization = options_lib.create_option(
+      name="map_vectorization",
+      ty=bool,
+      docstring=
+      "Whether to rewrite `map(f).batch(n)` into `batch(n).map(f')`, where "
+      "`f'` applies `f` to a whole batch, when `f` is stateless and only made "
+      "of elementwise ops. If None, defaults to False.")
+
   noop_elimination = options_lib.create_option(
       name="noop_elimination",
       ty=bool,
@@ -435,6 +443,8 @@ class OptimizationOptions(options_lib.OptionsBase):
       pb.map_fusion = self.map_fusion
     if self.map_parallelization is not None:
       pb.map_parallelization = self.map_parallelization
+    if self.map_vectorization is not None:
+      pb.map_vectorization = self.map_vectorization
     if self.noop_elimination is not None:
       pb.noop_elimination = self.noop_elimination
     if self.parallel_batch is not None:
@@ -462,6 +472,8 @@ class OptimizationOptions(options_lib.OptionsBase):
       self.map_fusion = pb.map_fusion
     if pb.WhichOneof("optional_map_parallelization") is not None:
       self.map_parallelization = pb.map_parallelization
+    if pb.WhichOneof("optional_map_vectorization") is not None:
+      self.map_vectorization = pb.map_vectorization
     if pb.WhichOneof("optional_noop_elimination") is not None:
       self.noop_elimination = pb.noop_elimination
     if pb.WhichOneof("optional_parallel_batch") is not None:
@@ -1234,6 +1234,7 @@ class Context:
     rewriter_bool("disable_model_pruning")
     rewriter_toggle("scoped_allocator_optimization")
     rewriter_toggle("pin_to_host_optimization")
+    rewriter_toggle("cpu_op_splitting")
     rewriter_toggle("implementation_selector")
     rewriter_toggle("auto_mixed_precision")
     rewriter_toggle("use_plugin_optimizers")
@@ -2011,6 +2012,7 @@ class Context:
     rewriter_bool("disable_model_pruning")
     rewriter_toggle("scoped_allocator_optimization")
     rewriter_toggle("pin_to_host_optimization")
+    rewriter_toggle("cpu_op_splitting")
     rewriter_toggle("implementation_selector")
     rewriter_toggle("auto_mixed_precision")
     rewriter_toggle("use_plugin_optimizers")
@@ -239,6 +239,8 @@ def set_optimizer_experimental_options(options):
       - scoped_allocator_optimization: Try to allocate some independent Op
         outputs contiguously in order to merge or eliminate downstream Ops.
       - pin_to_host_optimization: Force small ops onto the CPU.
+      - cpu_op_splitting: Split large MatMul and Conv2D ops on CPU into
+        sub-ops that run concurrently.
       - implementation_selector: Enable the swap of kernel implementations based
         on the device placement.
       - auto_mixed_precision: Change certain float32 ops to float16 on Volta
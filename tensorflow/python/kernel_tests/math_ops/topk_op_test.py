@@ -195,6 +195,19 @@ class TopKTest(test.TestCase):
       values = -np.sort(-inputs, axis=1)[:, :k]
       self._validateTopK(inputs, k, values, indices)
 
+  def testLongRows(self):
+    # Rows long enough to be split into blocks of columns on CPU.
+    b = 2
+    n = 200000
+    for k in [2, 100, 1000]:
+      # Repeated integers, to check that ties across blocks are broken by
+      # index.
+      inputs = np.random.randint(0, 5000, size=(b, n)).astype(np.int32)
+      indices = np.argsort(-inputs, axis=1, kind="mergesort")[:, :k]
+      values = -np.sort(-inputs, axis=1)[:, :k]
+      self._validateTopK(inputs, k, values, indices)
+      self._validateTopK(inputs, k, values, indices, sorted=False)
+
   def testTopAll(self):
     inputs = [[0.1, 0.3, 0.2, 0.4], [0.1, 0.3, 0.3, 0.2]]
     self._validateTopK(inputs, 4, [[0.4, 0.3, 0.2, 0.1], [0.3, 0.3, 0.2, 0.1]],
@@ -238,6 +238,23 @@ class SparseTensorDenseMatMulTest(test.TestCase):
     self._testLarge(np.complex64)
     self._testLarge(np.complex128)
 
+  # Tests products large enough to be split across threads, including ones
+  # with fewer output rows than threads.
+  def testManyNonZeros(self):
+    np.random.seed(127)  # Repeatable results
+    for np_dtype in [np.float32, np.complex64]:
+      for m, k, n in [(3, 2000, 1500), (700, 300, 200)]:
+        x = _maybe_complex(np.random.rand(m, k).astype(np_dtype))
+        x[np.abs(x) < 0.7] = 0
+
+        y = _maybe_complex(np.random.randn(k, n).astype(np_dtype))
+
+        self._testMatmul(x, y, adjoint_a=False, adjoint_b=False)
+        self._testMatmul(x.transpose(), y, adjoint_a=True, adjoint_b=False)
+        self._testMatmul(x, y.transpose(), adjoint_a=False, adjoint_b=True)
+        self._testMatmul(
+            x.transpose(), y.transpose(), adjoint_a=True, adjoint_b=True)
+
   # Tests random sized matrices.
   def testFloatRandom(self):
     np.random.seed(127)  # Repeatable results